@@ -0,0 +1,342 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_BENCH_COMMON_HPP)
+#define MQTT_BENCH_COMMON_HPP
+
+#include <mqtt/variant.hpp> // should be top to configure variant limit
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <mqtt_client_cpp.hpp>
+
+#include "../test/test_server_no_tls.hpp"
+#include "../test/test_broker.hpp"
+
+namespace as = boost::asio;
+
+namespace bench {
+
+/**
+ * @brief test_broker that runs on its own thread and listens on broker_notls_port.
+ *        All the benchmarks talk to it over the loopback interface.
+ */
+class broker_thread {
+public:
+    broker_thread()
+        : b_(ioc_),
+          s_(ioc_, b_),
+          th_([this] { ioc_.run(); }) {
+    }
+
+    ~broker_thread() {
+        as::post(
+            ioc_,
+            [this] {
+                s_.close();
+                ioc_.stop();
+            }
+        );
+        th_.join();
+    }
+
+private:
+    as::io_context ioc_;
+    test_broker b_;
+    test_server_no_tls s_;
+    std::thread th_;
+};
+
+/**
+ * @brief Sync API. Packets are written by blocking writes.
+ */
+struct sync_api {
+    static char const* name() { return "sync"; }
+
+    template <typename... Args>
+    static auto make_client(Args&&... args) {
+        return MQTT_NS::make_client(std::forward<Args>(args)...);
+    }
+
+    template <typename Client>
+    static void subscribe(Client& c, std::string const& topic, MQTT_NS::qos qos_value) {
+        c.subscribe(topic, qos_value);
+    }
+
+    template <typename Client>
+    static void publish(Client& c, MQTT_NS::buffer topic, MQTT_NS::buffer payload, MQTT_NS::qos qos_value) {
+        c.publish(MQTT_NS::force_move(topic), MQTT_NS::force_move(payload), qos_value);
+    }
+
+    template <typename Client>
+    static void disconnect(Client& c) {
+        c.disconnect();
+    }
+};
+
+/**
+ * @brief Async API. Packets are queued and written by async writes.
+ */
+struct async_api {
+    static char const* name() { return "async"; }
+
+    template <typename... Args>
+    static auto make_client(Args&&... args) {
+        return MQTT_NS::make_async_client(std::forward<Args>(args)...);
+    }
+
+    template <typename Client>
+    static void subscribe(Client& c, std::string const& topic, MQTT_NS::qos qos_value) {
+        c.async_subscribe(topic, qos_value);
+    }
+
+    template <typename Client>
+    static void publish(Client& c, MQTT_NS::buffer topic, MQTT_NS::buffer payload, MQTT_NS::qos qos_value) {
+        c.async_publish(MQTT_NS::force_move(topic), MQTT_NS::force_move(payload), qos_value);
+    }
+
+    template <typename Client>
+    static void disconnect(Client& c) {
+        c.async_disconnect();
+    }
+};
+
+/**
+ * @brief Callbacks of a benchmark client that don't depend on the protocol version.
+ */
+struct callbacks {
+    std::function<void()> connack;
+    std::function<void()> suback;
+    std::function<void()> publish;
+    // Called when a QoS1 publish is acknowledged by PUBACK or a QoS2 publish by PUBCOMP.
+    std::function<void()> complete;
+    // Called when PUBACK of a received QoS1 publish or PUBCOMP of a received QoS2 publish is sent.
+    std::function<void()> pub_res_sent;
+};
+
+template <typename Client>
+inline void set_callbacks(Client& c, std::string name, callbacks cbs) {
+    using packet_id_t = typename Client::packet_id_t;
+    c.set_error_handler(
+        [name = MQTT_NS::force_move(name)](boost::system::error_code const& ec) {
+            std::cerr << name << " error: " << ec.message() << std::endl;
+            std::exit(1);
+        }
+    );
+    c.set_pub_res_sent_handler(
+        [cb = cbs.pub_res_sent]
+        (packet_id_t /*packet_id*/) {
+            if (cb) cb();
+        }
+    );
+    switch (c.get_protocol_version()) {
+    case MQTT_NS::protocol_version::v3_1_1:
+        c.set_connack_handler(
+            [cb = cbs.connack]
+            (bool /*sp*/, MQTT_NS::connect_return_code /*rc*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        c.set_suback_handler(
+            [cb = cbs.suback]
+            (packet_id_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        c.set_publish_handler(
+            [cb = cbs.publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::buffer /*topic*/,
+             MQTT_NS::buffer /*contents*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        c.set_puback_handler(
+            [cb = cbs.complete]
+            (packet_id_t /*packet_id*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        c.set_pubcomp_handler(
+            [cb = cbs.complete]
+            (packet_id_t /*packet_id*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        break;
+    case MQTT_NS::protocol_version::v5:
+        c.set_v5_connack_handler(
+            [cb = cbs.connack]
+            (bool /*sp*/, MQTT_NS::v5::connect_reason_code /*rc*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        c.set_v5_suback_handler(
+            [cb = cbs.suback]
+            (packet_id_t /*packet_id*/,
+             std::vector<MQTT_NS::v5::suback_reason_code> /*reasons*/,
+             std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        c.set_v5_publish_handler(
+            [cb = cbs.publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::buffer /*topic*/,
+             MQTT_NS::buffer /*contents*/,
+             std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        c.set_v5_puback_handler(
+            [cb = cbs.complete]
+            (packet_id_t /*packet_id*/, MQTT_NS::v5::puback_reason_code /*rc*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        c.set_v5_pubcomp_handler(
+            [cb = cbs.complete]
+            (packet_id_t /*packet_id*/, MQTT_NS::v5::pubcomp_reason_code /*rc*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                if (cb) cb();
+                return true;
+            }
+        );
+        break;
+    default:
+        BOOST_ASSERT(false);
+        break;
+    }
+}
+
+inline std::vector<MQTT_NS::protocol_version> const& protocol_versions() {
+    static std::vector<MQTT_NS::protocol_version> const versions {
+        MQTT_NS::protocol_version::v3_1_1,
+        MQTT_NS::protocol_version::v5
+    };
+    return versions;
+}
+
+inline std::vector<MQTT_NS::qos> const& qoss() {
+    static std::vector<MQTT_NS::qos> const qoss {
+        MQTT_NS::qos::at_most_once,
+        MQTT_NS::qos::at_least_once,
+        MQTT_NS::qos::exactly_once
+    };
+    return qoss;
+}
+
+inline std::vector<std::size_t> const& payload_sizes() {
+    static std::vector<std::size_t> const sizes {
+        16,
+        256,
+        4 * 1024,
+        64 * 1024,
+        1024 * 1024
+    };
+    return sizes;
+}
+
+/**
+ * @brief Get the number of messages for the payload size.
+ *        Large payloads are sent fewer times so that each case moves at most 64 MiB,
+ *        but at least 100 messages are sent.
+ * @param max_messages number of messages for small payloads
+ * @param payload_size payload size
+ * @return number of messages
+ */
+inline std::size_t message_count(std::size_t max_messages, std::size_t payload_size) {
+    std::size_t const bytes_per_case = 64 * 1024 * 1024;
+    std::size_t const min_messages = 100;
+    return std::min(max_messages, std::max(min_messages, bytes_per_case / payload_size));
+}
+
+/**
+ * @brief Make the payload. The contents are the same on every run.
+ */
+inline MQTT_NS::buffer make_payload(std::size_t size) {
+    std::string s(size, '\0');
+    for (std::size_t i = 0; i != size; ++i) {
+        s[i] = static_cast<char>('a' + i % 26);
+    }
+    return MQTT_NS::allocate_buffer(s);
+}
+
+inline char const* version_name(MQTT_NS::protocol_version version) {
+    switch (version) {
+    case MQTT_NS::protocol_version::v3_1_1: return "v3.1.1";
+    case MQTT_NS::protocol_version::v5:     return "v5";
+    default:                                return "undetermined";
+    }
+}
+
+/**
+ * @brief One JSON object per line. Each benchmark case prints one line to stdout.
+ */
+class json_line {
+public:
+    json_line& add(char const* key, char const* val) {
+        add_key(key);
+        ss_ << '"' << val << '"';
+        return *this;
+    }
+
+    json_line& add(char const* key, std::size_t val) {
+        add_key(key);
+        ss_ << val;
+        return *this;
+    }
+
+    json_line& add(char const* key, double val) {
+        add_key(key);
+        ss_ << std::fixed << std::setprecision(3) << val;
+        return *this;
+    }
+
+    std::string str() const {
+        return "{" + ss_.str() + "}";
+    }
+
+private:
+    void add_key(char const* key) {
+        if (!first_) ss_ << ',';
+        first_ = false;
+        ss_ << '"' << key << "\":";
+    }
+
+private:
+    std::ostringstream ss_;
+    bool first_ = true;
+};
+
+} // namespace bench
+
+#endif // MQTT_BENCH_COMMON_HPP
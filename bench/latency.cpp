@@ -0,0 +1,154 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// End-to-end latency through test_broker over the loopback interface.
+//
+// One client subscribes to a topic and another client publishes messages to
+// it one at a time. The next message is published when the previous one is
+// received, so each sample is the time from publish() to the publish handler
+// of the subscriber without queueing. The first warmup samples are dropped.
+//
+// Each case prints one JSON object line to stdout.
+
+#include "bench_common.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+namespace {
+
+template <typename Api>
+void latency(
+    MQTT_NS::protocol_version version,
+    MQTT_NS::qos qos_value,
+    std::size_t payload_size,
+    std::size_t samples) {
+    // test_broker forwards messages by blocking writes, so the subscriber
+    // runs on its own thread in order to keep reading while publishing.
+    as::io_context ioc_sub;
+    as::io_context ioc_pub;
+    auto sub = Api::make_client(ioc_sub, broker_url, broker_notls_port, version);
+    auto pub = Api::make_client(ioc_pub, broker_url, broker_notls_port, version);
+    sub->set_client_id("bench_sub");
+    sub->set_clean_session(true);
+    pub->set_client_id("bench_pub");
+    pub->set_clean_session(true);
+
+    std::string const topic_str = "bench/latency";
+    auto topic = MQTT_NS::allocate_buffer(topic_str);
+    auto payload = bench::make_payload(payload_size);
+
+    std::size_t const warmup = std::max<std::size_t>(samples / 10, 1);
+    std::size_t const messages = warmup + samples;
+    std::size_t sent = 0;
+    std::size_t completed = 0;
+    std::size_t received = 0;
+    std::size_t responded = 0;
+    std::vector<std::chrono::nanoseconds> durations;
+    durations.reserve(samples);
+    std::atomic<std::chrono::steady_clock::rep> sent_at(0);
+    std::promise<void> subscribed;
+
+    auto publish_next = [&] {
+        ++sent;
+        sent_at = std::chrono::steady_clock::now().time_since_epoch().count();
+        Api::publish(*pub, topic, payload, qos_value);
+        if (qos_value == MQTT_NS::qos::at_most_once && sent == messages) Api::disconnect(*pub);
+    };
+
+    bench::callbacks sub_cbs;
+    sub_cbs.connack = [&] {
+        Api::subscribe(*sub, topic_str, qos_value);
+    };
+    sub_cbs.suback = [&] {
+        subscribed.set_value();
+    };
+    sub_cbs.publish = [&] {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        if (++received > warmup) {
+            durations.emplace_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::duration(now - sent_at)
+                )
+            );
+        }
+        if (received == messages) {
+            if (qos_value == MQTT_NS::qos::at_most_once) Api::disconnect(*sub);
+            return;
+        }
+        as::post(ioc_pub, publish_next);
+    };
+    sub_cbs.pub_res_sent = [&] {
+        // Disconnect after the last response is sent, otherwise the broker could reset the connection.
+        if (++responded == messages) Api::disconnect(*sub);
+    };
+    bench::set_callbacks(*sub, "subscriber", sub_cbs);
+
+    bench::callbacks pub_cbs;
+    pub_cbs.connack = [&] {
+        publish_next();
+    };
+    pub_cbs.complete = [&] {
+        if (++completed == messages) Api::disconnect(*pub);
+    };
+    bench::set_callbacks(*pub, "publisher", pub_cbs);
+
+    sub->connect();
+    std::thread th_sub([&] { ioc_sub.run(); });
+    subscribed.get_future().wait();
+    pub->connect();
+    ioc_pub.run();
+    th_sub.join();
+
+    std::sort(durations.begin(), durations.end());
+    auto percentile_us = [&](double p) {
+        auto index = std::min(durations.size() - 1, static_cast<std::size_t>(p * static_cast<double>(durations.size())));
+        return std::chrono::duration<double, std::micro>(durations[index]).count();
+    };
+    std::cout
+        << bench::json_line()
+        .add("benchmark", "latency")
+        .add("api", Api::name())
+        .add("version", bench::version_name(version))
+        .add("qos", static_cast<std::size_t>(qos_value))
+        .add("payload_bytes", payload_size)
+        .add("samples", samples)
+        .add("p50_us", percentile_us(0.5))
+        .add("p99_us", percentile_us(0.99))
+        .add("p999_us", percentile_us(0.999))
+        .add("max_us", std::chrono::duration<double, std::micro>(durations.back()).count())
+        .str()
+        << std::endl;
+}
+
+template <typename Api>
+void latency_all(std::size_t max_samples) {
+    for (auto version : bench::protocol_versions()) {
+        for (auto qos_value : bench::qoss()) {
+            for (auto payload_size : bench::payload_sizes()) {
+                latency<Api>(
+                    version,
+                    qos_value,
+                    payload_size,
+                    bench::message_count(max_samples, payload_size)
+                );
+            }
+        }
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        std::cerr << argv[0] << " [max_samples]" << std::endl;
+        return -1;
+    }
+    std::size_t max_samples = argc == 2 ? boost::lexical_cast<std::size_t>(argv[1]) : 10000;
+
+    bench::broker_thread b;
+    latency_all<bench::sync_api>(max_samples);
+    latency_all<bench::async_api>(max_samples);
+}
@@ -0,0 +1,147 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Publish throughput through test_broker over the loopback interface.
+//
+// One client subscribes to a topic and another client publishes messages to
+// it. The time from the first publish until the subscriber receives the last
+// message and the publisher receives the last PUBACK/PUBCOMP is measured.
+// QoS1 and QoS2 publishes are pipelined with at most inflight_window
+// messages in flight.
+//
+// Each case prints one JSON object line to stdout.
+
+#include "bench_common.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+namespace {
+
+std::size_t const inflight_window = 100;
+
+template <typename Api>
+void publish_throughput(
+    MQTT_NS::protocol_version version,
+    MQTT_NS::qos qos_value,
+    std::size_t payload_size,
+    std::size_t messages) {
+    // test_broker forwards messages by blocking writes, so the subscriber
+    // runs on its own thread in order to keep reading while publishing.
+    as::io_context ioc_sub;
+    as::io_context ioc_pub;
+    auto sub = Api::make_client(ioc_sub, broker_url, broker_notls_port, version);
+    auto pub = Api::make_client(ioc_pub, broker_url, broker_notls_port, version);
+    sub->set_client_id("bench_sub");
+    sub->set_clean_session(true);
+    pub->set_client_id("bench_pub");
+    pub->set_clean_session(true);
+
+    std::string const topic_str = "bench/throughput";
+    auto topic = MQTT_NS::allocate_buffer(topic_str);
+    auto payload = bench::make_payload(payload_size);
+
+    std::size_t sent = 0;
+    std::size_t completed = 0;
+    std::size_t received = 0;
+    std::size_t responded = 0;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point pub_finish;
+    std::chrono::steady_clock::time_point sub_finish;
+    std::promise<void> subscribed;
+
+    bench::callbacks sub_cbs;
+    sub_cbs.connack = [&] {
+        Api::subscribe(*sub, topic_str, qos_value);
+    };
+    sub_cbs.suback = [&] {
+        subscribed.set_value();
+    };
+    sub_cbs.publish = [&] {
+        if (++received != messages) return;
+        sub_finish = std::chrono::steady_clock::now();
+        if (qos_value == MQTT_NS::qos::at_most_once) Api::disconnect(*sub);
+    };
+    sub_cbs.pub_res_sent = [&] {
+        // Disconnect after the last response is sent, otherwise the broker could reset the connection.
+        if (++responded == messages) Api::disconnect(*sub);
+    };
+    bench::set_callbacks(*sub, "subscriber", sub_cbs);
+
+    auto publish_next = [&] {
+        ++sent;
+        Api::publish(*pub, topic, payload, qos_value);
+    };
+    bench::callbacks pub_cbs;
+    pub_cbs.connack = [&] {
+        start = std::chrono::steady_clock::now();
+        if (qos_value == MQTT_NS::qos::at_most_once) {
+            while (sent < messages) publish_next();
+            Api::disconnect(*pub);
+            return;
+        }
+        while (sent < messages && sent < inflight_window) publish_next();
+    };
+    pub_cbs.complete = [&] {
+        if (sent < messages) publish_next();
+        if (++completed != messages) return;
+        pub_finish = std::chrono::steady_clock::now();
+        Api::disconnect(*pub);
+    };
+    bench::set_callbacks(*pub, "publisher", pub_cbs);
+
+    sub->connect();
+    std::thread th_sub([&] { ioc_sub.run(); });
+    subscribed.get_future().wait();
+    pub->connect();
+    ioc_pub.run();
+    th_sub.join();
+
+    auto finish = std::max(sub_finish, pub_finish);
+    auto seconds = std::chrono::duration<double>(finish - start).count();
+    std::cout
+        << bench::json_line()
+        .add("benchmark", "publish_throughput")
+        .add("api", Api::name())
+        .add("version", bench::version_name(version))
+        .add("qos", static_cast<std::size_t>(qos_value))
+        .add("payload_bytes", payload_size)
+        .add("messages", messages)
+        .add("seconds", seconds)
+        .add("messages_per_second", static_cast<double>(messages) / seconds)
+        .add("bytes_per_second", static_cast<double>(messages * payload_size) / seconds)
+        .str()
+        << std::endl;
+}
+
+template <typename Api>
+void publish_throughput_all(std::size_t max_messages) {
+    for (auto version : bench::protocol_versions()) {
+        for (auto qos_value : bench::qoss()) {
+            for (auto payload_size : bench::payload_sizes()) {
+                publish_throughput<Api>(
+                    version,
+                    qos_value,
+                    payload_size,
+                    bench::message_count(max_messages, payload_size)
+                );
+            }
+        }
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        std::cerr << argv[0] << " [max_messages]" << std::endl;
+        return -1;
+    }
+    std::size_t max_messages = argc == 2 ? boost::lexical_cast<std::size_t>(argv[1]) : 10000;
+
+    bench::broker_thread b;
+    publish_throughput_all<bench::sync_api>(max_messages);
+    publish_throughput_all<bench::async_api>(max_messages);
+}
@@ -0,0 +1,96 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// UTF-8 string validation used for topics, client ids, user names, and
+// string properties.
+//
+// The scalar validator is compared with the SSE2 and AVX2 ones and with
+// utf8string::validate_contents() that selects one of them at runtime.
+// Each input is validated repeatedly until about total_bytes are validated.
+//
+// Each case prints one JSON object line to stdout.
+
+#include "bench_common.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <mqtt/utf8encoded_strings.hpp>
+
+namespace {
+
+namespace u8 = MQTT_NS::utf8string;
+
+struct input {
+    char const* name;
+    std::string str;
+};
+
+std::string repeat(std::string const& unit, std::size_t size) {
+    std::string ret;
+    while (ret.size() < size) ret += unit;
+    return ret;
+}
+
+std::vector<input> const& inputs() {
+    static std::vector<input> const ret {
+        { "topic_ascii",       "sensors/building1/floor3/room12/temp" },
+        { "long_ascii",        repeat("abcdefghijklmnopqrstuvwxyz0123456789/", 1024) },
+        // 'あ' and 7 ASCII characters
+        { "long_mixed",        repeat("\xe3\x81\x82" "abc/def", 1024) },
+        // 'あ' only
+        { "long_multibyte",    repeat("\xe3\x81\x82", 1024) },
+    };
+    return ret;
+}
+
+template <typename Validate>
+void validate(char const* implementation, Validate v, input const& in, std::size_t total_bytes) {
+    std::size_t const iterations = std::max<std::size_t>(total_bytes / in.str.size(), 1);
+    std::size_t well_formed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != iterations; ++i) {
+        if (v(MQTT_NS::string_view(in.str)) == u8::validation::well_formed) ++well_formed;
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (well_formed != iterations) {
+        std::cerr << in.name << " is not well formed" << std::endl;
+        std::exit(-1);
+    }
+    std::cout
+        << bench::json_line()
+        .add("benchmark", "utf8_validation")
+        .add("implementation", implementation)
+        .add("input", in.name)
+        .add("string_bytes", in.str.size())
+        .add("iterations", iterations)
+        .add("seconds", seconds)
+        .add("bytes_per_second", static_cast<double>(iterations * in.str.size()) / seconds)
+        .str()
+        << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        std::cerr << argv[0] << " [total_bytes]" << std::endl;
+        return -1;
+    }
+    std::size_t total_bytes = argc == 2 ? boost::lexical_cast<std::size_t>(argv[1]) : 256 * 1024 * 1024;
+
+    for (auto const& in : inputs()) {
+        validate("scalar", u8::detail::validate_contents_scalar, in, total_bytes);
+#if defined(MQTT_UTF8_VALIDATE_SSE2)
+        validate("sse2", u8::detail::validate_contents_sse2, in, total_bytes);
+#endif // defined(MQTT_UTF8_VALIDATE_SSE2)
+#if defined(MQTT_UTF8_VALIDATE_AVX2)
+        if (u8::detail::has_avx2()) {
+            validate("avx2", u8::detail::validate_contents_avx2, in, total_bytes);
+        }
+#endif // defined(MQTT_UTF8_VALIDATE_AVX2)
+        validate("dispatch", u8::validate_contents, in, total_bytes);
+    }
+}
@@ -1,9 +1,52 @@
 #include "../test/test_server_no_tls.hpp"
 #include "../test/test_broker.hpp"
+#include "../test/sharded_broker.hpp"
 
-int main() {
-    boost::asio::io_context ioc;
-    test_broker b(ioc);
-    test_server_no_tls s(ioc, b);
-    ioc.run();
+#include <iostream>
+
+#include <boost/lexical_cast.hpp>
+
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        std::cout << argv[0] << " [num_of_threads]" << std::endl;
+        return -1;
+    }
+    std::size_t num_of_threads = argc == 2 ? boost::lexical_cast<std::size_t>(argv[1]) : 1;
+
+    if (num_of_threads <= 1) {
+        boost::asio::io_context ioc;
+        test_broker b(ioc);
+        test_server_no_tls s(ioc, b);
+        ioc.run();
+        return 0;
+    }
+
+    // Each thread has its own broker shard and its own acceptor. The kernel
+    // balances incoming connections over the acceptors.
+    sharded_broker sb(num_of_threads);
+    MQTT_NS::server<> s(
+        as::ip::tcp::endpoint(
+            as::ip::tcp::v4(),
+            broker_notls_port
+        ),
+        sb.ioc(0),
+        sb.pool(),
+        [](auto& acceptor) {
+            acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+        }
+    );
+#if defined(SO_REUSEPORT)
+    s.set_reuse_port_acceptors(true);
+#endif // defined(SO_REUSEPORT)
+    s.set_error_handler(
+        [](boost::system::error_code const& /*ec*/) {
+        }
+    );
+    s.set_accept_handler(
+        [&sb](MQTT_NS::server<>::endpoint_t& ep) {
+            sb.handle_accept(ep);
+        }
+    );
+    s.listen();
+    sb.run();
 }
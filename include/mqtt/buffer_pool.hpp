@@ -0,0 +1,227 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_BUFFER_POOL_HPP)
+#define MQTT_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/shared_ptr_array.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Size-class slab pool of shared_ptr_array.
+ * Freed blocks are kept in a per size-class free list and reused by the
+ * next allocation of the same class instead of going back to the heap.
+ * The array and its control block are allocated from the pool as one block.
+ * Each allocated shared_ptr_array holds the pool's lifetime, so the pool
+ * (e.g. a per-connection arena) is released when the last buffer that
+ * references it dies.
+ * Blocks larger than the biggest size class are not pooled.
+ */
+template <typename Mutex = std::mutex>
+class basic_buffer_pool : public std::enable_shared_from_this<basic_buffer_pool<Mutex>> {
+    using this_type = basic_buffer_pool<Mutex>;
+    struct private_tag {};
+
+public:
+    /**
+     * @brief Allocation counters.
+     */
+    struct stats {
+        std::size_t hit = 0;          ///< allocations served from a free list
+        std::size_t miss = 0;         ///< pooled size allocations that reached the heap
+        std::size_t oversize = 0;     ///< allocations bigger than the biggest size class
+        std::size_t release = 0;      ///< blocks returned to a free list
+        std::size_t cached_blocks = 0;///< blocks currently kept in the free lists
+        std::size_t cached_bytes = 0; ///< bytes currently kept in the free lists
+    };
+
+    /**
+     * @brief Create a pool.
+     * @param max_cached_blocks maximum number of free blocks kept per size class.
+     *                          Blocks beyond this limit are returned to the heap.
+     * @return shared_ptr of the pool
+     */
+    static std::shared_ptr<this_type> create(std::size_t max_cached_blocks = 1024) {
+        return std::make_shared<this_type>(private_tag(), max_cached_blocks);
+    }
+
+    basic_buffer_pool(private_tag, std::size_t max_cached_blocks)
+        : max_cached_blocks_(max_cached_blocks) {}
+
+    ~basic_buffer_pool() {
+        for (std::size_t i = 0; i != free_lists_.size(); ++i) {
+            for (auto p : free_lists_[i]) {
+                ::operator delete(p);
+            }
+        }
+    }
+
+    basic_buffer_pool(this_type const&) = delete;
+    basic_buffer_pool(this_type&&) = delete;
+    basic_buffer_pool& operator=(this_type const&) = delete;
+    basic_buffer_pool& operator=(this_type&&) = delete;
+
+    /**
+     * @brief Allocate shared_ptr_array from the pool
+     * @param size size of the array
+     * @return shared_ptr_array
+     */
+    shared_ptr_array allocate(std::size_t size) {
+        return allocate_shared_ptr_array(allocator<char>(this->shared_from_this()), size);
+    }
+
+    /**
+     * @brief Get the allocation counters
+     * @return the snapshot of the counters
+     */
+    stats get_stats() const {
+        std::lock_guard<Mutex> lck (mtx_);
+        return stats_;
+    }
+
+    /**
+     * @brief Return all cached free blocks to the heap.
+     */
+    void shrink() {
+        std::lock_guard<Mutex> lck (mtx_);
+        for (std::size_t i = 0; i != free_lists_.size(); ++i) {
+            for (auto p : free_lists_[i]) {
+                ::operator delete(p);
+            }
+            free_lists_[i].clear();
+            free_lists_[i].shrink_to_fit();
+        }
+        stats_.cached_blocks = 0;
+        stats_.cached_bytes = 0;
+    }
+
+    /**
+     * @brief Standard allocator that allocates from the pool.
+     *        It can be used with allocate_shared_ptr_array().
+     */
+    template <typename T>
+    struct allocator {
+        using value_type = T;
+
+        template <typename U>
+        struct rebind {
+            using other = allocator<U>;
+        };
+
+        explicit allocator(std::shared_ptr<this_type> pool) noexcept
+            : pool(force_move(pool)) {}
+
+        template <typename U>
+        allocator(allocator<U> const& other) noexcept
+            : pool(other.pool) {}
+
+        T* allocate(std::size_t n) {
+            return static_cast<T*>(pool->allocate_block(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) noexcept {
+            pool->deallocate_block(p, n * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(allocator<U> const& rhs) const noexcept {
+            return pool == rhs.pool;
+        }
+
+        template <typename U>
+        bool operator!=(allocator<U> const& rhs) const noexcept {
+            return pool != rhs.pool;
+        }
+
+        std::shared_ptr<this_type> pool;
+    };
+
+private:
+    // size classes are 64, 128, 256, ..., 64KiB
+    static constexpr std::size_t min_class_size = 64;
+    static constexpr std::size_t num_of_classes = 11;
+
+    static std::size_t class_index(std::size_t size) {
+        std::size_t index = 0;
+        std::size_t class_size = min_class_size;
+        while (class_size < size) {
+            class_size <<= 1;
+            ++index;
+        }
+        return index;
+    }
+
+    static std::size_t class_size(std::size_t index) {
+        return min_class_size << index;
+    }
+
+    void* allocate_block(std::size_t size) {
+        auto index = class_index(size);
+        if (index >= num_of_classes) {
+            {
+                std::lock_guard<Mutex> lck (mtx_);
+                ++stats_.oversize;
+            }
+            return ::operator new(size);
+        }
+        {
+            std::lock_guard<Mutex> lck (mtx_);
+            auto& fl = free_lists_[index];
+            if (!fl.empty()) {
+                auto p = fl.back();
+                fl.pop_back();
+                ++stats_.hit;
+                --stats_.cached_blocks;
+                stats_.cached_bytes -= class_size(index);
+                return p;
+            }
+            ++stats_.miss;
+        }
+        return ::operator new(class_size(index));
+    }
+
+    void deallocate_block(void* p, std::size_t size) noexcept {
+        auto index = class_index(size);
+        if (index < num_of_classes) {
+            std::lock_guard<Mutex> lck (mtx_);
+            auto& fl = free_lists_[index];
+            if (fl.size() < max_cached_blocks_) {
+                try {
+                    fl.push_back(p);
+                    ++stats_.release;
+                    ++stats_.cached_blocks;
+                    stats_.cached_bytes += class_size(index);
+                    return;
+                }
+                catch (std::bad_alloc const&) {
+                    // fall through and return the block to the heap
+                }
+            }
+        }
+        ::operator delete(p);
+    }
+
+    std::size_t max_cached_blocks_;
+    mutable Mutex mtx_;
+    std::array<std::vector<void*>, num_of_classes> free_lists_;
+    stats stats_;
+};
+
+using buffer_pool = basic_buffer_pool<>;
+
+} // namespace MQTT_NS
+
+#endif // MQTT_BUFFER_POOL_HPP
@@ -0,0 +1,116 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_ENCODED_PUBLISH_HPP)
+#define MQTT_ENCODED_PUBLISH_HPP
+
+#include <array>
+#include <vector>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/buffer.hpp>
+#include <mqtt/message.hpp>
+#include <mqtt/v5_message.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/property_variant.hpp>
+#include <mqtt/subscribe_options.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Publish message that is encoded once and sent to many endpoints.
+ *
+ * The message is built lazily for each combination of protocol version, QoS, and
+ * retain flag, and the built message is reused by all endpoints that receive
+ * the same combination. Copying a built message doesn't copy the topic name,
+ * the payload, nor the properties, so only the packet id is patched for each
+ * recipient. It is useful for the broker's fan-out.
+ *
+ * This class is not thread safe. Use it on one thread at a time.
+ */
+template <std::size_t PacketIdBytes>
+class basic_encoded_publish {
+public:
+    /**
+     * @brief constructor
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param props
+     *        Properties. They are used only for MQTT v5 recipients.
+     */
+    basic_encoded_publish(
+        buffer topic_name,
+        buffer contents,
+        std::vector<v5::property_variant> props = {})
+        : topic_name_(force_move(topic_name)),
+          contents_(force_move(contents)),
+          props_(force_move(props)) {}
+
+    /**
+     * @brief Get the MQTT v3.1.1 message
+     * @param qos_value qos
+     * @param retain retain flag
+     * @return the message. Its packet id is 0.
+     */
+    v3_1_1::basic_publish_message<PacketIdBytes> const& v3_1_1_message(qos qos_value, bool retain) {
+        auto& m = v3_1_1_messages_[index(qos_value, retain)];
+        if (!m) {
+            m.emplace(topic_name_, qos_value, retain, false, 0, contents_);
+        }
+        return *m;
+    }
+
+    /**
+     * @brief Get the MQTT v5 message
+     * @param qos_value qos
+     * @param retain retain flag
+     * @return the message. Its packet id is 0.
+     */
+    v5::basic_publish_message<PacketIdBytes> const& v5_message(qos qos_value, bool retain) {
+        auto& m = v5_messages_[index(qos_value, retain)];
+        if (!m) {
+            m.emplace(topic_name_, qos_value, retain, false, 0, props_, contents_);
+        }
+        return *m;
+    }
+
+    /**
+     * @brief Get topic name
+     * @return topic name
+     */
+    buffer const& topic() const {
+        return topic_name_;
+    }
+
+    /**
+     * @brief Get contents
+     * @return contents
+     */
+    buffer const& contents() const {
+        return contents_;
+    }
+
+private:
+    static std::size_t index(qos qos_value, bool retain) {
+        return static_cast<std::size_t>(qos_value) * 2 + (retain ? 1 : 0);
+    }
+
+    buffer topic_name_;
+    buffer contents_;
+    std::vector<v5::property_variant> props_;
+    // index is qos * 2 + retain
+    std::array<optional<v3_1_1::basic_publish_message<PacketIdBytes>>, 6> v3_1_1_messages_;
+    std::array<optional<v5::basic_publish_message<PacketIdBytes>>, 6> v5_messages_;
+};
+
+using encoded_publish = basic_encoded_publish<2>;
+
+} // namespace MQTT_NS
+
+#endif // MQTT_ENCODED_PUBLISH_HPP
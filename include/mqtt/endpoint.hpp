@@ -10,6 +10,7 @@
 #include <mqtt/variant.hpp> // should be top to configure variant limit
 
 #include <string>
+#include <cstring>
 #include <vector>
 #include <deque>
 #include <functional>
@@ -18,6 +19,8 @@
 #include <mutex>
 #include <atomic>
 #include <algorithm>
+#include <chrono>
+#include <climits>
 
 #include <boost/any.hpp>
 #include <boost/lexical_cast.hpp>
@@ -48,9 +51,11 @@
 #include <mqtt/unique_scope_guard.hpp>
 #include <mqtt/shared_scope_guard.hpp>
 #include <mqtt/message_variant.hpp>
+#include <mqtt/encoded_publish.hpp>
 #include <mqtt/two_byte_util.hpp>
 #include <mqtt/four_byte_util.hpp>
 #include <mqtt/packet_id_type.hpp>
+#include <mqtt/packet_id_manager.hpp>
 #include <mqtt/optional.hpp>
 #include <mqtt/property_variant.hpp>
 #include <mqtt/protocol_version.hpp>
@@ -58,7 +63,12 @@
 #include <mqtt/buffer.hpp>
 #include <mqtt/shared_ptr_array.hpp>
 #include <mqtt/type_erased_socket.hpp>
+#include <mqtt/static_socket.hpp>
+#include <mqtt/topic_alias_send.hpp>
+#include <mqtt/topic_alias_recv.hpp>
+#include <mqtt/inflight_store.hpp>
 #include <mqtt/move.hpp>
+#include <mqtt/visitor_util.hpp>
 #include <mqtt/deprecated.hpp>
 #include <mqtt/deprecated_msg.hpp>
 
@@ -71,9 +81,20 @@ namespace MQTT_NS {
 namespace as = boost::asio;
 namespace mi = boost::multi_index;
 
-template <typename Mutex = std::mutex, template<typename...> class LockGuard = std::lock_guard, std::size_t PacketIdBytes = 2>
-class endpoint : public std::enable_shared_from_this<endpoint<Mutex, LockGuard, PacketIdBytes>> {
-    using this_type = endpoint<Mutex, LockGuard, PacketIdBytes>;
+/**
+ * @brief MQTT endpoint
+ * @tparam Socket socket that is used via the interface of MQTT_NS::socket.
+ *                The default is the type erased MQTT_NS::socket that accepts any kind of sockets.
+ *                MQTT_NS::static_socket<T> accepts only T, and calls it without type erasure.
+ */
+template <
+    typename Mutex = std::mutex,
+    template<typename...> class LockGuard = std::lock_guard,
+    std::size_t PacketIdBytes = 2,
+    typename Socket = MQTT_NS::socket
+>
+class endpoint : public std::enable_shared_from_this<endpoint<Mutex, LockGuard, PacketIdBytes, Socket>> {
+    using this_type = endpoint<Mutex, LockGuard, PacketIdBytes, Socket>;
     using this_type_sp = std::shared_ptr<this_type>;
 
 public:
@@ -99,8 +120,8 @@ public:
      * @brief Constructor for server.
      *        socket should have already been connected with another endpoint.
      */
-    template <typename Socket>
-    explicit endpoint(std::shared_ptr<Socket> socket, protocol_version version = protocol_version::undetermined, bool async_send_store = false)
+    template <typename UnderlyingSocket>
+    explicit endpoint(std::shared_ptr<UnderlyingSocket> socket, protocol_version version = protocol_version::undetermined, bool async_send_store = false)
         :socket_(force_move(socket)),
          connected_(true),
          async_send_store_{async_send_store},
@@ -403,6 +424,8 @@ public:
      *        Topic name<BR>
      *        See https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901107<BR>
      *        3.3.2.1 Topic Name<BR>
+     *        If the endpoint sent topic_alias_maximum property by CONNECT or CONNACK,
+     *        the topic alias is resolved and the topic_name is always set.
      * @param contents
      *        Publish Payload<BR>
      *        See https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901119<BR>
@@ -729,6 +752,21 @@ public:
      */
     using pre_send_handler = std::function<void()>;
 
+    /**
+     * @brief Send queue high watermark handler
+     *        This handler is called when the queued bytes or messages reach the high watermark.
+     *        See set_send_queue_watermarks().
+     */
+    using send_queue_high_handler = std::function<void()>;
+
+    /**
+     * @brief Send queue low watermark handler
+     *        This handler is called when the send queue is drained to the low watermarks
+     *        after the high watermark is reached.
+     *        See set_send_queue_watermarks().
+     */
+    using send_queue_low_handler = std::function<void()>;
+
     /**
      * @brief is valid length handler
      *        This handler is called when remaining length is received.
@@ -739,6 +777,16 @@ public:
     using is_valid_length_handler =
         std::function<bool(control_packet_type packet_type, std::size_t remaining_length)>;
 
+    /**
+     * @brief receive buffer allocator
+     *        This allocator is called when the memory to store a received packet
+     *        (or a part of it) is required.
+     * @param size size of the memory
+     * @return shared_ptr_array that has at least size bytes
+     */
+    using receive_buffer_allocator =
+        std::function<shared_ptr_array(std::size_t size)>;
+
     /**
      * @brief next read handler
      *        This handler is called when the current mqtt message has been processed.
@@ -788,6 +836,53 @@ public:
         auto_pub_response_async_ = async;
     }
 
+    /**
+     * @brief Set auto topic alias send mode.
+     * @param b set value
+     *
+     * When set auto topic alias send mode to true, MQTT v5 publish messages are sent with topic aliases
+     * that are assigned automatically. The number of aliases is limited by topic_alias_maximum property
+     * that the peer sent by CONNECT or CONNACK. If the peer didn't send it, topic aliases are not used.<BR>
+     * When all the aliases are used, the alias of the least recently published topic is reassigned.<BR>
+     * Publish messages that already have topic_alias property, and publish messages that are
+     * published by basic_encoded_publish are sent as they are.<BR>
+     * Messages are stored for resending with the topic name, because topic aliases are valid only in
+     * one network connection.<BR>
+     * Blocking publish messages are written in the order that the aliases are assigned. If another
+     * thread is writing them, the publish returns after its message is queued, and the other thread
+     * writes it. The handlers that are called while writing can publish.<BR>
+     * See https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901113<BR>
+     * 3.3.2.3.4 Topic Alias
+     */
+    void set_auto_topic_alias_send(bool b = true) {
+        auto_topic_alias_send_ = b;
+    }
+
+    /**
+     * @brief Get the number of in-flight QoS1 and QoS2 publish messages.
+     *        A publish message is in-flight until PUBACK or PUBCOMP is received.<BR>
+     *        On MQTT v5, async publish functions send QoS1 and QoS2 publish messages only while
+     *        the number is less than receive_maximum property that the peer sent by CONNECT or CONNACK.
+     *        The rest of messages are held and sent when in-flight messages are completed.<BR>
+     *        See https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901251<BR>
+     *        4.9 Flow Control
+     * @return the number of in-flight publish messages
+     */
+    std::size_t get_inflight_publish_count() {
+        LockGuard<Mutex> lck (publish_send_mtx_);
+        return publish_send_count_;
+    }
+
+    /**
+     * @brief Get the number of publish messages that are held by Receive Maximum of the peer.
+     *        While any messages are held, QoS0 publish messages are also held in order to keep the order.
+     * @return the number of held publish messages
+     */
+    std::size_t get_pending_publish_count() {
+        LockGuard<Mutex> lck (publish_send_mtx_);
+        return publish_send_queue_.size();
+    }
+
 
     // MQTT Common handlers
 
@@ -1363,6 +1458,22 @@ public:
         h_pre_send_ = force_move(h);
     }
 
+    /**
+     * @brief Set send queue high watermark handler
+     * @param h handler
+     */
+    void set_send_queue_high_handler(send_queue_high_handler h = send_queue_high_handler()) {
+        h_send_queue_high_ = force_move(h);
+    }
+
+    /**
+     * @brief Set send queue low watermark handler
+     * @param h handler
+     */
+    void set_send_queue_low_handler(send_queue_low_handler h = send_queue_low_handler()) {
+        h_send_queue_low_ = force_move(h);
+    }
+
     /**
      * @brief Set check length handler
      * @param h handler
@@ -1371,6 +1482,20 @@ public:
         h_is_valid_length_ = force_move(h);
     }
 
+    /**
+     * @brief Set receive buffer allocator
+     *        By default, make_shared_ptr_array() is used.
+     *        e.g.) allocate from the buffer_pool
+     *        auto pool = buffer_pool::create();
+     *        ep.set_receive_buffer_allocator(
+     *            [pool](std::size_t size) { return pool->allocate(size); }
+     *        );
+     * @param a allocator
+     */
+    void set_receive_buffer_allocator(receive_buffer_allocator a = receive_buffer_allocator()) {
+        receive_buffer_allocator_ = force_move(a);
+    }
+
     void set_packet_bulk_read_limit(std::size_t size) {
         packet_bulk_read_limit_ = size;
     }
@@ -1452,6 +1577,22 @@ public:
         return h_pre_send_;
     }
 
+    /**
+     * @brief Get send queue high watermark handler
+     * @return handler
+     */
+    send_queue_high_handler const& get_send_queue_high_handler() const {
+        return h_send_queue_high_;
+    }
+
+    /**
+     * @brief Get send queue low watermark handler
+     * @return handler
+     */
+    send_queue_low_handler const& get_send_queue_low_handler() const {
+        return h_send_queue_low_;
+    }
+
     /**
      * @brief Get check length handler
      * @return handler
@@ -1600,6 +1741,31 @@ public:
         return packet_id;
     }
 
+    /**
+     * @brief Publish the encoded message
+     * @param msg
+     *        The message that is encoded once and published to many endpoints.
+     *        Only the packet id is set for this endpoint. See basic_encoded_publish.
+     * @param qos
+     *        qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901104<BR>
+     *        3.3.1.3 RETAIN
+     * @return packet_id. If qos is set to at_most_once, return 0.
+     * packet_id is automatically generated.
+     */
+    packet_id_t publish(
+        basic_encoded_publish<PacketIdBytes>& msg,
+        qos qos_value = qos::at_most_once,
+        bool retain = false
+    ) {
+        BOOST_ASSERT(qos_value == qos::at_most_once || qos_value == qos::at_least_once || qos_value == qos::exactly_once);
+        packet_id_t packet_id = (qos_value == qos::at_most_once) ? 0 : acquire_unique_packet_id();
+        send_publish(msg, qos_value, retain, packet_id, any());
+        return packet_id;
+    }
+
     /**
      * @brief Subscribe
      * @param topic_name
@@ -3557,6 +3723,34 @@ public:
         return packet_id;
     }
 
+    /**
+     * @brief Publish the encoded message
+     * @param msg
+     *        The message that is encoded once and published to many endpoints.
+     *        Only the packet id is set for this endpoint. See basic_encoded_publish.
+     * @param qos
+     *        qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901104<BR>
+     *        3.3.1.3 RETAIN
+     * @param func
+     *        functor object who's operator() will be called when the async operation completes.
+     * @return packet_id. If qos is set to at_most_once, return 0.
+     * packet_id is automatically generated.
+     */
+    packet_id_t async_publish(
+        basic_encoded_publish<PacketIdBytes>& msg,
+        qos qos_value = qos::at_most_once,
+        bool retain = false,
+        async_handler_t func = async_handler_t()
+    ) {
+        BOOST_ASSERT(qos_value == qos::at_most_once || qos_value == qos::at_least_once || qos_value == qos::exactly_once);
+        packet_id_t packet_id = (qos_value == qos::at_most_once) ? 0 : acquire_unique_packet_id();
+        async_send_publish(msg, qos_value, retain, packet_id, force_move(func), any());
+        return packet_id;
+    }
+
     /**
      * @brief Subscribe
      * @param topic_name
@@ -7138,10 +7332,19 @@ public:
      */
     void clear_stored_publish(packet_id_t packet_id) {
         LockGuard<Mutex> lck (store_mtx_);
-        auto& idx = store_.template get<tag_packet_id>();
-        auto r = idx.equal_range(packet_id);
-        idx.erase(std::get<0>(r), std::get<1>(r));
-        packet_id_.erase(packet_id);
+        store_.erase(packet_id);
+        packet_id_.release_id(packet_id);
+    }
+
+    /**
+     * @brief Get the number of stored messages.
+     *        QoS1 and QoS2 publish messages and pubrel messages are stored until
+     *        PUBACK, PUBREC, or PUBCOMP is received.
+     * @return the number of stored messages
+     */
+    std::size_t get_stored_message_count() {
+        LockGuard<Mutex> lck (store_mtx_);
+        return store_.size();
     }
 
     /**
@@ -7150,8 +7353,7 @@ public:
      */
     void for_each_store(std::function<void(char const*, std::size_t)> const& f) {
         LockGuard<Mutex> lck (store_mtx_);
-        auto const& idx = store_.template get<tag_seq>();
-        for (auto const & e : idx) {
+        for (auto const& e : store_) {
             auto const& m = e.message();
             auto cb = continuous_buffer(m);
             f(cb.data(), cb.size());
@@ -7164,8 +7366,7 @@ public:
      */
     void for_each_store(std::function<void(message_variant const&)> const& f) {
         LockGuard<Mutex> lck (store_mtx_);
-        auto const& idx = store_.template get<tag_seq>();
-        for (auto const & e : idx) {
+        for (auto const& e : store_) {
             f(e.message());
         }
     }
@@ -7182,41 +7383,7 @@ public:
      */
     packet_id_t acquire_unique_packet_id() {
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.size() == std::numeric_limits<packet_id_t>::max()) throw packet_id_exhausted_error();
-        if (packet_id_master_ == std::numeric_limits<packet_id_t>::max()) {
-            packet_id_master_ = 1U;
-        }
-        else {
-            ++packet_id_master_;
-        }
-        auto ret = packet_id_.insert(packet_id_master_);
-        if (ret.second) return packet_id_master_;
-
-        auto last = packet_id_.end();
-        auto e = last;
-        --last;
-
-        if (*last != std::numeric_limits<packet_id_t>::max()) {
-            packet_id_master_ = static_cast<packet_id_t>(*last + 1U);
-            packet_id_.insert(e, packet_id_master_);
-            return packet_id_master_;
-        }
-
-        auto b = packet_id_.begin();
-        auto prev = *b;
-        if (prev != 1U) {
-            packet_id_master_ = 1U;
-            packet_id_.insert(b, packet_id_master_);
-            return packet_id_master_;
-        }
-        ++b;
-        while (*b - 1U == prev && b != e) {
-            prev = *b;
-            ++b;
-        }
-        packet_id_master_ = static_cast<packet_id_t>(prev + 1U);
-        packet_id_.insert(b, packet_id_master_);
-        return packet_id_master_;
+        return packet_id_.acquire_unique_id();
     }
 
     /**
@@ -7227,9 +7394,8 @@ public:
      * @return If packet_id is successfully registerd then return true, otherwise return false.
      */
     bool register_packet_id(packet_id_t packet_id) {
-        if (packet_id == 0) return false;
         LockGuard<Mutex> lck (store_mtx_);
-        return packet_id_.insert(packet_id).second;
+        return packet_id_.register_id(packet_id);
     }
 
     /**
@@ -7241,7 +7407,7 @@ public:
      */
     bool release_packet_id(packet_id_t packet_id) {
         LockGuard<Mutex> lck (store_mtx_);
-        return packet_id_.erase(packet_id);
+        return packet_id_.release_id(packet_id);
     }
 
     /**
@@ -7301,34 +7467,9 @@ public:
      */
     void restore_serialized_message(basic_publish_message<PacketIdBytes> msg, any life_keeper) {
         auto packet_id = msg.packet_id();
-        qos qos_value = msg.get_qos();
+        auto expected_type = expected_control_packet_type(msg.get_qos());
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.insert(packet_id).second) {
-            auto ret = store_.emplace(
-                packet_id,
-                ((qos_value == qos::at_least_once) ? control_packet_type::puback
-                                                   : control_packet_type::pubrec),
-                force_move(msg),
-                force_move(life_keeper)
-            );
-            // When client want to restore serialized messages,
-            // endpoint might keep the message that has the same packet_id.
-            // In this case, overwrite store_.
-            if (!ret.second) {
-                store_.modify(
-                    ret.first,
-                    [&] (auto& e) {
-                        e = store(
-                            packet_id,
-                            ((qos_value == qos::at_least_once) ? control_packet_type::puback
-                                                               : control_packet_type::pubrec),
-                            force_move(msg),
-                            force_move(life_keeper)
-                        );
-                    }
-                );
-            }
-        }
+        restore_store_no_lock(packet_id, expected_type, force_move(msg), force_move(life_keeper));
     }
 
     /**
@@ -7339,33 +7480,17 @@ public:
     void restore_serialized_message(basic_pubrel_message<PacketIdBytes> msg) {
         auto packet_id = msg.packet_id();
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.insert(packet_id).second) {
-            auto ret = store_.emplace(
-                packet_id,
-                control_packet_type::pubcomp,
-                force_move(msg)
-            );
-            // When client want to restore serialized messages,
-            // endpoint might keep the message that has the same packet_id.
-            // In this case, overwrite store_.
-            if (!ret.second) {
-                store_.modify(
-                    ret.first,
-                    [&] (auto& e) {
-                        e = store(
-                            packet_id,
-                            control_packet_type::pubcomp,
-                            force_move(msg)
-                        );
-                    }
-                );
-            }
-        }
+        restore_store_no_lock(packet_id, control_packet_type::pubcomp, force_move(msg));
     }
 
     /**
      * @brief Restore serialized publish and pubrel messages.
      *        This function shouold be called before connect.
+     *        The Message Expiry Interval of a restored publish message counts from the restore,
+     *        not from the original publish, because the serialized message doesn't have the time
+     *        when it was stored. If the time matters, keep it with the serialized message, and
+     *        restore the message by restore_v5_serialized_message(v5::basic_publish_message, any)
+     *        after decreasing the interval by update_message_expiry_interval().
      * @param packet_id packet id of the message
      * @param b         iterator begin of the message
      * @param e         iterator end of the message
@@ -7400,40 +7525,18 @@ public:
     /**
      * @brief Restore serialized publish message.
      *        This function shouold be called before connect.
+     *        The Message Expiry Interval of the message counts from the restore. In order to count
+     *        the time while the message was stored, decrease it by update_message_expiry_interval()
+     *        before calling this function. An expired message should not be restored.
      * @param msg         publish message.
      * @param life_keeper
      *        An object that stays alive (but is moved with force_move()) until the stored message is sent.
      */
     void restore_v5_serialized_message(v5::basic_publish_message<PacketIdBytes> msg, any life_keeper) {
         auto packet_id = msg.packet_id();
-        auto qos = msg.get_qos();
+        auto expected_type = expected_control_packet_type(msg.get_qos());
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.insert(packet_id).second) {
-            auto ret = store_.emplace(
-                packet_id,
-                qos == qos::at_least_once ? control_packet_type::puback
-                                          : control_packet_type::pubrec,
-                force_move(msg),
-                force_move(life_keeper)
-            );
-            // When client want to restore serialized messages,
-            // endpoint might keep the message that has the same packet_id.
-            // In this case, overwrite store_.
-            if (!ret.second) {
-                store_.modify(
-                    ret.first,
-                    [&] (auto& e) {
-                        e = store(
-                            packet_id,
-                            qos == qos::at_least_once ? control_packet_type::puback
-                                                      : control_packet_type::pubrec,
-                            force_move(msg),
-                            force_move(life_keeper)
-                        );
-                    }
-                );
-            }
-        }
+        restore_store_no_lock(packet_id, expected_type, force_move(msg), force_move(life_keeper));
     }
 
     /**
@@ -7446,29 +7549,46 @@ public:
     void restore_v5_serialized_message(v5::basic_pubrel_message<PacketIdBytes> msg, any life_keeper) {
         auto packet_id = msg.packet_id();
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.insert(packet_id).second) {
-            auto ret = store_.emplace(
-                packet_id,
-                control_packet_type::pubcomp,
-                force_move(msg),
-                force_move(life_keeper)
-            );
-            // When client want to restore serialized messages,
-            // endpoint might keep the message that has the same packet_id.
-            // In this case, overwrite store_.
-            if (!ret.second) {
-                store_.modify(
-                    ret.first,
-                    [&] (auto& e) {
-                        e = store(
-                            packet_id,
-                            control_packet_type::pubcomp,
-                            force_move(msg)
-                        );
-                    }
-                );
-            }
-        }
+        restore_store_no_lock(packet_id, control_packet_type::pubcomp, force_move(msg), force_move(life_keeper));
+    }
+
+    /**
+     * @brief Restore serialized publish and pubrel messages in bulk.
+     *        [b, e) is the sequence of the serialized messages, for example the concatenation of
+     *        the data that the serialize handlers passed.
+     *        The messages are parsed in one pass and share one buffer allocated for the whole sequence.
+     *        Then they are stored under a single lock.
+     *        If the sequence contains an invalid message, protocol_error is thrown and nothing is restored.
+     *        This function should be called before connect.
+     * @param b iterator begin of the messages
+     * @param e iterator end of the messages
+     */
+    template <typename Iterator>
+    typename std::enable_if<std::is_convertible<typename Iterator::value_type, char>::value>::type
+    restore_serialized_messages(Iterator b, Iterator e) {
+        restore_serialized_messages_impl(protocol_version::v3_1_1, b, e);
+    }
+
+    /**
+     * @brief Restore serialized v5 publish and pubrel messages in bulk.
+     *        [b, e) is the sequence of the serialized messages, for example the concatenation of
+     *        the data that the serialize handlers passed.
+     *        The messages are parsed in one pass and share one buffer allocated for the whole sequence.
+     *        Then they are stored under a single lock.
+     *        If the sequence contains an invalid message, protocol_error is thrown and nothing is restored.
+     *        This function should be called before connect.
+     *        The Message Expiry Interval of a restored publish message counts from the restore,
+     *        not from the original publish, because the serialized message doesn't have the time
+     *        when it was stored. If the time matters, keep it with the serialized message, and
+     *        restore the message by restore_v5_serialized_message(v5::basic_publish_message, any)
+     *        after decreasing the interval by update_message_expiry_interval().
+     * @param b iterator begin of the messages
+     * @param e iterator end of the messages
+     */
+    template <typename Iterator>
+    typename std::enable_if<std::is_convertible<typename Iterator::value_type, char>::value>::type
+    restore_v5_serialized_messages(Iterator b, Iterator e) {
+        restore_serialized_messages_impl(protocol_version::v5, b, e);
     }
 
     /**
@@ -7554,43 +7674,180 @@ public:
         max_queue_send_size_ = size;
     }
 
+    /**
+     * @brief Set write coalescing policy.
+     *        If watermark is not 0, all queued messages up to watermark bytes
+     *        (and up to IOV_MAX buffers) are sent by one gathered write.
+     *        The first message is always sent even if it is bigger than watermark.
+     *        set_max_queue_send_count() and set_max_queue_send_size() are ignored.
+     *        If hold is not zero, the first message after an idle period is held up to
+     *        hold in order to coalesce following messages. The queue is flushed as soon
+     *        as watermark bytes are queued. Holding is adaptive, it happens only while
+     *        the previous write carried more than one message, so sparse traffic
+     *        is not delayed.
+     *        The default watermark is 0 (coalescing is disabled).
+     *        Call this function before the session is started.
+     *
+     * @param watermark maximum bytes of one write. 0 means coalescing is disabled.
+     * @param hold maximum time to hold the queue.
+     *
+     */
+    void set_write_coalescing(
+        std::size_t watermark,
+        std::chrono::microseconds hold = std::chrono::microseconds::zero()) {
+        write_coalescing_watermark_ = watermark;
+        write_coalescing_hold_ = hold;
+    }
+
+    /**
+     * @brief Set the number of stored messages that are resent at once after reconnecting.
+     *        It is used when the endpoint is created with async_send_store.
+     *        The stored messages are taken from the store batch by batch, and the next batch
+     *        is taken after the previous batch is written, so the store is not locked during the
+     *        whole resend and the send queue doesn't hold all the stored messages at once.
+     *        Without async_send_store, all the stored messages are taken at once.
+     *        In both cases, for MQTT v5, the resent publish messages are within Receive Maximum
+     *        of the peer. The rest are written when the in-flight ones are completed.
+     *        The default value is 64.
+     *
+     * @param count the number of messages in a batch. 0 is treated as 1.
+     *
+     */
+    void set_resend_batch_count(std::size_t count) {
+        resend_batch_count_ = std::max<std::size_t>(count, 1);
+    }
+
+    /**
+     * @brief Set priority lane of the send queue.
+     *        If it is enabled, PUBACK, PUBREC, PUBREL, PUBCOMP, PINGREQ, and PINGRESP that are sent
+     *        by async functions (including auto_pub_response) are queued ahead of the other messages
+     *        that are not written yet, so they don't wait behind large PUBLISH messages.
+     *        The order of the messages in each lane is kept, so the order of PUBLISH messages
+     *        and the order of acknowledgements are not changed.
+     *        The default value is true.
+     *        Call this function before the session is started.
+     *
+     * @param b set value
+     *
+     */
+    void set_send_priority_lane(bool b = true) {
+        send_priority_lane_ = b;
+    }
+
+    /**
+     * @brief Policy that is applied while the send queue is over the high watermark.
+     */
+    enum class send_queue_policy {
+        // Reject new publish messages. The handler of the async publish function is called with
+        // operation_would_block, and the packet_id is released. Messages that are already queued,
+        // held by Receive Maximum, or resent are written. Send again after send_queue_low_handler is called.
+        block,
+        // Drop QoS0 publish messages. The handler of the async function is called with no_buffer_space.
+        // A publish message that has both the topic and Topic Alias is not dropped, because it maps the alias.
+        drop_qos0,
+        // Disconnect when the high watermark is reached. QoS1 and QoS2 messages are kept in the store.
+        disconnect
+    };
+
+    /**
+     * @brief Set watermarks of the send queue.
+     *        Messages sent by async functions are queued while the previous write is in progress.
+     *        For MQTT v5, publish messages that are held by Receive Maximum of the peer are also counted.
+     *        When the queued bytes or messages reach the high watermark, send_queue_high_handler
+     *        is called and the policy is applied. When the queue is drained to both low watermarks,
+     *        send_queue_low_handler is called.
+     *        The default values are 0 (no limit).
+     *        Call this function before the session is started.
+     *
+     * @param high_bytes high watermark of the queued bytes. 0 means no limit.
+     * @param low_bytes low watermark of the queued bytes.
+     * @param high_count high watermark of the number of queued messages. 0 means no limit.
+     * @param low_count low watermark of the number of queued messages.
+     * @param policy policy that is applied while the send queue is over the high watermark.
+     *
+     */
+    void set_send_queue_watermarks(
+        std::size_t high_bytes,
+        std::size_t low_bytes,
+        std::size_t high_count = 0,
+        std::size_t low_count = 0,
+        send_queue_policy policy = send_queue_policy::block) {
+        BOOST_ASSERT(high_bytes == 0 || low_bytes < high_bytes);
+        BOOST_ASSERT(high_count == 0 || low_count < high_count);
+        send_queue_high_bytes_ = high_bytes;
+        send_queue_low_bytes_ = low_bytes;
+        send_queue_high_count_ = high_count;
+        send_queue_low_count_ = low_count;
+        send_queue_policy_ = policy;
+    }
+
+    /**
+     * @brief Set the size of the read-ahead buffer.
+     *        By default, each part of a received packet (fixed header,
+     *        remaining length, and the rest) is read from the socket separately.
+     *        If the size is not 0, the endpoint reads up to size bytes from the
+     *        socket at once, and decodes as many packets as are in the buffer
+     *        before reading the socket again.
+     *        It reduces the number of read system calls on a stream of small packets.
+     *        Payloads bigger than the buffer are read directly.
+     *        The default value is 0.
+     *        Call this function before the session is started.
+     *
+     * @param size read-ahead buffer size. 0 means read-ahead is disabled.
+     *
+     */
+    void set_read_ahead_buffer_size(std::size_t size) {
+        read_ahead_buf_.resize(size);
+        read_ahead_buf_.shrink_to_fit();
+        read_ahead_begin_ = 0;
+        read_ahead_end_ = 0;
+    }
+
     protocol_version get_protocol_version() const {
         return version_;
     }
 
-    MQTT_NS::socket const& socket() const {
+    Socket const& socket() const {
         return socket_.value();
     }
 
-    MQTT_NS::socket& socket() {
+    Socket& socket() {
         return socket_.value();
     }
 
 protected:
 
     /**
-     * @brief Get shared_any of socket
-     * @return reference of shared_any socket
+     * @brief Get optional of socket
+     * @return reference of optional socket
      */
-    optional<MQTT_NS::socket>& socket_optional() {
+    optional<Socket>& socket_optional() {
         return socket_;
     }
 
     void async_read_control_packet_type(async_handler_t func) {
         auto self = shared_from_this();
-        socket_->async_read(
-            as::buffer(buf_.data(), 1),
-            [this, self = force_move(self), func = force_move(func)](
-                boost::system::error_code const& ec,
-                std::size_t bytes_transferred) mutable {
-                if (!check_error_and_transferred_length(ec, func, bytes_transferred, 1)) return;
-                handle_control_packet_type(force_move(func), force_move(self));
-            }
-        );
+        if (read_ahead_begin_ != read_ahead_end_) {
+            // The next packet has already been read ahead.
+            // Post it instead of processing it here in order to
+            // keep the call stack bounded while draining the buffer.
+            socket_->post(
+                [this, self = force_move(self), func = force_move(func)]
+                () mutable {
+                    read_control_packet_type(force_move(func), force_move(self));
+                }
+            );
+            return;
+        }
+        read_control_packet_type(force_move(func), force_move(self));
     }
 
     bool handle_close_or_error(boost::system::error_code const& ec) {
         if (!ec) return false;
+        // Bytes read ahead from the closed connection must not leak into the next one.
+        read_ahead_begin_ = 0;
+        read_ahead_end_ = 0;
+        cancel_write_hold(ec);
         if (connected_) {
             connected_ = false;
             mqtt_connected_ = false;
@@ -7994,68 +8251,264 @@ private:
             : packet_id_(id)
             , expected_control_packet_type_(type)
             , smv_(force_move(smv))
-            , life_keeper_(force_move(life_keeper)) {}
+            , life_keeper_(force_move(life_keeper)) {
+            // The Message Expiry Interval counts from the time the message is stored.
+            // A restored message counts from the restore. See restore_v5_serialized_message().
+            MQTT_NS::visit(
+                make_lambda_visitor<void>(
+                    [&](v5::basic_publish_message<PacketIdBytes> const& m) {
+                        if (auto mei = m.message_expiry_interval()) {
+                            expiry_.emplace(std::chrono::steady_clock::now() + std::chrono::seconds(mei.value()));
+                        }
+                    },
+                    [](auto const&) {
+                    }
+                ),
+                smv_
+            );
+        }
         packet_id_t packet_id() const { return packet_id_; }
         control_packet_type expected_control_packet_type() const { return expected_control_packet_type_; }
         basic_message_variant<PacketIdBytes> message() const {
             return get_basic_message_variant<PacketIdBytes>(smv_);
         }
+        /**
+         * @brief Get the message to resend.
+         *        The Message Expiry Interval is decreased by the time the message has been stored.
+         */
+        basic_message_variant<PacketIdBytes> message(std::chrono::steady_clock::time_point now) const {
+            if (!expiry_) return message();
+            auto msg = variant_get<v5::basic_publish_message<PacketIdBytes>>(smv_);
+            // Round up in order not to send 0 before the message expires.
+            auto remaining = std::chrono::duration_cast<std::chrono::seconds>(
+                expiry_.value() - now + std::chrono::seconds(1) - std::chrono::steady_clock::duration(1)
+            );
+            msg.update_message_expiry_interval(static_cast<std::uint32_t>(remaining.count()));
+            return msg;
+        }
+        bool expired(std::chrono::steady_clock::time_point now) const {
+            return expiry_ && expiry_.value() <= now;
+        }
     private:
         packet_id_t packet_id_;
         control_packet_type expected_control_packet_type_;
         basic_store_message_variant<PacketIdBytes> smv_;
         any life_keeper_;
+        optional<std::chrono::steady_clock::time_point> expiry_;
     };
 
-    struct tag_packet_id {};
-    struct tag_packet_id_type {};
-    struct tag_seq {};
-    using mi_store = mi::multi_index_container<
-        store,
-        mi::indexed_by<
-            mi::ordered_unique<
-                mi::tag<tag_packet_id_type>,
-                mi::composite_key<
-                    store,
-                    mi::const_mem_fun<
-                        store, packet_id_t,
-                        &store::packet_id
-                    >,
-                    mi::const_mem_fun<
-                        store, control_packet_type,
-                        &store::expected_control_packet_type
-                    >
-                >
-            >,
-            mi::ordered_non_unique<
-                mi::tag<tag_packet_id>,
-                mi::const_mem_fun<
-                    store, packet_id_t,
-                    &store::packet_id
-                >
-            >,
-            mi::sequenced<
-                mi::tag<tag_seq>
-            >
-        >
-    >;
+    static control_packet_type expected_control_packet_type(qos qos_value) {
+        return qos_value == qos::at_least_once ? control_packet_type::puback
+                                               : control_packet_type::pubrec;
+    }
 
-    void handle_control_packet_type(async_handler_t func, this_type_sp self) {
-        fixed_header_ = static_cast<std::uint8_t>(buf_.front());
-        remaining_length_ = 0;
-        remaining_length_multiplier_ = 1;
-        socket_->async_read(
-            as::buffer(buf_.data(), 1),
-            [this, self = force_move(self), func = force_move(func)] (
-                boost::system::error_code const& ec,
-                std::size_t bytes_transferred) mutable {
-                if (!check_error_and_transferred_length(ec, func, bytes_transferred, 1)) return;
-                handle_remaining_length(force_move(func), force_move(self));
+    // Call with store_mtx_ locked.
+    void restore_store_no_lock(
+        packet_id_t packet_id,
+        control_packet_type expected_type,
+        basic_store_message_variant<PacketIdBytes> smv,
+        any life_keeper = any()) {
+        if (packet_id_.register_id(packet_id)) {
+            // smv and life_keeper are not moved if the packet_id is already stored.
+            auto ret = store_.emplace(
+                packet_id,
+                expected_type,
+                force_move(smv),
+                force_move(life_keeper)
+            );
+            // When client want to restore serialized messages,
+            // endpoint might keep the message that has the same packet_id.
+            // In this case, overwrite store_.
+            if (!ret.second) {
+                *ret.first = store(
+                    packet_id,
+                    expected_type,
+                    force_move(smv),
+                    force_move(life_keeper)
+                );
             }
-        );
+        }
     }
 
-    bool calc_variable_length(std::size_t& v, std::size_t& multiplier, char buf) {
+    template <typename Iterator>
+    void restore_serialized_messages_impl(protocol_version version, Iterator b, Iterator e) {
+        static_assert(
+            std::is_same<
+                typename std::iterator_traits<Iterator>::iterator_category,
+                std::random_access_iterator_tag
+            >::value,
+            "Iterators provided to restore_serialized_messages() must be random access iterators."
+        );
+
+        auto buf = allocate_buffer(b, e);
+        std::vector<std::tuple<packet_id_t, control_packet_type, basic_store_message_variant<PacketIdBytes>, buffer>> msgs;
+        std::size_t pos = 0;
+        while (pos != buf.size()) {
+            std::size_t len;
+            std::size_t consumed;
+            std::tie(len, consumed) = remaining_length(std::next(buf.begin(), static_cast<std::ptrdiff_t>(pos + 1)), buf.end());
+            if (consumed == 0 ||
+                (static_cast<std::uint8_t>(buf[pos + consumed]) & 0b10000000) ||
+                buf.size() - pos - 1 - consumed < len) {
+                throw protocol_error();
+            }
+            auto size = 1 + consumed + len;
+            auto mbuf = buf.substr(pos, size);
+            switch (get_control_packet_type(static_cast<std::uint8_t>(buf[pos]))) {
+            case control_packet_type::publish:
+                if (version == protocol_version::v5) {
+                    v5::basic_publish_message<PacketIdBytes> msg(mbuf);
+                    auto packet_id = msg.packet_id();
+                    auto expected_type = expected_control_packet_type(msg.get_qos());
+                    msgs.emplace_back(packet_id, expected_type, force_move(msg), force_move(mbuf));
+                }
+                else {
+                    basic_publish_message<PacketIdBytes> msg(mbuf);
+                    auto packet_id = msg.packet_id();
+                    auto expected_type = expected_control_packet_type(msg.get_qos());
+                    msgs.emplace_back(packet_id, expected_type, force_move(msg), force_move(mbuf));
+                }
+                break;
+            case control_packet_type::pubrel:
+                if (version == protocol_version::v5) {
+                    v5::basic_pubrel_message<PacketIdBytes> msg(mbuf);
+                    auto packet_id = msg.packet_id();
+                    msgs.emplace_back(packet_id, control_packet_type::pubcomp, force_move(msg), force_move(mbuf));
+                }
+                else {
+                    basic_pubrel_message<PacketIdBytes> msg(mbuf);
+                    auto packet_id = msg.packet_id();
+                    msgs.emplace_back(packet_id, control_packet_type::pubcomp, force_move(msg), buffer());
+                }
+                break;
+            default:
+                throw protocol_error();
+                break;
+            }
+            pos += size;
+        }
+
+        LockGuard<Mutex> lck (store_mtx_);
+        for (auto& m : msgs) {
+            restore_store_no_lock(
+                std::get<0>(m),
+                std::get<1>(m),
+                force_move(std::get<2>(m)),
+                force_move(std::get<3>(m))
+            );
+        }
+    }
+
+    // Erase the stored message only if it waits for the expected_type.
+    // Call with store_mtx_ locked.
+    // Returns true if the message is erased.
+    bool erase_store(packet_id_t packet_id, control_packet_type expected_type) {
+        auto e = store_.find(packet_id);
+        if (e && e->expected_control_packet_type() == expected_type) {
+            store_.erase(packet_id);
+            return true;
+        }
+        return false;
+    }
+
+    // Erase the stored publish messages whose Message Expiry Interval has passed,
+    // and release their packet ids. They are not resent.
+    // Call with store_mtx_ locked.
+    // Returns the packet ids of the erased messages in order to call h_serialize_remove_ without the lock.
+    std::vector<packet_id_t> erase_expired_store(std::chrono::steady_clock::time_point now) {
+        std::vector<packet_id_t> ids;
+        for (auto const& e : store_) {
+            if (e.expired(now)) ids.push_back(e.packet_id());
+        }
+        for (auto id : ids) {
+            store_.erase(id);
+            packet_id_.release_id(id);
+        }
+        return ids;
+    }
+
+    // Read exactly buf.size() bytes.
+    // If the read-ahead buffer is enabled, bytes are served from it and the
+    // socket is only read (in large chunks) when the buffer runs dry.
+    template <typename ReadHandler>
+    void do_async_read(as::mutable_buffer buf, ReadHandler&& handler) {
+        if (read_ahead_buf_.empty()) {
+            socket_->async_read(buf, std::forward<ReadHandler>(handler));
+            return;
+        }
+        do_async_read_ahead(buf, 0, std::forward<ReadHandler>(handler));
+    }
+
+    template <typename ReadHandler>
+    void do_async_read_ahead(as::mutable_buffer buf, std::size_t transferred, ReadHandler&& handler) {
+        auto size = std::min(buf.size(), read_ahead_end_ - read_ahead_begin_);
+        std::memcpy(buf.data(), read_ahead_buf_.data() + read_ahead_begin_, size);
+        read_ahead_begin_ += size;
+        transferred += size;
+        buf += size;
+        if (buf.size() == 0) {
+            std::forward<ReadHandler>(handler)(boost::system::errc::make_error_code(boost::system::errc::success), transferred);
+            return;
+        }
+
+        // read-ahead buffer is drained
+        read_ahead_begin_ = 0;
+        read_ahead_end_ = 0;
+        if (buf.size() >= read_ahead_buf_.size()) {
+            // Staging doesn't help for large payloads. Read them directly.
+            socket_->async_read(
+                buf,
+                [transferred, handler = std::forward<ReadHandler>(handler)]
+                (boost::system::error_code const& ec,
+                 std::size_t bytes_transferred) mutable {
+                    handler(ec, transferred + bytes_transferred);
+                }
+            );
+            return;
+        }
+        socket_->async_read_some(
+            as::buffer(read_ahead_buf_),
+            [this, buf, transferred, handler = std::forward<ReadHandler>(handler)]
+            (boost::system::error_code const& ec,
+             std::size_t bytes_transferred) mutable {
+                if (ec) {
+                    handler(ec, transferred);
+                    return;
+                }
+                read_ahead_end_ = bytes_transferred;
+                do_async_read_ahead(buf, transferred, force_move(handler));
+            }
+        );
+    }
+
+    void read_control_packet_type(async_handler_t func, this_type_sp self) {
+        do_async_read(
+            as::buffer(buf_.data(), 1),
+            [this, self = force_move(self), func = force_move(func)](
+                boost::system::error_code const& ec,
+                std::size_t bytes_transferred) mutable {
+                if (!check_error_and_transferred_length(ec, func, bytes_transferred, 1)) return;
+                handle_control_packet_type(force_move(func), force_move(self));
+            }
+        );
+    }
+
+    void handle_control_packet_type(async_handler_t func, this_type_sp self) {
+        fixed_header_ = static_cast<std::uint8_t>(buf_.front());
+        remaining_length_ = 0;
+        remaining_length_multiplier_ = 1;
+        do_async_read(
+            as::buffer(buf_.data(), 1),
+            [this, self = force_move(self), func = force_move(func)] (
+                boost::system::error_code const& ec,
+                std::size_t bytes_transferred) mutable {
+                if (!check_error_and_transferred_length(ec, func, bytes_transferred, 1)) return;
+                handle_remaining_length(force_move(func), force_move(self));
+            }
+        );
+    }
+
+    bool calc_variable_length(std::size_t& v, std::size_t& multiplier, char buf) {
         v += (buf & 0b01111111) * multiplier;
         multiplier *= 128;
         return multiplier <= 128 * 128 * 128 * 128;
@@ -8068,7 +8521,7 @@ private:
             return;
         }
         if (buf_.front() & variable_length_continue_flag) {
-            socket_->async_read(
+            do_async_read(
                 as::buffer(buf_.data(), 1),
                 [this, self = force_move(self), func = force_move(func)](
                     boost::system::error_code const& ec,
@@ -8235,6 +8688,11 @@ private:
         }
     }
 
+    shared_ptr_array allocate_receive_buffer(std::size_t size) {
+        if (receive_buffer_allocator_) return receive_buffer_allocator_(size);
+        return make_shared_ptr_array(size);
+    }
+
     // primitive read functions
     void process_nbytes(
         async_handler_t func,
@@ -8250,9 +8708,9 @@ private:
         remaining_length_ -= size;
 
         if (buf.empty()) {
-            auto spa = make_shared_ptr_array(size);
+            auto spa = allocate_receive_buffer(size);
             auto ptr = spa.get();
-            socket_->async_read(
+            do_async_read(
                 as::buffer(ptr, size),
                 [
                     this,
@@ -8313,7 +8771,7 @@ private:
         remaining_length_ -= Bytes;
 
         if (buf.empty()) {
-            socket_->async_read(
+            do_async_read(
                 as::buffer(buf_.data(), Bytes),
                 [
                     this,
@@ -8434,7 +8892,7 @@ private:
             };
 
         if (buf.empty()) {
-            socket_->async_read(
+            do_async_read(
                 as::buffer(buf_.data(), 1),
                 [
                     this,
@@ -8595,7 +9053,7 @@ private:
                     auto result =
                         [&] () -> spa_address_len {
                             if (property_length < props_bulk_read_limit_) {
-                                auto spa = make_shared_ptr_array(property_length);
+                                auto spa = allocate_receive_buffer(property_length);
                                 auto ptr = spa.get();
                                 return
                                     {
@@ -8611,7 +9069,7 @@ private:
                                     1
                                 };
                         } ();
-                    socket_->async_read(
+                    do_async_read(
                         as::buffer(result.address, result.len),
                         [
                             this,
@@ -8678,7 +9136,7 @@ private:
 
         --remaining_length_;
         if (buf.empty()) {
-            socket_->async_read(
+            do_async_read(
                 as::buffer(buf_.data(), 1),
                 [
                     this,
@@ -9598,9 +10056,9 @@ private:
     ) {
 
         if (all_read) {
-            auto spa = make_shared_ptr_array(remaining_length_);
+            auto spa = allocate_receive_buffer(remaining_length_);
             auto ptr = spa.get();
-            socket_->async_read(
+            do_async_read(
                 as::buffer(ptr, remaining_length_),
                 [
                     this,
@@ -9636,7 +10094,7 @@ private:
             return;
         }
 
-        socket_->async_read(
+        do_async_read(
             as::buffer(buf_.data(), header_len),
             [
                 this,
@@ -9968,6 +10426,8 @@ private:
             break;
         case connect_phase::finish:
             mqtt_connected_ = true;
+            reset_topic_alias_send(info.props);
+            reset_publish_send_window(info.props);
             switch (version_) {
             case protocol_version::v3_1_1:
                 if (h_connect_) {
@@ -10132,6 +10592,9 @@ private:
             break;
         case connack_phase::finish: {
             mqtt_connected_ = true;
+            // Stored publish messages could be resent after this, so the aliases and the window should be reset before.
+            reset_topic_alias_send(info.props);
+            reset_publish_send_window(info.props);
             // I use rvalue reference parameter to reduce move constructor calling.
             // This is a local lambda expression invoked from this function, so
             // I can control all callers.
@@ -10334,6 +10797,10 @@ private:
                 ]
                 (std::vector<v5::property_variant> props, buffer buf, async_handler_t func, this_type_sp self) mutable {
                     info.props = force_move(props);
+                    if (!resolve_topic_alias_recv(info)) {
+                        call_protocol_error_handlers(func);
+                        return;
+                    }
                     process_publish_impl(
                         force_move(func),
                         force_move(buf),
@@ -10559,15 +11026,16 @@ private:
                 force_move(self)
             );
             break;
-        case puback_phase::finish:
+        case puback_phase::finish: {
+            bool erased;
             {
                 LockGuard<Mutex> lck (store_mtx_);
-                auto& idx = store_.template get<tag_packet_id_type>();
-                auto r = idx.equal_range(std::make_tuple(info.packet_id, control_packet_type::puback));
-                idx.erase(std::get<0>(r), std::get<1>(r));
-                packet_id_.erase(info.packet_id);
+                erased = erase_store(info.packet_id, control_packet_type::puback);
+                packet_id_.release_id(info.packet_id);
             }
             if (h_serialize_remove_) h_serialize_remove_(info.packet_id);
+            // Unexpected PUBACK doesn't free the Receive Maximum slot.
+            if (erased) complete_publish_send();
             switch (version_) {
             case protocol_version::v3_1_1:
                 if (h_puback_) {
@@ -10588,7 +11056,7 @@ private:
             default:
                 BOOST_ASSERT(false);
             }
-            break;
+        } break;
         }
     }
 
@@ -10711,16 +11179,26 @@ private:
             );
             break;
         case pubrec_phase::finish: {
+            // PUBREC with the Reason Code 0x80 or greater completes the QoS2 flow.
+            // No PUBREL is sent for it.
+            bool const failed =
+                version_ == protocol_version::v5 &&
+                static_cast<std::uint8_t>(info.reason_code) >= 0x80;
+            bool erased;
             {
                 LockGuard<Mutex> lck (store_mtx_);
-                auto& idx = store_.template get<tag_packet_id_type>();
-                auto r = idx.equal_range(std::make_tuple(info.packet_id, control_packet_type::pubrec));
-                idx.erase(std::get<0>(r), std::get<1>(r));
+                erased = erase_store(info.packet_id, control_packet_type::pubrec);
                 // packet_id shouldn't be erased here.
                 // It is reused for pubrel/pubcomp.
+                if (erased && failed) packet_id_.release_id(info.packet_id);
+            }
+            if (erased && failed) {
+                if (h_serialize_remove_) h_serialize_remove_(info.packet_id);
+                complete_publish_send();
             }
             auto res =
                 [&] {
+                    if (failed) return;
                     auto_pub_response(
                         [&] {
                             if (connected_) {
@@ -11055,16 +11533,17 @@ private:
                 force_move(self)
             );
             break;
-        case pubcomp_phase::finish:
+        case pubcomp_phase::finish: {
+            bool erased;
             {
                 LockGuard<Mutex> lck (store_mtx_);
-                auto& idx = store_.template get<tag_packet_id_type>();
-                auto r = idx.equal_range(std::make_tuple(info.packet_id, control_packet_type::pubcomp));
-                idx.erase(std::get<0>(r), std::get<1>(r));
+                erased = erase_store(info.packet_id, control_packet_type::pubcomp);
                 // packet_id shouldn't be erased here.
                 // It is reused for pubrel/pubcomp.
             }
             if (h_serialize_remove_) h_serialize_remove_(info.packet_id);
+            // Unexpected PUBCOMP doesn't free the Receive Maximum slot.
+            if (erased) complete_publish_send();
             switch (version_) {
             case protocol_version::v3_1_1:
                 if (h_pubcomp_) {
@@ -11085,7 +11564,7 @@ private:
             default:
                 BOOST_ASSERT(false);
             }
-            break;
+        } break;
         }
     }
 
@@ -11361,7 +11840,7 @@ private:
                 (buffer body, buffer /*buf*/, async_handler_t func, this_type_sp /*self*/) mutable {
                     {
                         LockGuard<Mutex> lck (store_mtx_);
-                        packet_id_.erase(info.packet_id);
+                        packet_id_.release_id(info.packet_id);
                     }
                     switch (version_) {
                     case protocol_version::v3_1_1:
@@ -11619,7 +12098,7 @@ private:
                     info.packet_id = packet_id;
                     {
                         LockGuard<Mutex> lck (store_mtx_);
-                        packet_id_.erase(info.packet_id);
+                        packet_id_.release_id(info.packet_id);
                     }
                     switch (version_) {
                     case protocol_version::v3_1_1:
@@ -11680,7 +12159,7 @@ private:
                     BOOST_ASSERT(version_ == protocol_version::v5);
                     {
                         LockGuard<Mutex> lck (store_mtx_);
-                        packet_id_.erase(info.packet_id);
+                        packet_id_.release_id(info.packet_id);
                     }
                     if (h_v5_unsuback_) {
                         std::vector<v5::unsuback_reason_code> reasons;
@@ -11999,6 +12478,7 @@ private:
         std::uint16_t keep_alive_sec,
         std::vector<v5::property_variant> props
     ) {
+        reset_topic_alias_recv(props);
         switch (version_) {
         case protocol_version::v3_1_1:
             do_sync_write(
@@ -12036,6 +12516,7 @@ private:
         variant<connect_return_code, v5::connect_reason_code> reason_code,
         std::vector<v5::property_variant> props
     ) {
+        reset_topic_alias_recv(props);
         switch (version_) {
         case protocol_version::v3_1_1:
             do_sync_write(
@@ -12070,31 +12551,9 @@ private:
         buffer payload,
         any life_keeper) {
 
-        auto do_send_publish =
-            [&](auto msg, auto const& serialize_publish) {
-
-                if (qos_value == qos::at_least_once || qos_value == qos::exactly_once) {
-                    auto store_msg = msg;
-                    store_msg.set_dup(true);
-                    LockGuard<Mutex> lck (store_mtx_);
-                    store_.emplace(
-                        packet_id,
-                        qos_value == qos::at_least_once
-                         ? control_packet_type::puback
-                         : control_packet_type::pubrec,
-                        store_msg,
-                        force_move(life_keeper)
-                    );
-                    if (serialize_publish) {
-                        serialize_publish(store_msg);
-                    }
-                }
-                do_sync_write(force_move(msg));
-            };
-
         switch (version_) {
         case protocol_version::v3_1_1:
-            do_send_publish(
+            send_publish_message(
                 v3_1_1::basic_publish_message<PacketIdBytes>(
                     force_move(topic_name),
                     qos_value,
@@ -12103,11 +12562,46 @@ private:
                     packet_id,
                     force_move(payload)
                 ),
-                h_serialize_publish_
+                h_serialize_publish_,
+                force_move(life_keeper)
             );
             break;
         case protocol_version::v5:
-            do_send_publish(
+            if (auto_topic_alias_send_) {
+                // Aliases are assigned in the order that the messages are queued,
+                // and the queued messages are written in the order without the lock.
+                bool writer = false;
+                {
+                    LockGuard<Mutex> lck (topic_alias_send_mtx_);
+                    writer = !topic_alias_send_writing_;
+                    topic_alias_send_writing_ = true;
+                    if (!writer) {
+                        // The message is written after this function returns,
+                        // and QoS0 message doesn't have the life_keeper.
+                        topic_name = allocate_buffer(topic_name);
+                        payload = allocate_buffer(payload);
+                    }
+                    auto msgs = make_topic_alias_publish_messages(
+                        force_move(topic_name),
+                        qos_value,
+                        retain,
+                        dup,
+                        packet_id,
+                        force_move(props),
+                        force_move(payload)
+                    );
+                    topic_alias_send_queue_.push_back(
+                        topic_alias_publish {
+                            force_move(msgs.first),
+                            force_move(life_keeper),
+                            force_move(msgs.second)
+                        }
+                    );
+                }
+                if (writer) send_topic_alias_publish_messages();
+                break;
+            }
+            send_publish_message(
                 v5::basic_publish_message<PacketIdBytes>(
                     force_move(topic_name),
                     qos_value,
@@ -12117,7 +12611,8 @@ private:
                     force_move(props),
                     force_move(payload)
                 ),
-                h_serialize_v5_publish_
+                h_serialize_v5_publish_,
+                force_move(life_keeper)
             );
             break;
         default:
@@ -12126,6 +12621,230 @@ private:
         }
     }
 
+    void send_publish(
+        basic_encoded_publish<PacketIdBytes>& msg,
+        qos qos_value,
+        bool retain,
+        packet_id_t packet_id,
+        any life_keeper) {
+
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto m = msg.v3_1_1_message(qos_value, retain);
+            m.set_packet_id(packet_id);
+            send_publish_message(force_move(m), h_serialize_publish_, force_move(life_keeper));
+        } break;
+        case protocol_version::v5: {
+            auto m = msg.v5_message(qos_value, retain);
+            m.set_packet_id(packet_id);
+            send_publish_message(force_move(m), h_serialize_v5_publish_, force_move(life_keeper));
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            break;
+        }
+    }
+
+    /**
+     * @brief Reset the topic aliases to send by the topic_alias_maximum of the peer.
+     * @param props properties of CONNECT or CONNACK that the peer sent
+     */
+    void reset_topic_alias_send(std::vector<v5::property_variant> const& props) {
+        auto max = get_topic_alias_maximum(props);
+        LockGuard<Mutex> lck (topic_alias_send_mtx_);
+        topic_alias_send_.reset(max);
+    }
+
+    /**
+     * @brief Reset the topic aliases to receive by the topic_alias_maximum that the endpoint sends.
+     * @param props properties of CONNECT or CONNACK that the endpoint sends
+     */
+    void reset_topic_alias_recv(std::vector<v5::property_variant> const& props) {
+        topic_alias_recv_.reset(get_topic_alias_maximum(props));
+    }
+
+    /**
+     * @brief Get topic_alias_maximum in the properties of CONNECT or CONNACK.
+     * @param props properties
+     * @return topic_alias_maximum. 0 if it is not contained or the protocol version is not v5.
+     */
+    std::uint16_t get_topic_alias_maximum(std::vector<v5::property_variant> const& props) const {
+        std::uint16_t max = 0;
+        if (version_ == protocol_version::v5) {
+            for (auto const& pv : props) {
+                MQTT_NS::visit(
+                    make_lambda_visitor<void>(
+                        [&](v5::property::topic_alias_maximum const& p) {
+                            max = p.val();
+                        },
+                        [](auto const&) {
+                        }
+                    ),
+                    pv
+                );
+            }
+        }
+        return max;
+    }
+
+    /**
+     * @brief Resolve the topic alias of the received publish message.
+     *        If the topic name is not empty, the topic name is mapped to the alias.
+     *        If the topic name is empty, the mapped topic name is set.
+     * @param info received publish message
+     * @return false if the topic alias is invalid, otherwise true
+     */
+    bool resolve_topic_alias_recv(publish_info& info) {
+        // Topic aliases are not accepted. Pass the message through as it is.
+        if (topic_alias_recv_.max() == 0) return true;
+
+        optional<std::uint16_t> alias;
+        for (auto const& pv : info.props) {
+            MQTT_NS::visit(
+                make_lambda_visitor<void>(
+                    [&](v5::property::topic_alias const& p) {
+                        alias.emplace(p.val());
+                    },
+                    [](auto const&) {
+                    }
+                ),
+                pv
+            );
+        }
+        if (!alias) return !info.topic_name.empty();
+
+        if (info.topic_name.empty()) {
+            auto topic_name = topic_alias_recv_.find(alias.value());
+            if (!topic_name) return false;
+            info.topic_name = force_move(topic_name.value());
+            return true;
+        }
+        // The received topic name refers to the whole packet, so copy it once
+        // in order not to keep the packet alive while the alias is mapped.
+        info.topic_name = allocate_buffer(info.topic_name);
+        return topic_alias_recv_.insert_or_update(alias.value(), info.topic_name);
+    }
+
+    /**
+     * @brief Make the v5 publish message with the topic alias
+     * @return pair of the message to store and the message to write.
+     *         If the second is nullopt, the first is also the message to write.
+     */
+    std::pair<v5::basic_publish_message<PacketIdBytes>, optional<v5::basic_publish_message<PacketIdBytes>>>
+    make_topic_alias_publish_messages(
+        buffer topic_name,
+        qos qos_value,
+        bool retain,
+        bool dup,
+        packet_id_t packet_id,
+        std::vector<v5::property_variant> props,
+        buffer payload) {
+
+        using message_t = v5::basic_publish_message<PacketIdBytes>;
+
+        auto has_topic_alias =
+            std::any_of(
+                props.begin(),
+                props.end(),
+                [](v5::property_variant const& pv) {
+                    return
+                        MQTT_NS::visit(
+                            make_lambda_visitor<bool>(
+                                [](v5::property::topic_alias const&) { return true; },
+                                [](auto const&) { return false; }
+                            ),
+                            pv
+                        );
+                }
+            );
+        auto alias = has_topic_alias ? nullopt : topic_alias_send_.find_or_assign(topic_name);
+        if (!alias) {
+            return {
+                message_t(force_move(topic_name), qos_value, retain, dup, packet_id, force_move(props), force_move(payload)),
+                nullopt
+            };
+        }
+
+        // The topic name can be omitted after the alias is mapped.
+        auto aliased_topic_name = alias.value().second ? topic_name : buffer();
+        if (qos_value == qos::at_most_once) {
+            // QoS0 message is not stored, so only the aliased one is required.
+            props.emplace_back(v5::property::topic_alias(alias.value().first));
+            return {
+                message_t(force_move(aliased_topic_name), qos_value, retain, dup, packet_id, force_move(props), force_move(payload)),
+                nullopt
+            };
+        }
+        auto aliased_props = props;
+        aliased_props.emplace_back(v5::property::topic_alias(alias.value().first));
+        return {
+            message_t(force_move(topic_name), qos_value, retain, dup, packet_id, force_move(props), payload),
+            message_t(force_move(aliased_topic_name), qos_value, retain, dup, packet_id, force_move(aliased_props), payload)
+        };
+    }
+
+    /**
+     * @brief Write the queued publish messages with topic aliases in the order of the queue.
+     *        The publish messages that are queued while writing, including the ones that are
+     *        published by the handlers on this thread, are also written.
+     */
+    void send_topic_alias_publish_messages() {
+        while (true) {
+            optional<topic_alias_publish> p;
+            {
+                LockGuard<Mutex> lck (topic_alias_send_mtx_);
+                if (topic_alias_send_queue_.empty()) {
+                    topic_alias_send_writing_ = false;
+                    return;
+                }
+                p.emplace(force_move(topic_alias_send_queue_.front()));
+                topic_alias_send_queue_.pop_front();
+            }
+            send_publish_message(
+                force_move(p.value().message),
+                h_serialize_v5_publish_,
+                force_move(p.value().life_keeper),
+                force_move(p.value().wire_message)
+            );
+        }
+    }
+
+    template <typename PublishMessage, typename SerializePublish>
+    void send_publish_message(
+        PublishMessage msg,
+        SerializePublish const& serialize_publish,
+        any life_keeper,
+        optional<PublishMessage> wire_msg = nullopt) {
+
+        auto qos_value = msg.get_qos();
+        if (qos_value == qos::at_least_once || qos_value == qos::exactly_once) {
+            auto store_msg = msg;
+            store_msg.set_dup(true);
+            LockGuard<Mutex> lck (store_mtx_);
+            store_.emplace(
+                msg.packet_id(),
+                qos_value == qos::at_least_once
+                 ? control_packet_type::puback
+                 : control_packet_type::pubrec,
+                store_msg,
+                force_move(life_keeper)
+            );
+            if (serialize_publish) {
+                serialize_publish(store_msg);
+            }
+            if (version_ == protocol_version::v5) {
+                // Blocking publish is not held, but it is counted as in-flight.
+                LockGuard<Mutex> lck (publish_send_mtx_);
+                ++publish_send_count_;
+            }
+        }
+        if (wire_msg) {
+            do_sync_write(force_move(wire_msg.value()));
+            return;
+        }
+        do_sync_write(force_move(msg));
+    }
+
     void send_puback(
         packet_id_t packet_id,
         optional<v5::puback_reason_code> reason = nullopt,
@@ -12177,7 +12896,7 @@ private:
                     LockGuard<Mutex> lck (store_mtx_);
 
                     // insert if not registerd (start from pubrel sending case)
-                    packet_id_.insert(packet_id);
+                    packet_id_.register_id(packet_id);
 
                     auto ret = store_.emplace(
                         packet_id,
@@ -12226,7 +12945,7 @@ private:
                     LockGuard<Mutex> lck (store_mtx_);
 
                     // insert if not registerd (start from pubrel sending case)
-                    packet_id_.insert(packet_id);
+                    packet_id_.register_id(packet_id);
 
                     auto ret = store_.emplace(
                         packet_id,
@@ -12523,10 +13242,40 @@ private:
     }
 
     void send_store() {
-        LockGuard<Mutex> lck (store_mtx_);
-        auto const& idx = store_.template get<tag_seq>();
-        for (auto const& e : idx) {
-            do_sync_write(e.message());
+        // Copy the messages in order to write them without locking store_mtx_.
+        // The second element is true if the message is publish.
+        std::vector<std::tuple<basic_message_variant<PacketIdBytes>, bool>> msgs;
+        std::vector<packet_id_t> expired_ids;
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            auto now = std::chrono::steady_clock::now();
+            expired_ids = erase_expired_store(now);
+            msgs.reserve(store_.size());
+            for (auto const& e : store_) {
+                msgs.emplace_back(
+                    e.message(now),
+                    e.expected_control_packet_type() != control_packet_type::pubcomp
+                );
+            }
+        }
+        if (h_serialize_remove_) {
+            for (auto id : expired_ids) h_serialize_remove_(id);
+        }
+        for (auto& m : msgs) {
+            auto& mv = std::get<0>(m);
+            if (version_ == protocol_version::v5) {
+                // Resent messages are in-flight. Publish messages are within Receive Maximum.
+                LockGuard<Mutex> lck (publish_send_mtx_);
+                bool const is_publish = std::get<1>(m);
+                if (is_publish &&
+                    (!publish_send_queue_.empty() || publish_send_count_ >= publish_send_max_)) {
+                    // Written by complete_publish_send().
+                    hold_publish(qos::at_least_once, force_move(mv), async_handler_t());
+                    continue;
+                }
+                ++publish_send_count_;
+            }
+            do_sync_write(force_move(mv));
         }
     }
 
@@ -12552,6 +13301,7 @@ private:
         async_handler_t func) {
 
         clean_session_ = clean_session;
+        reset_topic_alias_recv(props);
 
         switch (version_) {
         case protocol_version::v3_1_1:
@@ -12593,6 +13343,7 @@ private:
         std::vector<v5::property_variant> props,
         async_handler_t func
     ) {
+        reset_topic_alias_recv(props);
         switch (version_) {
         case protocol_version::v3_1_1:
             do_async_write(
@@ -12630,39 +13381,12 @@ private:
         async_handler_t func,
         any life_keeper) {
 
-        auto do_async_send_publish =
-            [&](auto msg, auto const& serialize_publish) {
-                if (qos_value == qos::at_least_once || qos_value == qos::exactly_once) {
-                    auto store_msg = msg;
-                    store_msg.set_dup(true);
-                    {
-                        LockGuard<Mutex> lck (store_mtx_);
-                        auto ret = store_.emplace(
-                            packet_id,
-                            qos_value == qos::at_least_once ? control_packet_type::puback
-                                                            : control_packet_type::pubrec,
-                            store_msg,
-                            life_keeper
-                        );
-                        (void)ret;
-                        BOOST_ASSERT(ret.second);
-                    }
-
-                    if (serialize_publish) {
-                        serialize_publish(store_msg);
-                    }
-                }
-                do_async_write(
-                    force_move(msg),
-                    [life_keeper = force_move(life_keeper), func = force_move(func)](boost::system::error_code const& ec) {
-                        if (func) func(ec);
-                    }
-                );
-            };
+        // Before the topic alias is assigned.
+        if (reject_async_publish(packet_id, func)) return;
 
         switch (version_) {
         case protocol_version::v3_1_1:
-            do_async_send_publish(
+            async_send_publish_message(
                 v3_1_1::basic_publish_message<PacketIdBytes>(
                     force_move(topic_name),
                     qos_value,
@@ -12671,11 +13395,34 @@ private:
                     packet_id,
                     force_move(payload)
                 ),
-                h_serialize_publish_
+                h_serialize_publish_,
+                force_move(func),
+                force_move(life_keeper)
             );
             break;
         case protocol_version::v5:
-            do_async_send_publish(
+            if (auto_topic_alias_send_) {
+                // Aliases are assigned in the order that the messages are queued.
+                LockGuard<Mutex> lck (topic_alias_send_mtx_);
+                auto msgs = make_topic_alias_publish_messages(
+                    force_move(topic_name),
+                    qos_value,
+                    retain,
+                    dup,
+                    packet_id,
+                    force_move(props),
+                    force_move(payload)
+                );
+                async_send_publish_message(
+                    force_move(msgs.first),
+                    h_serialize_v5_publish_,
+                    force_move(func),
+                    force_move(life_keeper),
+                    force_move(msgs.second)
+                );
+                break;
+            }
+            async_send_publish_message(
                 v5::basic_publish_message<PacketIdBytes>(
                     force_move(topic_name),
                     qos_value,
@@ -12685,7 +13432,9 @@ private:
                     force_move(props),
                     force_move(payload)
                 ),
-                h_serialize_v5_publish_
+                h_serialize_v5_publish_,
+                force_move(func),
+                force_move(life_keeper)
             );
             break;
         default:
@@ -12694,6 +13443,204 @@ private:
         }
     }
 
+    void async_send_publish(
+        basic_encoded_publish<PacketIdBytes>& msg,
+        qos qos_value,
+        bool retain,
+        packet_id_t packet_id,
+        async_handler_t func,
+        any life_keeper) {
+
+        if (reject_async_publish(packet_id, func)) return;
+
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto m = msg.v3_1_1_message(qos_value, retain);
+            m.set_packet_id(packet_id);
+            async_send_publish_message(
+                force_move(m), h_serialize_publish_, force_move(func), force_move(life_keeper)
+            );
+        } break;
+        case protocol_version::v5: {
+            auto m = msg.v5_message(qos_value, retain);
+            m.set_packet_id(packet_id);
+            async_send_publish_message(
+                force_move(m), h_serialize_v5_publish_, force_move(func), force_move(life_keeper)
+            );
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            break;
+        }
+    }
+
+    /**
+     * @brief Reject the new async publish message by send_queue_policy::block
+     *        while the send queue is over the high watermark.
+     *        func is called with operation_would_block on the socket's strand.
+     * @return true if the message is rejected.
+     */
+    bool reject_async_publish(packet_id_t packet_id, async_handler_t& func) {
+        if (send_queue_policy_ != send_queue_policy::block || !send_queue_high_) return false;
+        if (packet_id != 0) release_packet_id(packet_id);
+        socket_->post(
+            [self = shared_from_this(), func = force_move(func)] {
+                if (func) func(boost::system::errc::make_error_code(boost::system::errc::operation_would_block));
+            }
+        );
+        return true;
+    }
+
+    template <typename PublishMessage, typename SerializePublish>
+    void async_send_publish_message(
+        PublishMessage msg,
+        SerializePublish const& serialize_publish,
+        async_handler_t func,
+        any life_keeper,
+        optional<PublishMessage> wire_msg = nullopt) {
+
+        auto qos_value = msg.get_qos();
+        if (qos_value == qos::at_least_once || qos_value == qos::exactly_once) {
+            auto store_msg = msg;
+            store_msg.set_dup(true);
+            {
+                LockGuard<Mutex> lck (store_mtx_);
+                auto ret = store_.emplace(
+                    msg.packet_id(),
+                    qos_value == qos::at_least_once ? control_packet_type::puback
+                                                    : control_packet_type::pubrec,
+                    store_msg,
+                    life_keeper
+                );
+                (void)ret;
+                BOOST_ASSERT(ret.second);
+            }
+
+            if (serialize_publish) {
+                serialize_publish(store_msg);
+            }
+        }
+        async_send_publish_within_window(
+            qos_value,
+            wire_msg ? force_move(wire_msg.value()) : force_move(msg),
+            [life_keeper = force_move(life_keeper), func = force_move(func)](boost::system::error_code const& ec) {
+                if (func) func(ec);
+            }
+        );
+    }
+
+    /**
+     * @brief Write the publish message within Receive Maximum of the peer.
+     *        If the number of in-flight QoS1 and QoS2 publish messages reaches Receive Maximum,
+     *        the message is held and written when one of them is completed.
+     *        While any messages are held, QoS0 messages are also held in order to keep the order.
+     */
+    void async_send_publish_within_window(
+        qos qos_value,
+        basic_message_variant<PacketIdBytes> mv,
+        async_handler_t func) {
+        if (version_ != protocol_version::v5 || !connected_) {
+            do_async_write(force_move(mv), force_move(func));
+            return;
+        }
+        // do_async_write() is called in the lock in order to keep the order of messages.
+        LockGuard<Mutex> lck (publish_send_mtx_);
+        if (publish_send_queue_.empty()) {
+            if (qos_value == qos::at_most_once) {
+                do_async_write(force_move(mv), force_move(func));
+                return;
+            }
+            if (publish_send_count_ < publish_send_max_) {
+                ++publish_send_count_;
+                do_async_write(force_move(mv), force_move(func));
+                return;
+            }
+        }
+        hold_publish(qos_value, force_move(mv), force_move(func));
+    }
+
+    /**
+     * @brief Hold the publish message until one of the in-flight ones is completed.
+     *        The held message is counted by the send queue watermarks.
+     *        Call with publish_send_mtx_ locked.
+     */
+    void hold_publish(
+        qos qos_value,
+        basic_message_variant<PacketIdBytes> mv,
+        async_handler_t func) {
+        publish_send_queue_.emplace_back(qos_value, force_move(mv), force_move(func));
+        publish_send_queue_bytes_ += publish_send_queue_.back().packet.size();
+        if (send_queue_high_bytes_ == 0 && send_queue_high_count_ == 0) return;
+        // The watermarks are checked on the socket's strand.
+        socket_->post(
+            [this, self = shared_from_this()] {
+                check_send_queue_high();
+            }
+        );
+    }
+
+    /**
+     * @brief Complete the in-flight publish message and write the held messages within Receive Maximum.
+     *        It is called when PUBACK or PUBCOMP is received.
+     */
+    void complete_publish_send() {
+        if (version_ != protocol_version::v5) return;
+        LockGuard<Mutex> lck (publish_send_mtx_);
+        if (publish_send_count_ > 0) --publish_send_count_;
+        while (!publish_send_queue_.empty()) {
+            auto& p = publish_send_queue_.front();
+            if (p.qos_value != qos::at_most_once) {
+                if (publish_send_count_ >= publish_send_max_) break;
+                ++publish_send_count_;
+            }
+            // The bytes are counted again by queue_bytes_.
+            publish_send_queue_bytes_ -= p.packet.size();
+            do_async_write(force_move(p.packet.message()), force_move(p.packet.handler()));
+            publish_send_queue_.pop_front();
+        }
+    }
+
+    /**
+     * @brief Reset the send window by receive_maximum that the peer sent by CONNECT or CONNACK.
+     *        Held publish messages are discarded. QoS1 and QoS2 ones are resent from the store.
+     * @param props properties of CONNECT or CONNACK that the peer sent
+     */
+    void reset_publish_send_window(std::vector<v5::property_variant> const& props) {
+        // If the Receive Maximum value is absent, then its value defaults to 65,535.
+        std::uint16_t max = 0xffff;
+        for (auto const& pv : props) {
+            MQTT_NS::visit(
+                make_lambda_visitor<void>(
+                    [&](v5::property::receive_maximum const& p) {
+                        max = p.val();
+                    },
+                    [](auto const&) {
+                    }
+                ),
+                pv
+            );
+        }
+        std::deque<pending_publish> discarded;
+        {
+            LockGuard<Mutex> lck (publish_send_mtx_);
+            publish_send_max_ = max;
+            publish_send_count_ = 0;
+            publish_send_queue_bytes_ = 0;
+            discarded.swap(publish_send_queue_);
+        }
+        if (!discarded.empty() && (send_queue_high_bytes_ != 0 || send_queue_high_count_ != 0)) {
+            socket_->post(
+                [this, self = shared_from_this()] {
+                    check_send_queue_low();
+                }
+            );
+        }
+        for (auto& p : discarded) {
+            // Same as offline async publish.
+            if (p.packet.handler()) p.packet.handler()(boost::system::errc::make_error_code(boost::system::errc::success));
+        }
+    }
+
     void async_send_puback(
         packet_id_t packet_id,
         optional<v5::puback_reason_code> reason,
@@ -12772,7 +13719,7 @@ private:
                     LockGuard<Mutex> lck (store_mtx_);
 
                     // insert if not registerd (start from pubrel sending case)
-                    packet_id_.insert(packet_id);
+                    packet_id_.register_id(packet_id);
 
                     auto ret = store_.emplace(
                         packet_id,
@@ -12786,16 +13733,11 @@ private:
                     // implementation.
                     // In this case, overwrite store_.
                     if (!ret.second) {
-                        store_.modify(
-                            ret.first,
-                            [&] (auto& e) {
-                                e = store(
-                                    packet_id,
-                                    control_packet_type::pubcomp,
-                                    force_move(msg),
-                                    life_keeper
-                                );
-                            }
+                        *ret.first = store(
+                            packet_id,
+                            control_packet_type::pubcomp,
+                            force_move(msg),
+                            life_keeper
                         );
                     }
                 }
@@ -13234,20 +14176,102 @@ private:
     }
 
     void async_send_store(std::function<void()> func) {
+        // Only the packet ids are taken here. The messages are taken batch by batch.
+        // The messages that are stored after this point are written by their own publish.
+        auto ids = std::make_shared<std::vector<packet_id_t>>();
+        std::vector<packet_id_t> expired_ids;
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            expired_ids = erase_expired_store(std::chrono::steady_clock::now());
+            ids->reserve(store_.size());
+            for (auto const& e : store_) {
+                ids->push_back(e.packet_id());
+            }
+        }
+        if (h_serialize_remove_) {
+            for (auto id : expired_ids) h_serialize_remove_(id);
+        }
+        async_send_store_batch(force_move(ids), 0, force_move(func));
+    }
+
+    /**
+     * @brief Write the stored messages of ids[pos, pos + resend_batch_count_).
+     *        When all of them are written, write the next batch.
+     *        After the last batch is written or any write fails, func is called.
+     */
+    void async_send_store_batch(
+        std::shared_ptr<std::vector<packet_id_t>> ids,
+        std::size_t pos,
+        std::function<void()> func) {
+        std::vector<std::tuple<basic_message_variant<PacketIdBytes>, bool>> batch;
+        std::vector<packet_id_t> expired_ids;
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            auto now = std::chrono::steady_clock::now();
+            while (batch.empty() && pos != ids->size()) {
+                auto end = std::min(ids->size(), pos + resend_batch_count_);
+                for (; pos != end; ++pos) {
+                    // The message might be removed while the previous batch is written.
+                    auto id = (*ids)[pos];
+                    if (auto e = store_.find(id)) {
+                        // The message might expire while the previous batch is written.
+                        if (e->expired(now)) {
+                            store_.erase(id);
+                            packet_id_.release_id(id);
+                            expired_ids.push_back(id);
+                            continue;
+                        }
+                        batch.emplace_back(
+                            e->message(now),
+                            e->expected_control_packet_type() != control_packet_type::pubcomp
+                        );
+                    }
+                }
+            }
+        }
+        if (h_serialize_remove_) {
+            for (auto id : expired_ids) h_serialize_remove_(id);
+        }
+        if (batch.empty()) {
+            func();
+            return;
+        }
+
+        auto failed = std::make_shared<bool>(false);
         auto g = shared_scope_guard(
-            [func = force_move(func)] {
-                func();
+            [this, self = this->shared_from_this(), ids, pos, func = force_move(func), failed] () mutable {
+                if (*failed || pos == ids->size()) {
+                    func();
+                }
+                else {
+                    async_send_store_batch(force_move(ids), pos, force_move(func));
+                }
             }
         );
-        LockGuard<Mutex> lck (store_mtx_);
-        auto const& idx = store_.template get<tag_seq>();
-        for (auto const& e : idx) {
-            do_async_write(
-                e.message(),
-                [g]
-                (boost::system::error_code const& /*ec*/) {
-                }
-            );
+        auto handler =
+            [g, failed]
+            (boost::system::error_code const& ec) {
+                if (ec) *failed = true;
+            };
+        for (auto& m : batch) {
+            auto& mv = std::get<0>(m);
+            if (version_ != protocol_version::v5) {
+                do_async_write(force_move(mv), handler);
+                continue;
+            }
+            // Resent messages are in-flight. Publish messages are within Receive Maximum.
+            LockGuard<Mutex> lck (publish_send_mtx_);
+            bool const is_publish = std::get<1>(m);
+            if (!is_publish ||
+                (publish_send_queue_.empty() && publish_send_count_ < publish_send_max_)) {
+                ++publish_send_count_;
+                do_async_write(force_move(mv), handler);
+            }
+            else {
+                // Written by complete_publish_send().
+                // The handler doesn't wait for it because reading PUBACK and PUBCOMP waits for the resend.
+                hold_publish(qos::at_least_once, force_move(mv), async_handler_t());
+            }
         }
     }
 
@@ -13259,7 +14283,8 @@ private:
             basic_message_variant<PacketIdBytes> mv,
             async_handler_t h = async_handler_t())
             : mv_(force_move(mv))
-            , handler_(force_move(h)) {}
+            , handler_(force_move(h))
+            , size_(MQTT_NS::size<PacketIdBytes>(mv_)) {}
         basic_message_variant<PacketIdBytes> const& message() const {
             return mv_;
         }
@@ -13268,9 +14293,23 @@ private:
         }
         async_handler_t const& handler() const { return handler_; }
         async_handler_t& handler() { return handler_; }
+        std::size_t size() const { return size_; }
     private:
         basic_message_variant<PacketIdBytes> mv_;
         async_handler_t handler_;
+        std::size_t size_;
+    };
+
+    // Publish message that is held by Receive Maximum of the peer.
+    struct pending_publish {
+        pending_publish(
+            qos q,
+            basic_message_variant<PacketIdBytes> mv,
+            async_handler_t h)
+            : qos_value(q)
+            , packet(force_move(mv), force_move(h)) {}
+        qos qos_value;
+        async_packet packet;
     };
 
     struct write_completion_handler {
@@ -13287,17 +14326,19 @@ private:
         void operator()(boost::system::error_code const& ec) const {
             if (func_) func_(ec);
             for (std::size_t i = 0; i != num_of_messages_; ++i) {
-                self_->queue_.pop_front();
+                self_->pop_send_queue_front();
             }
             if (ec || // Error is handled by async_read.
                 !self_->connected_) {
                 self_->connected_ = false;
                 while (!self_->queue_.empty()) {
                     self_->queue_.front().handler()(ec);
-                    self_->queue_.pop_front();
+                    self_->pop_send_queue_front();
                 }
+                self_->check_send_queue_low();
                 return;
             }
+            self_->check_send_queue_low();
             if (!self_->queue_.empty()) {
                 self_->do_async_write();
             }
@@ -13307,25 +14348,28 @@ private:
             std::size_t bytes_transferred) const {
             if (func_) func_(ec);
             for (std::size_t i = 0; i != num_of_messages_; ++i) {
-                self_->queue_.pop_front();
+                self_->pop_send_queue_front();
             }
             if (ec || // Error is handled by async_read.
                 !self_->connected_) {
                 self_->connected_ = false;
                 while (!self_->queue_.empty()) {
                     self_->queue_.front().handler()(ec);
-                    self_->queue_.pop_front();
+                    self_->pop_send_queue_front();
                 }
+                self_->check_send_queue_low();
                 return;
             }
             if (bytes_to_transfer_ != bytes_transferred) {
                 self_->connected_ = false;
                 while (!self_->queue_.empty()) {
                     self_->queue_.front().handler()(ec);
-                    self_->queue_.pop_front();
+                    self_->pop_send_queue_front();
                 }
+                self_->check_send_queue_low();
                 throw write_bytes_transferred_error(bytes_to_transfer_, bytes_transferred);
             }
+            self_->check_send_queue_low();
             if (!self_->queue_.empty()) {
                 self_->do_async_write();
             }
@@ -13337,31 +14381,42 @@ private:
     };
 
     void do_async_write() {
+        bool const coalescing = write_coalescing_watermark_ != 0;
         // Only attempt to send up to the user specified maximum items
         using difference_t = typename decltype(queue_)::difference_type;
-        std::size_t iterator_count =   (max_queue_send_count_ == 0)
+        std::size_t iterator_count =   (coalescing || max_queue_send_count_ == 0)
                                 ? queue_.size()
                                 : std::min(max_queue_send_count_, queue_.size());
         auto const& start = queue_.cbegin();
         auto end = std::next(start, boost::numeric_cast<difference_t>(iterator_count));
 
         // And further, only up to the specified maximum bytes
+        std::size_t const max_bytes = coalescing ? write_coalescing_watermark_ : max_queue_send_size_;
         std::size_t total_bytes = 0;
         std::size_t total_const_buffer_sequence = 0;
         for (auto it = start; it != end; ++it) {
             auto const& elem = *it;
             auto const& mv = elem.message();
-            std::size_t const size = MQTT_NS::size<PacketIdBytes>(mv);
+            std::size_t const size = elem.size();
+            std::size_t const num_of_cbs = num_of_const_buffer_sequence(mv);
 
             // If we hit the byte limit, we don't include this buffer for this send.
-            if (max_queue_send_size_ != 0 && max_queue_send_size_ < total_bytes + size) {
-                end = it;
-                iterator_count = boost::numeric_cast<std::size_t>(std::distance(start, end));
-                break;
+            // In the coalescing mode, the first message is always sent.
+            if (!coalescing || it != start) {
+                if ((max_bytes != 0 && max_bytes < total_bytes + size) ||
+                    (coalescing && max_write_buffers < total_const_buffer_sequence + num_of_cbs)) {
+                    end = it;
+                    iterator_count = boost::numeric_cast<std::size_t>(std::distance(start, end));
+                    break;
+                }
             }
             total_bytes += size;
-            total_const_buffer_sequence += num_of_const_buffer_sequence(mv);
+            total_const_buffer_sequence += num_of_cbs;
         }
+        write_batch_count_ = iterator_count;
+        // Priority messages are at the front of the messages that are not written yet.
+        queue_priority_ -= std::min(queue_priority_, iterator_count);
+        queue_writing_ = iterator_count;
 
         std::vector<as::const_buffer> buf;
         std::vector<async_handler_t> handlers;
@@ -13377,6 +14432,20 @@ private:
             handlers.emplace_back(elem.handler());
         }
 
+        // A gathered write sends at most 64 buffers per system call.
+        // Copy many small buffers into one contiguous buffer, it is cheaper than
+        // additional system calls. The bytes are bounded by the watermark.
+        if (coalescing && buf.size() > max_write_buffers_per_call) {
+            write_staging_buf_.resize(total_bytes);
+            auto ptr = write_staging_buf_.data();
+            for (auto const& b : buf) {
+                std::memcpy(ptr, b.data(), b.size());
+                ptr += b.size();
+            }
+            buf.clear();
+            buf.emplace_back(as::buffer(write_staging_buf_));
+        }
+
         if (h_pre_send_) h_pre_send_();
 
         socket_->async_write(
@@ -13406,14 +14475,192 @@ private:
                     if (func) func(boost::system::errc::make_error_code(boost::system::errc::success));
                     return;
                 }
-                queue_.emplace_back(force_move(mv), force_move(func));
+                if (send_queue_high_ &&
+                    send_queue_policy_ == send_queue_policy::drop_qos0 &&
+                    is_droppable_publish(mv)) {
+                    if (func) func(boost::system::errc::make_error_code(boost::system::errc::no_buffer_space));
+                    return;
+                }
+                bool const priority = send_priority_lane_ && is_priority_message(mv);
+                auto size =
+                    [&] {
+                        if (priority) {
+                            // Queue ahead of the messages that are not written yet.
+                            using difference_t = typename decltype(queue_)::difference_type;
+                            auto it = queue_.emplace(
+                                std::next(
+                                    queue_.begin(),
+                                    boost::numeric_cast<difference_t>(queue_writing_ + queue_priority_)
+                                ),
+                                force_move(mv),
+                                force_move(func)
+                            );
+                            ++queue_priority_;
+                            return it->size();
+                        }
+                        queue_.emplace_back(force_move(mv), force_move(func));
+                        return queue_.back().size();
+                    } ();
+                queue_bytes_ += size;
+                // If the connection is closed by the policy, the following write fails and
+                // the queued messages are finished with the error.
+                check_send_queue_high();
+                if (write_holding_) {
+                    write_hold_bytes_ += size;
+                    if (!priority && write_hold_bytes_ < write_coalescing_watermark_) return;
+                    // Enough bytes are queued. Flush without waiting for the timer.
+                    write_holding_ = false;
+                    write_hold_timer().cancel();
+                    do_async_write();
+                    return;
+                }
                 // Only need to start async writes if there was nothing in the queue before the above item.
                 if (queue_.size() > 1) return;
+                if (write_coalescing_watermark_ != 0 &&
+                    write_coalescing_hold_ != std::chrono::microseconds::zero() &&
+                    write_batch_count_ > 1 &&
+                    size < write_coalescing_watermark_) {
+                    hold_async_write(size);
+                    return;
+                }
                 do_async_write();
             }
         );
     }
 
+    void pop_send_queue_front() {
+        queue_bytes_ -= queue_.front().size();
+        queue_.pop_front();
+        if (queue_writing_ != 0) {
+            --queue_writing_;
+        }
+        else if (queue_priority_ != 0) {
+            // Popped without writing on error
+            --queue_priority_;
+        }
+    }
+
+    struct is_priority_message_visitor {
+        using result_type = bool;
+        template <typename T>
+        bool operator()(T const&) const { return false; }
+        bool operator()(v3_1_1::basic_puback_message<PacketIdBytes> const&) const { return true; }
+        bool operator()(v3_1_1::basic_pubrec_message<PacketIdBytes> const&) const { return true; }
+        bool operator()(v3_1_1::basic_pubrel_message<PacketIdBytes> const&) const { return true; }
+        bool operator()(v3_1_1::basic_pubcomp_message<PacketIdBytes> const&) const { return true; }
+        bool operator()(v3_1_1::pingreq_message const&) const { return true; }
+        bool operator()(v3_1_1::pingresp_message const&) const { return true; }
+        bool operator()(v5::basic_puback_message<PacketIdBytes> const&) const { return true; }
+        bool operator()(v5::basic_pubrec_message<PacketIdBytes> const&) const { return true; }
+        bool operator()(v5::basic_pubrel_message<PacketIdBytes> const&) const { return true; }
+        bool operator()(v5::basic_pubcomp_message<PacketIdBytes> const&) const { return true; }
+        bool operator()(v5::pingreq_message const&) const { return true; }
+        bool operator()(v5::pingresp_message const&) const { return true; }
+    };
+
+    static bool is_priority_message(basic_message_variant<PacketIdBytes> const& mv) {
+        return MQTT_NS::visit(is_priority_message_visitor(), mv);
+    }
+
+    // Get the bytes and the number of the queued messages including the held publish messages.
+    // Call on the socket's strand.
+    std::pair<std::size_t, std::size_t> send_queue_usage() {
+        LockGuard<Mutex> lck (publish_send_mtx_);
+        return {
+            queue_bytes_ + publish_send_queue_bytes_,
+            queue_.size() + publish_send_queue_.size()
+        };
+    }
+
+    void check_send_queue_high() {
+        if (send_queue_high_) return;
+        auto usage = send_queue_usage();
+        if ((send_queue_high_bytes_ == 0 || usage.first < send_queue_high_bytes_) &&
+            (send_queue_high_count_ == 0 || usage.second < send_queue_high_count_)) return;
+        send_queue_high_ = true;
+        if (h_send_queue_high_) h_send_queue_high_();
+        if (send_queue_policy_ == send_queue_policy::disconnect) force_disconnect();
+    }
+
+    void check_send_queue_low() {
+        if (!send_queue_high_) return;
+        auto usage = send_queue_usage();
+        if (send_queue_high_bytes_ != 0 && usage.first > send_queue_low_bytes_) return;
+        if (send_queue_high_count_ != 0 && usage.second > send_queue_low_count_) return;
+        send_queue_high_ = false;
+        if (h_send_queue_low_) h_send_queue_low_();
+    }
+
+    // QoS0 publish message that can be dropped by send_queue_policy::drop_qos0.
+    // The one that has both the topic and Topic Alias is kept, because it maps the alias
+    // to the topic and the following publish messages might have only the alias.
+    static bool is_droppable_publish(basic_message_variant<PacketIdBytes> const& mv) {
+        return
+            MQTT_NS::visit(
+                make_lambda_visitor<bool>(
+                    [](v3_1_1::basic_publish_message<PacketIdBytes> const& m) {
+                        return m.get_qos() == qos::at_most_once;
+                    },
+                    [](v5::basic_publish_message<PacketIdBytes> const& m) {
+                        return
+                            m.get_qos() == qos::at_most_once &&
+                            (m.topic().empty() || !m.topic_alias());
+                    },
+                    [](auto const&) {
+                        return false;
+                    }
+                ),
+                mv
+            );
+    }
+
+    void hold_async_write(std::size_t size) {
+        write_holding_ = true;
+        write_hold_bytes_ = size;
+        auto& tim = write_hold_timer();
+        tim.expires_after(write_coalescing_hold_);
+        tim.async_wait(
+            [this, self = shared_from_this()]
+            (boost::system::error_code const& ec) mutable {
+                if (ec) return;
+                // Move to the socket's strand.
+                socket_->post(
+                    [this, self = force_move(self)]
+                    () {
+                        // Already flushed by the watermark.
+                        if (!write_holding_) return;
+                        write_holding_ = false;
+                        do_async_write();
+                    }
+                );
+            }
+        );
+    }
+
+    // Stop holding the queue on close or error. The held messages are never written,
+    // so they are finished with the error. Call on the socket's strand.
+    void cancel_write_hold(boost::system::error_code const& ec) {
+        if (!write_holding_) return;
+        write_holding_ = false;
+        write_hold_timer().cancel();
+        while (!queue_.empty()) {
+            if (auto const& h = queue_.front().handler()) h(ec);
+            pop_send_queue_front();
+        }
+        check_send_queue_low();
+    }
+
+    as::steady_timer& write_hold_timer() {
+        if (!tim_write_hold_) {
+#if BOOST_VERSION >= 107000
+            tim_write_hold_.emplace(socket_->lowest_layer().get_executor());
+#else  // BOOST_VERSION >= 107000
+            tim_write_hold_.emplace(socket_->lowest_layer().get_executor().context());
+#endif // BOOST_VERSION >= 107000
+        }
+        return *tim_write_hold_;
+    }
+
     static constexpr std::uint16_t make_uint16_t(char b1, char b2) {
         return
             static_cast<std::uint16_t>(
@@ -13426,7 +14673,7 @@ protected:
     bool clean_session_{false};
 
 private:
-    optional<MQTT_NS::socket> socket_;
+    optional<Socket> socket_;
     std::atomic<bool> connected_{false};
     std::atomic<bool> mqtt_connected_{false};
 
@@ -13479,25 +14726,74 @@ private:
     serialize_v5_pubrel_message_handler h_serialize_v5_pubrel_;
     serialize_remove_handler h_serialize_remove_;
     pre_send_handler h_pre_send_;
+    send_queue_high_handler h_send_queue_high_;
+    send_queue_low_handler h_send_queue_low_;
     is_valid_length_handler h_is_valid_length_;
+    receive_buffer_allocator receive_buffer_allocator_;
     Mutex store_mtx_;
-    mi_store store_;
+    inflight_store<packet_id_t, store> store_;
     std::set<packet_id_t> qos2_publish_handled_;
     std::deque<async_packet> queue_;
-    packet_id_t packet_id_master_{0};
-    std::set<packet_id_t> packet_id_;
+    std::size_t queue_bytes_{0};
+    // The front queue_writing_ messages of queue_ are being written,
+    // and the following queue_priority_ messages are in the priority lane.
+    std::size_t queue_writing_{0};
+    std::size_t queue_priority_{0};
+    bool send_priority_lane_{true};
+    std::size_t resend_batch_count_{64};
+    std::size_t send_queue_high_bytes_{0};
+    std::size_t send_queue_low_bytes_{0};
+    std::size_t send_queue_high_count_{0};
+    std::size_t send_queue_low_count_{0};
+    send_queue_policy send_queue_policy_{send_queue_policy::block};
+    std::atomic<bool> send_queue_high_{false}; ///< Written on the socket's strand, and read by async publish functions
+    packet_id_manager<packet_id_t> packet_id_;
     bool auto_pub_response_{true};
     bool auto_pub_response_async_{false};
+    bool auto_topic_alias_send_{false};
+    Mutex topic_alias_send_mtx_;
+    /// Blocking publish message with the topic alias that waits to be written.
+    struct topic_alias_publish {
+        v5::basic_publish_message<PacketIdBytes> message; ///< Message to store
+        any life_keeper;
+        optional<v5::basic_publish_message<PacketIdBytes>> wire_message; ///< Message to write if it differs from message
+    };
+    std::deque<topic_alias_publish> topic_alias_send_queue_; ///< Guarded by topic_alias_send_mtx_
+    bool topic_alias_send_writing_{false}; ///< Whether a thread is writing topic_alias_send_queue_. Guarded by topic_alias_send_mtx_
+    topic_alias_send topic_alias_send_;
+    topic_alias_recv topic_alias_recv_;
+
+    Mutex publish_send_mtx_;
+    std::uint16_t publish_send_max_{0xffff};
+    std::size_t publish_send_count_{0};
+    std::deque<pending_publish> publish_send_queue_;
+    std::size_t publish_send_queue_bytes_{0};
     bool async_send_store_ { false };
     bool disconnect_requested_{false};
     bool connect_requested_{false};
     std::size_t max_queue_send_count_{1};
     std::size_t max_queue_send_size_{0};
+    std::size_t write_coalescing_watermark_{0};
+    std::chrono::microseconds write_coalescing_hold_{std::chrono::microseconds::zero()};
+    std::size_t write_batch_count_{0};
+    bool write_holding_{false};
+    std::size_t write_hold_bytes_{0};
+    optional<as::steady_timer> tim_write_hold_;
+    std::vector<char> write_staging_buf_;
     mqtt_message_processed_handler h_mqtt_message_processed_;
     protocol_version version_{protocol_version::undetermined};
     std::size_t packet_bulk_read_limit_ = 256;
     std::size_t props_bulk_read_limit_ = packet_bulk_read_limit_;
+    std::vector<char> read_ahead_buf_;
+    std::size_t read_ahead_begin_{0};
+    std::size_t read_ahead_end_{0};
     static constexpr std::uint8_t variable_length_continue_flag = 0b10000000;
+#if defined(IOV_MAX)
+    static constexpr std::size_t max_write_buffers = IOV_MAX;
+#else  // defined(IOV_MAX)
+    static constexpr std::size_t max_write_buffers = 1024;
+#endif // defined(IOV_MAX)
+    static constexpr std::size_t max_write_buffers_per_call = 64;
 };
 
 } // namespace MQTT_NS
@@ -0,0 +1,404 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_FILE_STORE_HPP)
+#define MQTT_FILE_STORE_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/system/system_error.hpp>
+
+#if defined(_WIN32)
+#include <io.h>
+#else  // defined(_WIN32)
+#include <unistd.h>
+#endif // defined(_WIN32)
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/packet_id_type.hpp>
+#include <mqtt/protocol_version.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Append-only file store of the serialized publish and pubrel messages.
+ *        Each add and remove is appended to the batch in memory. commit() writes the batch
+ *        and flushes it to the storage device (fsync), so one flush covers many messages.
+ *        The batch is also committed when it reaches commit_bytes.
+ *        Messages that are not committed yet can be lost by a crash.
+ *        When the removed records take more than half of the file, commit() rewrites the file
+ *        with the live records only.
+ *
+ *        Record format: op (1 byte, 'a' add or 'r' remove), packet_id (PacketIdBytes bytes),
+ *        size (4 bytes), and the serialized message (size bytes). Integers are big endian.
+ *        A truncated record at the end of the file (e.g. crash while writing) is ignored.
+ *
+ *        Typical usage:
+ *        @code
+ *        MQTT_NS::file_store fs("session.log");
+ *        auto c = MQTT_NS::make_client(ioc, host, port);
+ *        fs.restore(*c);                 // before connect
+ *        fs.set_serialize_handlers(*c);  // fs should outlive c
+ *        @endcode
+ *        The application calls commit() at the points it needs durability,
+ *        e.g. periodically by a timer.
+ *
+ * @tparam PacketIdBytes packet id bytes of the endpoint
+ */
+template <std::size_t PacketIdBytes>
+class basic_file_store {
+public:
+    using packet_id_t = typename packet_id_type<PacketIdBytes>::type;
+
+    /**
+     * @brief constructor
+     *        The file is created if it doesn't exist.
+     * @param path               file path
+     * @param commit_bytes       the batch is committed when it reaches this size
+     * @param compaction_bytes   the file is not compacted until the removed records take this size
+     */
+    explicit basic_file_store(
+        std::string path,
+        std::size_t commit_bytes = 64 * 1024,
+        std::size_t compaction_bytes = 1024 * 1024)
+        : path_(std::move(path)),
+          commit_bytes_(commit_bytes),
+          compaction_bytes_(compaction_bytes) {
+        open();
+        std::fseek(fp_, 0, SEEK_END);
+        file_bytes_ = static_cast<std::uint64_t>(std::ftell(fp_));
+    }
+
+    ~basic_file_store() {
+        try {
+            commit();
+        }
+        catch (...) {
+        }
+        if (fp_) std::fclose(fp_);
+    }
+
+    basic_file_store(basic_file_store const&) = delete;
+    basic_file_store& operator=(basic_file_store const&) = delete;
+
+    /**
+     * @brief Add the serialized message. The message that has the same packet_id is replaced.
+     * @param packet_id packet identifier of the message
+     * @param data      pointer to the serialized message
+     * @param size      size of the serialized message
+     */
+    void add(packet_id_t packet_id, char const* data, std::size_t size) {
+        std::lock_guard<std::mutex> lck (mtx_);
+        auto it = index_.find(packet_id);
+        if (it != index_.end()) {
+            dead_bytes_ += record_size(it->second.size);
+        }
+        auto offset = append_header('a', packet_id, size);
+        batch_.append(data, size);
+        index_[packet_id] = record { offset, static_cast<std::uint32_t>(size) };
+        if (batch_.size() >= commit_bytes_) commit_impl();
+    }
+
+    /**
+     * @brief Remove the serialized message.
+     * @param packet_id packet identifier of the message
+     */
+    void remove(packet_id_t packet_id) {
+        std::lock_guard<std::mutex> lck (mtx_);
+        auto it = index_.find(packet_id);
+        if (it == index_.end()) return;
+        dead_bytes_ += record_size(it->second.size);
+        index_.erase(it);
+        append_header('r', packet_id, 0);
+        dead_bytes_ += record_size(0);
+        if (batch_.size() >= commit_bytes_) commit_impl();
+    }
+
+    /**
+     * @brief Write the batch and flush the file to the storage device.
+     *        The file is compacted if the removed records take more than half of it.
+     */
+    void commit() {
+        std::lock_guard<std::mutex> lck (mtx_);
+        commit_impl();
+    }
+
+    /**
+     * @brief Rewrite the file with the live records only.
+     */
+    void compact() {
+        std::lock_guard<std::mutex> lck (mtx_);
+        write_batch();
+        compact_impl();
+    }
+
+    /**
+     * @brief Restore the messages in the file to the endpoint.
+     *        Call this function before connect.
+     *        The messages are restored in the order that they were added.
+     * @param ep endpoint
+     */
+    template <typename Endpoint>
+    void restore(Endpoint& ep) {
+        std::lock_guard<std::mutex> lck (mtx_);
+        write_batch();
+
+        // Read the whole file at once, and build the index.
+        std::string data(static_cast<std::size_t>(file_bytes_), '\0');
+        std::fseek(fp_, 0, SEEK_SET);
+        if (!data.empty() && std::fread(&data[0], 1, data.size(), fp_) != data.size()) throw_error("read");
+
+        index_.clear();
+        std::size_t pos = 0;
+        while (data.size() - pos >= header_size) {
+            auto op = data[pos];
+            auto packet_id = static_cast<packet_id_t>(read_uint(data, pos + 1, PacketIdBytes));
+            auto size = static_cast<std::uint32_t>(read_uint(data, pos + 1 + PacketIdBytes, 4));
+            if (data.size() - pos - header_size < size) break; // truncated
+            if (op == 'a') {
+                index_[packet_id] = record { pos + header_size, size };
+            }
+            else {
+                index_.erase(packet_id);
+            }
+            pos += record_size(size);
+        }
+
+        // Restore the live messages in bulk.
+        auto records = sorted_records();
+        std::string messages;
+        for (auto const& e : records) {
+            auto const& r = *std::get<1>(e);
+            messages.append(&data[static_cast<std::size_t>(r.offset)], r.size);
+        }
+        if (ep.get_protocol_version() == protocol_version::v5) {
+            ep.restore_v5_serialized_messages(messages.cbegin(), messages.cend());
+        }
+        else {
+            ep.restore_serialized_messages(messages.cbegin(), messages.cend());
+        }
+
+        // Drop the removed and truncated records.
+        std::size_t live_bytes = 0;
+        for (auto const& e : records) live_bytes += record_size(std::get<1>(e)->size);
+        if (live_bytes != data.size()) {
+            std::string live;
+            live.reserve(live_bytes);
+            for (auto const& e : records) {
+                auto const& r = *std::get<1>(e);
+                append_record(live, std::get<0>(e), &data[static_cast<std::size_t>(r.offset)], r.size);
+            }
+            rewrite(live);
+        }
+    }
+
+    /**
+     * @brief Set the serialize handlers of the endpoint to this store.
+     *        The store should outlive the endpoint.
+     * @param ep endpoint
+     */
+    template <typename Endpoint>
+    void set_serialize_handlers(Endpoint& ep) {
+        auto add_handler =
+            [this](packet_id_t packet_id, char const* data, std::size_t size) {
+                add(packet_id, data, size);
+            };
+        auto remove_handler =
+            [this](packet_id_t packet_id) {
+                remove(packet_id);
+            };
+        ep.set_serialize_handlers(add_handler, add_handler, remove_handler);
+        ep.set_v5_serialize_handlers(add_handler, add_handler, remove_handler);
+    }
+
+    /**
+     * @brief Get the number of the stored messages.
+     * @return the number of the stored messages
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lck (mtx_);
+        return index_.size();
+    }
+
+    /**
+     * @brief Get the file size including the batch that is not committed yet.
+     * @return file size
+     */
+    std::uint64_t file_size() const {
+        std::lock_guard<std::mutex> lck (mtx_);
+        return file_bytes_ + batch_.size();
+    }
+
+private:
+    static constexpr std::size_t const header_size = 1 + PacketIdBytes + 4;
+
+    struct record {
+        std::uint64_t offset; // offset of the serialized message in the file
+        std::uint32_t size;
+    };
+
+    static std::size_t record_size(std::size_t size) {
+        return header_size + size;
+    }
+
+    static std::uint64_t read_uint(std::string const& data, std::size_t pos, std::size_t bytes) {
+        std::uint64_t v = 0;
+        for (std::size_t i = 0; i != bytes; ++i) {
+            v = (v << 8) | static_cast<std::uint8_t>(data[pos + i]);
+        }
+        return v;
+    }
+
+    static void append_uint(std::string& out, std::uint64_t v, std::size_t bytes) {
+        for (std::size_t i = bytes; i != 0; --i) {
+            out.push_back(static_cast<char>((v >> ((i - 1) * 8)) & 0xff));
+        }
+    }
+
+    static void append_record(std::string& out, packet_id_t packet_id, char const* data, std::size_t size) {
+        out.push_back('a');
+        append_uint(out, packet_id, PacketIdBytes);
+        append_uint(out, size, 4);
+        out.append(data, size);
+    }
+
+    // Return the offset of the message in the file.
+    std::uint64_t append_header(char op, packet_id_t packet_id, std::size_t size) {
+        batch_.push_back(op);
+        append_uint(batch_, packet_id, PacketIdBytes);
+        append_uint(batch_, size, 4);
+        return file_bytes_ + batch_.size();
+    }
+
+    // The live records in the order of the file.
+    std::vector<std::tuple<packet_id_t, record const*>> sorted_records() const {
+        std::vector<std::tuple<packet_id_t, record const*>> ret;
+        ret.reserve(index_.size());
+        for (auto const& e : index_) ret.emplace_back(e.first, &e.second);
+        std::sort(
+            ret.begin(),
+            ret.end(),
+            [](auto const& lhs, auto const& rhs) {
+                return std::get<1>(lhs)->offset < std::get<1>(rhs)->offset;
+            }
+        );
+        return ret;
+    }
+
+    void commit_impl() {
+        write_batch();
+        if (dead_bytes_ >= compaction_bytes_ && dead_bytes_ * 2 > file_bytes_) {
+            compact_impl();
+        }
+    }
+
+    void compact_impl() {
+        std::string live;
+        live.reserve(static_cast<std::size_t>(file_bytes_ - dead_bytes_));
+        std::vector<char> buf;
+        for (auto const& e : sorted_records()) {
+            auto const& r = *std::get<1>(e);
+            buf.resize(r.size);
+            std::fseek(fp_, static_cast<long>(r.offset), SEEK_SET);
+            if (r.size != 0 && std::fread(buf.data(), 1, r.size, fp_) != r.size) throw_error("read");
+            append_record(live, std::get<0>(e), buf.data(), r.size);
+        }
+        rewrite(live);
+    }
+
+    void write_batch() {
+        if (batch_.empty()) return;
+        std::fseek(fp_, 0, SEEK_END);
+        if (std::fwrite(batch_.data(), 1, batch_.size(), fp_) != batch_.size()) throw_error("write");
+        sync();
+        file_bytes_ += batch_.size();
+        batch_.clear();
+    }
+
+    // Replace the file with the live records, and update the index.
+    void rewrite(std::string const& live) {
+        auto tmp_path = path_ + ".tmp";
+        auto fp = std::fopen(tmp_path.c_str(), "wb");
+        if (!fp) throw_error("open");
+        bool ok = std::fwrite(live.data(), 1, live.size(), fp) == live.size();
+        ok = ok && std::fflush(fp) == 0;
+#if defined(_WIN32)
+        ok = ok && ::_commit(::_fileno(fp)) == 0;
+#else  // defined(_WIN32)
+        ok = ok && ::fsync(::fileno(fp)) == 0;
+#endif // defined(_WIN32)
+        std::fclose(fp);
+        if (!ok) throw_error("write");
+
+        std::fclose(fp_);
+        fp_ = nullptr;
+#if defined(_WIN32)
+        std::remove(path_.c_str());
+#endif // defined(_WIN32)
+        if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) throw_error("rename");
+        open();
+
+        // Records are written in the order of the offset.
+        std::uint64_t offset = 0;
+        for (auto const& e : sorted_records()) {
+            auto& r = index_[std::get<0>(e)];
+            r.offset = offset + header_size;
+            offset += record_size(r.size);
+        }
+        file_bytes_ = live.size();
+        dead_bytes_ = 0;
+    }
+
+    // Open for read and write. The file is created if it doesn't exist.
+    void open() {
+        if (auto fp = std::fopen(path_.c_str(), "ab")) {
+            std::fclose(fp);
+        }
+        fp_ = std::fopen(path_.c_str(), "rb+");
+        if (!fp_) throw_error("open");
+    }
+
+    void sync() {
+        if (std::fflush(fp_) != 0) throw_error("flush");
+#if defined(_WIN32)
+        if (::_commit(::_fileno(fp_)) != 0) throw_error("commit");
+#else  // defined(_WIN32)
+        if (::fsync(::fileno(fp_)) != 0) throw_error("fsync");
+#endif // defined(_WIN32)
+    }
+
+    [[noreturn]] void throw_error(char const* what) const {
+        throw boost::system::system_error(
+            boost::system::error_code(errno, boost::system::generic_category()),
+            std::string(what) + " " + path_
+        );
+    }
+
+    std::string path_;
+    std::size_t commit_bytes_;
+    std::size_t compaction_bytes_;
+    mutable std::mutex mtx_;
+    std::FILE* fp_ = nullptr;
+    std::string batch_;
+    std::uint64_t file_bytes_ = 0;
+    std::uint64_t dead_bytes_ = 0;
+    std::unordered_map<packet_id_t, record> index_;
+};
+
+using file_store = basic_file_store<2>;
+
+} // namespace MQTT_NS
+
+#endif // MQTT_FILE_STORE_HPP
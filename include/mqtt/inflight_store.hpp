@@ -0,0 +1,244 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_INFLIGHT_STORE_HPP)
+#define MQTT_INFLIGHT_STORE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Store of in-flight messages keyed by packet id.
+ *        The values are held in a contiguous node vector that is linked in insertion order,
+ *        and the packet id index is an open addressing hash table.
+ *        Insert, find, and erase are O(1) and no node is allocated per message.
+ *        Erased nodes are reused by the following insertions.
+ *        Value should have packet_id() member function that returns the key.
+ * @tparam PacketId packet id type
+ * @tparam Value    stored type
+ */
+template <typename PacketId, typename Value>
+class inflight_store {
+    using index_t = std::uint32_t;
+    static constexpr index_t const npos = std::numeric_limits<index_t>::max();
+
+    struct node {
+        optional<Value> value;
+        index_t prev = npos;
+        index_t next = npos;
+    };
+
+    struct slot {
+        PacketId packet_id = 0;
+        index_t index = npos;
+    };
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value const*;
+        using reference = Value const&;
+
+        const_iterator() = default;
+        reference operator*() const { return *(*nodes_)[index_].value; }
+        pointer operator->() const { return &**this; }
+        const_iterator& operator++() {
+            index_ = (*nodes_)[index_].next;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        friend bool operator==(const_iterator const& lhs, const_iterator const& rhs) {
+            return lhs.index_ == rhs.index_;
+        }
+        friend bool operator!=(const_iterator const& lhs, const_iterator const& rhs) {
+            return !(lhs == rhs);
+        }
+
+    private:
+        friend class inflight_store;
+        const_iterator(std::vector<node> const& nodes, index_t index)
+            : nodes_(&nodes), index_(index) {}
+
+        std::vector<node> const* nodes_ = nullptr;
+        index_t index_ = npos;
+    };
+
+    /**
+     * @brief Construct Value(packet_id, args...) at the end of the insertion order.
+     * @return pointer to the value and true if inserted.
+     *         If packet_id is already stored, pointer to the stored value and false.
+     *         The pointer is valid until the next emplace.
+     */
+    template <typename... Args>
+    std::pair<Value*, bool> emplace(PacketId packet_id, Args&&... args) {
+        if (auto v = find(packet_id)) return { v, false };
+        if (slots_.empty()) {
+            rehash(min_slots);
+        }
+        else if ((size_ + 1) * 2 > slots_.size()) {
+            rehash(slots_.size() * 2);
+        }
+        auto index = allocate_node();
+        auto& n = nodes_[index];
+        n.value.emplace(packet_id, std::forward<Args>(args)...);
+        n.prev = tail_;
+        n.next = npos;
+        if (tail_ == npos) {
+            head_ = index;
+        }
+        else {
+            nodes_[tail_].next = index;
+        }
+        tail_ = index;
+        insert_slot(packet_id, index);
+        ++size_;
+        return { &*n.value, true };
+    }
+
+    /**
+     * @brief Find the value of packet_id.
+     * @return pointer to the value. nullptr if packet_id is not stored.
+     */
+    Value* find(PacketId packet_id) {
+        auto pos = find_slot(packet_id);
+        if (pos == npos) return nullptr;
+        return &*nodes_[slots_[pos].index].value;
+    }
+
+    Value const* find(PacketId packet_id) const {
+        return const_cast<inflight_store*>(this)->find(packet_id);
+    }
+
+    /**
+     * @brief Erase the value of packet_id.
+     * @return true if erased, false if packet_id is not stored.
+     */
+    bool erase(PacketId packet_id) {
+        auto pos = find_slot(packet_id);
+        if (pos == npos) return false;
+        auto index = slots_[pos].index;
+        erase_slot(pos);
+        auto& n = nodes_[index];
+        if (n.prev == npos) head_ = n.next; else nodes_[n.prev].next = n.next;
+        if (n.next == npos) tail_ = n.prev; else nodes_[n.next].prev = n.prev;
+        n.value = nullopt;
+        n.prev = npos;
+        n.next = free_;
+        free_ = index;
+        --size_;
+        return true;
+    }
+
+    /**
+     * @brief Erase all the values. The allocated capacity is kept.
+     */
+    void clear() {
+        nodes_.clear();
+        for (auto& s : slots_) s = slot();
+        head_ = tail_ = free_ = npos;
+        size_ = 0;
+    }
+
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /**
+     * @brief Iterate the values in insertion order.
+     *        Updating the value by the pointer that is returned from emplace or find keeps the order.
+     */
+    const_iterator begin() const { return const_iterator(nodes_, head_); }
+    const_iterator end() const { return const_iterator(nodes_, npos); }
+
+private:
+    static constexpr std::size_t const min_slots = 16;
+
+    index_t allocate_node() {
+        if (free_ != npos) {
+            auto index = free_;
+            free_ = nodes_[index].next;
+            return index;
+        }
+        BOOST_ASSERT(nodes_.size() < npos);
+        nodes_.emplace_back();
+        return static_cast<index_t>(nodes_.size() - 1);
+    }
+
+    // Packet ids are allocated sequentially, so the id itself spreads well over the slots.
+    std::size_t home(PacketId packet_id) const {
+        return static_cast<std::size_t>(packet_id) & (slots_.size() - 1);
+    }
+
+    index_t find_slot(PacketId packet_id) const {
+        if (size_ == 0) return npos;
+        auto mask = slots_.size() - 1;
+        for (auto pos = home(packet_id); slots_[pos].index != npos; pos = (pos + 1) & mask) {
+            if (slots_[pos].packet_id == packet_id) return static_cast<index_t>(pos);
+        }
+        return npos;
+    }
+
+    void insert_slot(PacketId packet_id, index_t index) {
+        auto mask = slots_.size() - 1;
+        auto pos = home(packet_id);
+        while (slots_[pos].index != npos) pos = (pos + 1) & mask;
+        slots_[pos].packet_id = packet_id;
+        slots_[pos].index = index;
+    }
+
+    // Backward shift deletion keeps the probe sequences without tombstones.
+    void erase_slot(std::size_t pos) {
+        auto mask = slots_.size() - 1;
+        auto next = pos;
+        while (true) {
+            next = (next + 1) & mask;
+            if (slots_[next].index == npos) break;
+            auto h = home(slots_[next].packet_id);
+            // Move the slot back if its home is not in (pos, next].
+            if ((pos <= next) ? (h <= pos || h > next) : (h <= pos && h > next)) {
+                slots_[pos] = slots_[next];
+                pos = next;
+            }
+        }
+        slots_[pos] = slot();
+    }
+
+    void rehash(std::size_t slots) {
+        slots_.assign(slots, slot());
+        for (auto index = head_; index != npos; index = nodes_[index].next) {
+            insert_slot(nodes_[index].value->packet_id(), index);
+        }
+    }
+
+    std::vector<node> nodes_;
+    std::vector<slot> slots_;
+    index_t head_ = npos;
+    index_t tail_ = npos;
+    index_t free_ = npos;
+    std::size_t size_ = 0;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_INFLIGHT_STORE_HPP
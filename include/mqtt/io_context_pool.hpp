@@ -0,0 +1,146 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_IO_CONTEXT_POOL_HPP)
+#define MQTT_IO_CONTEXT_POOL_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/assert.hpp>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+namespace as = boost::asio;
+
+/**
+ * @brief io_contexts that the server distributes accepted connections over.
+ *
+ * Each io_context is expected to be run by its own thread. All the operations of
+ * a connection are done on the io_context that its socket is created on, so the
+ * connections on different io_contexts are processed in parallel.
+ */
+class io_context_pool {
+public:
+    enum class policy {
+        round_robin,  ///< Select the io_contexts in turn.
+        least_loaded  ///< Select the io_context that has the fewest alive sockets.
+    };
+
+    /**
+     * @brief constructor
+     * @param ioc the only io_context of the pool
+     */
+    explicit io_context_pool(as::io_context& ioc)
+        : io_context_pool(std::vector<std::reference_wrapper<as::io_context>>{ std::ref(ioc) }) {}
+
+    /**
+     * @brief constructor
+     * @param iocs io_contexts of the pool. It must not be empty.
+     * @param p policy to select the io_context for a new connection
+     */
+    explicit io_context_pool(
+        std::vector<std::reference_wrapper<as::io_context>> iocs,
+        policy p = policy::round_robin)
+        : iocs_(force_move(iocs)),
+          policy_(p) {
+        BOOST_ASSERT(!iocs_.empty());
+        loads_.reserve(iocs_.size());
+        for (std::size_t i = 0; i != iocs_.size(); ++i) {
+            loads_.emplace_back(std::make_shared<std::atomic<std::size_t>>(0));
+        }
+    }
+
+    /**
+     * @brief Get the number of io_contexts
+     */
+    std::size_t size() const {
+        return iocs_.size();
+    }
+
+    /**
+     * @brief Get the io_context
+     * @param index index of the io_context
+     * @return io_context
+     */
+    as::io_context& ioc(std::size_t index) const {
+        return iocs_.at(index).get();
+    }
+
+    /**
+     * @brief Get the number of alive sockets that are created by make_socket() on the io_context
+     * @param index index of the io_context
+     * @return number of sockets
+     */
+    std::size_t load(std::size_t index) const {
+        return loads_.at(index)->load();
+    }
+
+    /**
+     * @brief Select the io_context for a new connection according to the policy
+     * @return index of the io_context
+     */
+    std::size_t select() {
+        if (iocs_.size() == 1) return 0;
+        switch (policy_) {
+        case policy::round_robin: {
+            auto index = next_;
+            next_ = (next_ + 1) % iocs_.size();
+            return index;
+        }
+        case policy::least_loaded: {
+            std::size_t index = 0;
+            std::size_t min = loads_[0]->load();
+            for (std::size_t i = 1; i != loads_.size(); ++i) {
+                auto l = loads_[i]->load();
+                if (l < min) {
+                    index = i;
+                    min = l;
+                }
+            }
+            return index;
+        }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Create a socket on the io_context.
+     *        The socket is counted as the load of the io_context until it is destroyed.
+     * @param index index of the io_context
+     * @param args arguments that follow the io_context for the constructor of the Socket
+     * @return socket
+     */
+    template <typename Socket, typename... Args>
+    std::shared_ptr<Socket> make_socket(std::size_t index, Args&&... args) {
+        auto load = loads_.at(index);
+        auto socket = std::make_unique<Socket>(iocs_[index].get(), std::forward<Args>(args)...);
+        ++*load;
+        return std::shared_ptr<Socket>(
+            socket.release(),
+            [load = force_move(load)](Socket* p) {
+                delete p;
+                --*load;
+            }
+        );
+    }
+
+private:
+    std::vector<std::reference_wrapper<as::io_context>> iocs_;
+    std::vector<std::shared_ptr<std::atomic<std::size_t>>> loads_;
+    policy policy_;
+    std::size_t next_ = 0;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_IO_CONTEXT_POOL_HPP
@@ -715,6 +715,17 @@ public:
         publish::set_dup(fixed_header_, dup);
     }
 
+    /**
+     * @brief Set packet id
+     *        If qos is at_most_once, the message has no packet id and nothing happens.
+     * @param packet_id packet id to set
+     */
+    void set_packet_id(typename packet_id_type<PacketIdBytes>::type packet_id) {
+        if (packet_id_.empty()) return;
+        packet_id_.clear();
+        add_packet_id_to_buf<PacketIdBytes>::apply(packet_id_, packet_id);
+    }
+
 private:
     std::uint8_t fixed_header_;
     buffer topic_name_;
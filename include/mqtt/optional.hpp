@@ -25,12 +25,14 @@ namespace MQTT_NS {
 
 using std::optional;
 using std::nullopt_t;
+using std::bad_optional_access;
 static constexpr auto nullopt = std::nullopt;
 
 #else  // defined(MQTT_STD_OPTIONAL)
 
 using boost::optional;
 using nullopt_t = boost::none_t;
+using boost::bad_optional_access;
 static const auto nullopt = boost::none;
 
 #endif // defined(MQTT_STD_OPTIONAL)
@@ -0,0 +1,250 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_PACKET_ID_MANAGER_HPP)
+#define MQTT_PACKET_ID_MANAGER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <limits>
+#include <unordered_set>
+
+#include <boost/assert.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif // defined(_MSC_VER)
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/exception.hpp>
+
+namespace MQTT_NS {
+
+namespace detail {
+
+inline std::size_t count_trailing_zeros(std::uint64_t v) {
+    BOOST_ASSERT(v != 0);
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<std::size_t>(__builtin_ctzll(v));
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return index;
+#else
+    std::size_t n = 0;
+    while ((v & 1) == 0) {
+        v >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+} // namespace detail
+
+/**
+ * @brief Manager of in-use packet ids.
+ *        acquire_unique_id() returns the first free id after the last acquired one,
+ *        wrapping around to 1. 0 is never used.
+ *        This generic version is used for 4 bytes packet ids. The id space is
+ *        much larger than the number of in-flight messages, so the next id is
+ *        almost always free and acquiring costs one hash lookup.
+ */
+template <typename PacketId>
+class packet_id_manager {
+public:
+    /**
+     * @brief Acquire the new unique packet id.
+     *        If all packet ids are already in use, then throw packet_id_exhausted_error exception.
+     * @return packet id
+     */
+    PacketId acquire_unique_id() {
+        if (used_.size() == std::numeric_limits<PacketId>::max()) throw packet_id_exhausted_error();
+        while (true) {
+            if (master_ == std::numeric_limits<PacketId>::max()) {
+                master_ = 1U;
+            }
+            else {
+                ++master_;
+            }
+            if (used_.insert(master_).second) return master_;
+        }
+    }
+
+    /**
+     * @brief Register packet_id as in-use.
+     * @return If packet_id is successfully registerd then return true, otherwise return false.
+     */
+    bool register_id(PacketId packet_id) {
+        if (packet_id == 0) return false;
+        return used_.insert(packet_id).second;
+    }
+
+    /**
+     * @brief Release packet_id.
+     * @return If packet_id is successfully released then return true, otherwise return false.
+     */
+    bool release_id(PacketId packet_id) {
+        return used_.erase(packet_id) != 0;
+    }
+
+    /**
+     * @brief Release all packet ids.
+     */
+    void clear() {
+        used_.clear();
+    }
+
+    /**
+     * @brief Get the number of in-use packet ids
+     */
+    std::size_t size() const {
+        return used_.size();
+    }
+
+private:
+    std::unordered_set<PacketId> used_;
+    PacketId master_{0};
+};
+
+/**
+ * @brief Manager of in-use 2 bytes packet ids.
+ *        In-use ids are kept in a bitmap (8KiB). A second level bitmap records
+ *        which words of the first level are full, so that acquiring skips full
+ *        words 64 at a time. Acquiring is a few word scans even if almost all ids
+ *        are in use, and registering or releasing an id is O(1) without any allocation.
+ */
+template <>
+class packet_id_manager<std::uint16_t> {
+public:
+    packet_id_manager() {
+        clear();
+    }
+
+    /**
+     * @brief Acquire the new unique packet id.
+     *        If all packet ids are already in use, then throw packet_id_exhausted_error exception.
+     * @return packet id
+     */
+    std::uint16_t acquire_unique_id() {
+        if (size_ == std::numeric_limits<std::uint16_t>::max()) throw packet_id_exhausted_error();
+        std::size_t candidate =
+            master_ == std::numeric_limits<std::uint16_t>::max() ? 1U : master_ + 1U;
+        auto found = find_free(candidate, bits);
+        if (found == bits) {
+            // wrap around
+            found = find_free(1, candidate);
+        }
+        BOOST_ASSERT(found != bits);
+        master_ = static_cast<std::uint16_t>(found);
+        set(found);
+        return master_;
+    }
+
+    /**
+     * @brief Register packet_id as in-use.
+     * @return If packet_id is successfully registerd then return true, otherwise return false.
+     */
+    bool register_id(std::uint16_t packet_id) {
+        if (packet_id == 0) return false;
+        if (test(packet_id)) return false;
+        set(packet_id);
+        return true;
+    }
+
+    /**
+     * @brief Release packet_id.
+     * @return If packet_id is successfully released then return true, otherwise return false.
+     */
+    bool release_id(std::uint16_t packet_id) {
+        if (packet_id == 0) return false;
+        if (!test(packet_id)) return false;
+        reset(packet_id);
+        return true;
+    }
+
+    /**
+     * @brief Release all packet ids.
+     */
+    void clear() {
+        used_.fill(0);
+        full_.fill(0);
+        // 0 is not a valid packet id. Keep it occupied.
+        used_[0] = 1;
+        size_ = 0;
+    }
+
+    /**
+     * @brief Get the number of in-use packet ids
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+private:
+    static constexpr std::size_t bits = 0x10000;
+    static constexpr std::size_t word_bits = 64;
+    static constexpr std::size_t words = bits / word_bits;
+    static constexpr std::uint64_t full_word = ~std::uint64_t(0);
+
+    bool test(std::size_t id) const {
+        return (used_[id / word_bits] >> (id % word_bits)) & 1U;
+    }
+
+    void set(std::size_t id) {
+        auto w = id / word_bits;
+        used_[w] |= std::uint64_t(1) << (id % word_bits);
+        if (used_[w] == full_word) {
+            full_[w / word_bits] |= std::uint64_t(1) << (w % word_bits);
+        }
+        ++size_;
+    }
+
+    void reset(std::size_t id) {
+        auto w = id / word_bits;
+        used_[w] &= ~(std::uint64_t(1) << (id % word_bits));
+        full_[w / word_bits] &= ~(std::uint64_t(1) << (w % word_bits));
+        --size_;
+    }
+
+    // Find the first free id in [first, last). Returns bits if not found.
+    std::size_t find_free(std::size_t first, std::size_t last) const {
+        if (first >= last) return bits;
+        auto w = first / word_bits;
+        // The word that contains first. Ignore the ids before first.
+        auto free_bits = ~used_[w] & (full_word << (first % word_bits));
+        if (free_bits != 0) return check_last(w * word_bits + detail::count_trailing_zeros(free_bits), last);
+
+        // Skip full words using the second level bitmap.
+        ++w;
+        auto last_word = (last + word_bits - 1) / word_bits;
+        while (w < last_word) {
+            auto fw = w / word_bits;
+            auto not_full = ~full_[fw] & (full_word << (w % word_bits));
+            if (not_full != 0) {
+                w = fw * word_bits + detail::count_trailing_zeros(not_full);
+                if (w >= last_word) return bits;
+                return check_last(w * word_bits + detail::count_trailing_zeros(~used_[w]), last);
+            }
+            w = (fw + 1) * word_bits;
+        }
+        return bits;
+    }
+
+    static std::size_t check_last(std::size_t found, std::size_t last) {
+        return found < last ? found : bits;
+    }
+
+    std::array<std::uint64_t, words> used_;
+    std::array<std::uint64_t, words / word_bits> full_;
+    std::size_t size_;
+    std::uint16_t master_{0};
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_PACKET_ID_MANAGER_HPP
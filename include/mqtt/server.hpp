@@ -9,7 +9,11 @@
 
 #include <mqtt/variant.hpp> // should be top to configure variant limit
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <boost/asio.hpp>
 
 #include <mqtt/namespace.hpp>
@@ -25,6 +29,7 @@
 #endif // defined(MQTT_USE_WS)
 
 #include <mqtt/endpoint.hpp>
+#include <mqtt/io_context_pool.hpp>
 #include <mqtt/null_strand.hpp>
 #include <mqtt/move.hpp>
 
@@ -32,6 +37,94 @@ namespace MQTT_NS {
 
 namespace as = boost::asio;
 
+namespace detail {
+
+inline as::ip::tcp::acceptor make_reuse_port_acceptor(as::io_context& ioc, as::ip::tcp::endpoint const& ep) {
+    as::ip::tcp::acceptor acceptor(ioc);
+    acceptor.open(ep.protocol());
+    acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+#if defined(SO_REUSEPORT)
+    acceptor.set_option(as::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#else  // defined(SO_REUSEPORT)
+    throw boost::system::system_error(make_error_code(as::error::operation_not_supported));
+#endif // defined(SO_REUSEPORT)
+    acceptor.bind(ep);
+    acceptor.listen();
+    return acceptor;
+}
+
+/**
+ * @brief Get whether the acceptor can continue accepting after the error.
+ *        The error is caused by the connection being accepted, or by a temporary
+ *        shortage of resources such as file descriptors.
+ * @param ec error of the accept
+ * @return true if recoverable
+ */
+inline bool accept_error_recoverable(boost::system::error_code const& ec) {
+    return
+        ec == as::error::connection_aborted ||
+        ec == boost::system::errc::protocol_error ||
+        ec == as::error::no_descriptors ||
+        ec == boost::system::errc::too_many_files_open_in_system ||
+        ec == as::error::no_buffer_space ||
+        ec == as::error::no_memory;
+}
+
+/**
+ * @brief Call the function to accept again after the recoverable error.
+ *        After a shortage of resources, the function is called after a while
+ *        in order not to spin on the error.
+ * @param ioc io_context of the acceptor
+ * @param ec error of the accept
+ * @param f function to accept again
+ */
+template <typename Func>
+inline void retry_accept(as::io_context& ioc, boost::system::error_code const& ec, Func&& f) {
+    if (ec == as::error::connection_aborted || ec == boost::system::errc::protocol_error) {
+        as::post(ioc, std::forward<Func>(f));
+        return;
+    }
+    auto tim = std::make_shared<as::steady_timer>(ioc);
+    tim->expires_after(std::chrono::milliseconds(100));
+    tim->async_wait(
+        [tim, f = std::forward<Func>(f)]
+        (boost::system::error_code const& /*ec*/) mutable {
+            f();
+        }
+    );
+}
+
+/**
+ * @brief Close the acceptors on the threads of their io_contexts.
+ *        An acceptor is closed immediately if this function is called on the thread of its io_context,
+ *        or if the io_context is stopped. Otherwise closing is posted to the io_context.
+ *        Each acceptor is destroyed when its pending accept has completed.
+ * @param acceptors acceptors to close
+ * @param get_ioc function that returns the io_context of the acceptor from its index
+ */
+template <typename GetIoc>
+inline void close_acceptors(std::vector<std::shared_ptr<as::ip::tcp::acceptor>> acceptors, GetIoc&& get_ioc) {
+    for (std::size_t i = 0; i != acceptors.size(); ++i) {
+        auto& ioc = get_ioc(i);
+        auto acceptor = force_move(acceptors[i]);
+        if (ioc.get_executor().running_in_this_thread() || ioc.stopped()) {
+            boost::system::error_code ec;
+            acceptor->close(ec);
+        }
+        else {
+            as::post(
+                ioc,
+                [acceptor] {
+                    boost::system::error_code ec;
+                    acceptor->close(ec);
+                }
+            );
+        }
+    }
+}
+
+} // namespace detail
+
 template <
     typename Strand = as::io_context::strand,
     typename Mutex = std::mutex,
@@ -59,14 +152,32 @@ public:
     server(
         AsioEndpoint&& ep,
         as::io_context& ioc_accept,
-        as::io_context& ioc_con,
+        io_context_pool pool,
         AcceptorConfig&& config)
         : ep_(std::forward<AsioEndpoint>(ep)),
           ioc_accept_(ioc_accept),
-          ioc_con_(ioc_con),
-          acceptor_(as::ip::tcp::acceptor(ioc_accept_, ep_)),
+          pool_(force_move(pool)),
           config_(std::forward<AcceptorConfig>(config)) {
-        config_(acceptor_.value());
+        acceptors_.emplace_back(std::make_shared<as::ip::tcp::acceptor>(ioc_accept_, ep_));
+        config_(*acceptors_.back());
+    }
+
+    template <typename AsioEndpoint>
+    server(
+        AsioEndpoint&& ep,
+        as::io_context& ioc_accept,
+        io_context_pool pool)
+        : server(std::forward<AsioEndpoint>(ep), ioc_accept, force_move(pool), [](as::ip::tcp::acceptor&) {}) {}
+
+    template <typename AsioEndpoint, typename AcceptorConfig>
+    server(
+        AsioEndpoint&& ep,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con,
+        AcceptorConfig&& config)
+        : server(std::forward<AsioEndpoint>(ep), ioc_accept, io_context_pool(ioc_con), std::forward<AcceptorConfig>(config)) {
+        // The accept handler is called on the thread of ioc_accept as before the pool.
+        post_accept_handler_ = false;
     }
 
     template <typename AsioEndpoint>
@@ -92,40 +203,93 @@ public:
     void listen() {
         close_request_ = false;
 
-        if (!acceptor_) {
+        if (acceptors_.empty()) {
             try {
-                acceptor_.emplace(ioc_accept_, ep_);
-                config_(acceptor_.value());
+                if (reuse_port_) {
+                    acceptors_.reserve(pool_.size());
+                    for (std::size_t i = 0; i != pool_.size(); ++i) {
+                        acceptors_.emplace_back(
+                            std::make_shared<as::ip::tcp::acceptor>(detail::make_reuse_port_acceptor(pool_.ioc(i), ep_))
+                        );
+                        config_(*acceptors_.back());
+                    }
+                }
+                else {
+                    acceptors_.emplace_back(std::make_shared<as::ip::tcp::acceptor>(ioc_accept_, ep_));
+                    config_(*acceptors_.back());
+                }
             }
             catch (boost::system::system_error const& e) {
+                acceptors_.clear();
                 as::post(
                     ioc_accept_,
                     [this, ec = e.code()] {
-                        if (h_error_) h_error_(ec);
+                        call_error_handler(ec);
                     }
                 );
                 return;
             }
         }
-        do_accept();
+        for (std::size_t i = 0; i != acceptors_.size(); ++i) {
+            do_accept(i, acceptors_[i]);
+        }
     }
 
-    unsigned short port() const { return acceptor_.value().local_endpoint().port(); }
+    /**
+     * @brief Get the port that the server listens on
+     * @return port
+     * @throw bad_optional_access if the server is not listening
+     */
+    unsigned short port() const {
+        if (acceptors_.empty()) throw bad_optional_access();
+        return acceptors_.front()->local_endpoint().port();
+    }
 
+    /**
+     * @brief Stop accepting
+     *        In reuse port mode, it can be called on any thread. Each acceptor is closed
+     *        on the thread of its io_context. The server must outlive the threads
+     *        that run the io_contexts.
+     *        Otherwise it should be called on the thread of ioc_accept.
+     */
     void close() {
         close_request_ = true;
-        acceptor_.reset();
+        close_acceptors();
+    }
+
+    /**
+     * @brief Set whether each io_context of the pool has its own acceptor
+     * @param val If true, listen() opens one acceptor with SO_REUSEPORT per io_context of the pool,
+     *            and the kernel balances incoming connections over them. A connection is accepted
+     *            on the io_context that it is processed on, and ioc_accept is not used.
+     *            If false, the acceptor on ioc_accept accepts all connections and distributes them
+     *            according to the policy of the pool.
+     *            Initial value is false. It should be set before listen().
+     */
+    void set_reuse_port_acceptors(bool val) {
+        if (reuse_port_ == val) return;
+        reuse_port_ = val;
+        // The acceptors are not accepting yet.
+        for (auto& acceptor : acceptors_) {
+            boost::system::error_code ec;
+            acceptor->close(ec);
+        }
+        acceptors_.clear();
     }
 
     void set_accept_handler(accept_handler h = accept_handler()) {
+        std::lock_guard<std::mutex> g(mtx_handlers_);
         h_accept_ = force_move(h);
     }
 
     /**
      * @brief Set error handler
+     *        Errors of accept that the acceptor recovers from, such as running out of file
+     *        descriptors, are also reported. Accepting continues after them.
      * @param h handler
      */
     void set_error_handler(error_handler h = error_handler()) {
+        std::lock_guard<std::mutex> g(mtx_handlers_);
         h_error_ = force_move(h);
     }
 
@@ -141,21 +305,89 @@ public:
     }
 
 private:
-    void do_accept() {
+    void close_acceptors() {
+        if (reuse_port_) {
+            detail::close_acceptors(
+                force_move(acceptors_),
+                [this](std::size_t i) -> as::io_context& {
+                    return pool_.ioc(i);
+                }
+            );
+        }
+        else {
+            for (auto& acceptor : acceptors_) {
+                boost::system::error_code ec;
+                acceptor->close(ec);
+            }
+        }
+        acceptors_.clear();
+    }
+
+    void call_accept_handler(endpoint_t& ep) {
+        accept_handler h;
+        {
+            std::lock_guard<std::mutex> g(mtx_handlers_);
+            h = h_accept_;
+        }
+        if (h) h(ep);
+    }
+
+    void call_error_handler(boost::system::error_code const& ec) {
+        error_handler h;
+        {
+            std::lock_guard<std::mutex> g(mtx_handlers_);
+            h = h_error_;
+        }
+        if (h) h(ec);
+    }
+
+    // The acceptor is captured by the handlers, so it is destroyed after its pending accept has completed.
+    void handle_accept_error(
+        std::size_t acceptor_index,
+        std::shared_ptr<as::ip::tcp::acceptor> acceptor,
+        boost::system::error_code const& ec) {
+        call_error_handler(ec);
         if (close_request_) return;
-        auto socket = std::make_shared<socket_t>(ioc_con_);
-        acceptor_.value().async_accept(
+        if (detail::accept_error_recoverable(ec)) {
+            detail::retry_accept(
+                reuse_port_ ? pool_.ioc(acceptor_index) : ioc_accept_,
+                ec,
+                [this, acceptor_index, acceptor] {
+                    do_accept(acceptor_index, acceptor);
+                }
+            );
+            return;
+        }
+        // The acceptors of reuse port are released by close() on the thread of the caller.
+        if (!reuse_port_ && !acceptors_.empty() && acceptors_.front() == acceptor) acceptors_.clear();
+    }
+
+    void do_accept(std::size_t acceptor_index, std::shared_ptr<as::ip::tcp::acceptor> acceptor) {
+        if (close_request_ || !acceptor->is_open()) return;
+        auto index = reuse_port_ ? acceptor_index : pool_.select();
+        auto socket = pool_.make_socket<socket_t>(index);
+        acceptor->async_accept(
             socket->lowest_layer(),
-            [this, socket]
+            [this, socket, acceptor_index, acceptor, index]
             (boost::system::error_code const& ec) mutable {
                 if (ec) {
-                    acceptor_.reset();
-                    if (h_error_) h_error_(ec);
+                    handle_accept_error(acceptor_index, force_move(acceptor), ec);
                     return;
                 }
                 auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
-                if (h_accept_) h_accept_(*sp);
-                do_accept();
+                if (reuse_port_ || !post_accept_handler_ || &pool_.ioc(index) == &ioc_accept_) {
+                    call_accept_handler(*sp);
+                }
+                else {
+                    // Call the handler on the io_context that the endpoint runs on.
+                    as::post(
+                        pool_.ioc(index),
+                        [this, sp] {
+                            call_accept_handler(*sp);
+                        }
+                    );
+                }
+                do_accept(acceptor_index, force_move(acceptor));
             }
         );
     }
@@ -163,10 +395,13 @@ private:
 private:
     as::ip::tcp::endpoint ep_;
     as::io_context& ioc_accept_;
-    as::io_context& ioc_con_;
-    optional<as::ip::tcp::acceptor> acceptor_;
+    io_context_pool pool_;
+    std::vector<std::shared_ptr<as::ip::tcp::acceptor>> acceptors_;
+    bool reuse_port_{false};
+    bool post_accept_handler_{true}; ///< Whether the accept handler is called on the io_context of the endpoint
     std::function<void(as::ip::tcp::acceptor&)> config_;
-    bool close_request_{false};
+    std::atomic<bool> close_request_{false};
+    std::mutex mtx_handlers_; ///< Guards h_accept_ and h_error_
     accept_handler h_accept_;
     error_handler h_error_;
     protocol_version version_ = protocol_version::undetermined;
@@ -202,17 +437,34 @@ public:
         AsioEndpoint&& ep,
         as::ssl::context&& ctx,
         as::io_context& ioc_accept,
-        as::io_context& ioc_con,
+        io_context_pool pool,
         AcceptorConfig&& config)
         : ep_(std::forward<AsioEndpoint>(ep)),
           ioc_accept_(ioc_accept),
-          ioc_con_(ioc_con),
-          acceptor_(as::ip::tcp::acceptor(ioc_accept_, ep_)),
+          pool_(force_move(pool)),
           config_(std::forward<AcceptorConfig>(config)),
           ctx_(force_move(ctx)) {
-        config_(acceptor_.value());
+        acceptors_.emplace_back(std::make_shared<as::ip::tcp::acceptor>(ioc_accept_, ep_));
+        config_(*acceptors_.back());
     }
 
+    template <typename AsioEndpoint>
+    server_tls(
+        AsioEndpoint&& ep,
+        as::ssl::context&& ctx,
+        as::io_context& ioc_accept,
+        io_context_pool pool)
+        : server_tls(std::forward<AsioEndpoint>(ep), force_move(ctx), ioc_accept, force_move(pool), [](as::ip::tcp::acceptor&) {}) {}
+
+    template <typename AsioEndpoint, typename AcceptorConfig>
+    server_tls(
+        AsioEndpoint&& ep,
+        as::ssl::context&& ctx,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con,
+        AcceptorConfig&& config)
+        : server_tls(std::forward<AsioEndpoint>(ep), force_move(ctx), ioc_accept, io_context_pool(ioc_con), std::forward<AcceptorConfig>(config)) {}
+
     template <typename AsioEndpoint>
     server_tls(
         AsioEndpoint&& ep,
@@ -239,40 +491,93 @@ public:
     void listen() {
         close_request_ = false;
 
-        if (!acceptor_) {
+        if (acceptors_.empty()) {
             try {
-                acceptor_.emplace(ioc_accept_, ep_);
-                config_(acceptor_.value());
+                if (reuse_port_) {
+                    acceptors_.reserve(pool_.size());
+                    for (std::size_t i = 0; i != pool_.size(); ++i) {
+                        acceptors_.emplace_back(
+                            std::make_shared<as::ip::tcp::acceptor>(detail::make_reuse_port_acceptor(pool_.ioc(i), ep_))
+                        );
+                        config_(*acceptors_.back());
+                    }
+                }
+                else {
+                    acceptors_.emplace_back(std::make_shared<as::ip::tcp::acceptor>(ioc_accept_, ep_));
+                    config_(*acceptors_.back());
+                }
             }
             catch (boost::system::system_error const& e) {
+                acceptors_.clear();
                 as::post(
                     ioc_accept_,
                     [this, ec = e.code()] {
-                        if (h_error_) h_error_(ec);
+                        call_error_handler(ec);
                     }
                 );
                 return;
             }
         }
-        do_accept();
+        for (std::size_t i = 0; i != acceptors_.size(); ++i) {
+            do_accept(i, acceptors_[i]);
+        }
     }
 
-    unsigned short port() const { return acceptor_.value().local_endpoint().port(); }
+    /**
+     * @brief Get the port that the server listens on
+     * @return port
+     * @throw bad_optional_access if the server is not listening
+     */
+    unsigned short port() const {
+        if (acceptors_.empty()) throw bad_optional_access();
+        return acceptors_.front()->local_endpoint().port();
+    }
 
+    /**
+     * @brief Stop accepting
+     *        In reuse port mode, it can be called on any thread. Each acceptor is closed
+     *        on the thread of its io_context. The server must outlive the threads
+     *        that run the io_contexts.
+     *        Otherwise it should be called on the thread of ioc_accept.
+     */
     void close() {
         close_request_ = true;
-        acceptor_.reset();
+        close_acceptors();
+    }
+
+    /**
+     * @brief Set whether each io_context of the pool has its own acceptor
+     * @param val If true, listen() opens one acceptor with SO_REUSEPORT per io_context of the pool,
+     *            and the kernel balances incoming connections over them. A connection is accepted
+     *            on the io_context that it is processed on, and ioc_accept is not used.
+     *            If false, the acceptor on ioc_accept accepts all connections and distributes them
+     *            according to the policy of the pool.
+     *            Initial value is false. It should be set before listen().
+     */
+    void set_reuse_port_acceptors(bool val) {
+        if (reuse_port_ == val) return;
+        reuse_port_ = val;
+        // The acceptors are not accepting yet.
+        for (auto& acceptor : acceptors_) {
+            boost::system::error_code ec;
+            acceptor->close(ec);
+        }
+        acceptors_.clear();
     }
 
     void set_accept_handler(accept_handler h = accept_handler()) {
+        std::lock_guard<std::mutex> g(mtx_handlers_);
         h_accept_ = force_move(h);
     }
 
     /**
      * @brief Set error handler
+     *        Errors of accept that the acceptor recovers from, such as running out of file
+     *        descriptors, are also reported. Accepting continues after them.
      * @param h handler
      */
     void set_error_handler(error_handler h = error_handler()) {
+        std::lock_guard<std::mutex> g(mtx_handlers_);
         h_error_ = force_move(h);
     }
 
@@ -300,21 +605,78 @@ public:
     }
 
 private:
-    void do_accept() {
+    void close_acceptors() {
+        if (reuse_port_) {
+            detail::close_acceptors(
+                force_move(acceptors_),
+                [this](std::size_t i) -> as::io_context& {
+                    return pool_.ioc(i);
+                }
+            );
+        }
+        else {
+            for (auto& acceptor : acceptors_) {
+                boost::system::error_code ec;
+                acceptor->close(ec);
+            }
+        }
+        acceptors_.clear();
+    }
+
+    void call_accept_handler(endpoint_t& ep) {
+        accept_handler h;
+        {
+            std::lock_guard<std::mutex> g(mtx_handlers_);
+            h = h_accept_;
+        }
+        if (h) h(ep);
+    }
+
+    void call_error_handler(boost::system::error_code const& ec) {
+        error_handler h;
+        {
+            std::lock_guard<std::mutex> g(mtx_handlers_);
+            h = h_error_;
+        }
+        if (h) h(ec);
+    }
+
+    // The acceptor is captured by the handlers, so it is destroyed after its pending accept has completed.
+    void handle_accept_error(
+        std::size_t acceptor_index,
+        std::shared_ptr<as::ip::tcp::acceptor> acceptor,
+        boost::system::error_code const& ec) {
+        call_error_handler(ec);
         if (close_request_) return;
-        auto socket = std::make_shared<socket_t>(ioc_con_, ctx_);
+        if (detail::accept_error_recoverable(ec)) {
+            detail::retry_accept(
+                reuse_port_ ? pool_.ioc(acceptor_index) : ioc_accept_,
+                ec,
+                [this, acceptor_index, acceptor] {
+                    do_accept(acceptor_index, acceptor);
+                }
+            );
+            return;
+        }
+        // The acceptors of reuse port are released by close() on the thread of the caller.
+        if (!reuse_port_ && !acceptors_.empty() && acceptors_.front() == acceptor) acceptors_.clear();
+    }
+
+    void do_accept(std::size_t acceptor_index, std::shared_ptr<as::ip::tcp::acceptor> acceptor) {
+        if (close_request_ || !acceptor->is_open()) return;
+        auto index = reuse_port_ ? acceptor_index : pool_.select();
+        auto socket = pool_.make_socket<socket_t>(index, ctx_);
         auto ps = socket.get();
-        acceptor_.value().async_accept(
+        acceptor->async_accept(
             ps->lowest_layer(),
-            [this, socket = force_move(socket)]
+            [this, socket = force_move(socket), acceptor_index, acceptor, index]
             (boost::system::error_code const& ec) mutable {
                 if (ec) {
-                    acceptor_.reset();
-                    if (h_error_) h_error_(ec);
+                    handle_accept_error(acceptor_index, force_move(acceptor), ec);
                     return;
                 }
                 auto underlying_finished = std::make_shared<bool>(false);
-                auto tim = std::make_shared<as::deadline_timer>(ioc_con_);
+                auto tim = std::make_shared<as::deadline_timer>(pool_.ioc(index));
                 tim->expires_from_now(underlying_connect_timeout_);
                 tim->async_wait(
                     [socket, tim, underlying_finished]
@@ -336,10 +698,10 @@ private:
                             return;
                         }
                         auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
-                        if (h_accept_) h_accept_(*sp);
+                        call_accept_handler(*sp);
                     }
                 );
-                do_accept();
+                do_accept(acceptor_index, force_move(acceptor));
             }
         );
     }
@@ -347,10 +709,12 @@ private:
 private:
     as::ip::tcp::endpoint ep_;
     as::io_context& ioc_accept_;
-    as::io_context& ioc_con_;
-    optional<as::ip::tcp::acceptor> acceptor_;
+    io_context_pool pool_;
+    std::vector<std::shared_ptr<as::ip::tcp::acceptor>> acceptors_;
+    bool reuse_port_{false};
     std::function<void(as::ip::tcp::acceptor&)> config_;
-    bool close_request_{false};
+    std::atomic<bool> close_request_{false};
+    std::mutex mtx_handlers_; ///< Guards h_accept_ and h_error_
     accept_handler h_accept_;
     error_handler h_error_;
     as::ssl::context ctx_;
@@ -404,16 +768,31 @@ public:
     server_ws(
         AsioEndpoint&& ep,
         as::io_context& ioc_accept,
-        as::io_context& ioc_con,
+        io_context_pool pool,
         AcceptorConfig&& config)
         : ep_(std::forward<AsioEndpoint>(ep)),
           ioc_accept_(ioc_accept),
-          ioc_con_(ioc_con),
-          acceptor_(as::ip::tcp::acceptor(ioc_accept_, ep_)),
+          pool_(force_move(pool)),
           config_(std::forward<AcceptorConfig>(config)) {
-        config_(acceptor_.value());
+        acceptors_.emplace_back(std::make_shared<as::ip::tcp::acceptor>(ioc_accept_, ep_));
+        config_(*acceptors_.back());
     }
 
+    template <typename AsioEndpoint>
+    server_ws(
+        AsioEndpoint&& ep,
+        as::io_context& ioc_accept,
+        io_context_pool pool)
+        : server_ws(std::forward<AsioEndpoint>(ep), ioc_accept, force_move(pool), [](as::ip::tcp::acceptor&) {}) {}
+
+    template <typename AsioEndpoint, typename AcceptorConfig>
+    server_ws(
+        AsioEndpoint&& ep,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con,
+        AcceptorConfig&& config)
+        : server_ws(std::forward<AsioEndpoint>(ep), ioc_accept, io_context_pool(ioc_con), std::forward<AcceptorConfig>(config)) {}
+
     template <typename AsioEndpoint>
     server_ws(
         AsioEndpoint&& ep,
@@ -437,40 +816,93 @@ public:
     void listen() {
         close_request_ = false;
 
-        if (!acceptor_) {
+        if (acceptors_.empty()) {
             try {
-                acceptor_.emplace(ioc_accept_, ep_);
-                config_(acceptor_.value());
+                if (reuse_port_) {
+                    acceptors_.reserve(pool_.size());
+                    for (std::size_t i = 0; i != pool_.size(); ++i) {
+                        acceptors_.emplace_back(
+                            std::make_shared<as::ip::tcp::acceptor>(detail::make_reuse_port_acceptor(pool_.ioc(i), ep_))
+                        );
+                        config_(*acceptors_.back());
+                    }
+                }
+                else {
+                    acceptors_.emplace_back(std::make_shared<as::ip::tcp::acceptor>(ioc_accept_, ep_));
+                    config_(*acceptors_.back());
+                }
             }
             catch (boost::system::system_error const& e) {
+                acceptors_.clear();
                 as::post(
                     ioc_accept_,
                     [this, ec = e.code()] {
-                        if (h_error_) h_error_(ec);
+                        call_error_handler(ec);
                     }
                 );
                 return;
             }
         }
-        do_accept();
+        for (std::size_t i = 0; i != acceptors_.size(); ++i) {
+            do_accept(i, acceptors_[i]);
+        }
     }
 
-    unsigned short port() const { return acceptor_.value().local_endpoint().port(); }
+    /**
+     * @brief Get the port that the server listens on
+     * @return port
+     * @throw bad_optional_access if the server is not listening
+     */
+    unsigned short port() const {
+        if (acceptors_.empty()) throw bad_optional_access();
+        return acceptors_.front()->local_endpoint().port();
+    }
 
+    /**
+     * @brief Stop accepting
+     *        In reuse port mode, it can be called on any thread. Each acceptor is closed
+     *        on the thread of its io_context. The server must outlive the threads
+     *        that run the io_contexts.
+     *        Otherwise it should be called on the thread of ioc_accept.
+     */
     void close() {
         close_request_ = true;
-        acceptor_.reset();
+        close_acceptors();
+    }
+
+    /**
+     * @brief Set whether each io_context of the pool has its own acceptor
+     * @param val If true, listen() opens one acceptor with SO_REUSEPORT per io_context of the pool,
+     *            and the kernel balances incoming connections over them. A connection is accepted
+     *            on the io_context that it is processed on, and ioc_accept is not used.
+     *            If false, the acceptor on ioc_accept accepts all connections and distributes them
+     *            according to the policy of the pool.
+     *            Initial value is false. It should be set before listen().
+     */
+    void set_reuse_port_acceptors(bool val) {
+        if (reuse_port_ == val) return;
+        reuse_port_ = val;
+        // The acceptors are not accepting yet.
+        for (auto& acceptor : acceptors_) {
+            boost::system::error_code ec;
+            acceptor->close(ec);
+        }
+        acceptors_.clear();
     }
 
     void set_accept_handler(accept_handler h = accept_handler()) {
+        std::lock_guard<std::mutex> g(mtx_handlers_);
         h_accept_ = force_move(h);
     }
 
     /**
      * @brief Set error handler
+     *        Errors of accept that the acceptor recovers from, such as running out of file
+     *        descriptors, are also reported. Accepting continues after them.
      * @param h handler
      */
     void set_error_handler(error_handler h = error_handler()) {
+        std::lock_guard<std::mutex> g(mtx_handlers_);
         h_error_ = force_move(h);
     }
 
@@ -498,21 +930,78 @@ public:
     }
 
 private:
-    void do_accept() {
+    void close_acceptors() {
+        if (reuse_port_) {
+            detail::close_acceptors(
+                force_move(acceptors_),
+                [this](std::size_t i) -> as::io_context& {
+                    return pool_.ioc(i);
+                }
+            );
+        }
+        else {
+            for (auto& acceptor : acceptors_) {
+                boost::system::error_code ec;
+                acceptor->close(ec);
+            }
+        }
+        acceptors_.clear();
+    }
+
+    void call_accept_handler(endpoint_t& ep) {
+        accept_handler h;
+        {
+            std::lock_guard<std::mutex> g(mtx_handlers_);
+            h = h_accept_;
+        }
+        if (h) h(ep);
+    }
+
+    void call_error_handler(boost::system::error_code const& ec) {
+        error_handler h;
+        {
+            std::lock_guard<std::mutex> g(mtx_handlers_);
+            h = h_error_;
+        }
+        if (h) h(ec);
+    }
+
+    // The acceptor is captured by the handlers, so it is destroyed after its pending accept has completed.
+    void handle_accept_error(
+        std::size_t acceptor_index,
+        std::shared_ptr<as::ip::tcp::acceptor> acceptor,
+        boost::system::error_code const& ec) {
+        call_error_handler(ec);
         if (close_request_) return;
-        auto socket = std::make_shared<socket_t>(ioc_con_);
+        if (detail::accept_error_recoverable(ec)) {
+            detail::retry_accept(
+                reuse_port_ ? pool_.ioc(acceptor_index) : ioc_accept_,
+                ec,
+                [this, acceptor_index, acceptor] {
+                    do_accept(acceptor_index, acceptor);
+                }
+            );
+            return;
+        }
+        // The acceptors of reuse port are released by close() on the thread of the caller.
+        if (!reuse_port_ && !acceptors_.empty() && acceptors_.front() == acceptor) acceptors_.clear();
+    }
+
+    void do_accept(std::size_t acceptor_index, std::shared_ptr<as::ip::tcp::acceptor> acceptor) {
+        if (close_request_ || !acceptor->is_open()) return;
+        auto index = reuse_port_ ? acceptor_index : pool_.select();
+        auto socket = pool_.make_socket<socket_t>(index);
         auto ps = socket.get();
-        acceptor_.value().async_accept(
+        acceptor->async_accept(
             ps->next_layer(),
-            [this, socket = force_move(socket)]
+            [this, socket = force_move(socket), acceptor_index, acceptor, index]
             (boost::system::error_code const& ec) mutable {
                 if (ec) {
-                    acceptor_.reset();
-                    if (h_error_) h_error_(ec);
+                    handle_accept_error(acceptor_index, force_move(acceptor), ec);
                     return;
                 }
                 auto underlying_finished = std::make_shared<bool>(false);
-                auto tim = std::make_shared<as::deadline_timer>(ioc_con_);
+                auto tim = std::make_shared<as::deadline_timer>(pool_.ioc(index));
                 tim->expires_from_now(underlying_connect_timeout_);
                 tim->async_wait(
                     [socket, tim, underlying_finished]
@@ -561,12 +1050,12 @@ private:
                                     return;
                                 }
                                 auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
-                                if (h_accept_) h_accept_(*sp);
+                                call_accept_handler(*sp);
                             }
                         );
                     }
                 );
-                do_accept();
+                do_accept(acceptor_index, force_move(acceptor));
             }
         );
     }
@@ -574,10 +1063,12 @@ private:
 private:
     as::ip::tcp::endpoint ep_;
     as::io_context& ioc_accept_;
-    as::io_context& ioc_con_;
-    optional<as::ip::tcp::acceptor> acceptor_;
+    io_context_pool pool_;
+    std::vector<std::shared_ptr<as::ip::tcp::acceptor>> acceptors_;
+    bool reuse_port_{false};
     std::function<void(as::ip::tcp::acceptor&)> config_;
-    bool close_request_{false};
+    std::atomic<bool> close_request_{false};
+    std::mutex mtx_handlers_; ///< Guards h_accept_ and h_error_
     accept_handler h_accept_;
     error_handler h_error_;
     protocol_version version_ = protocol_version::undetermined;
@@ -615,17 +1106,34 @@ public:
         AsioEndpoint&& ep,
         as::ssl::context&& ctx,
         as::io_context& ioc_accept,
-        as::io_context& ioc_con,
+        io_context_pool pool,
         AcceptorConfig&& config)
         : ep_(std::forward<AsioEndpoint>(ep)),
           ioc_accept_(ioc_accept),
-          ioc_con_(ioc_con),
-          acceptor_(as::ip::tcp::acceptor(ioc_accept_, ep_)),
+          pool_(force_move(pool)),
           config_(std::forward<AcceptorConfig>(config)),
           ctx_(force_move(ctx)) {
-        config_(acceptor_.value());
+        acceptors_.emplace_back(std::make_shared<as::ip::tcp::acceptor>(ioc_accept_, ep_));
+        config_(*acceptors_.back());
     }
 
+    template <typename AsioEndpoint>
+    server_tls_ws(
+        AsioEndpoint&& ep,
+        as::ssl::context&& ctx,
+        as::io_context& ioc_accept,
+        io_context_pool pool)
+        : server_tls_ws(std::forward<AsioEndpoint>(ep), force_move(ctx), ioc_accept, force_move(pool), [](as::ip::tcp::acceptor&) {}) {}
+
+    template <typename AsioEndpoint, typename AcceptorConfig>
+    server_tls_ws(
+        AsioEndpoint&& ep,
+        as::ssl::context&& ctx,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con,
+        AcceptorConfig&& config)
+        : server_tls_ws(std::forward<AsioEndpoint>(ep), force_move(ctx), ioc_accept, io_context_pool(ioc_con), std::forward<AcceptorConfig>(config)) {}
+
     template <typename AsioEndpoint>
     server_tls_ws(
         AsioEndpoint&& ep,
@@ -652,40 +1160,93 @@ public:
     void listen() {
         close_request_ = false;
 
-        if (!acceptor_) {
+        if (acceptors_.empty()) {
             try {
-                acceptor_.emplace(ioc_accept_, ep_);
-                config_(acceptor_.value());
+                if (reuse_port_) {
+                    acceptors_.reserve(pool_.size());
+                    for (std::size_t i = 0; i != pool_.size(); ++i) {
+                        acceptors_.emplace_back(
+                            std::make_shared<as::ip::tcp::acceptor>(detail::make_reuse_port_acceptor(pool_.ioc(i), ep_))
+                        );
+                        config_(*acceptors_.back());
+                    }
+                }
+                else {
+                    acceptors_.emplace_back(std::make_shared<as::ip::tcp::acceptor>(ioc_accept_, ep_));
+                    config_(*acceptors_.back());
+                }
             }
             catch (boost::system::system_error const& e) {
+                acceptors_.clear();
                 as::post(
                     ioc_accept_,
                     [this, ec = e.code()] {
-                        if (h_error_) h_error_(ec);
+                        call_error_handler(ec);
                     }
                 );
                 return;
             }
         }
-        do_accept();
+        for (std::size_t i = 0; i != acceptors_.size(); ++i) {
+            do_accept(i, acceptors_[i]);
+        }
     }
 
-    unsigned short port() const { return acceptor_.value().local_endpoint().port(); }
+    /**
+     * @brief Get the port that the server listens on
+     * @return port
+     * @throw bad_optional_access if the server is not listening
+     */
+    unsigned short port() const {
+        if (acceptors_.empty()) throw bad_optional_access();
+        return acceptors_.front()->local_endpoint().port();
+    }
 
+    /**
+     * @brief Stop accepting
+     *        In reuse port mode, it can be called on any thread. Each acceptor is closed
+     *        on the thread of its io_context. The server must outlive the threads
+     *        that run the io_contexts.
+     *        Otherwise it should be called on the thread of ioc_accept.
+     */
     void close() {
         close_request_ = true;
-        acceptor_.reset();
+        close_acceptors();
+    }
+
+    /**
+     * @brief Set whether each io_context of the pool has its own acceptor
+     * @param val If true, listen() opens one acceptor with SO_REUSEPORT per io_context of the pool,
+     *            and the kernel balances incoming connections over them. A connection is accepted
+     *            on the io_context that it is processed on, and ioc_accept is not used.
+     *            If false, the acceptor on ioc_accept accepts all connections and distributes them
+     *            according to the policy of the pool.
+     *            Initial value is false. It should be set before listen().
+     */
+    void set_reuse_port_acceptors(bool val) {
+        if (reuse_port_ == val) return;
+        reuse_port_ = val;
+        // The acceptors are not accepting yet.
+        for (auto& acceptor : acceptors_) {
+            boost::system::error_code ec;
+            acceptor->close(ec);
+        }
+        acceptors_.clear();
     }
 
     void set_accept_handler(accept_handler h = accept_handler()) {
+        std::lock_guard<std::mutex> g(mtx_handlers_);
         h_accept_ = force_move(h);
     }
 
     /**
      * @brief Set error handler
+     *        Errors of accept that the acceptor recovers from, such as running out of file
+     *        descriptors, are also reported. Accepting continues after them.
      * @param h handler
      */
     void set_error_handler(error_handler h = error_handler()) {
+        std::lock_guard<std::mutex> g(mtx_handlers_);
         h_error_ = force_move(h);
     }
 
@@ -713,20 +1274,77 @@ public:
     }
 
 private:
-    void do_accept() {
+    void close_acceptors() {
+        if (reuse_port_) {
+            detail::close_acceptors(
+                force_move(acceptors_),
+                [this](std::size_t i) -> as::io_context& {
+                    return pool_.ioc(i);
+                }
+            );
+        }
+        else {
+            for (auto& acceptor : acceptors_) {
+                boost::system::error_code ec;
+                acceptor->close(ec);
+            }
+        }
+        acceptors_.clear();
+    }
+
+    void call_accept_handler(endpoint_t& ep) {
+        accept_handler h;
+        {
+            std::lock_guard<std::mutex> g(mtx_handlers_);
+            h = h_accept_;
+        }
+        if (h) h(ep);
+    }
+
+    void call_error_handler(boost::system::error_code const& ec) {
+        error_handler h;
+        {
+            std::lock_guard<std::mutex> g(mtx_handlers_);
+            h = h_error_;
+        }
+        if (h) h(ec);
+    }
+
+    // The acceptor is captured by the handlers, so it is destroyed after its pending accept has completed.
+    void handle_accept_error(
+        std::size_t acceptor_index,
+        std::shared_ptr<as::ip::tcp::acceptor> acceptor,
+        boost::system::error_code const& ec) {
+        call_error_handler(ec);
         if (close_request_) return;
-        auto socket = std::make_shared<socket_t>(ioc_con_, ctx_);
-        acceptor_.value().async_accept(
+        if (detail::accept_error_recoverable(ec)) {
+            detail::retry_accept(
+                reuse_port_ ? pool_.ioc(acceptor_index) : ioc_accept_,
+                ec,
+                [this, acceptor_index, acceptor] {
+                    do_accept(acceptor_index, acceptor);
+                }
+            );
+            return;
+        }
+        // The acceptors of reuse port are released by close() on the thread of the caller.
+        if (!reuse_port_ && !acceptors_.empty() && acceptors_.front() == acceptor) acceptors_.clear();
+    }
+
+    void do_accept(std::size_t acceptor_index, std::shared_ptr<as::ip::tcp::acceptor> acceptor) {
+        if (close_request_ || !acceptor->is_open()) return;
+        auto index = reuse_port_ ? acceptor_index : pool_.select();
+        auto socket = pool_.make_socket<socket_t>(index, ctx_);
+        acceptor->async_accept(
             socket->next_layer().next_layer(),
-            [this, socket]
-            (boost::system::error_code const& ec) {
+            [this, socket, acceptor_index, acceptor, index]
+            (boost::system::error_code const& ec) mutable {
                 if (ec) {
-                    acceptor_.reset();
-                    if (h_error_) h_error_(ec);
+                    handle_accept_error(acceptor_index, force_move(acceptor), ec);
                     return;
                 }
                 auto underlying_finished = std::make_shared<bool>(false);
-                auto tim = std::make_shared<as::deadline_timer>(ioc_con_);
+                auto tim = std::make_shared<as::deadline_timer>(pool_.ioc(index));
                 tim->expires_from_now(underlying_connect_timeout_);
                 tim->async_wait(
                     [socket, tim, underlying_finished]
@@ -784,14 +1402,14 @@ private:
                                         // a static assertion that socket is a const object when
                                         // TLS is enabled, and WS is enabled, with Boost 1.70, and gcc 8.3.0
                                         auto sp = std::make_shared<endpoint_t>(socket, version_);
-                                        if (h_accept_) h_accept_(*sp);
+                                        call_accept_handler(*sp);
                                     }
                                 );
                             }
                         );
                     }
                 );
-                do_accept();
+                do_accept(acceptor_index, force_move(acceptor));
             }
         );
     }
@@ -799,10 +1417,12 @@ private:
 private:
     as::ip::tcp::endpoint ep_;
     as::io_context& ioc_accept_;
-    as::io_context& ioc_con_;
-    optional<as::ip::tcp::acceptor> acceptor_;
+    io_context_pool pool_;
+    std::vector<std::shared_ptr<as::ip::tcp::acceptor>> acceptors_;
+    bool reuse_port_{false};
     std::function<void(as::ip::tcp::acceptor&)> config_;
-    bool close_request_{false};
+    std::atomic<bool> close_request_{false};
+    std::mutex mtx_handlers_; ///< Guards h_accept_ and h_error_
     accept_handler h_accept_;
     error_handler h_error_;
     as::ssl::context ctx_;
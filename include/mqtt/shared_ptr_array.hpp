@@ -32,6 +32,18 @@ using shared_ptr_array = std::shared_ptr<char []>;
  */
 inline shared_ptr_array make_shared_ptr_array(std::size_t size);
 
+/**
+ * @brief shared_ptr_array creating function with the allocator.
+ * The array elements are not initialized.
+ * - If MQTT_STD_SHARED_PTR_ARRAY is defined,
+ *   - and if your compiler setting is C++20 or later, then `std::allocate_shared<char[]>(alloc, size)` is used.
+ *   - otherwise the array and the control block are allocated separately by alloc.
+ * - If MQTT_STD_SHARED_PTR_ARRAY is not defined (default), then `boost::allocate_shared_noinit<char[]>(alloc, size)` is used.
+ *      - It can allocate an array of characters and the control block in a single allocation.
+ */
+template <typename Alloc>
+inline shared_ptr_array allocate_shared_ptr_array(Alloc const& alloc, std::size_t size);
+
 #else  // defined(_DOXYGEN_)
 
 #include <mqtt/namespace.hpp>
@@ -52,12 +64,37 @@ inline shared_ptr_array make_shared_ptr_array(std::size_t size) {
 #endif // __cplusplus > 201703L
 }
 
+template <typename Alloc>
+inline shared_ptr_array allocate_shared_ptr_array(Alloc const& alloc, std::size_t size) {
+#if __cplusplus > 201703L // C++20 date is not determined yet
+    return std::allocate_shared<char[]>(alloc, size);
+#else  // __cplusplus > 201703L
+    using char_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<char>;
+    char_alloc_t char_alloc(alloc);
+    auto p = std::allocator_traits<char_alloc_t>::allocate(char_alloc, size);
+    try {
+        return std::shared_ptr<char[]>(
+            p,
+            [char_alloc, size](char* p) mutable {
+                std::allocator_traits<char_alloc_t>::deallocate(char_alloc, p, size);
+            },
+            char_alloc
+        );
+    }
+    catch (...) {
+        std::allocator_traits<char_alloc_t>::deallocate(char_alloc, p, size);
+        throw;
+    }
+#endif // __cplusplus > 201703L
+}
+
 } // namespace MQTT_NS
 
 #else  // MQTT_STD_SHARED_PTR_ARRAY
 
 #include <boost/shared_ptr.hpp>
 #include <boost/smart_ptr/make_shared.hpp>
+#include <boost/smart_ptr/allocate_shared_array.hpp>
 
 namespace MQTT_NS {
 
@@ -67,6 +104,11 @@ inline shared_ptr_array make_shared_ptr_array(std::size_t size) {
     return boost::make_shared<char[]>(size);
 }
 
+template <typename Alloc>
+inline shared_ptr_array allocate_shared_ptr_array(Alloc const& alloc, std::size_t size) {
+    return boost::allocate_shared_noinit<char[]>(alloc, size);
+}
+
 } // namespace MQTT_NS
 
 #endif // MQTT_STD_SHARED_PTR_ARRAY
@@ -0,0 +1,102 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_STATIC_SOCKET_HPP)
+#define MQTT_STATIC_SOCKET_HPP
+
+#include <memory>
+#include <type_traits>
+
+#include <boost/system/error_code.hpp>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief shared_ptr based socket that is not type erased
+ *
+ * static_socket provides the same interface as MQTT_NS::socket, so it can be
+ * the Socket template argument of the class template endpoint.
+ * e.g. endpoint<std::mutex, std::lock_guard, 2, static_socket<tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>>>
+ *
+ * MQTT_NS::socket converts each completion handler to std::function and each
+ * buffer sequence to std::vector, and calls the underlying socket through
+ * boost::type_erasure. static_socket forwards them to the underlying socket
+ * as they are, so the calls can be inlined and the handlers keep their types.
+ * The cost is one instantiation of endpoint per socket type.
+ *
+ * @tparam Socket underlying socket such as tcp_endpoint or ws_endpoint
+ */
+template <typename Socket>
+class static_socket {
+public:
+    using socket_type = Socket;
+
+    /**
+     * @brief constructor
+     * @param socket shared_ptr of the underlying socket. Pointer of U should be convertible to pointer of Socket.
+     */
+    template <
+        typename U,
+        typename std::enable_if_t<std::is_convertible<U*, Socket*>::value>* = nullptr
+    >
+    static_socket(std::shared_ptr<U> socket)
+        : socket_(force_move(socket)) {}
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read(MutableBufferSequence&& buffers, ReadHandler&& handler) {
+        socket_->async_read(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+    }
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(MutableBufferSequence&& buffers, ReadHandler&& handler) {
+        socket_->async_read_some(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write(ConstBufferSequence&& buffers, WriteHandler&& handler) {
+        socket_->async_write(std::forward<ConstBufferSequence>(buffers), std::forward<WriteHandler>(handler));
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write(ConstBufferSequence&& buffers, boost::system::error_code& ec) {
+        return socket_->write(std::forward<ConstBufferSequence>(buffers), ec);
+    }
+
+    template <typename PostHandler>
+    void post(PostHandler&& handler) {
+        socket_->post(std::forward<PostHandler>(handler));
+    }
+
+    decltype(auto) lowest_layer() {
+        return socket_->lowest_layer();
+    }
+
+    void close(boost::system::error_code& ec) {
+        socket_->close(ec);
+    }
+
+    /**
+     * @brief Get the underlying socket
+     * @return reference of the underlying socket
+     */
+    Socket& get() {
+        return *socket_;
+    }
+
+    Socket const& get() const {
+        return *socket_;
+    }
+
+private:
+    std::shared_ptr<Socket> socket_;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_STATIC_SOCKET_HPP
@@ -76,6 +76,19 @@ public:
         );
     }
 
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(
+        MutableBufferSequence && buffers,
+        ReadHandler&& handler) {
+        tcp_.async_read_some(
+            std::forward<MutableBufferSequence>(buffers),
+            as::bind_executor(
+                strand_,
+                std::forward<ReadHandler>(handler)
+            )
+        );
+    }
+
     template <typename... Args>
     std::size_t write(Args&& ... args) {
         return as::write(tcp_, std::forward<Args>(args)...);
@@ -0,0 +1,78 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TOPIC_ALIAS_RECV_HPP)
+#define MQTT_TOPIC_ALIAS_RECV_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/buffer.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Topic aliases that the endpoint receives.
+ *        The topic names are held as shared buffers, so resolving an alias doesn't copy the topic name.
+ *        See https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901113<BR>
+ *        3.3.2.3.4 Topic Alias
+ */
+class topic_alias_recv {
+public:
+    /**
+     * @brief constructor
+     * @param max topic_alias_maximum that the endpoint sent. 0 means topic aliases are not accepted.
+     */
+    explicit topic_alias_recv(std::uint16_t max = 0)
+        : topics_(max) {}
+
+    /**
+     * @brief Map the topic to the alias. The previous topic of the alias is replaced.
+     * @param alias topic alias. It should be 1 to max().
+     * @param topic topic name
+     * @return true if the alias is valid, otherwise false
+     */
+    bool insert_or_update(std::uint16_t alias, buffer topic) {
+        if (alias == 0 || alias > max()) return false;
+        topics_[alias - 1] = force_move(topic);
+        return true;
+    }
+
+    /**
+     * @brief Find the topic of the alias.
+     * @param alias topic alias
+     * @return topic name. nullopt if the alias is not mapped.
+     */
+    optional<buffer> find(std::uint16_t alias) const {
+        if (alias == 0 || alias > max()) return nullopt;
+        auto const& topic = topics_[alias - 1];
+        if (topic.empty()) return nullopt;
+        return topic;
+    }
+
+    /**
+     * @brief Clear all the aliases and set the maximum. It should be called for each new connection.
+     * @param max topic_alias_maximum that the endpoint sent
+     */
+    void reset(std::uint16_t max) {
+        topics_.clear();
+        topics_.resize(max);
+    }
+
+    std::uint16_t max() const {
+        return static_cast<std::uint16_t>(topics_.size());
+    }
+
+private:
+    std::vector<buffer> topics_;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_TOPIC_ALIAS_RECV_HPP
@@ -0,0 +1,130 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TOPIC_ALIAS_SEND_HPP)
+#define MQTT_TOPIC_ALIAS_SEND_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/member.hpp>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/string_view.hpp>
+
+namespace MQTT_NS {
+
+namespace mi = boost::multi_index;
+
+/**
+ * @brief Topic aliases that the endpoint sends.
+ *        A topic is mapped to an alias when it is published for the first time.
+ *        When all the aliases up to the maximum are used, the alias of the least
+ *        recently published topic is reassigned.
+ *        See https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901113<BR>
+ *        3.3.2.3.4 Topic Alias
+ */
+class topic_alias_send {
+public:
+    /**
+     * @brief constructor
+     * @param max topic_alias_maximum of the peer. 0 means the peer doesn't accept topic aliases.
+     */
+    explicit topic_alias_send(std::uint16_t max = 0)
+        : max_(max) {}
+
+    /**
+     * @brief Find the alias of the topic. If not found, assign a new alias.
+     * @param topic topic name to publish
+     * @return pair of the alias and whether the topic is newly mapped.
+     *         If it is newly mapped, the topic name needs to be sent with the alias,
+     *         otherwise the empty topic name can be sent with the alias.
+     *         nullopt if no alias can be used.
+     */
+    optional<std::pair<std::uint16_t, bool>> find_or_assign(string_view topic) {
+        if (max_ == 0 || topic.empty()) return nullopt;
+
+        auto& idx_topic = aliases_.get<tag_topic>();
+        auto& idx_seq = aliases_.get<tag_seq>();
+        auto it = idx_topic.find(topic, topic_less());
+        if (it != idx_topic.end()) {
+            idx_seq.relocate(idx_seq.begin(), aliases_.project<tag_seq>(it));
+            return std::make_pair(it->alias, false);
+        }
+
+        std::uint16_t alias;
+        if (aliases_.size() < max_) {
+            alias = static_cast<std::uint16_t>(aliases_.size() + 1);
+        }
+        else {
+            alias = idx_seq.back().alias;
+            idx_seq.pop_back();
+        }
+        idx_seq.push_front(entry { std::string(topic.data(), topic.size()), alias });
+        return std::make_pair(alias, true);
+    }
+
+    /**
+     * @brief Clear all the aliases and set the maximum. It should be called for each new connection.
+     * @param max topic_alias_maximum of the peer
+     */
+    void reset(std::uint16_t max) {
+        max_ = max;
+        aliases_.clear();
+    }
+
+    std::uint16_t max() const {
+        return max_;
+    }
+
+    std::size_t size() const {
+        return aliases_.size();
+    }
+
+private:
+    struct entry {
+        std::string topic;
+        std::uint16_t alias;
+    };
+
+    struct topic_less {
+        bool operator()(std::string const& lhs, string_view rhs) const {
+            return string_view(lhs) < rhs;
+        }
+        bool operator()(string_view lhs, std::string const& rhs) const {
+            return lhs < string_view(rhs);
+        }
+    };
+
+    struct tag_seq {};
+    struct tag_topic {};
+
+    // The front is the most recently used one.
+    using mi_alias = mi::multi_index_container<
+        entry,
+        mi::indexed_by<
+            mi::sequenced<
+                mi::tag<tag_seq>
+            >,
+            mi::ordered_unique<
+                mi::tag<tag_topic>,
+                mi::member<entry, std::string, &entry::topic>
+            >
+        >
+    >;
+
+    std::uint16_t max_;
+    mi_alias aliases_;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_TOPIC_ALIAS_SEND_HPP
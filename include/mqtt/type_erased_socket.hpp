@@ -23,6 +23,7 @@ namespace MQTT_NS {
 
 // New style boost type_erasure member fucntion concept definition
 BOOST_TYPE_ERASURE_MEMBER(has_async_read, async_read)
+BOOST_TYPE_ERASURE_MEMBER(has_async_read_some, async_read_some)
 BOOST_TYPE_ERASURE_MEMBER(has_async_write, async_write)
 BOOST_TYPE_ERASURE_MEMBER(has_write, write)
 BOOST_TYPE_ERASURE_MEMBER(has_post, post)
@@ -35,6 +36,7 @@ BOOST_TYPE_ERASURE_MEMBER(has_close, close)
 
 // Old style boost type_erasure member fucntion concept definition
 BOOST_TYPE_ERASURE_MEMBER((mqtt)(has_async_read), async_read, 3)
+BOOST_TYPE_ERASURE_MEMBER((mqtt)(has_async_read_some), async_read_some, 3)
 BOOST_TYPE_ERASURE_MEMBER((mqtt)(has_async_write), async_write, 3)
 BOOST_TYPE_ERASURE_MEMBER((mqtt)(has_write), write, 2)
 BOOST_TYPE_ERASURE_MEMBER((mqtt)(has_post), post, 1)
@@ -61,6 +63,7 @@ using socket = shared_any<
     mpl::vector<
         destructible<>,
         has_async_read<void(as::mutable_buffer, std::function<void(boost::system::error_code const&, std::size_t)>)>,
+        has_async_read_some<void(as::mutable_buffer, std::function<void(boost::system::error_code const&, std::size_t)>)>,
         has_async_write<void(std::vector<as::const_buffer>, std::function<void(boost::system::error_code const&, std::size_t)>)>,
         has_write<std::size_t(std::vector<as::const_buffer>, boost::system::error_code&)>,
         has_post<void(std::function<void()>)>,
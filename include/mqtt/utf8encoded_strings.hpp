@@ -7,6 +7,27 @@
 #if !defined(MQTT_UTF8ENCODED_STRINGS_HPP)
 #define MQTT_UTF8ENCODED_STRINGS_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// SSE2 is always available on x86-64. AVX2 is detected at runtime.
+// Define MQTT_NO_UTF8_VALIDATE_SIMD to use the scalar validator only.
+#if !defined(MQTT_NO_UTF8_VALIDATE_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MQTT_UTF8_VALIDATE_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif // defined(_MSC_VER)
+#endif // SSE2
+#if defined(MQTT_UTF8_VALIDATE_SSE2) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define MQTT_UTF8_VALIDATE_AVX2
+#include <immintrin.h>
+#endif // AVX2
+#endif // !defined(MQTT_NO_UTF8_VALIDATE_SIMD)
+
 #include <mqtt/namespace.hpp>
 #include <mqtt/string_view.hpp>
 
@@ -43,103 +64,409 @@ is_valid_length(string_view str) {
     return str.size() <= 0xffff;
 }
 
-inline validation
-validate_contents(string_view str) {
-    // This code is based on https://www.cl.cam.ac.uk/~mgk25/ucs/utf8_check.c
-    auto result = validation::well_formed;
-#if defined(MQTT_USE_STR_CHECK)
-    auto it = str.begin();
-    auto end = str.end();
+namespace detail {
 
-    while (it != end) {
-        if (static_cast<unsigned char>(*(it + 0)) < 0b1000'0000) {
-            // 0xxxxxxxxx
-            if (static_cast<unsigned char>(*(it + 0)) == 0x00) {
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 0)) >= 0x01 &&
-                 static_cast<unsigned char>(*(it + 0)) <= 0x1f) ||
-                static_cast<unsigned char>(*(it + 0)) == 0x7f) {
-                result = validation::well_formed_with_non_charactor;
-            }
-            ++it;
+/**
+ * @brief Validate one character that starts at it, and advance it to the next character.
+ *        If the character is a control character or a non-character, result is set to
+ *        well_formed_with_non_charactor.
+ * @return false if the character is ill formed or null character.
+ */
+inline bool
+validate_char(char const*& it, char const* end, validation& result) {
+    // This code is based on https://www.cl.cam.ac.uk/~mgk25/ucs/utf8_check.c
+    if (static_cast<unsigned char>(*(it + 0)) < 0b1000'0000) {
+        // 0xxxxxxxxx
+        if (static_cast<unsigned char>(*(it + 0)) == 0x00) {
+            return false;
+        }
+        if ((static_cast<unsigned char>(*(it + 0)) >= 0x01 &&
+             static_cast<unsigned char>(*(it + 0)) <= 0x1f) ||
+            static_cast<unsigned char>(*(it + 0)) == 0x7f) {
+            result = validation::well_formed_with_non_charactor;
+        }
+        ++it;
+    }
+    else if ((static_cast<unsigned char>(*(it + 0)) & 0b1110'0000) == 0b1100'0000) {
+        // 110XXXXx 10xxxxxx
+        if (it + 1 >= end) {
+            return false;
+        }
+        if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 0)) & 0b1111'1110) == 0b1100'0000) { // overlong
+            return false;
+        }
+        if (static_cast<unsigned char>(*(it + 0)) == 0b1100'0010 &&
+            static_cast<unsigned char>(*(it + 1)) >= 0b1000'0000 &&
+            static_cast<unsigned char>(*(it + 1)) <= 0b1001'1111) {
+            result = validation::well_formed_with_non_charactor;
+        }
+        it += 2;
+    }
+    else if ((static_cast<unsigned char>(*(it + 0)) & 0b1111'0000) == 0b1110'0000) {
+        // 1110XXXX 10Xxxxxx 10xxxxxx
+        if (it + 2 >= end) {
+            return false;
+        }
+        if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 2)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 0)) == 0b1110'0000 &&
+             (static_cast<unsigned char>(*(it + 1)) & 0b1110'0000) == 0b1000'0000) || // overlong?
+            (static_cast<unsigned char>(*(it + 0)) == 0b1110'1101 &&
+             (static_cast<unsigned char>(*(it + 1)) & 0b1110'0000) == 0b1010'0000)) { // surrogate?
+            return false;
         }
-        else if ((static_cast<unsigned char>(*(it + 0)) & 0b1110'0000) == 0b1100'0000) {
-            // 110XXXXx 10xxxxxx
-            if (it + 1 >= end) {
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 0)) & 0b1111'1110) == 0b1100'0000) { // overlong
-                result = validation::ill_formed;
-                break;
-            }
-            if (static_cast<unsigned char>(*(it + 0)) == 0b1100'0010 &&
-                static_cast<unsigned char>(*(it + 1)) >= 0b1000'0000 &&
-                static_cast<unsigned char>(*(it + 1)) <= 0b1001'1111) {
-                result = validation::well_formed_with_non_charactor;
-            }
-            it += 2;
+        if (static_cast<unsigned char>(*(it + 0)) == 0b1110'1111 &&
+            static_cast<unsigned char>(*(it + 1)) == 0b1011'1111 &&
+            (static_cast<unsigned char>(*(it + 2)) & 0b1111'1110) == 0b1011'1110) {
+            // U+FFFE or U+FFFF?
+            result = validation::well_formed_with_non_charactor;
         }
-        else if ((static_cast<unsigned char>(*(it + 0)) & 0b1111'0000) == 0b1110'0000) {
-            // 1110XXXX 10Xxxxxx 10xxxxxx
-            if (it + 2 >= end) {
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 2)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 0)) == 0b1110'0000 &&
-                 (static_cast<unsigned char>(*(it + 1)) & 0b1110'0000) == 0b1000'0000) || // overlong?
-                (static_cast<unsigned char>(*(it + 0)) == 0b1110'1101 &&
-                 (static_cast<unsigned char>(*(it + 1)) & 0b1110'0000) == 0b1010'0000)) { // surrogate?
-                result = validation::ill_formed;
-                break;
-            }
-            if (static_cast<unsigned char>(*(it + 0)) == 0b1110'1111 &&
-                static_cast<unsigned char>(*(it + 1)) == 0b1011'1111 &&
-                (static_cast<unsigned char>(*(it + 2)) & 0b1111'1110) == 0b1011'1110) {
-                // U+FFFE or U+FFFF?
-                result = validation::well_formed_with_non_charactor;
-            }
-            it += 3;
+        it += 3;
+    }
+    else if ((static_cast<unsigned char>(*(it + 0)) & 0b1111'1000) == 0b1111'0000) {
+        // 11110XXX 10XXxxxx 10xxxxxx 10xxxxxx
+        if (it + 3 >= end) {
+            return false;
+        }
+        if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 2)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 3)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 0)) == 0b1111'0000 &&
+             (static_cast<unsigned char>(*(it + 1)) & 0b1111'0000) == 0b1000'0000) ||    // overlong?
+            (static_cast<unsigned char>(*(it + 0)) == 0b1111'0100 &&
+             static_cast<unsigned char>(*(it + 1)) > 0b1000'1111) ||
+            static_cast<unsigned char>(*(it + 0)) > 0b1111'0100) { // > U+10FFFF?
+            return false;
+        }
+        if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'1111) == 0b1000'1111 &&
+            static_cast<unsigned char>(*(it + 2)) == 0b1011'1111 &&
+            (static_cast<unsigned char>(*(it + 3)) & 0b1111'1110) == 0b1011'1110) {
+            // U+nFFFE or U+nFFFF?
+            result = validation::well_formed_with_non_charactor;
+        }
+        it += 4;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+inline validation
+validate_contents_scalar(string_view str) {
+    auto result = validation::well_formed;
+    auto it = str.data();
+    auto end = it + str.size();
+    while (it != end) {
+        if (!validate_char(it, end, result)) return validation::ill_formed;
+    }
+    return result;
+}
+
+#if defined(MQTT_UTF8_VALIDATE_SSE2)
+
+inline std::size_t
+count_trailing_zeros(std::uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<std::size_t>(__builtin_ctz(v));
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return index;
+#endif
+}
+
+/**
+ * @brief Validate the characters in [it, it + first_non_ascii] and the non ASCII characters
+ *        that follow them one by one.
+ *        It is used when a block contains non ASCII characters.
+ * @return false if any character is ill formed or null character.
+ */
+inline bool
+validate_non_ascii_run(char const*& it, char const* end, std::size_t first_non_ascii, validation& result) {
+    auto stop = it + first_non_ascii + 1;
+    while (it != end && (it < stop || static_cast<unsigned char>(*it) >= 0b1000'0000)) {
+        if (!validate_char(it, end, result)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Validate 16 bytes at once while they are ASCII characters.
+ *        Null characters and control characters are detected by comparing the whole block.
+ *        Blocks that contain non ASCII characters are validated by validate_char().
+ */
+inline validation
+validate_contents_sse2(string_view str) {
+    auto result = validation::well_formed;
+    auto it = str.data();
+    auto end = it + str.size();
+    auto const zero = _mm_setzero_si128();
+    auto const space = _mm_set1_epi8(0x20);
+    auto const del = _mm_set1_epi8(0x7f);
+    while (end - it >= 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(it));
+        auto non_ascii = static_cast<std::uint32_t>(_mm_movemask_epi8(v));
+        if (non_ascii == 0) {
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0) return validation::ill_formed;
+            // All bytes are less than 0x80, so the signed comparison works.
+            auto control = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+            if (_mm_movemask_epi8(control) != 0) result = validation::well_formed_with_non_charactor;
+            it += 16;
+            continue;
         }
-        else if ((static_cast<unsigned char>(*(it + 0)) & 0b1111'1000) == 0b1111'0000) {
-            // 11110XXX 10XXxxxx 10xxxxxx 10xxxxxx
-            if (it + 3 >= end) {
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 2)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 3)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 0)) == 0b1111'0000 &&
-                 (static_cast<unsigned char>(*(it + 1)) & 0b1111'0000) == 0b1000'0000) ||    // overlong?
-                (static_cast<unsigned char>(*(it + 0)) == 0b1111'0100 &&
-                 static_cast<unsigned char>(*(it + 1)) > 0b1000'1111) ||
-                static_cast<unsigned char>(*(it + 0)) > 0b1111'0100) { // > U+10FFFF?
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'1111) == 0b1000'1111 &&
-                static_cast<unsigned char>(*(it + 2)) == 0b1011'1111 &&
-                (static_cast<unsigned char>(*(it + 3)) & 0b1111'1110) == 0b1011'1110) {
-                // U+nFFFE or U+nFFFF?
-                result = validation::well_formed_with_non_charactor;
-            }
-            it += 4;
+        if (!validate_non_ascii_run(it, end, count_trailing_zeros(non_ascii), result)) {
+            return validation::ill_formed;
         }
-        else {
-            result = validation::ill_formed;
-            break;
+    }
+    while (it != end) {
+        if (!validate_char(it, end, result)) return validation::ill_formed;
+    }
+    return result;
+}
+
+#endif // defined(MQTT_UTF8_VALIDATE_SSE2)
+
+#if defined(MQTT_UTF8_VALIDATE_AVX2)
+
+// Error bits of the lookup tables of validate_contents_avx2().
+// See "Validating UTF-8 In Less Than One Instruction Per Byte" by John Keiser and Daniel Lemire.
+constexpr std::uint8_t utf8_too_short      = 1 << 0; // lead byte not followed by a continuation
+constexpr std::uint8_t utf8_too_long       = 1 << 1; // continuation after ASCII
+constexpr std::uint8_t utf8_overlong_3     = 1 << 2; // 1110'0000 100x'xxxx
+constexpr std::uint8_t utf8_too_large      = 1 << 3; // 1111'0100 1001'xxxx or 1111'0100 101x'xxxx
+constexpr std::uint8_t utf8_surrogate      = 1 << 4; // 1110'1101 101x'xxxx
+constexpr std::uint8_t utf8_overlong_2     = 1 << 5; // 1100'000x 10xx'xxxx
+constexpr std::uint8_t utf8_too_large_1000 = 1 << 6; // 1111'0101..1111'1111 1000'xxxx
+constexpr std::uint8_t utf8_overlong_4     = 1 << 6; // 1111'0000 1000'xxxx
+constexpr std::uint8_t utf8_two_conts      = 1 << 7; // continuation after continuation
+constexpr std::uint8_t utf8_carry          = utf8_too_short | utf8_too_long | utf8_two_conts;
+
+/**
+ * @brief Validate 32 bytes at once including non ASCII characters.
+ *        The first byte of each pair of adjacent bytes is looked up by its high and low nibbles,
+ *        and the second byte by its high nibble. The AND of the three results is non zero
+ *        if the pair is ill formed. The third and fourth bytes of three and four bytes characters
+ *        are checked separately.
+ *        Null characters, control characters, and non-characters are detected by comparing
+ *        the block with the block shifted by one, two, and three bytes.
+ *        Call it only if has_avx2() returns true.
+ */
+__attribute__((target("avx2")))
+inline validation
+validate_contents_avx2(string_view str) {
+    static constexpr std::uint8_t byte_1_high_table[16] = {
+        // 0xxx'xxxx ASCII
+        utf8_too_long, utf8_too_long, utf8_too_long, utf8_too_long,
+        utf8_too_long, utf8_too_long, utf8_too_long, utf8_too_long,
+        // 10xx'xxxx continuation
+        utf8_two_conts, utf8_two_conts, utf8_two_conts, utf8_two_conts,
+        // 1100'xxxx two bytes lead
+        utf8_too_short | utf8_overlong_2,
+        // 1101'xxxx two bytes lead
+        utf8_too_short,
+        // 1110'xxxx three bytes lead
+        utf8_too_short | utf8_overlong_3 | utf8_surrogate,
+        // 1111'xxxx four bytes lead
+        utf8_too_short | utf8_too_large | utf8_too_large_1000 | utf8_overlong_4
+    };
+    static constexpr std::uint8_t byte_1_low_table[16] = {
+        // xxxx'0000
+        utf8_carry | utf8_overlong_3 | utf8_overlong_2 | utf8_overlong_4,
+        // xxxx'0001
+        utf8_carry | utf8_overlong_2,
+        // xxxx'001x
+        utf8_carry,
+        utf8_carry,
+        // xxxx'0100
+        utf8_carry | utf8_too_large,
+        // xxxx'0101
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        // xxxx'011x
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        // xxxx'1xxx
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        // xxxx'1101
+        utf8_carry | utf8_too_large | utf8_too_large_1000 | utf8_surrogate,
+        utf8_carry | utf8_too_large | utf8_too_large_1000,
+        utf8_carry | utf8_too_large | utf8_too_large_1000
+    };
+    static constexpr std::uint8_t byte_2_high_table[16] = {
+        // 0xxx'xxxx ASCII
+        utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+        utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+        // 1000'xxxx
+        utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_overlong_3 | utf8_too_large_1000 | utf8_overlong_4,
+        // 1001'xxxx
+        utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_overlong_3 | utf8_too_large,
+        // 101x'xxxx
+        utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_surrogate | utf8_too_large,
+        utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_surrogate | utf8_too_large,
+        // 11xx'xxxx lead
+        utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short
+    };
+    // Non zero if the last one, two, or three bytes of the block start a character
+    // that continues to the next block.
+    auto const incomplete_max = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1,
+        static_cast<char>(0b1111'0000 - 1),
+        static_cast<char>(0b1110'0000 - 1),
+        static_cast<char>(0b1100'0000 - 1)
+    );
+    // _mm256_shuffle_epi8() looks up each 128 bits lane separately, so the tables are broadcast.
+    auto const byte_1_high_lookup =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(byte_1_high_table)));
+    auto const byte_1_low_lookup =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(byte_1_low_table)));
+    auto const byte_2_high_lookup =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(byte_2_high_table)));
+    auto const low_nibble = _mm256_set1_epi8(0x0f);
+    auto const zero = _mm256_setzero_si256();
+
+    auto error = zero;
+    auto non_charactor = zero;
+    auto prev_input = zero;
+    auto prev_incomplete = zero;
+
+    auto check = [&](__m256i input) __attribute__((target("avx2"))) {
+        // Null character
+        error = _mm256_or_si256(error, _mm256_cmpeq_epi8(input, zero));
+        // U+0001..U+001F and U+007F
+        non_charactor = _mm256_or_si256(
+            non_charactor,
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(_mm256_max_epu8(input, _mm256_set1_epi8(0x1f)), _mm256_set1_epi8(0x1f)),
+                _mm256_cmpeq_epi8(input, _mm256_set1_epi8(0x7f))
+            )
+        );
+        if (_mm256_movemask_epi8(input) == 0) {
+            // All ASCII. Only the character at the end of the previous block needs to be checked.
+            error = _mm256_or_si256(error, prev_incomplete);
+            prev_incomplete = zero;
+            prev_input = input;
+            return;
         }
+
+        // The bytes before input are taken from prev_input.
+        auto shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+        auto prev1 = _mm256_alignr_epi8(input, shifted, 16 - 1);
+        auto prev2 = _mm256_alignr_epi8(input, shifted, 16 - 2);
+        auto prev3 = _mm256_alignr_epi8(input, shifted, 16 - 3);
+
+        auto byte_1_high = _mm256_shuffle_epi8(
+            byte_1_high_lookup, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)
+        );
+        auto byte_1_low = _mm256_shuffle_epi8(
+            byte_1_low_lookup, _mm256_and_si256(prev1, low_nibble)
+        );
+        auto byte_2_high = _mm256_shuffle_epi8(
+            byte_2_high_lookup, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble)
+        );
+        auto special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        // The third and fourth bytes must be continuations.
+        // Their two_conts bit of special_cases is flipped.
+        auto is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0b1110'0000 - 0b1000'0000)));
+        auto is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0b1111'0000 - 0b1000'0000)));
+        auto must_be_continuation = _mm256_and_si256(
+            _mm256_or_si256(is_third_byte, is_fourth_byte),
+            _mm256_set1_epi8(static_cast<char>(0b1000'0000))
+        );
+        error = _mm256_or_si256(error, _mm256_xor_si256(must_be_continuation, special_cases));
+
+        // The following patterns are checked only if the string is well formed,
+        // so lead bytes and continuations are not confused.
+        auto const last_bf = _mm256_set1_epi8(static_cast<char>(0b1011'1111));
+        auto const last_fe = _mm256_set1_epi8(static_cast<char>(0b1111'1110));
+        auto const last_be = _mm256_set1_epi8(static_cast<char>(0b1011'1110));
+        auto fffe_or_ffff = _mm256_cmpeq_epi8(_mm256_and_si256(input, last_fe), last_be);
+        // U+0080..U+009F (1100'0010 1000'0000..1100'0010 1001'1111)
+        auto c1 = _mm256_and_si256(
+            _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8(static_cast<char>(0b1100'0010))),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(input, _mm256_set1_epi8(static_cast<char>(0b1001'1111))), input)
+        );
+        // U+FFFE or U+FFFF
+        auto bmp = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(prev2, _mm256_set1_epi8(static_cast<char>(0b1110'1111))),
+                _mm256_cmpeq_epi8(prev1, last_bf)
+            ),
+            fffe_or_ffff
+        );
+        // U+nFFFE or U+nFFFF
+        auto plane = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_max_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0b1111'0000))), prev3),
+                _mm256_cmpeq_epi8(
+                    _mm256_and_si256(prev2, _mm256_set1_epi8(static_cast<char>(0b1100'1111))),
+                    _mm256_set1_epi8(static_cast<char>(0b1000'1111))
+                )
+            ),
+            _mm256_and_si256(_mm256_cmpeq_epi8(prev1, last_bf), fffe_or_ffff)
+        );
+        non_charactor = _mm256_or_si256(non_charactor, _mm256_or_si256(c1, _mm256_or_si256(bmp, plane)));
+
+        prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+        prev_input = input;
+    };
+
+    auto it = str.data();
+    auto end = it + str.size();
+    for (; end - it >= 32; it += 32) {
+        check(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(it)));
     }
+    // The rest is padded by spaces. If the string ends in the middle of a character,
+    // the padding is detected as too_short.
+    char last[32];
+    std::memset(last, ' ', sizeof(last));
+    std::memcpy(last, it, static_cast<std::size_t>(end - it));
+    check(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(last)));
+    error = _mm256_or_si256(error, prev_incomplete);
+
+    if (!_mm256_testz_si256(error, error)) return validation::ill_formed;
+    if (!_mm256_testz_si256(non_charactor, non_charactor)) return validation::well_formed_with_non_charactor;
+    return validation::well_formed;
+}
+
+inline bool
+has_avx2() {
+    static bool const ret =
+        [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+        }();
+    return ret;
+}
+
+#endif // defined(MQTT_UTF8_VALIDATE_AVX2)
+
+} // namespace detail
+
+inline validation
+validate_contents(string_view str) {
+#if defined(MQTT_USE_STR_CHECK)
+#if defined(MQTT_UTF8_VALIDATE_AVX2)
+    // Strings shorter than one AVX2 block are mostly ASCII topics. SSE2 is faster for them.
+    if (str.size() >= 32 && detail::has_avx2()) return detail::validate_contents_avx2(str);
+#endif // defined(MQTT_UTF8_VALIDATE_AVX2)
+#if defined(MQTT_UTF8_VALIDATE_SSE2)
+    return detail::validate_contents_sse2(str);
+#else  // defined(MQTT_UTF8_VALIDATE_SSE2)
+    return detail::validate_contents_scalar(str);
+#endif // defined(MQTT_UTF8_VALIDATE_SSE2)
 #else // MQTT_USE_STR_CHECK
     static_cast<void>(str);
+    return validation::well_formed;
 #endif // MQTT_USE_STR_CHECK
-    return result;
 }
 
 } // namespace utf8string
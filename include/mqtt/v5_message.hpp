@@ -37,6 +37,8 @@
 
 #include <mqtt/packet_id_type.hpp>
 #include <mqtt/move.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/visitor_util.hpp>
 
 namespace MQTT_NS {
 
@@ -563,7 +565,11 @@ public:
                   }
               )
           ),
-          props_(force_move(props)),
+          props_(
+              props.empty()
+              ? nullptr
+              : std::make_shared<properties const>(force_move(props))
+          ),
           payload_(force_move(payload)),
           remaining_length_(
               2                      // topic name length
@@ -580,14 +586,7 @@ public:
               1 +                   // topic name
               ((qos_value == qos::at_most_once) ? 0U : 1U) + // packet id
               1 +                   // property length
-              std::accumulate(
-                  props_.begin(),
-                  props_.end(),
-                  0U,
-                  [](std::size_t total, property_variant const& pv) {
-                      return total + v5::num_of_const_buffer_sequence(pv);
-                  }
-              ) +
+              num_of_props_const_buffer_sequence() +
               1                     // payload
           )
 
@@ -672,7 +671,8 @@ public:
         buf.remove_prefix(consume);
         if (buf.size() < property_length_) throw property_length_error();
 
-        props_ = property::parse(buf.substr(0, property_length_));
+        auto props = property::parse(buf.substr(0, property_length_));
+        if (!props.empty()) props_ = std::make_shared<properties const>(force_move(props));
         buf.remove_prefix(property_length_);
         payload_ = force_move(buf);
         num_of_const_buffer_sequence_ =
@@ -682,14 +682,7 @@ public:
             1 +                   // topic name
             ((qos_value == qos::at_most_once) ? 0U : 1U) + // packet id
             1 +                   // property length
-            std::accumulate(
-                props_.begin(),
-                props_.end(),
-                0U,
-                [](std::size_t total, property_variant const& pv) {
-                    return total + v5::num_of_const_buffer_sequence(pv);
-                }
-            ) +
+            num_of_props_const_buffer_sequence() +
             1;                    // payload
     }
 
@@ -712,8 +705,10 @@ public:
         }
 
         ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
-        for (auto const& p : props_) {
-            v5::add_const_buffer_sequence(ret, p);
+        if (props_) {
+            for (auto const& p : *props_) {
+                v5::add_const_buffer_sequence(ret, p);
+            }
         }
 
         ret.emplace_back(as::buffer(payload_));
@@ -764,9 +759,11 @@ public:
         auto it = ret.end();
         ret.resize(ret.size() + property_length_);
         auto end = ret.end();
-        for (auto const& p : props_) {
-            v5::fill(p, it, end);
-            it += static_cast<std::string::difference_type>(v5::size(p));
+        if (props_) {
+            for (auto const& p : *props_) {
+                v5::fill(p, it, end);
+                it += static_cast<std::string::difference_type>(v5::size(p));
+            }
         }
 
         ret.append(payload_.data(), payload_.size());
@@ -822,6 +819,79 @@ public:
         return payload_;
     }
 
+    /**
+     * @brief Get Message Expiry Interval
+     * @return Message Expiry Interval in seconds. nullopt if the message doesn't expire.
+     */
+    optional<std::uint32_t> message_expiry_interval() const {
+        optional<std::uint32_t> ret;
+        if (!props_) return ret;
+        for (auto const& pv : *props_) {
+            MQTT_NS::visit(
+                make_lambda_visitor<void>(
+                    [&](property::message_expiry_interval const& p) {
+                        ret.emplace(p.val());
+                    },
+                    [](auto const&) {
+                    }
+                ),
+                pv
+            );
+        }
+        return ret;
+    }
+
+    /**
+     * @brief Get Topic Alias
+     * @return Topic Alias. nullopt if the message has no Topic Alias.
+     */
+    optional<std::uint16_t> topic_alias() const {
+        optional<std::uint16_t> ret;
+        if (!props_) return ret;
+        for (auto const& pv : *props_) {
+            MQTT_NS::visit(
+                make_lambda_visitor<void>(
+                    [&](property::topic_alias const& p) {
+                        ret.emplace(p.val());
+                    },
+                    [](auto const&) {
+                    }
+                ),
+                pv
+            );
+        }
+        return ret;
+    }
+
+    /**
+     * @brief Update Message Expiry Interval
+     *        The properties shared with the copies of the message are not modified.
+     *        If the message has no Message Expiry Interval, nothing happens.
+     * @param val Message Expiry Interval in seconds
+     */
+    void update_message_expiry_interval(std::uint32_t val) {
+        if (!props_) return;
+        auto it = std::find_if(
+            props_->begin(),
+            props_->end(),
+            [](property_variant const& pv) {
+                return
+                    MQTT_NS::visit(
+                        make_lambda_visitor<bool>(
+                            [](property::message_expiry_interval const&) { return true; },
+                            [](auto const&) { return false; }
+                        ),
+                        pv
+                    );
+            }
+        );
+        if (it == props_->end()) return;
+        // The size of the property doesn't change, so the lengths are kept.
+        auto props = *props_;
+        props[static_cast<std::size_t>(std::distance(props_->begin(), it))] = property::message_expiry_interval(val);
+        props_ = std::make_shared<properties const>(force_move(props));
+    }
+
     /**
      * @brief Set dup flag
      * @param dup flag value to set
@@ -830,14 +900,39 @@ public:
         publish::set_dup(fixed_header_, dup);
     }
 
+    /**
+     * @brief Set packet id
+     *        If qos is at_most_once, the message has no packet id and nothing happens.
+     * @param packet_id packet id to set
+     */
+    void set_packet_id(typename packet_id_type<PacketIdBytes>::type packet_id) {
+        if (packet_id_.empty()) return;
+        packet_id_.clear();
+        add_packet_id_to_buf<PacketIdBytes>::apply(packet_id_, packet_id);
+    }
+
 private:
+    std::size_t num_of_props_const_buffer_sequence() const {
+        if (!props_) return 0;
+        return
+            std::accumulate(
+                props_->begin(),
+                props_->end(),
+                0U,
+                [](std::size_t total, property_variant const& pv) {
+                    return total + v5::num_of_const_buffer_sequence(pv);
+                }
+            );
+    }
+
     std::uint8_t fixed_header_;
     buffer topic_name_;
     boost::container::static_vector<char, 2> topic_name_length_buf_;
     boost::container::static_vector<char, PacketIdBytes> packet_id_;
     std::size_t property_length_;
     boost::container::static_vector<char, 4> property_length_buf_;
-    properties props_;
+    // Shared between copies. Copying the message doesn't copy the properties.
+    std::shared_ptr<properties const> props_;
     buffer payload_;
     std::size_t remaining_length_;
     boost::container::static_vector<char, 4> remaining_length_buf_;
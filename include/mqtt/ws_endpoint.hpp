@@ -158,6 +158,40 @@ public:
         );
     }
 
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(
+        MutableBufferSequence const& buffers,
+        ReadHandler&& handler) {
+        if (buffer_.size() != 0) {
+            auto copied = as::buffer_copy(buffers, buffer_.data());
+            buffer_.consume(copied);
+            handler(boost::system::errc::make_error_code(boost::system::errc::success), copied);
+            return;
+        }
+        ws_.async_read(
+            buffer_,
+            as::bind_executor(
+                strand_,
+                [this, buffers, handler = std::forward<ReadHandler>(handler)]
+                (boost::system::error_code const& ec, std::size_t) mutable {
+                    if (ec) {
+                        std::forward<ReadHandler>(handler)(ec, 0);
+                        return;
+                    }
+                    if (!ws_.got_binary()) {
+                        buffer_.consume(buffer_.size());
+                        std::forward<ReadHandler>(handler)
+                            (boost::system::errc::make_error_code(boost::system::errc::bad_message), 0);
+                        return;
+                    }
+                    auto copied = as::buffer_copy(buffers, buffer_.data());
+                    buffer_.consume(copied);
+                    std::forward<ReadHandler>(handler)(boost::system::errc::make_error_code(boost::system::errc::success), copied);
+                }
+            )
+        );
+    }
+
     template <typename ConstBufferSequence>
     std::size_t write(
         ConstBufferSequence const& buffers) {
@@ -9,9 +9,11 @@
 #include <mqtt/client.hpp>
 #include <mqtt/sync_client.hpp>
 #include <mqtt/async_client.hpp>
+#include <mqtt/buffer_pool.hpp>
 #include <mqtt/connect_flags.hpp>
 #include <mqtt/connect_return_code.hpp>
 #include <mqtt/control_packet_type.hpp>
+#include <mqtt/encoded_publish.hpp>
 #include <mqtt/exception.hpp>
 #include <mqtt/fixed_header.hpp>
 #include <mqtt/hexdump.hpp>
@@ -1713,4 +1713,159 @@ BOOST_AUTO_TEST_CASE( pubrec_rel_comp_prop ) {
 }
 
 
+BOOST_AUTO_TEST_CASE( write_coalescing ) {
+    auto test = [](boost::asio::io_context& ioc, auto& c, auto& s, auto& /*b*/) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+        // Smaller than the first round in order to exercise the watermark.
+        c->set_write_coalescing(1024, std::chrono::milliseconds(1));
+
+        // The first round is published in a burst, so it is coalesced.
+        // The second round is published after the first round, so it is held
+        // until the timer expires.
+        std::size_t const first_round = 100;
+        std::vector<std::string> contents_list;
+        for (std::size_t i = 0; i != first_round + 50; ++i) {
+            contents_list.push_back("contents" + std::to_string(i));
+        }
+        std::size_t received = 0;
+        // The number of the writes while the messages are published.
+        std::size_t writes = 0;
+        bool publishing = false;
+        packet_id_t pid_sub;
+        packet_id_t pid_unsub;
+
+        checker chk = {
+            // connect
+            cont("h_connack"),
+            // subscribe topic1 QoS0
+            cont("h_suback"),
+            // publish topic1 QoS0 * contents_list.size()
+            cont("h_publish_all"),
+            cont("h_unsuback"),
+            // disconnect
+            cont("h_close"),
+        };
+
+        auto publish_round =
+            [&] (std::size_t first, std::size_t last) {
+                for (std::size_t i = first; i != last; ++i) {
+                    c->async_publish("topic1", contents_list[i], MQTT_NS::qos::at_most_once);
+                }
+            };
+        auto publish_all =
+            [&] {
+                // The client replaces the handler on connect. Keep alive is not used in this test.
+                c->set_pre_send_handler(
+                    [&] {
+                        if (publishing) ++writes;
+                    }
+                );
+                publishing = true;
+                publish_round(0, first_round);
+            };
+        auto check_publish =
+            [&]
+            (MQTT_NS::string_view topic, MQTT_NS::string_view contents) {
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == contents_list[received]);
+                if (++received == first_round) {
+                    publish_round(first_round, contents_list.size());
+                }
+                if (received == contents_list.size()) {
+                    MQTT_CHK("h_publish_all");
+                    publishing = false;
+                    // Without coalescing, each message is written by its own write.
+                    BOOST_TEST(writes < contents_list.size() / 10);
+                    pid_unsub = c->async_unsubscribe("topic1");
+                }
+            };
+
+        c->set_connack_handler(
+            [&chk, &c, &pid_sub]
+            (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+                MQTT_CHK("h_connack");
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                pid_sub = c->async_subscribe("topic1", MQTT_NS::qos::at_most_once);
+                return true;
+            });
+        c->set_suback_handler(
+            [&chk, &pid_sub, &publish_all]
+            (packet_id_t packet_id, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+                MQTT_CHK("h_suback");
+                BOOST_TEST(packet_id == pid_sub);
+                publish_all();
+                return true;
+            });
+        c->set_unsuback_handler(
+            [&chk, &c, &pid_unsub]
+            (packet_id_t packet_id) {
+                MQTT_CHK("h_unsuback");
+                BOOST_TEST(packet_id == pid_unsub);
+                c->async_disconnect();
+                return true;
+            });
+        c->set_publish_handler(
+            [&check_publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::string_view topic,
+             MQTT_NS::string_view contents) {
+                check_publish(topic, contents);
+                return true;
+            });
+        c->set_v5_connack_handler(
+            [&chk, &c, &pid_sub]
+            (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_connack");
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+                pid_sub = c->async_subscribe("topic1", MQTT_NS::qos::at_most_once);
+                return true;
+            });
+        c->set_v5_suback_handler(
+            [&chk, &pid_sub, &publish_all]
+            (packet_id_t packet_id, std::vector<MQTT_NS::v5::suback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_suback");
+                BOOST_TEST(packet_id == pid_sub);
+                publish_all();
+                return true;
+            });
+        c->set_v5_unsuback_handler(
+            [&chk, &c, &pid_unsub]
+            (packet_id_t packet_id, std::vector<MQTT_NS::v5::unsuback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_unsuback");
+                BOOST_TEST(packet_id == pid_unsub);
+                c->async_disconnect();
+                return true;
+            });
+        c->set_v5_publish_handler(
+            [&check_publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::string_view topic,
+             MQTT_NS::string_view contents,
+             std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                check_publish(topic, contents);
+                return true;
+            });
+        c->set_close_handler(
+            [&chk, &s]
+            () {
+                MQTT_CHK("h_close");
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->connect();
+        ioc.run();
+        BOOST_TEST(chk.all());
+    };
+    do_combi_test_async(test);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+
+#include <cstring>
+
+#include <mqtt/buffer_pool.hpp>
+#include <mqtt/buffer.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_buffer_pool)
+
+BOOST_AUTO_TEST_CASE( reuse ) {
+    // If MQTT_STD_SHARED_PTR_ARRAY is defined and C++17 or earlier,
+    // the array and the control block are allocated separately.
+    // So the counters are compared relatively.
+    auto pool = MQTT_NS::buffer_pool::create();
+    std::size_t blocks;
+    {
+        auto spa = pool->allocate(10);
+        std::memset(spa.get(), 'a', 10);
+        auto s = pool->get_stats();
+        BOOST_TEST(s.hit == 0U);
+        BOOST_TEST(s.miss >= 1U);
+        BOOST_TEST(s.cached_blocks == 0U);
+        blocks = s.miss;
+    }
+    {
+        auto s = pool->get_stats();
+        BOOST_TEST(s.release == blocks);
+        BOOST_TEST(s.cached_blocks == blocks);
+    }
+    {
+        // the same size class
+        auto spa = pool->allocate(20);
+        auto s = pool->get_stats();
+        BOOST_TEST(s.hit == blocks);
+        BOOST_TEST(s.miss == blocks);
+        BOOST_TEST(s.cached_blocks == 0U);
+    }
+    pool->shrink();
+    {
+        auto s = pool->get_stats();
+        BOOST_TEST(s.cached_blocks == 0U);
+        BOOST_TEST(s.cached_bytes == 0U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( oversize ) {
+    auto pool = MQTT_NS::buffer_pool::create();
+    {
+        auto spa = pool->allocate(1024 * 1024);
+        std::memset(spa.get(), 'a', 1024 * 1024);
+    }
+    auto s = pool->get_stats();
+    BOOST_TEST(s.oversize == 1U);
+    BOOST_TEST(s.cached_blocks == s.release);
+}
+
+BOOST_AUTO_TEST_CASE( max_cached_blocks ) {
+    auto pool = MQTT_NS::buffer_pool::create(1);
+    {
+        auto spa1 = pool->allocate(100);
+        auto spa2 = pool->allocate(100);
+    }
+    auto s = pool->get_stats();
+    BOOST_TEST(s.miss == 2U);
+    // Only one of the two freed blocks of the size class is kept.
+    BOOST_TEST(s.cached_blocks == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( lifetime ) {
+    std::weak_ptr<MQTT_NS::buffer_pool> wp;
+    MQTT_NS::buffer buf;
+    {
+        auto pool = MQTT_NS::buffer_pool::create();
+        wp = pool;
+        auto spa = pool->allocate(5);
+        auto ptr = spa.get();
+        std::memcpy(ptr, "hello", 5);
+        buf = MQTT_NS::buffer(MQTT_NS::string_view(ptr, 5), std::move(spa));
+    }
+    // the buffer keeps the pool alive
+    BOOST_TEST(!wp.expired());
+    BOOST_TEST(buf == "hello");
+    buf = MQTT_NS::buffer();
+    BOOST_TEST(wp.expired());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -273,4 +273,23 @@ inline void do_combi_test_async(Test const& test) {
 #endif // defined(MQTT_USE_WS)
 }
 
+/**
+ * @brief Connect the client so that the broker keeps the session after the connection is closed.
+ *        In v5, the session ends with the connection unless the Session Expiry Interval is set.
+ * @param c client
+ */
+template <typename Client>
+inline void connect_keep_session(Client& c) {
+    if (c->get_protocol_version() == MQTT_NS::protocol_version::v5) {
+        c->connect(
+            std::vector<MQTT_NS::v5::property_variant>{
+                MQTT_NS::v5::property::session_expiry_interval(0xFFFFFFFFUL)
+            }
+        );
+    }
+    else {
+        c->connect();
+    }
+}
+
 #endif // MQTT_TEST_COMBI_TEST_HPP
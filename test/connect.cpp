@@ -591,19 +591,19 @@ BOOST_AUTO_TEST_CASE( noclean ) {
                 switch (connect) {
                 case 0:
                     MQTT_CHK("h_close1");
-                    c->connect();
+                    connect_keep_session(c);
                     ++connect;
                     break;
                 case 1:
                     MQTT_CHK("h_close2");
                     c->set_clean_session(true);
-                    c->connect();
+                    connect_keep_session(c);
                     ++connect;
                     break;
                 case 2:
                     MQTT_CHK("h_close3");
                     c->set_clean_session(false);
-                    c->connect();
+                    connect_keep_session(c);
                     ++connect;
                     break;
                 case 3:
@@ -617,6 +617,68 @@ BOOST_AUTO_TEST_CASE( noclean ) {
             (boost::system::error_code const&) {
                 BOOST_CHECK(false);
             });
+        connect_keep_session(c);
+        ioc.run();
+        BOOST_TEST(chk.all());
+    };
+    do_combi_test_sync(test);
+}
+
+BOOST_AUTO_TEST_CASE( noclean_no_session_expiry_interval ) {
+    auto test = [](boost::asio::io_context& ioc, auto& c, auto& s, auto& /*b*/) {
+        if (c->get_protocol_version() != MQTT_NS::protocol_version::v5) return;
+        c->set_client_id("cid1");
+        c->set_clean_session(false);
+
+        checker chk = {
+            // connect
+            cont("h_connack1"),
+            // disconnect
+            cont("h_close1"),
+            // connect
+            cont("h_connack2"),
+            // disconnect
+            cont("h_close2"),
+        };
+
+        int connect = 0;
+        c->set_v5_connack_handler(
+            [&chk, &connect, &c]
+            (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                switch (connect) {
+                case 0:
+                    MQTT_CHK("h_connack1");
+                    break;
+                case 1:
+                    MQTT_CHK("h_connack2");
+                    break;
+                }
+                // The absent Session Expiry Interval means 0, so the session ends with the connection.
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+                c->disconnect();
+                return true;
+            });
+        c->set_close_handler(
+            [&chk, &connect, &c, &s]
+            () {
+                switch (connect) {
+                case 0:
+                    MQTT_CHK("h_close1");
+                    c->connect();
+                    ++connect;
+                    break;
+                case 1:
+                    MQTT_CHK("h_close2");
+                    s.close();
+                    break;
+                }
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
         c->connect();
         ioc.run();
         BOOST_TEST(chk.all());
@@ -0,0 +1,157 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <mqtt_client_cpp.hpp>
+#include <mqtt/file_store.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_file_store)
+
+namespace as = boost::asio;
+
+char const* const path = "file_store_test.log";
+
+template <typename Client>
+std::vector<std::string> stored(Client const& c) {
+    std::vector<std::string> ret;
+    c->for_each_store(
+        [&](char const* data, std::size_t size) {
+            ret.emplace_back(data, size);
+        }
+    );
+    return ret;
+}
+
+// Serialized messages made by a client that is not connected.
+std::vector<std::string> make_messages(MQTT_NS::protocol_version version, std::size_t num) {
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, version);
+    for (std::size_t i = 0; i != num; ++i) {
+        c->publish("topic1", "contents" + std::to_string(i), MQTT_NS::qos::at_least_once);
+    }
+    return stored(c);
+}
+
+BOOST_AUTO_TEST_CASE( restore ) {
+    std::remove(path);
+    auto msgs = make_messages(MQTT_NS::protocol_version::v3_1_1, 3);
+    {
+        MQTT_NS::file_store fs(path);
+        fs.add(1, msgs[0].data(), msgs[0].size());
+        fs.add(2, msgs[1].data(), msgs[1].size());
+        fs.add(3, msgs[2].data(), msgs[2].size());
+        fs.remove(2);
+        BOOST_TEST(fs.size() == 2U);
+        // committed by the destructor
+    }
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    MQTT_NS::file_store fs(path);
+    fs.restore(*c);
+    BOOST_TEST(fs.size() == 2U);
+    BOOST_TEST((stored(c) == std::vector<std::string>{ msgs[0], msgs[2] }));
+    // The removed record is dropped by restore.
+    BOOST_TEST(fs.file_size() == (1 + 2 + 4) * 2 + msgs[0].size() + msgs[2].size());
+    std::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE( restore_v5 ) {
+    std::remove(path);
+    auto msgs = make_messages(MQTT_NS::protocol_version::v5, 2);
+    {
+        MQTT_NS::file_store fs(path);
+        fs.add(1, msgs[0].data(), msgs[0].size());
+        fs.add(2, msgs[1].data(), msgs[1].size());
+        fs.commit();
+    }
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    MQTT_NS::file_store fs(path);
+    fs.restore(*c);
+    BOOST_TEST(stored(c) == msgs);
+    std::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE( truncated ) {
+    std::remove(path);
+    auto msgs = make_messages(MQTT_NS::protocol_version::v3_1_1, 2);
+    {
+        MQTT_NS::file_store fs(path);
+        fs.add(1, msgs[0].data(), msgs[0].size());
+        fs.add(2, msgs[1].data(), msgs[1].size());
+    }
+    {
+        // crash while writing the last record
+        std::ifstream ifs(path, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        ifs.close();
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs.write(data.data(), static_cast<std::streamsize>(data.size() - 3));
+    }
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    MQTT_NS::file_store fs(path);
+    fs.restore(*c);
+    BOOST_TEST((stored(c) == std::vector<std::string>{ msgs[0] }));
+    std::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE( compaction ) {
+    std::remove(path);
+    auto msgs = make_messages(MQTT_NS::protocol_version::v3_1_1, 1);
+    auto const& m = msgs.front();
+    std::size_t const record_size = 1 + 2 + 4 + m.size();
+    {
+        // commit each message, and compact when the removed records take 10 records.
+        MQTT_NS::file_store fs(path, 0, record_size * 10);
+        for (std::uint16_t i = 1; i != 1000; ++i) {
+            fs.add(i, m.data(), m.size());
+            fs.remove(i);
+            BOOST_TEST(fs.file_size() < record_size * 20);
+        }
+        fs.add(1000, m.data(), m.size());
+    }
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    MQTT_NS::file_store fs(path);
+    fs.restore(*c);
+    BOOST_TEST(fs.size() == 1U);
+    BOOST_TEST(fs.file_size() == record_size);
+    std::remove(path);
+}
+
+// The endpoint serializes the stored messages to the file store,
+// and the next endpoint restores them.
+BOOST_AUTO_TEST_CASE( serialize_handlers ) {
+    std::remove(path);
+    std::vector<std::string> expected;
+    {
+        MQTT_NS::file_store fs(path);
+        as::io_context ioc;
+        auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+        fs.set_serialize_handlers(*c);
+        c->publish("topic1", "contents1", MQTT_NS::qos::at_least_once);
+        c->publish("topic1", "contents2", MQTT_NS::qos::exactly_once);
+        BOOST_TEST(fs.size() == 2U);
+        expected = stored(c);
+        c->set_serialize_handlers();
+    }
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    MQTT_NS::file_store fs(path);
+    fs.restore(*c);
+    BOOST_TEST(stored(c) == expected);
+    std::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+
+#include <string>
+#include <vector>
+
+#include <mqtt/inflight_store.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_inflight_store)
+
+struct elem {
+    elem(std::uint16_t id, std::string v) : id(id), v(std::move(v)) {}
+    std::uint16_t packet_id() const { return id; }
+    std::uint16_t id;
+    std::string v;
+};
+
+using store_t = MQTT_NS::inflight_store<std::uint16_t, elem>;
+
+std::vector<std::uint16_t> ids(store_t const& s) {
+    std::vector<std::uint16_t> ret;
+    for (auto const& e : s) ret.push_back(e.packet_id());
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE( emplace_find_erase ) {
+    store_t s;
+    BOOST_TEST(s.empty());
+    BOOST_TEST(!s.find(1));
+    BOOST_TEST(!s.erase(1));
+
+    BOOST_TEST(s.emplace(1, "a").second);
+    BOOST_TEST(s.emplace(2, "b").second);
+    auto r = s.emplace(1, "c");
+    BOOST_TEST(!r.second);
+    BOOST_TEST(r.first->v == "a");
+    BOOST_TEST(s.size() == 2U);
+    BOOST_TEST(s.find(2)->v == "b");
+
+    BOOST_TEST(s.erase(1));
+    BOOST_TEST(!s.find(1));
+    BOOST_TEST(s.find(2)->v == "b");
+    BOOST_TEST(s.size() == 1U);
+
+    s.clear();
+    BOOST_TEST(s.empty());
+    BOOST_TEST(!s.find(2));
+    BOOST_TEST(ids(s).empty());
+}
+
+BOOST_AUTO_TEST_CASE( insertion_order ) {
+    store_t s;
+    s.emplace(3, "a");
+    s.emplace(1, "b");
+    s.emplace(2, "c");
+    BOOST_TEST((ids(s) == std::vector<std::uint16_t>{ 3, 1, 2 }));
+
+    // overwriting keeps the order
+    *s.find(1) = elem(1, "d");
+    BOOST_TEST((ids(s) == std::vector<std::uint16_t>{ 3, 1, 2 }));
+
+    s.erase(1);
+    s.emplace(1, "e");
+    BOOST_TEST((ids(s) == std::vector<std::uint16_t>{ 3, 2, 1 }));
+    s.erase(3);
+    BOOST_TEST((ids(s) == std::vector<std::uint16_t>{ 2, 1 }));
+    s.erase(1);
+    BOOST_TEST((ids(s) == std::vector<std::uint16_t>{ 2 }));
+}
+
+// Colliding ids and erasing in the middle of the probe sequences
+BOOST_AUTO_TEST_CASE( many ) {
+    store_t s;
+    std::vector<std::uint16_t> expected;
+    for (std::uint32_t i = 0; i != 1000; ++i) {
+        auto id = static_cast<std::uint16_t>((i * 64) % 65535 + 1);
+        BOOST_TEST(s.emplace(id, std::to_string(id)).second);
+        expected.push_back(id);
+    }
+    for (std::size_t i = 0; i < expected.size(); i += 3) {
+        BOOST_TEST(s.erase(expected[i]));
+    }
+    std::vector<std::uint16_t> rest;
+    for (std::size_t i = 0; i != expected.size(); ++i) {
+        if (i % 3 == 0) {
+            BOOST_TEST(!s.find(expected[i]));
+        }
+        else {
+            BOOST_TEST(s.find(expected[i])->v == std::to_string(expected[i]));
+            rest.push_back(expected[i]);
+        }
+    }
+    BOOST_TEST(s.size() == rest.size());
+    BOOST_TEST(ids(s) == rest);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,289 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <mqtt/io_context_pool.hpp>
+#include <mqtt/server.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_io_context_pool)
+
+namespace as = boost::asio;
+
+// Wait for the other threads until pred returns true. Returns false on timeout.
+template <typename Pred>
+inline bool wait_until(Pred pred) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE( round_robin ) {
+    as::io_context ioc1;
+    as::io_context ioc2;
+    as::io_context ioc3;
+    MQTT_NS::io_context_pool pool({ std::ref(ioc1), std::ref(ioc2), std::ref(ioc3) });
+    BOOST_TEST(pool.size() == 3U);
+    BOOST_TEST(pool.select() == 0U);
+    BOOST_TEST(pool.select() == 1U);
+    BOOST_TEST(pool.select() == 2U);
+    BOOST_TEST(pool.select() == 0U);
+    BOOST_TEST(&pool.ioc(1) == &ioc2);
+}
+
+BOOST_AUTO_TEST_CASE( least_loaded ) {
+    as::io_context ioc1;
+    as::io_context ioc2;
+    MQTT_NS::io_context_pool pool(
+        { std::ref(ioc1), std::ref(ioc2) },
+        MQTT_NS::io_context_pool::policy::least_loaded
+    );
+    auto s1 = pool.make_socket<as::ip::tcp::socket>(pool.select());
+    BOOST_TEST(pool.load(0) == 1U);
+    BOOST_TEST(pool.load(1) == 0U);
+    auto s2 = pool.make_socket<as::ip::tcp::socket>(pool.select());
+    BOOST_TEST(pool.load(1) == 1U);
+    auto s3 = pool.make_socket<as::ip::tcp::socket>(pool.select());
+    BOOST_TEST(pool.load(0) == 2U);
+    s1.reset();
+    s3.reset();
+    BOOST_TEST(pool.load(0) == 0U);
+    BOOST_TEST(pool.select() == 0U);
+    BOOST_TEST(pool.select() == 0U);
+}
+
+// Each accepted endpoint is passed to the accept handler on the thread of its io_context.
+inline void accept_on_pool(bool reuse_port) {
+    as::io_context ioc_accept;
+    as::io_context ioc1;
+    as::io_context ioc2;
+    MQTT_NS::io_context_pool pool({ std::ref(ioc1), std::ref(ioc2) });
+
+    MQTT_NS::server<> s(
+        as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port),
+        ioc_accept,
+        pool,
+        [](as::ip::tcp::acceptor& acceptor) {
+            acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+        }
+    );
+    s.set_reuse_port_acceptors(reuse_port);
+
+    std::size_t const num_of_clients = 4;
+    std::atomic<std::size_t> accepted1(0);
+    std::atomic<std::size_t> accepted2(0);
+    std::atomic<std::size_t> unexpected(0);
+    std::vector<std::shared_ptr<MQTT_NS::server<>::endpoint_t>> eps;
+    std::mutex mtx;
+    s.set_accept_handler(
+        [&](MQTT_NS::server<>::endpoint_t& ep) {
+            if (ioc1.get_executor().running_in_this_thread()) ++accepted1;
+            else if (ioc2.get_executor().running_in_this_thread()) ++accepted2;
+            else ++unexpected;
+            std::lock_guard<std::mutex> g(mtx);
+            eps.emplace_back(ep.shared_from_this());
+        }
+    );
+    s.set_error_handler(
+        [](boost::system::error_code const& /*ec*/) {
+        }
+    );
+    s.listen();
+
+    auto guard1 = as::make_work_guard(ioc1);
+    auto guard2 = as::make_work_guard(ioc2);
+    std::thread th_accept([&] { ioc_accept.run(); });
+    std::thread th1([&] { ioc1.run(); });
+    std::thread th2([&] { ioc2.run(); });
+
+    as::io_context ioc_client;
+    std::vector<as::ip::tcp::socket> clients;
+    for (std::size_t i = 0; i != num_of_clients; ++i) {
+        clients.emplace_back(ioc_client);
+        clients.back().connect(as::ip::tcp::endpoint(as::ip::address_v4::loopback(), broker_notls_port));
+    }
+    BOOST_TEST(wait_until([&] { return accepted1 + accepted2 + unexpected == num_of_clients; }));
+    BOOST_TEST(unexpected == 0U);
+    if (!reuse_port) {
+        // round robin
+        BOOST_TEST(accepted1 == num_of_clients / 2);
+        BOOST_TEST(accepted2 == num_of_clients / 2);
+    }
+
+    clients.clear();
+    guard1.reset();
+    guard2.reset();
+    ioc_accept.stop();
+    ioc1.stop();
+    ioc2.stop();
+    th_accept.join();
+    th1.join();
+    th2.join();
+    s.close();
+    eps.clear();
+}
+
+// The server is closed while the threads of the io_contexts are accepting.
+inline void close_on_pool(bool reuse_port) {
+    as::io_context ioc_accept;
+    as::io_context ioc1;
+    as::io_context ioc2;
+    MQTT_NS::io_context_pool pool({ std::ref(ioc1), std::ref(ioc2) });
+
+    MQTT_NS::server<> s(
+        as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port),
+        ioc_accept,
+        pool,
+        [](as::ip::tcp::acceptor& acceptor) {
+            acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+        }
+    );
+    s.set_reuse_port_acceptors(reuse_port);
+
+    std::atomic<std::size_t> accepted(0);
+    std::atomic<std::size_t> aborted(0);
+    std::vector<std::shared_ptr<MQTT_NS::server<>::endpoint_t>> eps;
+    std::mutex mtx;
+    s.set_accept_handler(
+        [&](MQTT_NS::server<>::endpoint_t& ep) {
+            ++accepted;
+            std::lock_guard<std::mutex> g(mtx);
+            eps.emplace_back(ep.shared_from_this());
+        }
+    );
+    s.set_error_handler(
+        [&](boost::system::error_code const& ec) {
+            if (ec == as::error::operation_aborted) ++aborted;
+        }
+    );
+    s.listen();
+
+    auto guard_accept = as::make_work_guard(ioc_accept);
+    auto guard1 = as::make_work_guard(ioc1);
+    auto guard2 = as::make_work_guard(ioc2);
+    std::thread th_accept([&] { ioc_accept.run(); });
+    std::thread th1([&] { ioc1.run(); });
+    std::thread th2([&] { ioc2.run(); });
+
+    as::io_context ioc_client;
+    as::ip::tcp::socket client1(ioc_client);
+    client1.connect(as::ip::tcp::endpoint(as::ip::address_v4::loopback(), broker_notls_port));
+    BOOST_TEST(wait_until([&] { return accepted == 1; }));
+
+    if (reuse_port) {
+        s.close();
+    }
+    else {
+        // Without reuse port, the server is closed on the thread of ioc_accept.
+        as::post(ioc_accept, [&] { s.close(); });
+    }
+
+    // Each acceptor stops on its own thread.
+    std::size_t const num_of_acceptors = reuse_port ? 2 : 1;
+    BOOST_TEST(wait_until([&] { return aborted == num_of_acceptors; }));
+    as::ip::tcp::socket client2(ioc_client);
+    boost::system::error_code ec;
+    client2.connect(as::ip::tcp::endpoint(as::ip::address_v4::loopback(), broker_notls_port), ec);
+    BOOST_TEST(ec == as::error::connection_refused);
+    BOOST_TEST(accepted == 1U);
+
+    guard_accept.reset();
+    guard1.reset();
+    guard2.reset();
+    ioc_accept.stop();
+    ioc1.stop();
+    ioc2.stop();
+    th_accept.join();
+    th1.join();
+    th2.join();
+    eps.clear();
+}
+
+// The server that is constructed with ioc_con calls the accept handler on ioc_accept.
+BOOST_AUTO_TEST_CASE( accept_ioc_con ) {
+    as::io_context ioc_accept;
+    as::io_context ioc_con;
+
+    MQTT_NS::server<> s(
+        as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port),
+        ioc_accept,
+        ioc_con,
+        [](as::ip::tcp::acceptor& acceptor) {
+            acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+        }
+    );
+
+    std::atomic<std::size_t> accepted(0);
+    std::atomic<std::size_t> unexpected(0);
+    std::shared_ptr<MQTT_NS::server<>::endpoint_t> ep_sp;
+    s.set_accept_handler(
+        [&](MQTT_NS::server<>::endpoint_t& ep) {
+            if (ioc_accept.get_executor().running_in_this_thread()) ++accepted;
+            else ++unexpected;
+            ep_sp = ep.shared_from_this();
+        }
+    );
+    s.listen();
+
+    std::thread th_accept([&] { ioc_accept.run(); });
+
+    as::io_context ioc_client;
+    as::ip::tcp::socket client(ioc_client);
+    client.connect(as::ip::tcp::endpoint(as::ip::address_v4::loopback(), broker_notls_port));
+    BOOST_TEST(wait_until([&] { return accepted + unexpected == 1; }));
+    BOOST_TEST(accepted == 1U);
+
+    ioc_accept.stop();
+    th_accept.join();
+    s.close();
+    ep_sp.reset();
+}
+
+BOOST_AUTO_TEST_CASE( port_without_acceptor ) {
+    as::io_context ioc;
+    MQTT_NS::server<> s(
+        as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port),
+        ioc,
+        [](as::ip::tcp::acceptor& acceptor) {
+            acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+        }
+    );
+    BOOST_TEST(s.port() == broker_notls_port);
+    s.close();
+    BOOST_CHECK_THROW(s.port(), MQTT_NS::bad_optional_access);
+}
+
+BOOST_AUTO_TEST_CASE( accept_round_robin ) {
+    accept_on_pool(false);
+}
+
+BOOST_AUTO_TEST_CASE( close_round_robin ) {
+    close_on_pool(false);
+}
+
+#if defined(SO_REUSEPORT)
+
+BOOST_AUTO_TEST_CASE( accept_reuse_port ) {
+    accept_on_pool(true);
+}
+
+BOOST_AUTO_TEST_CASE( close_reuse_port ) {
+    close_on_pool(true);
+}
+
+#endif // defined(SO_REUSEPORT)
+
+BOOST_AUTO_TEST_SUITE_END()
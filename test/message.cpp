@@ -290,6 +290,68 @@ BOOST_AUTO_TEST_CASE( publish_get_attributes2 ) {
     }
 }
 
+BOOST_AUTO_TEST_CASE( encoded_publish_v3_1_1 ) {
+    MQTT_NS::encoded_publish e("1234"_mb, "AB"_mb);
+    auto const& cached = e.v3_1_1_message(MQTT_NS::qos::at_least_once, true);
+    // The built message is cached.
+    BOOST_TEST(&cached == &e.v3_1_1_message(MQTT_NS::qos::at_least_once, true));
+    BOOST_TEST(&cached != &e.v3_1_1_message(MQTT_NS::qos::at_least_once, false));
+
+    auto m = cached;
+    m.set_packet_id(0x0102);
+    auto expected = MQTT_NS::publish_message("1234"_mb, MQTT_NS::qos::at_least_once, true, false, 0x0102, "AB"_mb);
+    BOOST_TEST(m.continuous_buffer() == expected.continuous_buffer());
+    BOOST_TEST(cached.packet_id() == 0);
+
+    // qos0 message has no packet id
+    auto m0 = e.v3_1_1_message(MQTT_NS::qos::at_most_once, false);
+    m0.set_packet_id(0x0102);
+    BOOST_TEST(m0.continuous_buffer() == MQTT_NS::publish_message("1234"_mb, MQTT_NS::qos::at_most_once, false, false, 0, "AB"_mb).continuous_buffer());
+}
+
+BOOST_AUTO_TEST_CASE( encoded_publish_v5 ) {
+    MQTT_NS::v5::properties props {
+        MQTT_NS::v5::property::payload_format_indicator(MQTT_NS::v5::property::payload_format_indicator::string),
+        MQTT_NS::v5::property::content_type("text"_mb)
+    };
+    MQTT_NS::encoded_publish e("1234"_mb, "AB"_mb, props);
+    auto m1 = e.v5_message(MQTT_NS::qos::exactly_once, false);
+    auto m2 = m1;
+    m1.set_packet_id(1);
+    m2.set_packet_id(0xffff);
+    auto expected1 = MQTT_NS::v5::publish_message("1234"_mb, MQTT_NS::qos::exactly_once, false, false, 1, props, "AB"_mb);
+    auto expected2 = MQTT_NS::v5::publish_message("1234"_mb, MQTT_NS::qos::exactly_once, false, false, 0xffff, props, "AB"_mb);
+    BOOST_TEST(m1.continuous_buffer() == expected1.continuous_buffer());
+    BOOST_TEST(m2.continuous_buffer() == expected2.continuous_buffer());
+}
+
+BOOST_AUTO_TEST_CASE( publish_message_expiry_interval_v5 ) {
+    MQTT_NS::v5::properties props {
+        MQTT_NS::v5::property::content_type("text"_mb),
+        MQTT_NS::v5::property::message_expiry_interval(100)
+    };
+    auto m1 = MQTT_NS::v5::publish_message("1234"_mb, MQTT_NS::qos::at_least_once, false, false, 1, props, "AB"_mb);
+    BOOST_TEST(m1.message_expiry_interval().value() == 100U);
+    auto m2 = m1;
+    m2.update_message_expiry_interval(40);
+    BOOST_TEST(m2.message_expiry_interval().value() == 40U);
+    // The copy shares the properties but is not modified.
+    BOOST_TEST(m1.message_expiry_interval().value() == 100U);
+
+    MQTT_NS::v5::properties expected_props {
+        MQTT_NS::v5::property::content_type("text"_mb),
+        MQTT_NS::v5::property::message_expiry_interval(40)
+    };
+    auto expected = MQTT_NS::v5::publish_message("1234"_mb, MQTT_NS::qos::at_least_once, false, false, 1, expected_props, "AB"_mb);
+    BOOST_TEST(m2.continuous_buffer() == expected.continuous_buffer());
+
+    // The message without Message Expiry Interval never expires.
+    auto m3 = MQTT_NS::v5::publish_message("1234"_mb, MQTT_NS::qos::at_least_once, false, false, 1, {}, "AB"_mb);
+    BOOST_TEST(!m3.message_expiry_interval());
+    m3.update_message_expiry_interval(40);
+    BOOST_TEST(!m3.message_expiry_interval());
+}
+
 BOOST_AUTO_TEST_CASE( subscribe_cbuf ) {
     std::vector<std::tuple<MQTT_NS::buffer, MQTT_NS::subscribe_options>> v;
     auto topic = "tp"_mb;
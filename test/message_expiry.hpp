@@ -0,0 +1,75 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_MESSAGE_EXPIRY_HPP)
+#define MQTT_TEST_MESSAGE_EXPIRY_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <mqtt/optional.hpp>
+#include <mqtt/property_variant.hpp>
+#include <mqtt/visitor_util.hpp>
+
+using expiry_clock = std::chrono::steady_clock;
+
+/**
+ * @brief Get the time when the message expires.
+ * @param props properties of the message
+ * @param now time when the message is received
+ * @return expiry time. nullopt if the message has no Message Expiry Interval.
+ */
+inline MQTT_NS::optional<expiry_clock::time_point> message_expiry(
+    std::vector<MQTT_NS::v5::property_variant> const& props,
+    expiry_clock::time_point now = expiry_clock::now()) {
+    MQTT_NS::optional<expiry_clock::time_point> ret;
+    for (auto const& p : props) {
+        MQTT_NS::visit(
+            MQTT_NS::make_lambda_visitor<void>(
+                [&](MQTT_NS::v5::property::message_expiry_interval const& v) {
+                    ret.emplace(now + std::chrono::seconds(v.val()));
+                },
+                [](auto const&) {}
+            ),
+            p
+        );
+    }
+    return ret;
+}
+
+/**
+ * @brief Get the properties to send the message that has been waiting in the broker.
+ *        The Message Expiry Interval is decreased by the waiting time [MQTT-3.3.2-6].
+ * @param props properties of the message
+ * @param expiry time when the message expires
+ * @param now current time
+ * @return properties to send
+ */
+inline std::vector<MQTT_NS::v5::property_variant> remaining_expiry_props(
+    std::vector<MQTT_NS::v5::property_variant> props,
+    MQTT_NS::optional<expiry_clock::time_point> const& expiry,
+    expiry_clock::time_point now = expiry_clock::now()) {
+    if (!expiry) return props;
+    // Round up in order not to send 0 before the message expires.
+    auto remaining = std::chrono::duration_cast<std::chrono::seconds>(
+        expiry.value() - now + std::chrono::seconds(1) - expiry_clock::duration(1)
+    );
+    for (auto& p : props) {
+        MQTT_NS::visit(
+            MQTT_NS::make_lambda_visitor<void>(
+                [&](MQTT_NS::v5::property::message_expiry_interval& v) {
+                    v = MQTT_NS::v5::property::message_expiry_interval(static_cast<std::uint32_t>(remaining.count()));
+                },
+                [](auto&) {}
+            ),
+            p
+        );
+    }
+    return props;
+}
+
+#endif // MQTT_TEST_MESSAGE_EXPIRY_HPP
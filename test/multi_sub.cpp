@@ -578,4 +578,400 @@ BOOST_AUTO_TEST_CASE( multi_client_qos1 ) {
     BOOST_TEST(chk.all());
 }
 
+BOOST_AUTO_TEST_CASE( shared_subscription ) {
+    boost::asio::io_context ioc;
+    test_broker b(ioc);
+    test_server_no_tls s(ioc, b);
+
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_clean_session(true);
+    c1->set_client_id("cid1");
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c2->set_clean_session(true);
+    c2->set_client_id("cid2");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c1)>::packet_id_t;
+
+    int close_count = 0;
+    auto server_close = [&] {
+        if (++close_count == 2) s.close();
+    };
+
+    checker chk = {
+        // c1 connect
+        cont("h_connack_1"),
+        // c1 subscribe $share/g1/topic1 QoS0 and an invalid shared subscription
+        cont("h_suback_1"),
+        // c2 connect
+        cont("h_connack_2"),
+        // c2 subscribe $share/g1/topic1 QoS0
+        cont("h_suback_2"),
+        // c1 publish topic1 QoS0 4 times, delivered to c1 and c2 in turn
+        // disconnect
+        deps("h_close_1", "h_suback_2"),
+        deps("h_close_2", "h_suback_2"),
+    };
+
+    auto error = [](boost::system::error_code const&) {
+        BOOST_CHECK(false);
+    };
+    c1->set_error_handler(error);
+    c2->set_error_handler(error);
+
+    std::vector<std::string> received1;
+    std::vector<std::string> received2;
+
+    c1->set_connack_handler(
+        [&chk, &c1]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack_1");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c1->subscribe(
+                std::vector<std::tuple<MQTT_NS::string_view, MQTT_NS::subscribe_options>>{
+                    { "$share/g1/topic1", MQTT_NS::qos::at_most_once },
+                    { "$share/+/topic1", MQTT_NS::qos::at_most_once }
+                }
+            );
+            return true;
+        });
+    c1->set_suback_handler(
+        [&chk, &c2]
+        (packet_id_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> results) {
+            MQTT_CHK("h_suback_1");
+            BOOST_TEST(results.size() == 2U);
+            BOOST_TEST(*results[0] == MQTT_NS::suback_reason_code::granted_qos_0);
+            BOOST_TEST(!results[1]);
+            c2->connect();
+            return true;
+        });
+    c1->set_publish_handler(
+        [&c1, &received1]
+        (std::uint8_t /*header*/,
+         MQTT_NS::optional<packet_id_t> /*packet_id*/,
+         MQTT_NS::string_view topic,
+         MQTT_NS::string_view contents) {
+            BOOST_TEST(topic == "topic1");
+            received1.emplace_back(contents);
+            // c1 has sent all the publishes before, so the broker delivers all of them before the disconnect.
+            if (received1.size() == 2) c1->disconnect();
+            return true;
+        });
+    c1->set_close_handler(
+        [&chk, &server_close]
+        () {
+            MQTT_CHK("h_close_1");
+            server_close();
+        });
+
+    c2->set_connack_handler(
+        [&chk, &c2]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack_2");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c2->subscribe("$share/g1/topic1", MQTT_NS::qos::at_most_once);
+            return true;
+        });
+    c2->set_suback_handler(
+        [&chk, &c1]
+        (packet_id_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> results) {
+            MQTT_CHK("h_suback_2");
+            BOOST_TEST(results.size() == 1U);
+            BOOST_TEST(*results[0] == MQTT_NS::suback_reason_code::granted_qos_0);
+            for (auto contents : { "1", "2", "3", "4" }) {
+                c1->publish("topic1", contents, MQTT_NS::qos::at_most_once);
+            }
+            return true;
+        });
+    c2->set_publish_handler(
+        [&c2, &received2]
+        (std::uint8_t /*header*/,
+         MQTT_NS::optional<packet_id_t> /*packet_id*/,
+         MQTT_NS::string_view topic,
+         MQTT_NS::string_view contents) {
+            BOOST_TEST(topic == "topic1");
+            received2.emplace_back(contents);
+            if (received2.size() == 2) c2->disconnect();
+            return true;
+        });
+    c2->set_close_handler(
+        [&chk, &server_close]
+        () {
+            MQTT_CHK("h_close_2");
+            server_close();
+        });
+
+    c1->connect();
+
+    ioc.run();
+    BOOST_TEST(chk.all());
+    BOOST_TEST((received1 == std::vector<std::string>{ "1", "3" }));
+    BOOST_TEST((received2 == std::vector<std::string>{ "2", "4" }));
+}
+
+BOOST_AUTO_TEST_CASE( offline_message_limits ) {
+    boost::asio::io_context ioc;
+    test_broker b(ioc);
+    test_server_no_tls s(ioc, b);
+    offline_message_queue::limits limits;
+    limits.max_messages = 2;
+    b.set_offline_message_limits(limits);
+
+    // c1 and c3 use the same client id.
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_clean_session(false);
+    c1->set_client_id("cid1");
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c2->set_clean_session(true);
+    c2->set_client_id("cid2");
+    auto c3 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c3->set_clean_session(false);
+    c3->set_client_id("cid1");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c1)>::packet_id_t;
+
+    checker chk = {
+        // c1 connect
+        cont("h_connack_1"),
+        // c1 subscribe topic1 QoS1
+        cont("h_suback_1"),
+        // c1 disconnect
+        cont("h_close_1"),
+        // c2 connect
+        cont("h_connack_2"),
+        // c2 publish topic1 QoS1 3 times, the oldest one is dropped
+        cont("h_puback_2"),
+        // c2 disconnect
+        cont("h_close_2"),
+        // c3 connect, resumes the session of c1
+        cont("h_connack_3"),
+        // c3 disconnect
+        deps("h_close_3", "h_connack_3"),
+    };
+
+    auto error = [](boost::system::error_code const&) {
+        BOOST_CHECK(false);
+    };
+    c1->set_error_handler(error);
+    c2->set_error_handler(error);
+    c3->set_error_handler(error);
+
+    c1->set_connack_handler(
+        [&chk, &c1]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack_1");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c1->subscribe("topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c1->set_suback_handler(
+        [&chk, &c1]
+        (packet_id_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            MQTT_CHK("h_suback_1");
+            c1->disconnect();
+            return true;
+        });
+    c1->set_close_handler(
+        [&chk, &c2]
+        () {
+            MQTT_CHK("h_close_1");
+            c2->connect();
+        });
+
+    int puback_count = 0;
+    c2->set_connack_handler(
+        [&chk, &c2]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack_2");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            for (auto contents : { "1", "2", "3" }) {
+                c2->publish("topic1", contents, MQTT_NS::qos::at_least_once);
+            }
+            return true;
+        });
+    c2->set_puback_handler(
+        [&chk, &c2, &puback_count]
+        (packet_id_t /*packet_id*/) {
+            if (++puback_count == 3) {
+                MQTT_CHK("h_puback_2");
+                c2->disconnect();
+            }
+            return true;
+        });
+    c2->set_close_handler(
+        [&chk, &c3]
+        () {
+            MQTT_CHK("h_close_2");
+            c3->connect();
+        });
+
+    std::vector<std::string> received;
+    c3->set_connack_handler(
+        [&chk]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack_3");
+            BOOST_TEST(sp == true);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            return true;
+        });
+    c3->set_publish_handler(
+        [&c3, &received]
+        (std::uint8_t header,
+         MQTT_NS::optional<packet_id_t> /*packet_id*/,
+         MQTT_NS::string_view topic,
+         MQTT_NS::string_view contents) {
+            BOOST_TEST(MQTT_NS::publish::get_qos(header) == MQTT_NS::qos::at_least_once);
+            BOOST_TEST(topic == "topic1");
+            received.emplace_back(contents);
+            if (received.size() == 2) c3->disconnect();
+            return true;
+        });
+    c3->set_close_handler(
+        [&chk, &s]
+        () {
+            MQTT_CHK("h_close_3");
+            s.close();
+        });
+
+    c1->connect();
+
+    ioc.run();
+    BOOST_TEST(chk.all());
+    BOOST_TEST((received == std::vector<std::string>{ "2", "3" }));
+}
+
+BOOST_AUTO_TEST_CASE( resubscribe_saved_qos ) {
+    boost::asio::io_context ioc;
+    test_broker b(ioc);
+    test_server_no_tls s(ioc, b);
+
+    // c1 and c3 use the same client id.
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_clean_session(false);
+    c1->set_client_id("cid1");
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c2->set_clean_session(true);
+    c2->set_client_id("cid2");
+    auto c3 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c3->set_clean_session(false);
+    c3->set_client_id("cid1");
+
+    using packet_id_t = typename std::remove_reference_t<decltype(*c1)>::packet_id_t;
+
+    checker chk = {
+        // c1 connect
+        cont("h_connack_1"),
+        // c1 subscribe topic1 QoS0
+        cont("h_suback_1_1"),
+        // c1 subscribe topic1 QoS1, it replaces the subscription
+        cont("h_suback_1_2"),
+        // c1 disconnect
+        cont("h_close_1"),
+        // c2 connect
+        cont("h_connack_2"),
+        // c2 publish topic1 QoS1
+        cont("h_puback_2"),
+        // c2 disconnect
+        cont("h_close_2"),
+        // c3 connect, resumes the session of c1
+        cont("h_connack_3"),
+        // c3 receives the message by QoS1
+        cont("h_publish_3"),
+        // c3 disconnect
+        cont("h_close_3"),
+    };
+
+    auto error = [](boost::system::error_code const&) {
+        BOOST_CHECK(false);
+    };
+    c1->set_error_handler(error);
+    c2->set_error_handler(error);
+    c3->set_error_handler(error);
+
+    int suback_count = 0;
+    c1->set_connack_handler(
+        [&chk, &c1]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack_1");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c1->subscribe("topic1", MQTT_NS::qos::at_most_once);
+            return true;
+        });
+    c1->set_suback_handler(
+        [&chk, &c1, &suback_count]
+        (packet_id_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            if (++suback_count == 1) {
+                MQTT_CHK("h_suback_1_1");
+                c1->subscribe("topic1", MQTT_NS::qos::at_least_once);
+            }
+            else {
+                MQTT_CHK("h_suback_1_2");
+                c1->disconnect();
+            }
+            return true;
+        });
+    c1->set_close_handler(
+        [&chk, &c2]
+        () {
+            MQTT_CHK("h_close_1");
+            c2->connect();
+        });
+
+    c2->set_connack_handler(
+        [&chk, &c2]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack_2");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c2->publish("topic1", "topic1_contents", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c2->set_puback_handler(
+        [&chk, &c2]
+        (packet_id_t /*packet_id*/) {
+            MQTT_CHK("h_puback_2");
+            c2->disconnect();
+            return true;
+        });
+    c2->set_close_handler(
+        [&chk, &c3]
+        () {
+            MQTT_CHK("h_close_2");
+            c3->connect();
+        });
+
+    c3->set_connack_handler(
+        [&chk]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack_3");
+            BOOST_TEST(sp == true);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            return true;
+        });
+    c3->set_publish_handler(
+        [&chk, &c3]
+        (std::uint8_t header,
+         MQTT_NS::optional<packet_id_t> /*packet_id*/,
+         MQTT_NS::string_view topic,
+         MQTT_NS::string_view contents) {
+            MQTT_CHK("h_publish_3");
+            BOOST_TEST(MQTT_NS::publish::get_qos(header) == MQTT_NS::qos::at_least_once);
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "topic1_contents");
+            c3->disconnect();
+            return true;
+        });
+    c3->set_close_handler(
+        [&chk, &s]
+        () {
+            MQTT_CHK("h_close_3");
+            s.close();
+        });
+
+    c1->connect();
+
+    ioc.run();
+    BOOST_TEST(chk.all());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
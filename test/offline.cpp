@@ -115,7 +115,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
                         // offline publish
                         pid_pub = c->publish("topic1", "topic1_contents", MQTT_NS::qos::at_least_once);
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_puback",
                     [&] {
@@ -131,7 +131,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
                 BOOST_CHECK(false);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
@@ -258,7 +258,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
                         // offline publish
                         pid_pub = c->publish("topic1", "topic1_contents", MQTT_NS::qos::exactly_once);
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_pubcomp",
                     [&] {
@@ -274,7 +274,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
                 BOOST_CHECK(false);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
@@ -412,7 +412,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
                         pid_pub1 = c->publish(/*topic_base()*/ + "987/topic1", "topic1_contents1", MQTT_NS::qos::at_least_once);
                         pid_pub2 = c->publish(/*topic_base()*/ + "987/topic1", "topic1_contents2", MQTT_NS::qos::at_least_once);
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_puback2",
                     [&] {
@@ -428,7 +428,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
                 BOOST_CHECK(false);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
@@ -550,7 +550,7 @@ BOOST_AUTO_TEST_CASE( async_publish_qos1 ) {
                             }
                         );
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_puback",
                     [&] {
@@ -566,7 +566,7 @@ BOOST_AUTO_TEST_CASE( async_publish_qos1 ) {
                 BOOST_CHECK(false);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
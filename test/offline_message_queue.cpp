@@ -0,0 +1,225 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "offline_message_queue.hpp"
+
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_offline_message_queue)
+
+using queue_t = offline_message_queue;
+
+inline std::shared_ptr<offline_message const> make_message(std::string const& contents) {
+    return std::make_shared<offline_message const>(
+        MQTT_NS::allocate_buffer("topic1"),
+        MQTT_NS::allocate_buffer(contents),
+        std::vector<MQTT_NS::v5::property_variant>()
+    );
+}
+
+inline std::shared_ptr<offline_message const> make_expiring_message(std::string const& contents, std::uint32_t interval) {
+    return std::make_shared<offline_message const>(
+        MQTT_NS::allocate_buffer("topic1"),
+        MQTT_NS::allocate_buffer(contents),
+        std::vector<MQTT_NS::v5::property_variant> {
+            MQTT_NS::v5::property::message_expiry_interval(interval)
+        }
+    );
+}
+
+inline std::vector<std::string> contents(queue_t const& q) {
+    std::vector<std::string> ret;
+    q.for_each(
+        [&](queue_t::entry const& e) {
+            ret.emplace_back(e.message->contents);
+        }
+    );
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE( unlimited ) {
+    queue_t q;
+    queue_t::limits l;
+    for (int i = 0; i != 100; ++i) {
+        BOOST_TEST(q.push(make_message(std::to_string(i)), MQTT_NS::qos::at_least_once, l));
+    }
+    BOOST_TEST(q.size() == 100U);
+    BOOST_TEST(q.dropped() == 0U);
+    auto c = contents(q);
+    BOOST_TEST(c.front() == "0");
+    BOOST_TEST(c.back() == "99");
+
+    // The moved from queue is empty.
+    queue_t q2 = std::move(q);
+    BOOST_TEST(q2.size() == 100U);
+    BOOST_TEST(q.empty());
+    BOOST_TEST(q.bytes() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( drop_oldest ) {
+    queue_t q;
+    queue_t::limits l;
+    l.max_messages = 3;
+    for (auto s : { "1", "2", "3", "4", "5" }) {
+        BOOST_TEST(q.push(make_message(s), MQTT_NS::qos::at_least_once, l));
+    }
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "3", "4", "5" }));
+    BOOST_TEST(q.dropped() == 2U);
+}
+
+BOOST_AUTO_TEST_CASE( drop_newest ) {
+    queue_t q;
+    queue_t::limits l;
+    l.max_messages = 3;
+    l.policy = queue_t::overflow_policy::drop_newest;
+    BOOST_TEST(q.push(make_message("1"), MQTT_NS::qos::at_least_once, l));
+    BOOST_TEST(q.push(make_message("2"), MQTT_NS::qos::at_least_once, l));
+    BOOST_TEST(q.push(make_message("3"), MQTT_NS::qos::at_least_once, l));
+    BOOST_TEST(!q.push(make_message("4"), MQTT_NS::qos::at_least_once, l));
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "1", "2", "3" }));
+    BOOST_TEST(q.dropped() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( drop_qos0 ) {
+    queue_t q;
+    queue_t::limits l;
+    l.max_messages = 3;
+    l.policy = queue_t::overflow_policy::drop_qos0;
+    q.push(make_message("1"), MQTT_NS::qos::at_least_once, l);
+    q.push(make_message("2"), MQTT_NS::qos::at_most_once, l);
+    q.push(make_message("3"), MQTT_NS::qos::at_most_once, l);
+    q.push(make_message("4"), MQTT_NS::qos::exactly_once, l);
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "1", "3", "4" }));
+    q.push(make_message("5"), MQTT_NS::qos::at_least_once, l);
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "1", "4", "5" }));
+    // No QoS0 message is left, so the oldest one is dropped.
+    q.push(make_message("6"), MQTT_NS::qos::at_least_once, l);
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "4", "5", "6" }));
+    BOOST_TEST(q.dropped() == 3U);
+    // The new QoS0 message is dropped instead of the others.
+    BOOST_TEST(!q.push(make_message("7"), MQTT_NS::qos::at_most_once, l));
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "4", "5", "6" }));
+    BOOST_TEST(q.dropped() == 4U);
+    q.push(make_message("8"), MQTT_NS::qos::at_least_once, l);
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "5", "6", "8" }));
+
+    // The moved queue keeps the count of QoS0 messages.
+    queue_t q2;
+    q2.push(make_message("9"), MQTT_NS::qos::at_least_once, l);
+    q2.push(make_message("10"), MQTT_NS::qos::at_most_once, l);
+    q2.push(make_message("11"), MQTT_NS::qos::at_least_once, l);
+    queue_t q3 = std::move(q2);
+    q3.push(make_message("12"), MQTT_NS::qos::at_least_once, l);
+    BOOST_TEST((contents(q3) == std::vector<std::string>{ "9", "11", "12" }));
+}
+
+BOOST_AUTO_TEST_CASE( max_bytes ) {
+    queue_t q;
+    queue_t::limits l;
+    // "topic1" and 4 bytes contents are 10 bytes.
+    l.max_bytes = 25;
+    q.push(make_message("1111"), MQTT_NS::qos::at_least_once, l);
+    q.push(make_message("2222"), MQTT_NS::qos::at_least_once, l);
+    BOOST_TEST(q.bytes() == 20U);
+    q.push(make_message("3333"), MQTT_NS::qos::at_least_once, l);
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "2222", "3333" }));
+    BOOST_TEST(q.bytes() == 20U);
+
+    // A message that is larger than the limit is never stored.
+    BOOST_TEST(!q.push(make_message(std::string(20, 'x')), MQTT_NS::qos::at_least_once, l));
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "2222", "3333" }));
+    BOOST_TEST(q.dropped() == 2U);
+
+    q.clear();
+    BOOST_TEST(q.empty());
+    BOOST_TEST(q.bytes() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( shared_body ) {
+    queue_t q1;
+    queue_t q2;
+    queue_t::limits l;
+    auto msg = make_message("contents");
+    q1.push(msg, MQTT_NS::qos::at_least_once, l);
+    q2.push(msg, MQTT_NS::qos::at_most_once, l);
+    BOOST_TEST(msg.use_count() == 3);
+    q1.for_each(
+        [&](queue_t::entry const& e) {
+            BOOST_TEST(e.message == msg);
+            BOOST_TEST(e.qos_value == MQTT_NS::qos::at_least_once);
+        }
+    );
+    q2.for_each(
+        [&](queue_t::entry const& e) {
+            BOOST_TEST(e.message == msg);
+            BOOST_TEST(e.qos_value == MQTT_NS::qos::at_most_once);
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( erase_expired ) {
+    queue_t q;
+    queue_t::limits l;
+    auto now = expiry_clock::now();
+    q.push(make_expiring_message("1", 10), MQTT_NS::qos::at_least_once, l);
+    q.push(make_message("2"), MQTT_NS::qos::at_least_once, l);
+    q.push(make_expiring_message("3", 20), MQTT_NS::qos::at_least_once, l);
+    BOOST_TEST(q.erase_expired(now) == 0U);
+    BOOST_TEST(q.erase_expired(now + std::chrono::seconds(15)) == 1U);
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "2", "3" }));
+    BOOST_TEST(q.bytes() == 14U);
+
+    // The remaining interval is sent with the message.
+    q.for_each(
+        [&](queue_t::entry const& e) {
+            if (!e.message->expiry) return;
+            auto props = remaining_expiry_props(
+                e.message->props,
+                e.message->expiry,
+                e.message->expiry.value() - std::chrono::milliseconds(4500)
+            );
+            MQTT_NS::visit(
+                MQTT_NS::make_lambda_visitor<void>(
+                    [&](MQTT_NS::v5::property::message_expiry_interval const& v) {
+                        // The remaining time is rounded up.
+                        BOOST_TEST(v.val() == 5U);
+                    },
+                    [](auto const&) {
+                        BOOST_TEST(false);
+                    }
+                ),
+                props.front()
+            );
+        }
+    );
+
+    BOOST_TEST(q.erase_expired(now + std::chrono::seconds(3600)) == 1U);
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "2" }));
+    BOOST_TEST(q.bytes() == 7U);
+}
+
+BOOST_AUTO_TEST_CASE( erase_expired_front ) {
+    queue_t q;
+    queue_t::limits l;
+    auto now = expiry_clock::now();
+    q.push(make_expiring_message("1", 10), MQTT_NS::qos::at_least_once, l);
+    q.push(make_expiring_message("2", 5), MQTT_NS::qos::at_least_once, l);
+    q.push(make_message("3"), MQTT_NS::qos::at_least_once, l);
+    q.push(make_expiring_message("4", 1), MQTT_NS::qos::at_least_once, l);
+    BOOST_TEST((q.front_expiry().value() >= now + std::chrono::seconds(10)));
+
+    // "2" has expired, but it is behind "1".
+    BOOST_TEST(q.erase_expired_front(now + std::chrono::seconds(6)) == 0U);
+    BOOST_TEST(q.erase_expired_front(now + std::chrono::seconds(11)) == 2U);
+    BOOST_TEST((contents(q) == std::vector<std::string>{ "3", "4" }));
+    BOOST_TEST(q.bytes() == 14U);
+    // The oldest message never expires.
+    BOOST_TEST(!q.front_expiry());
+    BOOST_TEST(q.erase_expired_front(now + std::chrono::seconds(3600)) == 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,272 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_OFFLINE_MESSAGE_QUEUE_HPP)
+#define MQTT_TEST_OFFLINE_MESSAGE_QUEUE_HPP
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/circular_buffer.hpp>
+
+#include <mqtt/buffer.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/property_variant.hpp>
+#include <mqtt/subscribe_options.hpp>
+
+#include "message_expiry.hpp"
+
+/**
+ * @brief The body of a message that is published while the subscribers are offline.
+ *        It is shared by the queues of all the sessions that the message is delivered to.
+ */
+struct offline_message {
+    offline_message(
+        MQTT_NS::buffer topic,
+        MQTT_NS::buffer contents,
+        std::vector<MQTT_NS::v5::property_variant> props)
+        :topic(std::move(topic)), contents(std::move(contents)), props(std::move(props)),
+         expiry(message_expiry(this->props)) {}
+
+    /**
+     * @brief Get the size that is charged to each queue that holds the message.
+     *        The properties are not counted.
+     */
+    std::size_t size() const {
+        return topic.size() + contents.size();
+    }
+
+    bool expired(expiry_clock::time_point now) const {
+        return expiry && expiry.value() <= now;
+    }
+
+    MQTT_NS::buffer topic;
+    MQTT_NS::buffer contents;
+    std::vector<MQTT_NS::v5::property_variant> props;
+    MQTT_NS::optional<expiry_clock::time_point> expiry; ///< nullopt means never expire
+};
+
+/**
+ * @brief The queue of the messages that are published while a session is offline.
+ *
+ * Messages are held in a ring buffer that grows up to the count limit.
+ * When the count limit or the byte limit would be exceeded, a message is dropped
+ * according to the overflow policy. Each queue is charged for the full size of
+ * the messages that it holds, even if their bodies are shared with other queues.
+ * Messages whose Message Expiry Interval has passed stay in the queue until
+ * they are erased, so the reader should skip them. erase_expired_front() erases
+ * them from the front in O(1) each. A message that expires before an older one
+ * is left until it reaches the front, or until erase_expired() is called.
+ */
+class offline_message_queue {
+public:
+    enum class overflow_policy {
+        drop_oldest, ///< Drop the oldest messages to store the new one.
+        drop_newest, ///< Drop the new message.
+        drop_qos0    ///< Drop the oldest QoS0 messages first. If there is none, drop the new QoS0 message, or the oldest messages.
+    };
+
+    /**
+     * @brief The limits of each queue. 0 means unlimited.
+     */
+    struct limits {
+        std::size_t max_messages = 0;
+        std::size_t max_bytes = 0;
+        overflow_policy policy = overflow_policy::drop_oldest;
+    };
+
+    struct entry {
+        std::shared_ptr<offline_message const> message;
+        MQTT_NS::qos qos_value;
+    };
+
+    offline_message_queue() = default;
+    offline_message_queue(offline_message_queue const&) = default;
+    offline_message_queue& operator=(offline_message_queue const&) = default;
+
+    // The moved from queue is empty.
+    offline_message_queue(offline_message_queue&& other) noexcept
+        :entries_(MQTT_NS::force_move(other.entries_)),
+         bytes_(other.bytes_),
+         qos0_count_(other.qos0_count_),
+         dropped_(other.dropped_) {
+        other.clear();
+        other.dropped_ = 0;
+    }
+
+    offline_message_queue& operator=(offline_message_queue&& other) noexcept {
+        if (this == &other) return *this;
+        entries_ = MQTT_NS::force_move(other.entries_);
+        bytes_ = other.bytes_;
+        qos0_count_ = other.qos0_count_;
+        dropped_ = other.dropped_;
+        other.clear();
+        other.dropped_ = 0;
+        return *this;
+    }
+
+    /**
+     * @brief Push the message to the end of the queue.
+     * @param message message
+     * @param qos_value QoS to deliver the message
+     * @param l limits of the queue
+     * @return true if the message is stored, false if it is dropped
+     */
+    bool push(std::shared_ptr<offline_message const> message, MQTT_NS::qos qos_value, limits const& l) {
+        auto size = message->size();
+        if (l.max_bytes != 0 && size > l.max_bytes) {
+            ++dropped_;
+            return false;
+        }
+        while (!fits(size, l)) {
+            if (l.policy == overflow_policy::drop_newest) {
+                ++dropped_;
+                return false;
+            }
+            if (l.policy == overflow_policy::drop_qos0 && qos0_count_ == 0 &&
+                qos_value == MQTT_NS::qos::at_most_once) {
+                // The new message is the only QoS0 message.
+                ++dropped_;
+                return false;
+            }
+            // Don't scan the queue if it has no QoS0 message.
+            if (l.policy == overflow_policy::drop_qos0 && qos0_count_ != 0) {
+                auto it = std::find_if(
+                    entries_.begin(),
+                    entries_.end(),
+                    [](entry const& e) { return e.qos_value == MQTT_NS::qos::at_most_once; }
+                );
+                BOOST_ASSERT(it != entries_.end());
+                bytes_ -= it->message->size();
+                --qos0_count_;
+                entries_.erase(it);
+                ++dropped_;
+                continue;
+            }
+            pop_front();
+            ++dropped_;
+        }
+        if (entries_.full()) {
+            // Grow the ring buffer up to the count limit.
+            auto capacity = std::max<std::size_t>(entries_.capacity() * 2, 16);
+            if (l.max_messages != 0) capacity = std::min(capacity, l.max_messages);
+            entries_.set_capacity(capacity);
+        }
+        bytes_ += size;
+        if (qos_value == MQTT_NS::qos::at_most_once) ++qos0_count_;
+        entries_.push_back(entry{ MQTT_NS::force_move(message), qos_value });
+        return true;
+    }
+
+    /**
+     * @brief Call f for each message from the oldest one.
+     * @param f function that is called as f(entry const&)
+     */
+    template <typename F>
+    void for_each(F&& f) const {
+        for (auto const& e : entries_) f(e);
+    }
+
+    /**
+     * @brief Erase the messages whose Message Expiry Interval has passed.
+     * @param now current time
+     * @return number of the erased messages
+     */
+    std::size_t erase_expired(expiry_clock::time_point now = expiry_clock::now()) {
+        auto it = std::remove_if(
+            entries_.begin(),
+            entries_.end(),
+            [&](entry const& e) {
+                if (!e.message->expired(now)) return false;
+                bytes_ -= e.message->size();
+                if (e.qos_value == MQTT_NS::qos::at_most_once) --qos0_count_;
+                return true;
+            }
+        );
+        auto erased = static_cast<std::size_t>(std::distance(it, entries_.end()));
+        entries_.erase(it, entries_.end());
+        return erased;
+    }
+
+    /**
+     * @brief Erase the expired messages from the front of the queue.
+     *        It stops at the first message that is not expired.
+     * @param now current time
+     * @return number of the erased messages
+     */
+    std::size_t erase_expired_front(expiry_clock::time_point now = expiry_clock::now()) {
+        std::size_t erased = 0;
+        while (!entries_.empty() && entries_.front().message->expired(now)) {
+            pop_front();
+            ++erased;
+        }
+        return erased;
+    }
+
+    /**
+     * @brief Get the expiry of the oldest message
+     * @return expiry. nullopt if the queue is empty or the oldest message never expires.
+     */
+    MQTT_NS::optional<expiry_clock::time_point> front_expiry() const {
+        if (entries_.empty()) return MQTT_NS::nullopt;
+        return entries_.front().message->expiry;
+    }
+
+    void clear() {
+        entries_.clear();
+        bytes_ = 0;
+        qos0_count_ = 0;
+    }
+
+    /**
+     * @brief Get the number of messages
+     */
+    std::size_t size() const {
+        return entries_.size();
+    }
+
+    bool empty() const {
+        return entries_.empty();
+    }
+
+    /**
+     * @brief Get the total size of the messages
+     */
+    std::size_t bytes() const {
+        return bytes_;
+    }
+
+    /**
+     * @brief Get the number of messages that have been dropped by the limits
+     */
+    std::size_t dropped() const {
+        return dropped_;
+    }
+
+private:
+    bool fits(std::size_t size, limits const& l) const {
+        if (entries_.empty()) return true;
+        if (l.max_messages != 0 && entries_.size() >= l.max_messages) return false;
+        if (l.max_bytes != 0 && bytes_ + size > l.max_bytes) return false;
+        return true;
+    }
+
+    void pop_front() {
+        bytes_ -= entries_.front().message->size();
+        if (entries_.front().qos_value == MQTT_NS::qos::at_most_once) --qos0_count_;
+        entries_.pop_front();
+    }
+
+    boost::circular_buffer<entry> entries_;
+    std::size_t bytes_ = 0;
+    std::size_t qos0_count_ = 0; ///< Number of the QoS0 messages in entries_
+    std::size_t dropped_ = 0;
+};
+
+#endif // MQTT_TEST_OFFLINE_MESSAGE_QUEUE_HPP
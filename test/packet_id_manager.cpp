@@ -0,0 +1,100 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+
+#include <chrono>
+#include <vector>
+#include <random>
+
+#include <mqtt/packet_id_manager.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_packet_id_manager)
+
+BOOST_AUTO_TEST_CASE( wrap_around ) {
+    MQTT_NS::packet_id_manager<std::uint16_t> m;
+    BOOST_TEST(m.register_id(0xffff));
+    BOOST_TEST(m.register_id(0xfffe));
+    for (std::uint32_t i = 1; i != 0xfffe; ++i) {
+        BOOST_TEST(m.acquire_unique_id() == i);
+    }
+    BOOST_TEST(m.size() == 0xffffU);
+    BOOST_TEST(m.release_id(0x1234));
+    BOOST_TEST(!m.release_id(0x1234));
+    BOOST_TEST(m.acquire_unique_id() == 0x1234);
+    BOOST_TEST(m.release_id(64));
+    BOOST_TEST(m.release_id(0xffff));
+    // the first free id after the last acquired one
+    BOOST_TEST(m.acquire_unique_id() == 0xffff);
+    BOOST_TEST(m.acquire_unique_id() == 64);
+    try {
+        m.acquire_unique_id();
+        BOOST_TEST(false);
+    }
+    catch (MQTT_NS::packet_id_exhausted_error const&) {
+        BOOST_TEST(true);
+    }
+    m.clear();
+    BOOST_TEST(m.size() == 0U);
+    BOOST_TEST(!m.register_id(0));
+    BOOST_TEST(m.acquire_unique_id() == 65U);
+}
+
+BOOST_AUTO_TEST_CASE( four_bytes ) {
+    MQTT_NS::packet_id_manager<std::uint32_t> m;
+    BOOST_TEST(m.acquire_unique_id() == 1U);
+    BOOST_TEST(m.register_id(3));
+    BOOST_TEST(!m.register_id(3));
+    BOOST_TEST(!m.register_id(0));
+    BOOST_TEST(m.acquire_unique_id() == 2U);
+    BOOST_TEST(m.acquire_unique_id() == 4U);
+    BOOST_TEST(m.release_id(2));
+    BOOST_TEST(!m.release_id(2));
+    BOOST_TEST(m.acquire_unique_id() == 5U);
+    BOOST_TEST(m.size() == 4U);
+}
+
+// Throughput of acquire/release pairs at the given occupancy.
+template <typename PacketId>
+inline void bench(double occupancy) {
+    constexpr std::size_t capacity = 0xffff;
+    constexpr std::size_t loop = 1000000;
+
+    MQTT_NS::packet_id_manager<PacketId> m;
+    std::vector<PacketId> in_flight;
+    auto num = static_cast<std::size_t>(capacity * occupancy);
+    in_flight.reserve(num);
+    for (std::size_t i = 0; i != num; ++i) {
+        in_flight.push_back(m.acquire_unique_id());
+    }
+
+    // Release a random in-flight id and acquire a new one, keeping the occupancy.
+    std::mt19937 mt;
+    std::uniform_int_distribution<std::size_t> dist(0, num - 1);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != loop; ++i) {
+        auto& id = in_flight[dist(mt)];
+        m.release_id(id);
+        id = m.acquire_unique_id();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start
+    );
+    BOOST_TEST(m.size() == num);
+    BOOST_TEST_MESSAGE(
+        sizeof(PacketId) << " bytes packet id, occupancy " << occupancy * 100 << "%: " <<
+        static_cast<double>(elapsed.count()) / loop << " ns per acquire/release"
+    );
+}
+
+BOOST_AUTO_TEST_CASE( throughput ) {
+    for (auto occupancy : { 0.1, 0.9, 0.99 }) {
+        bench<std::uint16_t>(occupancy);
+        bench<std::uint32_t>(occupancy);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 #include "checker.hpp"
 
 #include <mqtt/optional.hpp>
+#include <mqtt/buffer_pool.hpp>
 
 BOOST_AUTO_TEST_SUITE(test_pubsub)
 
@@ -3011,4 +3012,435 @@ BOOST_AUTO_TEST_CASE( pubrec_rel_comp_prop ) {
     do_combi_test_sync(test);
 }
 
+BOOST_AUTO_TEST_CASE( sub_wildcard ) {
+    auto test = [](boost::asio::io_context& ioc, auto& c, auto& s, auto& /*b*/) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+
+        // topic, contents, matched
+        std::vector<std::tuple<std::string, std::string, bool>> const publishes {
+            std::make_tuple("topic1/b/d", "contents0", false),
+            std::make_tuple("topic1/b/c", "contents1", true),
+            std::make_tuple("topic2", "contents2", true),
+            std::make_tuple("$topic2/b", "contents3", false),
+            std::make_tuple("topic2/b/c", "contents4", true),
+        };
+        std::vector<std::tuple<std::string, std::string, bool>> expected;
+        std::copy_if(
+            publishes.begin(),
+            publishes.end(),
+            std::back_inserter(expected),
+            [](auto const& e) { return std::get<2>(e); }
+        );
+        std::size_t received = 0;
+        packet_id_t pid_sub;
+        packet_id_t pid_unsub;
+
+        checker chk = {
+            // connect
+            cont("h_connack"),
+            // subscribe topic1/+/c and topic2/# QoS0
+            cont("h_suback"),
+            // publish matched topics
+            cont("h_publish_all"),
+            cont("h_unsuback"),
+            // disconnect
+            cont("h_close"),
+        };
+
+        auto publish_all =
+            [&] {
+                for (auto const& e : publishes) {
+                    c->publish(std::get<0>(e), std::get<1>(e), MQTT_NS::qos::at_most_once);
+                }
+            };
+        auto check_publish =
+            [&]
+            (MQTT_NS::string_view topic, MQTT_NS::string_view contents) {
+                BOOST_TEST(received < expected.size());
+                if (received == expected.size()) return;
+                BOOST_TEST(topic == std::get<0>(expected[received]));
+                BOOST_TEST(contents == std::get<1>(expected[received]));
+                if (++received == expected.size()) {
+                    MQTT_CHK("h_publish_all");
+                    pid_unsub = c->unsubscribe(
+                        std::vector<MQTT_NS::string_view> { "topic1/+/c", "topic2/#" }
+                    );
+                }
+            };
+
+        c->set_connack_handler(
+            [&chk, &c, &pid_sub]
+            (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+                MQTT_CHK("h_connack");
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                pid_sub = c->subscribe(
+                    std::vector<std::tuple<MQTT_NS::string_view, MQTT_NS::subscribe_options>> {
+                        { "topic1/+/c", MQTT_NS::qos::at_most_once },
+                        { "topic2/#", MQTT_NS::qos::at_most_once }
+                    }
+                );
+                return true;
+            });
+        c->set_suback_handler(
+            [&chk, &pid_sub, &publish_all]
+            (packet_id_t packet_id, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+                MQTT_CHK("h_suback");
+                BOOST_TEST(packet_id == pid_sub);
+                publish_all();
+                return true;
+            });
+        c->set_unsuback_handler(
+            [&chk, &c, &pid_unsub]
+            (packet_id_t packet_id) {
+                MQTT_CHK("h_unsuback");
+                BOOST_TEST(packet_id == pid_unsub);
+                c->disconnect();
+                return true;
+            });
+        c->set_publish_handler(
+            [&check_publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::string_view topic,
+             MQTT_NS::string_view contents) {
+                check_publish(topic, contents);
+                return true;
+            });
+        c->set_v5_connack_handler(
+            [&chk, &c, &pid_sub]
+            (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_connack");
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+                pid_sub = c->subscribe(
+                    std::vector<std::tuple<MQTT_NS::string_view, MQTT_NS::subscribe_options>> {
+                        { "topic1/+/c", MQTT_NS::qos::at_most_once },
+                        { "topic2/#", MQTT_NS::qos::at_most_once }
+                    }
+                );
+                return true;
+            });
+        c->set_v5_suback_handler(
+            [&chk, &pid_sub, &publish_all]
+            (packet_id_t packet_id, std::vector<MQTT_NS::v5::suback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_suback");
+                BOOST_TEST(packet_id == pid_sub);
+                publish_all();
+                return true;
+            });
+        c->set_v5_unsuback_handler(
+            [&chk, &c, &pid_unsub]
+            (packet_id_t packet_id, std::vector<MQTT_NS::v5::unsuback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_unsuback");
+                BOOST_TEST(packet_id == pid_unsub);
+                c->disconnect();
+                return true;
+            });
+        c->set_v5_publish_handler(
+            [&check_publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::string_view topic,
+             MQTT_NS::string_view contents,
+             std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                check_publish(topic, contents);
+                return true;
+            });
+        c->set_close_handler(
+            [&chk, &s]
+            () {
+                MQTT_CHK("h_close");
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->connect();
+        ioc.run();
+        BOOST_TEST(chk.all());
+    };
+    do_combi_test_sync(test);
+}
+
+BOOST_AUTO_TEST_CASE( read_ahead ) {
+    auto test = [](boost::asio::io_context& ioc, auto& c, auto& s, auto& /*b*/) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+        // Smaller than some of the payloads in order to exercise the direct read path.
+        c->set_read_ahead_buffer_size(32);
+
+        std::vector<std::string> const contents_list {
+            "",
+            "a",
+            std::string(31, 'b'),
+            std::string(32, 'c'),
+            std::string(100, 'd'),
+            "e",
+            std::string(1000, 'f'),
+            "g",
+        };
+        std::size_t received = 0;
+        packet_id_t pid_sub;
+        packet_id_t pid_unsub;
+
+        checker chk = {
+            // connect
+            cont("h_connack"),
+            // subscribe topic1 QoS0
+            cont("h_suback"),
+            // publish topic1 QoS0 * contents_list.size()
+            cont("h_publish_all"),
+            cont("h_unsuback"),
+            // disconnect
+            cont("h_close"),
+        };
+
+        auto publish_all =
+            [&] {
+                for (auto const& contents : contents_list) {
+                    c->publish("topic1", contents, MQTT_NS::qos::at_most_once);
+                }
+            };
+        auto check_publish =
+            [&]
+            (MQTT_NS::string_view topic, MQTT_NS::string_view contents) {
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == contents_list[received]);
+                if (++received == contents_list.size()) {
+                    MQTT_CHK("h_publish_all");
+                    pid_unsub = c->unsubscribe("topic1");
+                }
+            };
+
+        c->set_connack_handler(
+            [&chk, &c, &pid_sub]
+            (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+                MQTT_CHK("h_connack");
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                pid_sub = c->subscribe("topic1", MQTT_NS::qos::at_most_once);
+                return true;
+            });
+        c->set_suback_handler(
+            [&chk, &pid_sub, &publish_all]
+            (packet_id_t packet_id, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+                MQTT_CHK("h_suback");
+                BOOST_TEST(packet_id == pid_sub);
+                publish_all();
+                return true;
+            });
+        c->set_unsuback_handler(
+            [&chk, &c, &pid_unsub]
+            (packet_id_t packet_id) {
+                MQTT_CHK("h_unsuback");
+                BOOST_TEST(packet_id == pid_unsub);
+                c->disconnect();
+                return true;
+            });
+        c->set_publish_handler(
+            [&check_publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::string_view topic,
+             MQTT_NS::string_view contents) {
+                check_publish(topic, contents);
+                return true;
+            });
+        c->set_v5_connack_handler(
+            [&chk, &c, &pid_sub]
+            (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_connack");
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+                pid_sub = c->subscribe("topic1", MQTT_NS::qos::at_most_once);
+                return true;
+            });
+        c->set_v5_suback_handler(
+            [&chk, &pid_sub, &publish_all]
+            (packet_id_t packet_id, std::vector<MQTT_NS::v5::suback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_suback");
+                BOOST_TEST(packet_id == pid_sub);
+                publish_all();
+                return true;
+            });
+        c->set_v5_unsuback_handler(
+            [&chk, &c, &pid_unsub]
+            (packet_id_t packet_id, std::vector<MQTT_NS::v5::unsuback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_unsuback");
+                BOOST_TEST(packet_id == pid_unsub);
+                c->disconnect();
+                return true;
+            });
+        c->set_v5_publish_handler(
+            [&check_publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::string_view topic,
+             MQTT_NS::string_view contents,
+             std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                check_publish(topic, contents);
+                return true;
+            });
+        c->set_close_handler(
+            [&chk, &s]
+            () {
+                MQTT_CHK("h_close");
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->connect();
+        ioc.run();
+        BOOST_TEST(chk.all());
+    };
+    do_combi_test_sync(test);
+}
+
+BOOST_AUTO_TEST_CASE( receive_buffer_allocator ) {
+    auto test = [](boost::asio::io_context& ioc, auto& c, auto& s, auto& /*b*/) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+        auto pool = MQTT_NS::buffer_pool::create();
+        c->set_receive_buffer_allocator(
+            [pool](std::size_t size) {
+                return pool->allocate(size);
+            }
+        );
+
+        std::vector<std::string> const contents_list {
+            "a",
+            std::string(1000, 'b'),
+            std::string(100000, 'c'),
+        };
+        std::size_t received = 0;
+        packet_id_t pid_sub;
+        packet_id_t pid_unsub;
+
+        checker chk = {
+            // connect
+            cont("h_connack"),
+            // subscribe topic1 QoS0
+            cont("h_suback"),
+            // publish topic1 QoS0 * contents_list.size()
+            cont("h_publish_all"),
+            cont("h_unsuback"),
+            // disconnect
+            cont("h_close"),
+        };
+
+        auto publish_all =
+            [&] {
+                for (auto const& contents : contents_list) {
+                    c->publish("topic1", contents, MQTT_NS::qos::at_most_once);
+                }
+            };
+        auto check_publish =
+            [&]
+            (MQTT_NS::string_view topic, MQTT_NS::string_view contents) {
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == contents_list[received]);
+                if (++received == contents_list.size()) {
+                    MQTT_CHK("h_publish_all");
+                    pid_unsub = c->unsubscribe("topic1");
+                }
+            };
+
+        c->set_connack_handler(
+            [&chk, &c, &pid_sub]
+            (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+                MQTT_CHK("h_connack");
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                pid_sub = c->subscribe("topic1", MQTT_NS::qos::at_most_once);
+                return true;
+            });
+        c->set_suback_handler(
+            [&chk, &pid_sub, &publish_all]
+            (packet_id_t packet_id, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+                MQTT_CHK("h_suback");
+                BOOST_TEST(packet_id == pid_sub);
+                publish_all();
+                return true;
+            });
+        c->set_unsuback_handler(
+            [&chk, &c, &pid_unsub]
+            (packet_id_t packet_id) {
+                MQTT_CHK("h_unsuback");
+                BOOST_TEST(packet_id == pid_unsub);
+                c->disconnect();
+                return true;
+            });
+        c->set_publish_handler(
+            [&check_publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::string_view topic,
+             MQTT_NS::string_view contents) {
+                check_publish(topic, contents);
+                return true;
+            });
+        c->set_v5_connack_handler(
+            [&chk, &c, &pid_sub]
+            (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_connack");
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+                pid_sub = c->subscribe("topic1", MQTT_NS::qos::at_most_once);
+                return true;
+            });
+        c->set_v5_suback_handler(
+            [&chk, &pid_sub, &publish_all]
+            (packet_id_t packet_id, std::vector<MQTT_NS::v5::suback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_suback");
+                BOOST_TEST(packet_id == pid_sub);
+                publish_all();
+                return true;
+            });
+        c->set_v5_unsuback_handler(
+            [&chk, &c, &pid_unsub]
+            (packet_id_t packet_id, std::vector<MQTT_NS::v5::unsuback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_unsuback");
+                BOOST_TEST(packet_id == pid_unsub);
+                c->disconnect();
+                return true;
+            });
+        c->set_v5_publish_handler(
+            [&check_publish]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<packet_id_t> /*packet_id*/,
+             MQTT_NS::string_view topic,
+             MQTT_NS::string_view contents,
+             std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                check_publish(topic, contents);
+                return true;
+            });
+        c->set_close_handler(
+            [&chk, &s]
+            () {
+                MQTT_CHK("h_close");
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->connect();
+        ioc.run();
+        BOOST_TEST(chk.all());
+        auto stats = pool->get_stats();
+        // connack, suback, publish * 3, unsuback
+        BOOST_TEST(stats.hit + stats.miss + stats.oversize >= 6U);
+        BOOST_TEST(stats.oversize >= 1U);
+    };
+    do_combi_test_sync(test);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
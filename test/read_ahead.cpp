@@ -0,0 +1,125 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_server_endpoint.hpp"
+
+#include <mqtt_client_cpp.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_read_ahead)
+
+namespace as = boost::asio;
+
+// The number of the read operations on the sockets of the server.
+std::size_t reads = 0;
+
+// tcp_endpoint that counts the read operations.
+class counting_socket : public MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand> {
+public:
+    using base = MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+    using base::base;
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read(MutableBufferSequence&& buffers, ReadHandler&& handler) {
+        ++reads;
+        base::async_read(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+    }
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(MutableBufferSequence&& buffers, ReadHandler&& handler) {
+        ++reads;
+        base::async_read_some(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+    }
+};
+
+using server_t = test_server_endpoint<MQTT_NS::endpoint<std::mutex, std::lock_guard, 2>, counting_socket>;
+using endpoint_t = server_t::endpoint_t;
+
+std::size_t const messages = 100;
+
+// The client publishes the messages at once, and the server counts the reads
+// until all of them are received.
+std::size_t count_reads(std::size_t read_ahead_buffer_size) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+
+    reads = 0;
+    std::size_t received = 0;
+    std::size_t ret = 0;
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_read_ahead_buffer_size(read_ahead_buffer_size);
+            ep.set_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_session*/,
+                 std::uint16_t /*keep_alive*/) {
+                    ep.connack(false, MQTT_NS::connect_return_code::accepted);
+                    // Count from the next packet.
+                    reads = 0;
+                    return true;
+                }
+            );
+            ep.set_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer /*topic*/,
+                 MQTT_NS::buffer contents) {
+                    BOOST_TEST(contents == std::to_string(received));
+                    if (++received == messages) ret = reads;
+                    return true;
+                }
+            );
+        }
+    );
+
+    c->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code /*connack_return_code*/) {
+            // The server doesn't read until this handler returns, so all the messages
+            // are waiting in the socket when it starts reading.
+            for (std::size_t i = 0; i != messages; ++i) {
+                c->publish("topic1", std::to_string(i), MQTT_NS::qos::at_most_once);
+            }
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(received == messages);
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE( disabled ) {
+    // fixed header, remaining length, and the rest for each message
+    BOOST_TEST(count_reads(0) == messages * 3);
+}
+
+BOOST_AUTO_TEST_CASE( enabled ) {
+    // The messages are about 1000 bytes in total.
+    BOOST_TEST(count_reads(256) <= 8U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,195 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_server_endpoint.hpp"
+
+#include <deque>
+
+#include <mqtt_client_cpp.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_receive_maximum)
+
+namespace as = boost::asio;
+
+using server_t = test_server_endpoint<>;
+using endpoint_t = server_t::endpoint_t;
+
+enum class ack_mode {
+    normal,
+    duplicate, // The server sends each PUBACK twice.
+    reject     // The server sends PUBREC with an error Reason Code.
+};
+
+// The server sends receive_maximum 2 and acknowledges publish messages manually.
+// The client never has more than 2 in-flight publish messages.
+void receive_maximum_test(MQTT_NS::qos qos_value, ack_mode mode = ack_mode::normal) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+
+    std::size_t const messages = 6;
+    std::size_t const receive_maximum = 2;
+    // The client calls the puback handler for the unexpected PUBACK too.
+    std::size_t const acks = mode == ack_mode::duplicate ? messages * 2 : messages;
+
+    std::deque<std::uint16_t> unacked;
+    std::size_t received = 0;
+    std::size_t max_unacked = 0;
+    std::size_t completed = 0;
+
+    auto s_ack =
+        [&](endpoint_t& ep) {
+            auto packet_id = unacked.front();
+            unacked.pop_front();
+            if (qos_value == MQTT_NS::qos::at_least_once) {
+                ep.puback(packet_id);
+                // The unexpected PUBACK doesn't free the slot.
+                if (mode == ack_mode::duplicate) ep.puback(packet_id);
+            }
+            else if (mode == ack_mode::reject) {
+                ep.pubrec(packet_id, MQTT_NS::v5::pubrec_reason_code::quota_exceeded);
+            }
+            else {
+                ep.pubrec(packet_id);
+            }
+        };
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_auto_pub_response(false);
+            ep.set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    ep.connack(
+                        false,
+                        MQTT_NS::v5::connect_reason_code::success,
+                        std::vector<MQTT_NS::v5::property_variant> {
+                            MQTT_NS::v5::property::receive_maximum(receive_maximum)
+                        }
+                    );
+                    return true;
+                }
+            );
+            ep.set_v5_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> packet_id,
+                 MQTT_NS::buffer /*topic*/,
+                 MQTT_NS::buffer contents,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    BOOST_TEST(contents == std::to_string(received));
+                    ++received;
+                    unacked.push_back(packet_id.value());
+                    max_unacked = std::max(max_unacked, unacked.size());
+                    if (unacked.size() == receive_maximum) {
+                        // The rest of messages are held by the client.
+                        BOOST_TEST(c->get_inflight_publish_count() == receive_maximum);
+                        BOOST_TEST(c->get_pending_publish_count() == messages - received);
+                        s_ack(ep);
+                    }
+                    if (received == messages) {
+                        while (!unacked.empty()) s_ack(ep);
+                    }
+                    return true;
+                }
+            );
+            ep.set_v5_pubrel_handler(
+                [&]
+                (std::uint16_t packet_id,
+                 MQTT_NS::v5::pubrel_reason_code /*reason_code*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    BOOST_TEST((mode != ack_mode::reject));
+                    ep.pubcomp(packet_id);
+                    return true;
+                }
+            );
+        }
+    );
+
+    c->set_v5_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            for (std::size_t i = 0; i != messages; ++i) {
+                c->async_publish("topic1", std::to_string(i), qos_value);
+            }
+            BOOST_TEST(c->get_inflight_publish_count() == receive_maximum);
+            BOOST_TEST(c->get_pending_publish_count() == messages - receive_maximum);
+            return true;
+        });
+    auto c_complete =
+        [&] {
+            ++completed;
+            if (completed == acks) {
+                BOOST_TEST(c->get_inflight_publish_count() == 0U);
+                BOOST_TEST(c->get_pending_publish_count() == 0U);
+                BOOST_TEST(c->get_stored_message_count() == 0U);
+                c->async_disconnect();
+            }
+            return true;
+        };
+    c->set_v5_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::puback_reason_code /*reason_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            return c_complete();
+        });
+    c->set_v5_pubrec_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::pubrec_reason_code reason_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            if (mode != ack_mode::reject) return true;
+            // The QoS2 flow is complete without PUBREL.
+            BOOST_TEST(reason_code == MQTT_NS::v5::pubrec_reason_code::quota_exceeded);
+            return c_complete();
+        });
+    c->set_v5_pubcomp_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::pubcomp_reason_code /*reason_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            return c_complete();
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(received == messages);
+    BOOST_TEST(completed == acks);
+    BOOST_TEST(max_unacked == receive_maximum);
+}
+
+BOOST_AUTO_TEST_CASE( qos1 ) {
+    receive_maximum_test(MQTT_NS::qos::at_least_once);
+}
+
+BOOST_AUTO_TEST_CASE( qos2 ) {
+    receive_maximum_test(MQTT_NS::qos::exactly_once);
+}
+
+BOOST_AUTO_TEST_CASE( qos1_duplicate_puback ) {
+    receive_maximum_test(MQTT_NS::qos::at_least_once, ack_mode::duplicate);
+}
+
+BOOST_AUTO_TEST_CASE( qos2_pubrec_error ) {
+    receive_maximum_test(MQTT_NS::qos::exactly_once, ack_mode::reject);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -203,7 +203,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
                     [&] {
                         MQTT_CHK("h_close1");
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_puback",
                     [&] {
@@ -217,10 +217,10 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
             [&chk, &c]
             (boost::system::error_code const&) {
                 MQTT_CHK("h_error");
-                c->connect();
+                connect_keep_session(c);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
@@ -363,7 +363,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
                     [&] {
                         MQTT_CHK("h_close1");
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_pubcomp",
                     [&] {
@@ -377,10 +377,10 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
             [&chk, &c]
             (boost::system::error_code const&) {
                 MQTT_CHK("h_error");
-                c->connect();
+                connect_keep_session(c);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
@@ -574,7 +574,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2 ) {
                     [&] {
                         MQTT_CHK("h_close1");
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_pubcomp",
                     [&] {
@@ -588,10 +588,10 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2 ) {
             [&chk, &c]
             (boost::system::error_code const&) {
                 MQTT_CHK("h_error");
-                c->connect();
+                connect_keep_session(c);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
@@ -750,7 +750,7 @@ BOOST_AUTO_TEST_CASE( publish_pubrel_qos2 ) {
                     [&] {
                         MQTT_CHK("h_close1");
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_pubcomp",
                     [&] {
@@ -767,18 +767,18 @@ BOOST_AUTO_TEST_CASE( publish_pubrel_qos2 ) {
                     "h_connack2",
                     [&] {
                         MQTT_CHK("h_error1");
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_pubrec",
                     [&] {
                         MQTT_CHK("h_error2");
-                        c->connect();
+                        connect_keep_session(c);
                     }
                 );
                 BOOST_TEST(ret);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
@@ -933,7 +933,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
                     [&] {
                         MQTT_CHK("h_close1");
                         c->set_clean_session(false);
-                        c->connect();
+                        connect_keep_session(c);
                     },
                     "h_puback2",
                     [&] {
@@ -947,10 +947,10 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
             [&chk, &c]
             (boost::system::error_code const&) {
                 MQTT_CHK("h_error1");
-                c->connect();
+                connect_keep_session(c);
             });
         MQTT_CHK("start");
-        c->connect();
+        connect_keep_session(c);
         ioc.run();
         BOOST_TEST(chk.all());
     };
@@ -0,0 +1,156 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_server_endpoint.hpp"
+
+#include <deque>
+
+#include <mqtt_client_cpp.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_resend_batch)
+
+namespace as = boost::asio;
+
+using server_t = test_server_endpoint<>;
+using endpoint_t = server_t::endpoint_t;
+
+// The server doesn't acknowledge the publish messages on the first connection and disconnects.
+// On the second connection, the server sends receive_maximum 3 and acknowledges manually.
+// The client resends the stored messages within receive_maximum.
+template <typename Client>
+void resend_within_receive_maximum(as::io_context& ioc, Client const& c) {
+    c->set_client_id("cid1");
+    c->set_clean_session(false);
+
+    std::size_t const messages = 10;
+    std::size_t const receive_maximum = 3;
+
+    std::size_t connection = 0;
+    std::size_t received = 0;
+    std::deque<std::uint16_t> unacked;
+    std::size_t max_unacked = 0;
+    std::size_t completed = 0;
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ++connection;
+            received = 0;
+            ep.set_auto_pub_response(false);
+            ep.set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    if (connection == 1) {
+                        ep.connack(false, MQTT_NS::v5::connect_reason_code::success);
+                    }
+                    else {
+                        ep.connack(
+                            true,
+                            MQTT_NS::v5::connect_reason_code::success,
+                            std::vector<MQTT_NS::v5::property_variant> {
+                                MQTT_NS::v5::property::receive_maximum(receive_maximum)
+                            }
+                        );
+                    }
+                    return true;
+                }
+            );
+            ep.set_v5_publish_handler(
+                [&]
+                (std::uint8_t header,
+                 MQTT_NS::optional<std::uint16_t> packet_id,
+                 MQTT_NS::buffer /*topic*/,
+                 MQTT_NS::buffer contents,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    BOOST_TEST(contents == std::to_string(received));
+                    ++received;
+                    if (connection == 1) {
+                        if (received == messages) {
+                            ep.force_disconnect();
+                        }
+                        return true;
+                    }
+                    BOOST_TEST(MQTT_NS::publish::is_dup(header));
+                    unacked.push_back(packet_id.value());
+                    max_unacked = std::max(max_unacked, unacked.size());
+                    if (unacked.size() == receive_maximum || received == messages) {
+                        while (!unacked.empty()) {
+                            ep.puback(unacked.front());
+                            unacked.pop_front();
+                        }
+                    }
+                    return true;
+                }
+            );
+        }
+    );
+
+    c->set_v5_connack_handler(
+        [&]
+        (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            if (!sp) {
+                for (std::size_t i = 0; i != messages; ++i) {
+                    c->async_publish("topic1", std::to_string(i), MQTT_NS::qos::at_least_once);
+                }
+            }
+            else {
+                // The rest of the stored messages are held.
+                BOOST_TEST(c->get_inflight_publish_count() == receive_maximum);
+                BOOST_TEST(c->get_pending_publish_count() == messages - receive_maximum);
+            }
+            return true;
+        });
+    c->set_v5_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::puback_reason_code /*reason_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            if (++completed == messages) {
+                c->async_disconnect();
+            }
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            // disconnected by the server on the first connection
+            c->connect();
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(connection == 2U);
+    BOOST_TEST(received == messages);
+    BOOST_TEST(completed == messages);
+    BOOST_TEST(max_unacked == receive_maximum);
+}
+
+// The async client resends the stored messages in batches of 2.
+BOOST_AUTO_TEST_CASE( receive_maximum ) {
+    as::io_context ioc;
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_resend_batch_count(2);
+    resend_within_receive_maximum(ioc, c);
+}
+
+// The sync client resends the stored messages at once.
+BOOST_AUTO_TEST_CASE( receive_maximum_sync ) {
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    resend_within_receive_maximum(ioc, c);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,232 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "combi_test.hpp"
+#include "checker.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_resend_message_expiry)
+
+using namespace MQTT_NS::literals;
+
+BOOST_AUTO_TEST_CASE( expired_not_resent ) {
+    auto test = [](boost::asio::io_context& ioc, auto& c, auto& s, auto& /*b*/) {
+        if (c->get_protocol_version() != MQTT_NS::protocol_version::v5) return;
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_client_id("cid1");
+        c->set_clean_session(true);
+
+        packet_id_t pid_pub = 0;
+        std::vector<packet_id_t> removed;
+        c->set_v5_serialize_handlers(
+            [](packet_id_t, char const*, std::size_t) {},
+            [](packet_id_t, char const*, std::size_t) {},
+            [&removed](packet_id_t packet_id) {
+                removed.push_back(packet_id);
+            }
+        );
+
+        checker chk = {
+            cont("start"),
+            // connect
+            cont("h_connack1"),
+            // publish topic1 QoS1 that expires after 1 second
+            // force_disconnect
+            cont("h_error"),
+            // wait until the message expires
+            cont("expired"),
+            // connect
+            cont("h_connack2"),
+            // disconnect
+            cont("h_close"),
+        };
+
+        boost::asio::steady_timer tim(ioc);
+        c->set_v5_connack_handler(
+            [&chk, &c, &pid_pub, &removed]
+            (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+                auto ret = chk.match(
+                    "start",
+                    [&] {
+                        MQTT_CHK("h_connack1");
+                        BOOST_TEST(sp == false);
+                        pid_pub = c->publish(
+                            "topic1",
+                            "topic1_contents",
+                            MQTT_NS::qos::at_least_once,
+                            false,
+                            std::vector<MQTT_NS::v5::property_variant>{
+                                MQTT_NS::v5::property::message_expiry_interval(1)
+                            }
+                        );
+                        c->force_disconnect();
+                    },
+                    "expired",
+                    [&] {
+                        MQTT_CHK("h_connack2");
+                        BOOST_TEST(sp == true);
+                        // The expired message is dropped instead of being resent.
+                        BOOST_TEST(c->get_stored_message_count() == 0U);
+                        BOOST_TEST((removed == std::vector<packet_id_t>{ pid_pub }));
+                        c->disconnect();
+                    }
+                );
+                BOOST_TEST(ret);
+                return true;
+            });
+        c->set_v5_puback_handler(
+            []
+            (packet_id_t, MQTT_NS::v5::puback_reason_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                BOOST_TEST(false);
+                return true;
+            });
+        c->set_close_handler(
+            [&chk, &s]
+            () {
+                MQTT_CHK("h_close");
+                s.close();
+            });
+        c->set_error_handler(
+            [&chk, &c, &tim]
+            (boost::system::error_code const&) {
+                MQTT_CHK("h_error");
+                BOOST_TEST(c->get_stored_message_count() == 1U);
+                tim.expires_after(std::chrono::milliseconds(1500));
+                tim.async_wait(
+                    [&chk, &c](boost::system::error_code const& ec) {
+                        BOOST_TEST(!ec);
+                        MQTT_CHK("expired");
+                        c->set_clean_session(false);
+                        connect_keep_session(c);
+                    }
+                );
+            });
+        MQTT_CHK("start");
+        connect_keep_session(c);
+        ioc.run();
+        BOOST_TEST(chk.all());
+        BOOST_TEST(removed.size() == 1U);
+    };
+    do_combi_test_sync(test);
+}
+
+BOOST_AUTO_TEST_CASE( resend_remaining_interval ) {
+    auto test = [](boost::asio::io_context& ioc, auto& c, auto& s, auto& b) {
+        if (c->get_protocol_version() != MQTT_NS::protocol_version::v5) return;
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_client_id("cid1");
+        c->set_clean_session(true);
+
+        packet_id_t pid_pub = 0;
+
+        checker chk = {
+            cont("start"),
+            // connect
+            cont("h_connack1"),
+            // publish topic1 QoS1 that expires after 10 seconds
+            // force_disconnect
+            cont("h_error"),
+            // wait for a while
+            cont("waited"),
+            // connect
+            cont("h_connack2"),
+            cont("h_puback"),
+            // disconnect
+            cont("h_close"),
+        };
+
+        // The broker might receive the first publish before force_disconnect.
+        std::vector<std::uint32_t> intervals;
+        b.set_publish_props_handler(
+            [&intervals] (std::vector<MQTT_NS::v5::property_variant> const& props) {
+                for (auto const& p : props) {
+                    MQTT_NS::visit(
+                        MQTT_NS::make_lambda_visitor<void>(
+                            [&](MQTT_NS::v5::property::message_expiry_interval const& t) {
+                                intervals.push_back(t.val());
+                            },
+                            [](auto&&) {}
+                        ),
+                        p
+                    );
+                }
+            }
+        );
+
+        boost::asio::steady_timer tim(ioc);
+        c->set_v5_connack_handler(
+            [&chk, &c, &pid_pub]
+            (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+                auto ret = chk.match(
+                    "start",
+                    [&] {
+                        MQTT_CHK("h_connack1");
+                        BOOST_TEST(sp == false);
+                        pid_pub = c->publish(
+                            "topic1",
+                            "topic1_contents",
+                            MQTT_NS::qos::at_least_once,
+                            false,
+                            std::vector<MQTT_NS::v5::property_variant>{
+                                MQTT_NS::v5::property::message_expiry_interval(10)
+                            }
+                        );
+                        c->force_disconnect();
+                    },
+                    "waited",
+                    [&] {
+                        MQTT_CHK("h_connack2");
+                        BOOST_TEST(sp == true);
+                    }
+                );
+                BOOST_TEST(ret);
+                return true;
+            });
+        c->set_v5_puback_handler(
+            [&chk, &c, &pid_pub]
+            (packet_id_t packet_id, MQTT_NS::v5::puback_reason_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                MQTT_CHK("h_puback");
+                BOOST_TEST(packet_id == pid_pub);
+                c->disconnect();
+                return true;
+            });
+        c->set_close_handler(
+            [&chk, &s]
+            () {
+                MQTT_CHK("h_close");
+                s.close();
+            });
+        c->set_error_handler(
+            [&chk, &c, &tim]
+            (boost::system::error_code const&) {
+                MQTT_CHK("h_error");
+                tim.expires_after(std::chrono::milliseconds(1500));
+                tim.async_wait(
+                    [&chk, &c](boost::system::error_code const& ec) {
+                        BOOST_TEST(!ec);
+                        MQTT_CHK("waited");
+                        c->set_clean_session(false);
+                        connect_keep_session(c);
+                    }
+                );
+            });
+        MQTT_CHK("start");
+        connect_keep_session(c);
+        ioc.run();
+        BOOST_TEST(chk.all());
+        // The resent message has the remaining interval, rounded up.
+        BOOST_TEST(!intervals.empty());
+        if (!intervals.empty()) {
+            BOOST_TEST(intervals.back() < 10U);
+            BOOST_TEST(intervals.back() >= 8U);
+        }
+    };
+    do_combi_test_sync(test);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -178,7 +178,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -195,7 +195,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
                     restore_serialized_pubrel_message(c2, packet);
                 }
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
 
     c2->set_connack_handler(
@@ -222,7 +222,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
         });
 
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -303,7 +303,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -320,7 +320,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
                     restore_serialized_pubrel_message(c2, packet);
                 }
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
 
     c2->set_connack_handler(
@@ -353,7 +353,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -433,7 +433,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -450,7 +450,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2 ) {
                     restore_serialized_pubrel_message(c2, packet);
                 }
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
     c1->set_pubrec_handler(
         [&chk, &c1, &pid_pub]
@@ -484,7 +484,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -568,7 +568,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -585,7 +585,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
                     restore_serialized_pubrel_message(c2, packet);
                 }
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
     c2->set_connack_handler(
         [&chk]
@@ -621,7 +621,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -870,7 +870,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1_v5 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -887,7 +887,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1_v5 ) {
                     restore_v5_serialized_pubrel_message(c2, packet);
                 }
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
 
     c2->set_v5_connack_handler(
@@ -914,7 +914,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1_v5 ) {
         });
 
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -1001,7 +1001,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2_v5 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -1018,7 +1018,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2_v5 ) {
                     restore_v5_serialized_pubrel_message(c2, packet);
                 }
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
 
     c2->set_v5_connack_handler(
@@ -1051,7 +1051,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2_v5 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -1187,7 +1187,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2_v5 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -1204,7 +1204,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2_v5 ) {
                     restore_v5_serialized_pubrel_message(c2, packet);
                 }
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
     c1->set_v5_pubrec_handler(
         [&chk, &c1, &pid_pub, ps = std::move(ps)]
@@ -1239,7 +1239,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2_v5 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -1329,7 +1329,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1_v5 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -1346,7 +1346,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1_v5 ) {
                     restore_v5_serialized_pubrel_message(c2, packet);
                 }
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
     c2->set_v5_connack_handler(
         [&chk]
@@ -1382,7 +1382,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1_v5 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -105,7 +105,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -114,7 +114,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
             for (auto const& e : serialized) {
                 restore_serialized_message(c2, e);
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
 
     c2->set_connack_handler(
@@ -141,7 +141,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1 ) {
         });
 
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -216,7 +216,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -225,7 +225,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
             for (auto const& e : serialized) {
                 restore_serialized_message(c2, e);
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
 
     c2->set_connack_handler(
@@ -258,7 +258,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -332,7 +332,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -341,7 +341,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2 ) {
             for (auto const& e : serialized) {
                 restore_serialized_message(c2, e);
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
     c1->set_pubrec_handler(
         [&chk, &c1, &pid_pub]
@@ -375,7 +375,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -453,7 +453,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -462,7 +462,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
             for (auto const& e : serialized) {
                 restore_serialized_message(c2, e);
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
     c2->set_connack_handler(
         [&chk]
@@ -498,7 +498,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -673,7 +673,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1_v5 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -682,7 +682,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1_v5 ) {
             for (auto const& e : serialized) {
                 restore_serialized_message(c2, e);
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
 
     c2->set_v5_connack_handler(
@@ -709,7 +709,7 @@ BOOST_AUTO_TEST_CASE( publish_qos1_v5 ) {
         });
 
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -790,7 +790,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2_v5 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -799,7 +799,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2_v5 ) {
             for (auto const& e : serialized) {
                 restore_serialized_message(c2, e);
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
 
     c2->set_v5_connack_handler(
@@ -832,7 +832,7 @@ BOOST_AUTO_TEST_CASE( publish_qos2_v5 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -962,7 +962,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2_v5 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -971,7 +971,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2_v5 ) {
             for (auto const& e : serialized) {
                 restore_v5_serialized_message(c2, e);
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
     c1->set_v5_pubrec_handler(
         [&chk, &c1, &pid_pub, ps = std::move(ps)]
@@ -1006,7 +1006,7 @@ BOOST_AUTO_TEST_CASE( pubrel_qos2_v5 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
@@ -1090,7 +1090,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1_v5 ) {
         () {
             MQTT_CHK("h_close1");
             c1->set_clean_session(false);
-            c1->connect();
+            connect_keep_session(c1);
         });
     c1->set_error_handler(
         [&chk, &c2, &serialized]
@@ -1099,7 +1099,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1_v5 ) {
             for (auto const& e : serialized) {
                 restore_serialized_message(c2, e);
             }
-            c2->connect();
+            connect_keep_session(c2);
         });
     c2->set_v5_connack_handler(
         [&chk]
@@ -1135,7 +1135,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1_v5 ) {
             return true;
         });
     MQTT_CHK("start");
-    c1->connect();
+    connect_keep_session(c1);
     ioc.run();
     BOOST_TEST(serialized.empty() == true);
     BOOST_TEST(chk.all());
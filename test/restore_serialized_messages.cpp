@@ -0,0 +1,97 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+
+#include <string>
+#include <vector>
+
+#include <mqtt_client_cpp.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_restore_serialized_messages)
+
+namespace as = boost::asio;
+
+template <typename Client>
+std::vector<std::string> stored(Client const& c) {
+    std::vector<std::string> ret;
+    c->for_each_store(
+        [&](char const* data, std::size_t size) {
+            ret.emplace_back(data, size);
+        }
+    );
+    return ret;
+}
+
+// publish QoS1, publish QoS2, and pubrel
+std::vector<std::string> make_messages(MQTT_NS::protocol_version version) {
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, version);
+    c->publish("topic1", "contents1", MQTT_NS::qos::at_least_once);
+    c->publish("topic1", "contents2", MQTT_NS::qos::exactly_once);
+    auto ret = stored(c);
+    if (version == MQTT_NS::protocol_version::v5) {
+        ret.push_back(MQTT_NS::v5::pubrel_message(10, MQTT_NS::nullopt, {}).continuous_buffer());
+    }
+    else {
+        ret.push_back(MQTT_NS::pubrel_message(10).continuous_buffer());
+    }
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE( v3_1_1 ) {
+    auto msgs = make_messages(MQTT_NS::protocol_version::v3_1_1);
+    std::string blob;
+    for (auto const& m : msgs) blob += m;
+
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c->restore_serialized_messages(blob.begin(), blob.end());
+    BOOST_TEST(stored(c) == msgs);
+    // packet ids are registered
+    BOOST_TEST(!c->register_packet_id(1));
+    BOOST_TEST(!c->register_packet_id(2));
+    BOOST_TEST(!c->register_packet_id(10));
+}
+
+BOOST_AUTO_TEST_CASE( v5 ) {
+    auto msgs = make_messages(MQTT_NS::protocol_version::v5);
+    std::string blob;
+    for (auto const& m : msgs) blob += m;
+
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->restore_v5_serialized_messages(blob.begin(), blob.end());
+    BOOST_TEST(stored(c) == msgs);
+}
+
+BOOST_AUTO_TEST_CASE( invalid ) {
+    auto msgs = make_messages(MQTT_NS::protocol_version::v3_1_1);
+    std::string blob;
+    for (auto const& m : msgs) blob += m;
+
+    as::io_context ioc;
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+
+    // truncated
+    auto truncated = blob.substr(0, blob.size() - 1);
+    BOOST_CHECK_THROW(
+        c->restore_serialized_messages(truncated.begin(), truncated.end()),
+        MQTT_NS::protocol_error
+    );
+    BOOST_TEST(stored(c).empty());
+
+    // not publish nor pubrel
+    auto pingreq = blob + std::string { '\xc0', '\x00' };
+    BOOST_CHECK_THROW(
+        c->restore_serialized_messages(pingreq.begin(), pingreq.end()),
+        MQTT_NS::protocol_error
+    );
+    BOOST_TEST(stored(c).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
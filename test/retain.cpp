@@ -8,6 +8,9 @@
 #include "combi_test.hpp"
 #include "checker.hpp"
 
+#include <set>
+#include <string>
+
 #include <mqtt/optional.hpp>
 
 BOOST_AUTO_TEST_SUITE(test_retain)
@@ -788,5 +791,105 @@ BOOST_AUTO_TEST_CASE( prop ) {
     do_combi_test_sync(test);
 }
 
+BOOST_AUTO_TEST_CASE( wildcard ) {
+    auto test = [](boost::asio::io_context& ioc, auto& c, auto& s, auto& /*b*/) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+
+        std::set<std::string> received;
+
+        auto connack =
+            [&] {
+                c->publish("topic1/a", "contents_a", MQTT_NS::qos::at_most_once, true);
+                c->publish("topic1/b/c", "contents_c", MQTT_NS::qos::at_most_once, true);
+                c->publish("topic2/a", "contents_d", MQTT_NS::qos::at_most_once, true);
+                c->publish("$SYS/a", "contents_e", MQTT_NS::qos::at_most_once, true);
+                c->subscribe("topic1/#", MQTT_NS::qos::at_most_once);
+                c->subscribe("+/a", MQTT_NS::qos::at_most_once);
+            };
+        auto publish =
+            [&] (std::uint8_t header, MQTT_NS::string_view topic, MQTT_NS::string_view contents) {
+                BOOST_TEST(MQTT_NS::publish::is_retain(header) == true);
+                received.insert(std::string(topic) + ":" + std::string(contents));
+                // topic1/a is received twice because it matches both subscriptions.
+                if (received.size() == 3) c->unsubscribe(std::vector<MQTT_NS::string_view>{"topic1/#", "+/a"});
+            };
+
+        switch (c->get_protocol_version()) {
+        case MQTT_NS::protocol_version::v3_1_1:
+            c->set_connack_handler(
+                [&]
+                (bool, MQTT_NS::connect_return_code) {
+                    connack();
+                    return true;
+                });
+            c->set_publish_handler(
+                [&]
+                (std::uint8_t header,
+                 MQTT_NS::optional<packet_id_t>,
+                 MQTT_NS::string_view topic,
+                 MQTT_NS::string_view contents) {
+                    publish(header, topic, contents);
+                    return true;
+                });
+            c->set_unsuback_handler(
+                [&]
+                (packet_id_t) {
+                    c->disconnect();
+                    return true;
+                });
+            break;
+        case MQTT_NS::protocol_version::v5:
+            c->set_v5_connack_handler(
+                [&]
+                (bool, MQTT_NS::v5::connect_reason_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    connack();
+                    return true;
+                });
+            c->set_v5_publish_handler(
+                [&]
+                (std::uint8_t header,
+                 MQTT_NS::optional<packet_id_t>,
+                 MQTT_NS::string_view topic,
+                 MQTT_NS::string_view contents,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    publish(header, topic, contents);
+                    return true;
+                });
+            c->set_v5_unsuback_handler(
+                [&]
+                (packet_id_t, std::vector<MQTT_NS::v5::unsuback_reason_code>, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    c->disconnect();
+                    return true;
+                });
+            break;
+        default:
+            BOOST_CHECK(false);
+            break;
+        }
+
+        c->set_close_handler(
+            [&s]
+            () {
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->connect();
+        ioc.run();
+        BOOST_TEST(
+            (received ==
+             std::set<std::string> {
+                 "topic1/a:contents_a",
+                 "topic1/b/c:contents_c",
+                 "topic2/a:contents_d",
+             })
+        );
+    };
+    do_combi_test_sync(test);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
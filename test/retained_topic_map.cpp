@@ -0,0 +1,137 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "retained_topic_map.hpp"
+
+#include <set>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_retained_topic_map)
+
+using map_t = retained_topic_map<std::string>;
+
+inline std::multiset<std::string> match(map_t const& m, MQTT_NS::string_view topic_filter) {
+    std::multiset<std::string> ret;
+    m.match(
+        topic_filter,
+        [&](std::string const& value) {
+            ret.insert(value);
+        }
+    );
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE( exact ) {
+    map_t m;
+    BOOST_TEST(m.insert_or_assign("a/b/c", "v1"));
+    BOOST_TEST(m.insert_or_assign("a/b", "v2"));
+    BOOST_TEST(!m.insert_or_assign("a/b/c", "v3"));
+    BOOST_TEST(m.size() == 2U);
+
+    BOOST_TEST((match(m, "a/b/c") == std::multiset<std::string>{ "v3" }));
+    BOOST_TEST((match(m, "a/b") == std::multiset<std::string>{ "v2" }));
+    BOOST_TEST(match(m, "a").empty());
+    BOOST_TEST(match(m, "a/b/c/d").empty());
+    BOOST_TEST(match(m, "a/b/").empty());
+
+    BOOST_TEST(m.find("a/b/c") != nullptr);
+    BOOST_TEST(*m.find("a/b/c") == "v3");
+    BOOST_TEST(m.find("a") == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( single_level_wildcard ) {
+    map_t m;
+    m.insert_or_assign("a/b/c", "v1");
+    m.insert_or_assign("a//c", "v2");
+    m.insert_or_assign("x/b/c", "v3");
+    m.insert_or_assign("a/b", "v4");
+    m.insert_or_assign("a", "v5");
+    m.insert_or_assign("a/", "v6");
+
+    BOOST_TEST((match(m, "a/+/c") == std::multiset<std::string>{ "v1", "v2" }));
+    BOOST_TEST((match(m, "+/+/+") == std::multiset<std::string>{ "v1", "v2", "v3" }));
+    BOOST_TEST((match(m, "+/b/c") == std::multiset<std::string>{ "v1", "v3" }));
+    BOOST_TEST((match(m, "+") == std::multiset<std::string>{ "v5" }));
+    BOOST_TEST((match(m, "a/+") == std::multiset<std::string>{ "v4", "v6" }));
+    BOOST_TEST(match(m, "a/+/c/+").empty());
+}
+
+BOOST_AUTO_TEST_CASE( multi_level_wildcard ) {
+    map_t m;
+    m.insert_or_assign("a", "v1");
+    m.insert_or_assign("a/b", "v2");
+    m.insert_or_assign("a/b/c/d", "v3");
+    m.insert_or_assign("b", "v4");
+    m.insert_or_assign("b/c", "v5");
+
+    BOOST_TEST((match(m, "#") == std::multiset<std::string>{ "v1", "v2", "v3", "v4", "v5" }));
+    BOOST_TEST((match(m, "a/#") == std::multiset<std::string>{ "v1", "v2", "v3" }));
+    BOOST_TEST((match(m, "a/b/#") == std::multiset<std::string>{ "v2", "v3" }));
+    BOOST_TEST((match(m, "a/+/#") == std::multiset<std::string>{ "v2", "v3" }));
+    BOOST_TEST((match(m, "+/#") == std::multiset<std::string>{ "v1", "v2", "v3", "v4", "v5" }));
+    BOOST_TEST(match(m, "c/#").empty());
+}
+
+BOOST_AUTO_TEST_CASE( dollar ) {
+    map_t m;
+    m.insert_or_assign("$SYS/monitor/Clients", "v1");
+    m.insert_or_assign("SYS/monitor/Clients", "v2");
+    m.insert_or_assign("a/$SYS", "v3");
+
+    BOOST_TEST((match(m, "#") == std::multiset<std::string>{ "v2", "v3" }));
+    BOOST_TEST((match(m, "+/monitor/Clients") == std::multiset<std::string>{ "v2" }));
+    BOOST_TEST((match(m, "$SYS/#") == std::multiset<std::string>{ "v1" }));
+    BOOST_TEST((match(m, "$SYS/monitor/+") == std::multiset<std::string>{ "v1" }));
+    // '$' is a special character only at the beginning of the topic
+    BOOST_TEST((match(m, "a/+") == std::multiset<std::string>{ "v3" }));
+}
+
+BOOST_AUTO_TEST_CASE( erase ) {
+    map_t m;
+    m.insert_or_assign("a/b/c", "v1");
+    m.insert_or_assign("a/b", "v2");
+
+    BOOST_TEST(m.erase("a/b/x") == 0U);
+    BOOST_TEST(m.erase("a") == 0U);
+    BOOST_TEST(m.erase("a/b/c") == 1U);
+    BOOST_TEST(m.erase("a/b/c") == 0U);
+    BOOST_TEST(m.size() == 1U);
+    BOOST_TEST((match(m, "a/#") == std::multiset<std::string>{ "v2" }));
+
+    BOOST_TEST(m.erase("a/b") == 1U);
+    BOOST_TEST(m.empty());
+    BOOST_TEST(match(m, "#").empty());
+    BOOST_TEST(m.find("a/b") == nullptr);
+
+    // Removed nodes can be created again.
+    m.insert_or_assign("a/b", "v3");
+    BOOST_TEST((match(m, "a/+") == std::multiset<std::string>{ "v3" }));
+}
+
+BOOST_AUTO_TEST_CASE( many_topics ) {
+    map_t m;
+    for (int i = 0; i != 1000; ++i) {
+        for (int j = 0; j != 10; ++j) {
+            m.insert_or_assign(
+                "site/" + std::to_string(i) + "/" + std::to_string(j),
+                "v" + std::to_string(i) + "_" + std::to_string(j)
+            );
+        }
+    }
+    BOOST_TEST(m.size() == 10000U);
+    BOOST_TEST((match(m, "site/123/#").size() == 10U));
+    BOOST_TEST((match(m, "site/+/4").size() == 1000U));
+    BOOST_TEST((match(m, "site/123/+") == match(m, "site/123/#")));
+    BOOST_TEST((match(m, "site/#").size() == 10000U));
+    for (int i = 0; i != 1000; ++i) {
+        m.erase("site/" + std::to_string(i) + "/4");
+    }
+    BOOST_TEST(match(m, "site/+/4").empty());
+    BOOST_TEST(m.size() == 9000U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,268 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_RETAINED_TOPIC_MAP_HPP)
+#define MQTT_TEST_RETAINED_TOPIC_MAP_HPP
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include <boost/assert.hpp>
+
+#include <mqtt/buffer.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/string_view.hpp>
+
+/**
+ * @brief Topic name trie of retained messages.
+ *
+ * Each topic name is split into levels, and every level is a node of the trie.
+ * Unlike multiple_subscription_map, the stored keys are topic names and the
+ * lookup key is a topic filter, so each node holds its children in an ordered
+ * map in order to enumerate them for '+' and '#'.
+ * Nodes that have no value in their subtree are removed, so match() visits
+ * only the nodes on the way to the matched values. For '#', the cost is
+ * proportional to the number of matched values (times the depth), not to the
+ * number of retained topics.
+ * Topics that start with '$' are not matched by filters that start with
+ * a wildcard.
+ *
+ * Topic names and filters are not validated. The caller should validate them.
+ */
+template <typename Value>
+class retained_topic_map {
+public:
+    /**
+     * @brief Insert or update the value of topic.
+     * @param topic topic name
+     * @param value value (e.g. retained message)
+     * @return true if inserted, false if updated
+     */
+    bool insert_or_assign(MQTT_NS::string_view topic, Value value) {
+        std::vector<node*> path;
+        auto n = &root_;
+        for_each_level(
+            topic,
+            [&](MQTT_NS::string_view level) {
+                path.push_back(n);
+                auto it = n->children.find(level);
+                if (it == n->children.end()) {
+                    // The key of the map must own the level.
+                    it = n->children.emplace(
+                        MQTT_NS::allocate_buffer(level),
+                        std::make_unique<node>()
+                    ).first;
+                }
+                n = it->second.get();
+            }
+        );
+        path.push_back(n);
+
+        if (n->value) {
+            n->value = std::move(value);
+            return false;
+        }
+        n->value.emplace(std::move(value));
+        for (auto p : path) ++p->count;
+        ++size_;
+        return true;
+    }
+
+    /**
+     * @brief Erase the value of topic.
+     * @param topic topic name
+     * @return number of erased values (0 or 1)
+     */
+    std::size_t erase(MQTT_NS::string_view topic) {
+        // (parent, child iterator) of each level
+        std::vector<std::pair<node*, typename children_type::iterator>> path;
+        auto n = &root_;
+        bool found = true;
+        for_each_level(
+            topic,
+            [&](MQTT_NS::string_view level) {
+                if (!found) return;
+                auto it = n->children.find(level);
+                if (it == n->children.end()) {
+                    found = false;
+                    return;
+                }
+                path.emplace_back(n, it);
+                n = it->second.get();
+            }
+        );
+        if (!found || !n->value) return 0;
+        n->value = MQTT_NS::nullopt;
+
+        --root_.count;
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            if (--it->second->second->count == 0) it->first->children.erase(it->second);
+        }
+        --size_;
+        return 1;
+    }
+
+    /**
+     * @brief Find the value of exactly topic.
+     * @param topic topic name
+     * @return pointer to the value. nullptr if not found.
+     */
+    Value const* find(MQTT_NS::string_view topic) const {
+        node const* n = &root_;
+        for_each_level(
+            topic,
+            [&](MQTT_NS::string_view level) {
+                if (!n) return;
+                n = find_child(n, level);
+            }
+        );
+        if (!n || !n->value) return nullptr;
+        return &*n->value;
+    }
+
+    /**
+     * @brief Call f for each value whose topic matches topic_filter.
+     * @param topic_filter topic filter
+     * @param f function that is called as f(Value const&)
+     */
+    template <typename F>
+    void match(MQTT_NS::string_view topic_filter, F&& f) const {
+        std::vector<node const*> current { &root_ };
+        std::vector<node const*> next;
+        bool first = true;
+        bool multi_level = false;
+        for_each_level(
+            topic_filter,
+            [&](MQTT_NS::string_view level) {
+                if (multi_level) return;
+                if (level == "#") {
+                    for (auto n : current) {
+                        // "a/#" matches "a"
+                        if (n->value) f(*n->value);
+                        for_each_child(
+                            n, first,
+                            [&](node const* c) {
+                                for_each_value(c, f);
+                            }
+                        );
+                    }
+                    current.clear();
+                    multi_level = true;
+                }
+                else if (level == "+") {
+                    for (auto n : current) {
+                        for_each_child(
+                            n, first,
+                            [&](node const* c) {
+                                next.push_back(c);
+                            }
+                        );
+                    }
+                    current.swap(next);
+                    next.clear();
+                }
+                else {
+                    for (auto n : current) {
+                        if (auto c = find_child(n, level)) next.push_back(c);
+                    }
+                    current.swap(next);
+                    next.clear();
+                }
+                first = false;
+            }
+        );
+        for (auto n : current) {
+            if (n->value) f(*n->value);
+        }
+    }
+
+    /**
+     * @brief Get the number of values
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    void clear() {
+        root_.children.clear();
+        root_.count = 0;
+        size_ = 0;
+    }
+
+private:
+    struct node;
+
+    struct level_less {
+        using is_transparent = void;
+        bool operator()(MQTT_NS::string_view lhs, MQTT_NS::string_view rhs) const {
+            return lhs < rhs;
+        }
+    };
+
+    using children_type = std::map<MQTT_NS::buffer, std::unique_ptr<node>, level_less>;
+
+    struct node {
+        std::size_t count = 0; ///< number of values of this node and its descendants
+        MQTT_NS::optional<Value> value;
+        children_type children;
+    };
+
+    template <typename F>
+    static void for_each_level(MQTT_NS::string_view topic, F&& f) {
+        while (true) {
+            auto pos = topic.find('/');
+            if (pos == MQTT_NS::string_view::npos) {
+                f(topic);
+                return;
+            }
+            f(topic.substr(0, pos));
+            topic.remove_prefix(pos + 1);
+        }
+    }
+
+    static node const* find_child(node const* n, MQTT_NS::string_view level) {
+        auto it = n->children.find(level);
+        if (it == n->children.end()) return nullptr;
+        return it->second.get();
+    }
+
+    /**
+     * @brief Call f for each child of n for a wildcard.
+     *        If first is true, the children that start with '$' are skipped.
+     */
+    template <typename F>
+    static void for_each_child(node const* n, bool first, F&& f) {
+        for (auto const& e : n->children) {
+            if (first && !e.first.empty() && e.first.front() == '$') continue;
+            f(e.second.get());
+        }
+    }
+
+    /**
+     * @brief Call f for each value of n and its descendants.
+     */
+    template <typename F>
+    static void for_each_value(node const* n, F&& f) {
+        std::vector<node const*> stack { n };
+        while (!stack.empty()) {
+            auto c = stack.back();
+            stack.pop_back();
+            if (c->value) f(*c->value);
+            for (auto const& e : c->children) stack.push_back(e.second.get());
+        }
+    }
+
+    node root_;
+    std::size_t size_ = 0;
+};
+
+#endif // MQTT_TEST_RETAINED_TOPIC_MAP_HPP
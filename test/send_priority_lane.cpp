@@ -0,0 +1,106 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_server_endpoint.hpp"
+
+#include <mqtt_client_cpp.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_send_priority_lane)
+
+namespace as = boost::asio;
+
+using server_t = test_server_endpoint<>;
+using endpoint_t = server_t::endpoint_t;
+
+// The client queues publish messages and then pingreq.
+// The server records the order of the received messages.
+// 'p' is publish and 'r' is pingreq.
+std::string send_order_test(bool priority_lane) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_send_priority_lane(priority_lane);
+
+    std::size_t const messages = 5;
+    std::string order;
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_session*/,
+                 std::uint16_t /*keep_alive*/) {
+                    ep.connack(false, MQTT_NS::connect_return_code::accepted);
+                    return true;
+                }
+            );
+            ep.set_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer /*topic*/,
+                 MQTT_NS::buffer /*contents*/) {
+                    order.push_back('p');
+                    return true;
+                }
+            );
+            ep.set_pingreq_handler(
+                [&] {
+                    order.push_back('r');
+                    ep.pingresp();
+                    return true;
+                }
+            );
+        }
+    );
+
+    c->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code /*connack_return_code*/) {
+            // The first publish is written, and the others are queued.
+            for (std::size_t i = 0; i != messages; ++i) {
+                c->async_publish("topic1", std::string(1000, 'a'), MQTT_NS::qos::at_most_once);
+            }
+            c->async_pingreq();
+            return true;
+        });
+    c->set_pingresp_handler(
+        [&] {
+            c->async_disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c->connect();
+    ioc.run();
+    return order;
+}
+
+BOOST_AUTO_TEST_CASE( priority ) {
+    BOOST_TEST(send_order_test(true) == "prpppp");
+}
+
+BOOST_AUTO_TEST_CASE( fifo ) {
+    BOOST_TEST(send_order_test(false) == "pppppr");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,433 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_server_endpoint.hpp"
+
+#include <mqtt_client_cpp.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_send_queue_watermark)
+
+namespace as = boost::asio;
+
+using server_t = test_server_endpoint<>;
+using endpoint_t = server_t::endpoint_t;
+
+// Each publish message is a little bigger than payload_size bytes.
+std::size_t const payload_size = 100;
+
+struct result {
+    std::size_t received = 0;
+    std::size_t high = 0;
+    std::size_t low = 0;
+    std::size_t succeeded = 0;
+    std::size_t dropped = 0;
+    bool error = false;
+};
+
+// The client publishes all the messages at once.
+// They are queued while the first message is written.
+result send_queue_test(
+    endpoint_t::send_queue_policy policy,
+    std::size_t high_bytes,
+    std::size_t low_bytes,
+    std::size_t high_count,
+    std::size_t low_count,
+    std::size_t messages) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_send_queue_watermarks(high_bytes, low_bytes, high_count, low_count, policy);
+
+    result r;
+    c->set_send_queue_high_handler([&] { ++r.high; });
+    c->set_send_queue_low_handler([&] { ++r.low; });
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_session*/,
+                 std::uint16_t /*keep_alive*/) {
+                    ep.connack(false, MQTT_NS::connect_return_code::accepted);
+                    return true;
+                }
+            );
+            ep.set_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer /*topic*/,
+                 MQTT_NS::buffer /*contents*/) {
+                    ++r.received;
+                    return true;
+                }
+            );
+        }
+    );
+
+    std::size_t finished = 0;
+    c->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code /*connack_return_code*/) {
+            for (std::size_t i = 0; i != messages; ++i) {
+                c->async_publish(
+                    "topic1",
+                    std::string(payload_size, 'a'),
+                    MQTT_NS::qos::at_most_once,
+                    false,
+                    [&](boost::system::error_code const& ec) {
+                        if (ec == boost::system::errc::no_buffer_space) {
+                            ++r.dropped;
+                        }
+                        else if (!ec) {
+                            ++r.succeeded;
+                        }
+                        if (++finished == messages && !r.error) c->async_disconnect();
+                    }
+                );
+            }
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            r.error = true;
+            s.close();
+        });
+
+    c->connect();
+    ioc.run();
+    return r;
+}
+
+BOOST_AUTO_TEST_CASE( block ) {
+    auto r = send_queue_test(endpoint_t::send_queue_policy::block, 0, 0, 5, 2, 10);
+    BOOST_TEST(r.high == 1U);
+    BOOST_TEST(r.low == 1U);
+    BOOST_TEST(r.succeeded == 10U);
+    BOOST_TEST(r.dropped == 0U);
+    BOOST_TEST(r.received == 10U);
+    BOOST_TEST(!r.error);
+}
+
+BOOST_AUTO_TEST_CASE( block_bytes ) {
+    // The high watermark is reached by the 5th queued message, and the low watermark when 2 messages are left.
+    auto r = send_queue_test(endpoint_t::send_queue_policy::block, payload_size * 5, payload_size * 3, 0, 0, 10);
+    BOOST_TEST(r.high == 1U);
+    BOOST_TEST(r.low == 1U);
+    BOOST_TEST(r.succeeded == 10U);
+    BOOST_TEST(r.received == 10U);
+    BOOST_TEST(!r.error);
+}
+
+// The client publishes while the send queue is over the high watermark.
+// The publish message is rejected, and the one that is published after the low watermark is sent.
+BOOST_AUTO_TEST_CASE( block_reject ) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_send_queue_watermarks(0, 0, 3, 1, endpoint_t::send_queue_policy::block);
+
+    std::vector<std::string> received;
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_session*/,
+                 std::uint16_t /*keep_alive*/) {
+                    ep.connack(false, MQTT_NS::connect_return_code::accepted);
+                    return true;
+                }
+            );
+            ep.set_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer /*topic*/,
+                 MQTT_NS::buffer contents) {
+                    received.emplace_back(contents);
+                    return true;
+                }
+            );
+        }
+    );
+
+    bool rejected = false;
+    c->set_send_queue_high_handler(
+        [&] {
+            auto packet_id = c->async_publish(
+                "topic1",
+                "rejected",
+                MQTT_NS::qos::at_least_once,
+                false,
+                [&](boost::system::error_code const& ec) {
+                    BOOST_TEST(ec == boost::system::errc::operation_would_block);
+                    rejected = true;
+                }
+            );
+            // The packet_id is released, so it can be registered again.
+            BOOST_TEST(c->register_packet_id(packet_id));
+            BOOST_TEST(c->release_packet_id(packet_id));
+        });
+    c->set_send_queue_low_handler(
+        [&] {
+            c->async_publish("topic1", "sent", MQTT_NS::qos::at_least_once);
+        });
+    c->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code /*connack_return_code*/) {
+            // The third one reaches the high watermark.
+            for (std::size_t i = 0; i != 3; ++i) {
+                c->async_publish("topic1", std::to_string(i), MQTT_NS::qos::at_most_once);
+            }
+            return true;
+        });
+    c->set_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/) {
+            c->async_disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+            s.close();
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(rejected);
+    BOOST_TEST((received == std::vector<std::string>{ "0", "1", "2", "sent" }));
+}
+
+BOOST_AUTO_TEST_CASE( drop_qos0 ) {
+    auto r = send_queue_test(endpoint_t::send_queue_policy::drop_qos0, 0, 0, 5, 2, 10);
+    BOOST_TEST(r.high == 1U);
+    BOOST_TEST(r.low == 1U);
+    BOOST_TEST(r.succeeded == 5U);
+    BOOST_TEST(r.dropped == 5U);
+    BOOST_TEST(r.received == 5U);
+    BOOST_TEST(!r.error);
+}
+
+BOOST_AUTO_TEST_CASE( disconnect ) {
+    auto r = send_queue_test(endpoint_t::send_queue_policy::disconnect, 0, 0, 5, 2, 10);
+    BOOST_TEST(r.high == 1U);
+    BOOST_TEST(r.dropped == 0U);
+    BOOST_TEST(r.received < 10U);
+    BOOST_TEST(r.error);
+}
+
+// The client publishes with auto topic alias while the send queue is over the high watermark.
+// The publish message that maps a new alias is not dropped, so the following publish message
+// that has only the alias is resolved by the server.
+BOOST_AUTO_TEST_CASE( drop_qos0_topic_alias ) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_auto_topic_alias_send();
+    c->set_send_queue_watermarks(0, 0, 2, 0, endpoint_t::send_queue_policy::drop_qos0);
+
+    std::vector<std::string> received;
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    ep.connack(
+                        false,
+                        MQTT_NS::v5::connect_reason_code::success,
+                        std::vector<MQTT_NS::v5::property_variant> {
+                            MQTT_NS::v5::property::topic_alias_maximum(2)
+                        }
+                    );
+                    return true;
+                }
+            );
+            ep.set_v5_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer /*contents*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    received.emplace_back(topic);
+                    return true;
+                }
+            );
+        }
+    );
+
+    std::size_t dropped = 0;
+    auto count_dropped =
+        [&](boost::system::error_code const& ec) {
+            if (ec == boost::system::errc::no_buffer_space) ++dropped;
+        };
+    c->set_send_queue_low_handler(
+        [&] {
+            // topic2 is sent with only the alias.
+            c->async_publish("topic2", "contents", MQTT_NS::qos::at_least_once);
+        });
+    c->set_v5_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            // The second one reaches the high watermark.
+            c->async_publish("topic1", "contents", MQTT_NS::qos::at_most_once, false, count_dropped);
+            c->async_publish("topic1", "contents", MQTT_NS::qos::at_most_once, false, count_dropped);
+            // dropped
+            c->async_publish("topic1", "contents", MQTT_NS::qos::at_most_once, false, count_dropped);
+            // maps the alias of topic2, not dropped
+            c->async_publish("topic2", "contents", MQTT_NS::qos::at_most_once, false, count_dropped);
+            // dropped
+            c->async_publish("topic2", "contents", MQTT_NS::qos::at_most_once, false, count_dropped);
+            return true;
+        });
+    c->set_v5_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::puback_reason_code /*reason_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            c->async_disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+            s.close();
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(dropped == 2U);
+    BOOST_TEST((received == std::vector<std::string>{ "topic1", "topic1", "topic2", "topic2" }));
+}
+
+// The server sends receive_maximum 1.
+// The publish messages that are held by Receive Maximum are counted by the watermarks.
+BOOST_AUTO_TEST_CASE( block_receive_maximum ) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_send_queue_watermarks(0, 0, 3, 1, endpoint_t::send_queue_policy::block);
+
+    std::size_t const messages = 5;
+    result r;
+    c->set_send_queue_high_handler(
+        [&] {
+            ++r.high;
+            // Only the first message is in-flight.
+            BOOST_TEST(c->get_pending_publish_count() == messages - 1);
+        });
+    c->set_send_queue_low_handler([&] { ++r.low; });
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    ep.connack(
+                        false,
+                        MQTT_NS::v5::connect_reason_code::success,
+                        std::vector<MQTT_NS::v5::property_variant> {
+                            MQTT_NS::v5::property::receive_maximum(1)
+                        }
+                    );
+                    return true;
+                }
+            );
+            ep.set_v5_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer /*topic*/,
+                 MQTT_NS::buffer /*contents*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    ++r.received;
+                    return true;
+                }
+            );
+        }
+    );
+
+    c->set_v5_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            for (std::size_t i = 0; i != messages; ++i) {
+                c->async_publish("topic1", std::string(payload_size, 'a'), MQTT_NS::qos::at_least_once);
+            }
+            return true;
+        });
+    c->set_v5_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::puback_reason_code /*reason_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            if (++r.succeeded == messages) c->async_disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            r.error = true;
+            s.close();
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(r.high == 1U);
+    BOOST_TEST(r.low == 1U);
+    BOOST_TEST(r.succeeded == messages);
+    BOOST_TEST(r.received == messages);
+    BOOST_TEST(!r.error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,824 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "sharded_broker.hpp"
+#include "checker.hpp"
+
+#include <future>
+#include <thread>
+
+#include <mqtt/sync_client.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_sharded_broker)
+
+// The shard i accepts connections on broker_notls_port + i.
+inline std::vector<std::unique_ptr<MQTT_NS::server<>>> listen(sharded_broker& sb) {
+    std::vector<std::unique_ptr<MQTT_NS::server<>>> servers;
+    for (std::size_t i = 0; i != sb.size(); ++i) {
+        servers.emplace_back(
+            std::make_unique<MQTT_NS::server<>>(
+                as::ip::tcp::endpoint(
+                    as::ip::tcp::v4(),
+                    static_cast<std::uint16_t>(broker_notls_port + i)
+                ),
+                sb.ioc(i),
+                sb.ioc(i),
+                [](auto& acceptor) {
+                    acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+                }
+            )
+        );
+        auto& b = sb.broker(i);
+        servers.back()->set_error_handler(
+            [](boost::system::error_code const& /*ec*/) {
+            }
+        );
+        servers.back()->set_accept_handler(
+            [&b](MQTT_NS::server<>::endpoint_t& ep) {
+                b.handle_accept(ep);
+            }
+        );
+        servers.back()->listen();
+    }
+    return servers;
+}
+
+BOOST_AUTO_TEST_CASE( session_and_publish_across_shards ) {
+    sharded_broker sb(2);
+    auto servers = listen(sb);
+    std::thread th(
+        [&] {
+            sb.run();
+        }
+    );
+
+    boost::asio::io_context ioc;
+    // c1 and c3 use the same client id. c1 connects to the shard 0, and c3 connects to the shard 1.
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    auto c3 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port + 1);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(false);
+    c2->set_client_id("cid2");
+    c2->set_clean_session(true);
+    c3->set_client_id("cid1");
+    c3->set_clean_session(false);
+
+    checker chk = {
+        cont("start"),
+        // c1 connect to the shard 0
+        cont("h_connack1"),
+        // c1 subscribe topic1 QoS1
+        cont("h_suback1"),
+        // c1 disconnect
+        cont("h_close1"),
+        // c2 connect to the shard 0
+        cont("h_connack2"),
+        // c2 subscribe topic2 QoS0
+        cont("h_suback2"),
+        // c2 publish topic1 QoS1 (saved in the session of cid1)
+        cont("h_puback2"),
+        // c3 connect to the shard 1, takes over the session of cid1
+        cont("h_connack3"),
+        cont("h_publish3"),
+        // c3 publish topic2 QoS0 (forwarded to the shard 0)
+        cont("h_publish2"),
+        // disconnect
+        deps("h_close2", "h_publish2"),
+        deps("h_close3", "h_publish2"),
+    };
+
+    auto error = [](boost::system::error_code const&) {
+        BOOST_CHECK(false);
+    };
+    c1->set_error_handler(error);
+    c2->set_error_handler(error);
+    c3->set_error_handler(error);
+
+    c1->set_connack_handler(
+        [&]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack1");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c1->subscribe("topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c1->set_suback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            MQTT_CHK("h_suback1");
+            // Messages of topic1 are routed only to the shard 0.
+            BOOST_TEST((sb.route("topic1") == std::vector<bool>{ true, false }));
+            c1->disconnect();
+            return true;
+        });
+    c1->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close1");
+            c2->connect();
+        });
+
+    c2->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack2");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c2->subscribe("topic2", MQTT_NS::qos::at_most_once);
+            return true;
+        });
+    c2->set_suback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            MQTT_CHK("h_suback2");
+            BOOST_TEST((sb.route("topic2") == std::vector<bool>{ true, false }));
+            BOOST_TEST((sb.route("topic3") == std::vector<bool>{ false, false }));
+            c2->publish("topic1", "topic1_contents", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c2->set_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/) {
+            MQTT_CHK("h_puback2");
+            // The subscription of the non active session is routed, too.
+            BOOST_TEST((sb.route("topic1") == std::vector<bool>{ true, false }));
+            c3->connect();
+            return true;
+        });
+    c2->set_publish_handler(
+        [&]
+        (std::uint8_t /*header*/,
+         MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents) {
+            MQTT_CHK("h_publish2");
+            BOOST_TEST(topic == "topic2");
+            BOOST_TEST(contents == "topic2_contents");
+            c2->disconnect();
+            c3->disconnect();
+            return true;
+        });
+
+    c3->set_connack_handler(
+        [&]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack3");
+            BOOST_TEST(sp == true);
+            // The subscription is moved with the session.
+            BOOST_TEST((sb.route("topic1") == std::vector<bool>{ false, true }));
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            return true;
+        });
+    c3->set_publish_handler(
+        [&]
+        (std::uint8_t header,
+         MQTT_NS::optional<std::uint16_t> packet_id,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents) {
+            MQTT_CHK("h_publish3");
+            BOOST_TEST(MQTT_NS::publish::get_qos(header) == MQTT_NS::qos::at_least_once);
+            BOOST_CHECK(packet_id);
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "topic1_contents");
+            c3->publish("topic2", "topic2_contents", MQTT_NS::qos::at_most_once);
+            return true;
+        });
+
+    std::size_t closed = 0;
+    auto close = [&] {
+        if (++closed == 2) {
+            sb.stop();
+        }
+    };
+    c2->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close2");
+            close();
+        });
+    c3->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close3");
+            close();
+        });
+
+    MQTT_CHK("start");
+    c1->connect();
+    ioc.run();
+    th.join();
+    BOOST_TEST(chk.all());
+}
+
+BOOST_AUTO_TEST_CASE( shared_subscription_across_shards ) {
+    sharded_broker sb(2);
+    auto servers = listen(sb);
+    std::thread th(
+        [&] {
+            sb.run();
+        }
+    );
+
+    boost::asio::io_context ioc;
+    // The members of the group g1 are c1 on the shard 0 and c2 on the shard 1.
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port + 1);
+    auto c3 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(true);
+    c2->set_client_id("cid2");
+    c2->set_clean_session(true);
+    c3->set_client_id("cid3");
+    c3->set_clean_session(true);
+
+    checker chk = {
+        cont("start"),
+        // c1 connect to the shard 0
+        cont("h_connack1"),
+        // c1 subscribe $share/g1/topic1 and topic2 QoS0
+        cont("h_suback1"),
+        // c2 connect to the shard 1
+        cont("h_connack2"),
+        // c2 subscribe $share/g1/topic1 and topic2 QoS0
+        cont("h_suback2"),
+        // c3 connect to the shard 0
+        cont("h_connack3"),
+        // c3 publish topic1 QoS0 * messages, and then topic2 QoS0.
+        // c1 and c2 disconnect when they receive topic2.
+        deps("h_close1", "h_connack3"),
+        deps("h_close2", "h_connack3"),
+        deps("h_close3", "h_connack3"),
+    };
+
+    auto error = [](boost::system::error_code const&) {
+        BOOST_CHECK(false);
+    };
+    c1->set_error_handler(error);
+    c2->set_error_handler(error);
+    c3->set_error_handler(error);
+
+    std::size_t const messages = 4;
+    std::vector<std::string> received1;
+    std::vector<std::string> received2;
+
+    auto subscribe = [](auto& c) {
+        c->subscribe(
+            std::vector<std::tuple<MQTT_NS::string_view, MQTT_NS::subscribe_options>>{
+                { "$share/g1/topic1", MQTT_NS::qos::at_most_once },
+                { "topic2", MQTT_NS::qos::at_most_once }
+            }
+        );
+    };
+
+    c1->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack1");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            subscribe(c1);
+            return true;
+        });
+    c1->set_suback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            MQTT_CHK("h_suback1");
+            c2->connect();
+            return true;
+        });
+    c2->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack2");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            subscribe(c2);
+            return true;
+        });
+    c2->set_suback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            MQTT_CHK("h_suback2");
+            c3->connect();
+            return true;
+        });
+    c3->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack3");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            for (std::size_t i = 0; i != messages; ++i) {
+                c3->publish("topic1", std::to_string(i), MQTT_NS::qos::at_most_once);
+            }
+            // topic2 is forwarded after topic1, so each member receives it last.
+            c3->publish("topic2", "end", MQTT_NS::qos::at_most_once);
+            c3->disconnect();
+            return true;
+        });
+
+    auto on_publish = [](auto& c, std::vector<std::string>& received) {
+        return
+            [&c, &received]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+             MQTT_NS::buffer topic,
+             MQTT_NS::buffer contents) {
+                if (topic == "topic2") {
+                    c->disconnect();
+                }
+                else {
+                    received.emplace_back(contents);
+                }
+                return true;
+            };
+    };
+    c1->set_publish_handler(on_publish(c1, received1));
+    c2->set_publish_handler(on_publish(c2, received2));
+
+    std::size_t closed = 0;
+    auto close = [&] {
+        if (++closed == 3) {
+            sb.stop();
+        }
+    };
+    c1->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close1");
+            close();
+        });
+    c2->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close2");
+            close();
+        });
+    c3->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close3");
+            close();
+        });
+
+    MQTT_CHK("start");
+    c1->connect();
+    ioc.run();
+    th.join();
+    BOOST_TEST(chk.all());
+    // Each message is received once, and the members on both shards receive them in turn.
+    BOOST_TEST(received1 == (std::vector<std::string>{ "0", "2" }), boost::test_tools::per_element());
+    BOOST_TEST(received2 == (std::vector<std::string>{ "1", "3" }), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE( publish_while_session_moves ) {
+    sharded_broker sb(2);
+    auto servers = listen(sb);
+
+    boost::asio::io_context ioc;
+    // c1 and c3 use the same client id. c1 connects to the shard 0, and c3 connects to the shard 1.
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port + 1);
+    auto c3 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port + 1, MQTT_NS::protocol_version::v5);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(false);
+    c2->set_client_id("cid2");
+    c2->set_clean_session(true);
+    c3->set_client_id("cid1");
+    c3->set_clean_session(false);
+    std::vector<MQTT_NS::v5::property_variant> con_ps {
+        MQTT_NS::v5::property::session_expiry_interval(0xFFFFFFFFUL)
+    };
+
+    checker chk = {
+        cont("start"),
+        // c1 connect to the shard 0
+        cont("h_connack1"),
+        // c1 subscribe topic1 QoS1
+        cont("h_suback1"),
+        // c1 disconnect
+        cont("h_close1"),
+        // c2 connect to the shard 1
+        cont("h_connack2"),
+        // the shard 0 is blocked, and c3 connects to the shard 1.
+        // c2 publish topic1 QoS1 while the session of cid1 is moving.
+        cont("h_puback2"),
+        // the shard 0 is released
+        cont("h_connack3"),
+        cont("h_publish3"),
+        // disconnect
+        deps("h_close2", "h_publish3"),
+        deps("h_close3", "h_publish3"),
+    };
+
+    std::promise<void> release;
+    auto released = release.get_future();
+
+    // The connection of c3 is waiting for the session on the shard 1.
+    sb.broker(1).set_connect_props_handler(
+        [&](std::vector<MQTT_NS::v5::property_variant> const& /*props*/) {
+            as::post(
+                ioc,
+                [&] {
+                    c2->publish("topic1", "topic1_contents", MQTT_NS::qos::at_least_once);
+                }
+            );
+        }
+    );
+
+    std::thread th(
+        [&] {
+            sb.run();
+        }
+    );
+
+    auto error = [](boost::system::error_code const&) {
+        BOOST_CHECK(false);
+    };
+    c1->set_error_handler(error);
+    c2->set_error_handler(error);
+    c3->set_error_handler(error);
+
+    c1->set_v5_connack_handler(
+        [&]
+        (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_connack1");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            c1->subscribe("topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c1->set_v5_suback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, std::vector<MQTT_NS::v5::suback_reason_code> /*reasons*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_suback1");
+            c1->disconnect();
+            return true;
+        });
+    c1->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close1");
+            c2->connect();
+        });
+
+    c2->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack2");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            // The session of cid1 stays on the shard 0 until it is released.
+            as::post(
+                sb.ioc(0),
+                [&] {
+                    released.wait();
+                }
+            );
+            c3->connect(con_ps);
+            return true;
+        });
+    c2->set_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/) {
+            MQTT_CHK("h_puback2");
+            // The message has been forwarded.
+            release.set_value();
+            return true;
+        });
+
+    c3->set_v5_connack_handler(
+        [&]
+        (bool sp, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_connack3");
+            BOOST_TEST(sp == true);
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            return true;
+        });
+    c3->set_v5_publish_handler(
+        [&]
+        (std::uint8_t header,
+         MQTT_NS::optional<std::uint16_t> packet_id,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents,
+         std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_publish3");
+            BOOST_TEST(MQTT_NS::publish::get_qos(header) == MQTT_NS::qos::at_least_once);
+            BOOST_CHECK(packet_id);
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "topic1_contents");
+            c2->disconnect();
+            c3->disconnect();
+            return true;
+        });
+
+    std::size_t closed = 0;
+    auto close = [&] {
+        if (++closed == 2) {
+            sb.stop();
+        }
+    };
+    c2->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close2");
+            close();
+        });
+    c3->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close3");
+            close();
+        });
+
+    MQTT_CHK("start");
+    c1->connect(con_ps);
+    ioc.run();
+    th.join();
+    BOOST_TEST(chk.all());
+}
+
+BOOST_AUTO_TEST_CASE( shared_member_leaves ) {
+    sharded_broker sb(2);
+    auto servers = listen(sb);
+    std::thread th(
+        [&] {
+            sb.run();
+        }
+    );
+
+    boost::asio::io_context ioc;
+    // The members of the group g1 are c1 on the shard 0 and c2 on the shard 1.
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port + 1);
+    auto c3 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(true);
+    c2->set_client_id("cid2");
+    c2->set_clean_session(true);
+    c3->set_client_id("cid3");
+    c3->set_clean_session(true);
+
+    checker chk = {
+        cont("start"),
+        // c1 connect to the shard 0
+        cont("h_connack1"),
+        // c1 subscribe $share/g1/topic1 QoS1
+        cont("h_suback1"),
+        // c2 connect to the shard 1
+        cont("h_connack2"),
+        // c2 subscribe $share/g1/topic1 QoS1
+        cont("h_suback2"),
+        // the shard 1 is blocked, and c3 connects to the shard 0
+        cont("h_connack3"),
+        // c3 publish topic1 QoS1 * 2. The second one is forwarded to the shard 1.
+        // c2 leaves when the shard 1 is released, and c1 receives both.
+        deps("h_close2", "h_connack3"),
+        deps("h_close1", "h_connack3"),
+        deps("h_close3", "h_connack3"),
+    };
+
+    auto error = [](boost::system::error_code const&) {
+        BOOST_CHECK(false);
+    };
+    c1->set_error_handler(error);
+    c3->set_error_handler(error);
+
+    std::size_t const messages = 2;
+    std::vector<std::string> received1;
+    std::vector<std::string> received2;
+    std::promise<void> release;
+    auto released = release.get_future();
+
+    c1->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack1");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c1->subscribe("$share/g1/topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c1->set_suback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            MQTT_CHK("h_suback1");
+            c2->connect();
+            return true;
+        });
+    c2->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack2");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c2->subscribe("$share/g1/topic1", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c2->set_suback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            MQTT_CHK("h_suback2");
+            as::post(
+                sb.ioc(1),
+                [&] {
+                    released.wait();
+                    // c2 leaves the group before the forwarded message arrives.
+                    auto client_id = MQTT_NS::allocate_buffer("cid2");
+                    sb.broker(1).export_session(client_id, [](test_broker::session_export) {});
+                    sb.broker(1).take_session(client_id);
+                }
+            );
+            c3->connect();
+            return true;
+        });
+    c3->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack3");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            for (std::size_t i = 0; i != messages; ++i) {
+                c3->publish("topic1", std::to_string(i), MQTT_NS::qos::at_least_once);
+            }
+            return true;
+        });
+    std::size_t acked = 0;
+    c3->set_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/) {
+            // The messages have been forwarded.
+            if (++acked == messages) release.set_value();
+            return true;
+        });
+
+    auto on_publish = [&](std::vector<std::string>& received) {
+        return
+            [&]
+            (std::uint8_t /*header*/,
+             MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+             MQTT_NS::buffer /*topic*/,
+             MQTT_NS::buffer contents) {
+                received.emplace_back(contents);
+                if (received1.size() + received2.size() == messages) {
+                    c1->disconnect();
+                    c3->disconnect();
+                }
+                return true;
+            };
+    };
+    c1->set_publish_handler(on_publish(received1));
+    c2->set_publish_handler(on_publish(received2));
+
+    std::size_t closed = 0;
+    auto close = [&] {
+        if (++closed == 3) {
+            sb.stop();
+        }
+    };
+    c1->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close1");
+            close();
+        });
+    // c2 is disconnected by the broker.
+    c2->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close2");
+            close();
+        });
+    c2->set_error_handler(
+        [&](boost::system::error_code const&) {
+            MQTT_CHK("h_close2");
+            close();
+        });
+    c3->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close3");
+            close();
+        });
+
+    MQTT_CHK("start");
+    c1->connect();
+    ioc.run();
+    th.join();
+    BOOST_TEST(chk.all());
+    // The message for c2 is delivered to c1 instead.
+    BOOST_TEST(received1 == (std::vector<std::string>{ "0", "1" }), boost::test_tools::per_element());
+    BOOST_TEST(received2.empty());
+}
+
+BOOST_AUTO_TEST_CASE( server_on_pool ) {
+    sharded_broker sb(2);
+    // Connections are accepted on the shard 0, and distributed over the shards in turn.
+    MQTT_NS::server<> s(
+        as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port),
+        sb.ioc(0),
+        sb.pool(),
+        [](auto& acceptor) {
+            acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+        }
+    );
+    s.set_error_handler(
+        [](boost::system::error_code const& /*ec*/) {
+        }
+    );
+    s.set_accept_handler(
+        [&sb](MQTT_NS::server<>::endpoint_t& ep) {
+            sb.handle_accept(ep);
+        }
+    );
+    s.listen();
+    std::thread th(
+        [&] {
+            sb.run();
+        }
+    );
+
+    boost::asio::io_context ioc;
+    auto c1 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    auto c2 = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(true);
+    c2->set_client_id("cid2");
+    c2->set_clean_session(true);
+
+    checker chk = {
+        cont("start"),
+        // c1 connect to the shard 0
+        cont("h_connack1"),
+        // c1 subscribe topic1 QoS0
+        cont("h_suback1"),
+        // c2 connect to the shard 1
+        cont("h_connack2"),
+        // c2 publish topic1 QoS0 (forwarded to the shard 0)
+        cont("h_publish1"),
+        // disconnect
+        deps("h_close1", "h_publish1"),
+        deps("h_close2", "h_publish1"),
+    };
+
+    auto error = [](boost::system::error_code const&) {
+        BOOST_CHECK(false);
+    };
+    c1->set_error_handler(error);
+    c2->set_error_handler(error);
+
+    c1->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack1");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c1->subscribe("topic1", MQTT_NS::qos::at_most_once);
+            return true;
+        });
+    c1->set_suback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, std::vector<MQTT_NS::optional<MQTT_NS::suback_reason_code>> /*results*/) {
+            MQTT_CHK("h_suback1");
+            c2->connect();
+            return true;
+        });
+    c1->set_publish_handler(
+        [&]
+        (std::uint8_t /*header*/,
+         MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer contents) {
+            MQTT_CHK("h_publish1");
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "topic1_contents");
+            c1->disconnect();
+            c2->disconnect();
+            return true;
+        });
+
+    c2->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack2");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c2->publish("topic1", "topic1_contents", MQTT_NS::qos::at_most_once);
+            return true;
+        });
+
+    std::size_t closed = 0;
+    auto close = [&] {
+        if (++closed == 2) {
+            as::post(
+                sb.ioc(0),
+                [&] {
+                    s.close();
+                    sb.stop();
+                }
+            );
+        }
+    };
+    c1->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close1");
+            close();
+        });
+    c2->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close2");
+            close();
+        });
+
+    MQTT_CHK("start");
+    c1->connect();
+    ioc.run();
+    th.join();
+    BOOST_TEST(chk.all());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,543 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_SHARDED_BROKER_HPP)
+#define MQTT_TEST_SHARDED_BROKER_HPP
+
+#include <mqtt/variant.hpp> // should be top to configure variant limit
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <mqtt/io_context_pool.hpp>
+
+#include "test_broker.hpp"
+#include "subscription_map.hpp"
+#include "shared_subscription_map.hpp"
+
+namespace as = boost::asio;
+
+/**
+ * @brief Broker that runs one test_broker per thread.
+ *
+ * Each shard has its own io_context, thread, and test_broker. Connections are
+ * handled by the shard whose io_context they are accepted on, and the state of
+ * a shard is only touched on the thread of the shard, so no lock is needed to
+ * process packets.
+ *
+ * A message published on a shard is delivered to the subscribers of the shard,
+ * and posted to the io_context of the other shards that have a matching subscription,
+ * including the subscriptions of non active sessions. The shards that subscribe each
+ * topic filter are kept in a trie that is shared by all the shards, so the other shards
+ * don't match the messages that they don't need. Retained messages are posted to
+ * all the shards, and kept by all of them.
+ * Each shared subscription group receives a message once. The shard that the message is
+ * published on selects the shard of the member in turn, weighted by the number of members
+ * on each shard, and only that shard dispatches the message to the group.
+ * If the selected member leaves before the message arrives at its shard, the shard selects
+ * a member of the group again, and posts the message to it. The message is dropped only if
+ * the group has no member left.
+ *
+ * A session belongs to the shard that its client id was connected on last time.
+ * When the client id connects to another shard, the session (and the connection
+ * if it is still alive) is taken over from the old shard before CONNACK is sent.
+ * The routes of its subscriptions are moved to the new shard at once, and the move
+ * gets a new version of the routes. Each message carries the version that its routes
+ * are looked up at. The messages of older versions are kept by the old shard until
+ * the session leaves it, and the others are kept by the new shard until the session
+ * arrives, then they are put after the messages of the session. So no message is lost
+ * or duplicated while the session is moving, and the order of each publisher is kept.
+ * The client id to shard directory and the trie of the routes are guarded by mutexes.
+ */
+class sharded_broker {
+public:
+    /**
+     * @brief constructor
+     * @param num_of_shards number of shards. Each shard runs on its own thread.
+     */
+    explicit sharded_broker(std::size_t num_of_shards) {
+        BOOST_ASSERT(num_of_shards > 0);
+        shards_.reserve(num_of_shards);
+        for (std::size_t i = 0; i != num_of_shards; ++i) {
+            shards_.emplace_back(std::make_unique<shard>());
+        }
+        for (std::size_t i = 0; i != num_of_shards; ++i) {
+            setup(i);
+        }
+    }
+
+    /**
+     * @brief Get the number of shards
+     */
+    std::size_t size() const {
+        return shards_.size();
+    }
+
+    /**
+     * @brief Get the io_context of the shard.
+     * @param index index of the shard
+     * @return io_context
+     */
+    as::io_context& ioc(std::size_t index) {
+        return shards_.at(index)->ioc;
+    }
+
+    /**
+     * @brief Get the broker of the shard
+     * @param index index of the shard
+     * @return broker
+     */
+    test_broker& broker(std::size_t index) {
+        return shards_.at(index)->broker;
+    }
+
+    /**
+     * @brief Get the pool of the io_contexts of the shards for the server.
+     *        The accept handler of the server should call handle_accept().
+     * @param p policy to select the shard for a new connection
+     * @return pool
+     */
+    MQTT_NS::io_context_pool pool(
+        MQTT_NS::io_context_pool::policy p = MQTT_NS::io_context_pool::policy::round_robin) {
+        std::vector<std::reference_wrapper<as::io_context>> iocs;
+        iocs.reserve(shards_.size());
+        for (auto& s : shards_) iocs.emplace_back(s->ioc);
+        return MQTT_NS::io_context_pool(MQTT_NS::force_move(iocs), p);
+    }
+
+    /**
+     * @brief Pass the endpoint to the broker of the shard that it is accepted on.
+     *        It must be called on the thread of the shard, that is where the accept
+     *        handler of the server that uses pool() is called.
+     * @param ep endpoint
+     */
+    template <typename Endpoint>
+    void handle_accept(Endpoint& ep) {
+        for (auto& s : shards_) {
+            if (s->ioc.get_executor().running_in_this_thread()) {
+                s->broker.handle_accept(ep);
+                return;
+            }
+        }
+        BOOST_ASSERT(false);
+    }
+
+    /**
+     * @brief Run the io_context of each shard on its own thread.
+     *        This function returns when stop() is called.
+     */
+    void run() {
+        std::vector<std::thread> threads;
+        threads.reserve(shards_.size());
+        for (auto& s : shards_) {
+            threads.emplace_back(
+                [&s] {
+                    // Shards that have no connection yet keep waiting for the posted ones.
+                    auto guard = as::make_work_guard(s->ioc);
+                    s->ioc.run();
+                }
+            );
+        }
+        for (auto& t : threads) t.join();
+    }
+
+    /**
+     * @brief Get the shards that a message of the topic is delivered to.
+     *        It can be called on any thread.
+     *        Shared subscriptions are not included. See select_shared().
+     * @param topic topic name
+     * @return flags indexed by the shard. true if the shard has a matching subscription.
+     */
+    std::vector<bool> route(MQTT_NS::string_view topic) {
+        std::shared_lock<std::shared_timed_mutex> g(routes_mtx_);
+        return route_locked(topic);
+    }
+
+    /**
+     * @brief Select the shard that dispatches a message of the topic to each shared subscription group.
+     *        It can be called on any thread.
+     * @param topic topic name
+     * @param publisher the publisher of the message
+     * @return share name and topic filter of the groups, indexed by the shard
+     */
+    std::vector<std::set<std::pair<std::string, std::string>>>
+    select_shared(MQTT_NS::string_view topic, MQTT_NS::string_view publisher) {
+        return select_shared_if(
+            topic,
+            publisher,
+            [](MQTT_NS::string_view /*share_name*/, MQTT_NS::string_view /*topic_filter*/) {
+                return true;
+            }
+        );
+    }
+
+    /**
+     * @brief Select the shard that dispatches a message of the topic to each shared subscription group
+     *        that pred returns true for.
+     *        It can be called on any thread.
+     * @param topic topic name
+     * @param publisher the publisher of the message
+     * @param pred function that is called as pred(MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter)
+     * @return share name and topic filter of the groups, indexed by the shard
+     */
+    template <typename Pred>
+    std::vector<std::set<std::pair<std::string, std::string>>>
+    select_shared_if(MQTT_NS::string_view topic, MQTT_NS::string_view publisher, Pred&& pred) {
+        std::vector<std::set<std::pair<std::string, std::string>>> ret(shards_.size());
+        std::lock_guard<std::mutex> g(shared_routes_mtx_);
+        shared_routes_.match_if(
+            topic,
+            publisher,
+            std::forward<Pred>(pred),
+            [&](std::pair<std::size_t, std::size_t> const& member, std::pair<std::string, std::string> const& group) {
+                ret[member.first].insert(group);
+            }
+        );
+        return ret;
+    }
+
+    /**
+     * @brief Stop the io_context of each shard.
+     */
+    void stop() {
+        for (auto& s : shards_) s->ioc.stop();
+    }
+
+private:
+    struct shard {
+        as::io_context ioc;
+        test_broker broker { ioc };
+    };
+
+    void setup(std::size_t index) {
+        auto& b = shards_[index]->broker;
+
+        b.set_publish_forward_handler(
+            [this, index]
+            (MQTT_NS::buffer const& topic,
+             MQTT_NS::buffer const& contents,
+             MQTT_NS::qos qos_value,
+             bool is_retain,
+             std::vector<MQTT_NS::v5::property_variant> const& props,
+             MQTT_NS::buffer const& publisher) {
+                // The routes are not moved until the message is posted to all the targets,
+                // so that the shards receive it in the order of the versions.
+                std::shared_lock<std::shared_timed_mutex> g(routes_mtx_);
+                // Retained messages are kept by all the shards.
+                auto targets = is_retain ? std::vector<bool>(shards_.size(), true) : route_locked(topic);
+                auto shared = select_shared(topic, publisher);
+                auto version = routes_version_;
+                for (std::size_t i = 0; i != shards_.size(); ++i) {
+                    if (i == index || (!targets[i] && shared[i].empty())) continue;
+                    auto& dst = *shards_[i];
+                    as::post(
+                        dst.ioc,
+                        [this, &dst, topic, contents, qos_value, is_retain, props, publisher, version,
+                         groups = std::make_shared<std::set<std::pair<std::string, std::string>>>(MQTT_NS::force_move(shared[i]))] {
+                            dst.broker.deliver_publish(
+                                topic,
+                                contents,
+                                qos_value,
+                                is_retain,
+                                props,
+                                publisher,
+                                make_shared_group_filter(groups),
+                                make_moved_filter(version)
+                            );
+                            redispatch_shared(topic, contents, qos_value, props, publisher, MQTT_NS::force_move(*groups));
+                        }
+                    );
+                }
+                return test_broker::delivery_filter {
+                    make_shared_group_filter(
+                        std::make_shared<std::set<std::pair<std::string, std::string>>>(MQTT_NS::force_move(shared[index]))
+                    ),
+                    make_moved_filter(version)
+                };
+            }
+        );
+
+        b.set_session_fetch_handler(
+            [this, index]
+            (MQTT_NS::buffer const& client_id,
+             std::function<void(test_broker::session_export)> completion) {
+                std::size_t owner = index;
+                {
+                    std::lock_guard<std::mutex> g(mtx_);
+                    auto ret = owners_.emplace(std::string(client_id), index);
+                    if (!ret.second) {
+                        owner = ret.first->second;
+                        ret.first->second = index;
+                    }
+                }
+                if (owner == index) {
+                    completion(test_broker::session_export());
+                    return;
+                }
+                move_session(client_id, owner, index, MQTT_NS::force_move(completion));
+            }
+        );
+
+        b.set_route_handler(
+            [this, index]
+            (MQTT_NS::string_view topic_filter, bool added) {
+                std::lock_guard<std::shared_timed_mutex> g(routes_mtx_);
+                update_route(topic_filter, index, added);
+            }
+        );
+
+        b.set_session_end_handler(
+            [this, index]
+            (MQTT_NS::buffer const& client_id) {
+                std::lock_guard<std::mutex> g(mtx_);
+                auto it = owners_.find(std::string(client_id));
+                // The client id might be connecting to another shard.
+                if (it != owners_.end() && it->second == index) owners_.erase(it);
+            }
+        );
+    }
+
+    /**
+     * @brief Move the session of the client id from the shard of src_index to the shard of dst_index.
+     *        It is called on the thread of the shard of dst_index.
+     *        See test_broker::export_session() for the steps.
+     * @param client_id client id
+     * @param src_index index of the shard that owns the session
+     * @param dst_index index of the shard that the client id connects to
+     * @param completion completion of the session fetch handler
+     */
+    void move_session(
+        MQTT_NS::buffer const& client_id,
+        std::size_t src_index,
+        std::size_t dst_index,
+        std::function<void(test_broker::session_export)> completion) {
+        auto& src = *shards_[src_index];
+        auto& dst = *shards_[dst_index];
+        as::post(
+            src.ioc,
+            [this, &src, &dst, src_index, dst_index, client_id, completion = MQTT_NS::force_move(completion)] {
+                src.broker.export_session(
+                    client_id,
+                    [this, &src, &dst, src_index, dst_index, client_id, completion]
+                    (test_broker::session_export subs) {
+                        as::post(
+                            dst.ioc,
+                            [this, &src, &dst, src_index, dst_index, client_id, completion, subs = MQTT_NS::force_move(subs)]
+                            () mutable {
+                                {
+                                    std::lock_guard<std::shared_timed_mutex> g(routes_mtx_);
+                                    for (auto const& sub : subs.subscriptions) {
+                                        update_route(sub.topic, src_index, false);
+                                        update_route(sub.topic, dst_index, true);
+                                    }
+                                    moves_[std::string(client_id)] = ++routes_version_;
+                                }
+                                dst.broker.prepare_import(client_id, MQTT_NS::force_move(subs));
+                                // The messages of the older versions have been posted to src.
+                                as::post(
+                                    src.ioc,
+                                    [this, &src, &dst, client_id, completion] {
+                                        auto s = src.broker.take_session(client_id);
+                                        as::post(
+                                            dst.ioc,
+                                            [this, client_id, completion, s = MQTT_NS::force_move(s)] () mutable {
+                                                completion(MQTT_NS::force_move(s));
+                                                std::lock_guard<std::shared_timed_mutex> g(routes_mtx_);
+                                                moves_.erase(std::string(client_id));
+                                            }
+                                        );
+                                    }
+                                );
+                            }
+                        );
+                    }
+                );
+            }
+        );
+    }
+
+    /**
+     * @brief Get the shards that a message of the topic is delivered to.
+     *        routes_mtx_ must be locked.
+     */
+    std::vector<bool> route_locked(MQTT_NS::string_view topic) {
+        std::vector<bool> ret(shards_.size());
+        routes_.match(
+            topic,
+            [&](std::size_t i, std::size_t /*count*/) {
+                ret[i] = true;
+            }
+        );
+        return ret;
+    }
+
+    /**
+     * @brief Count up or down the subscriptions of the topic filter on the shard.
+     *        routes_mtx_ must be locked.
+     */
+    void update_route(MQTT_NS::string_view topic_filter, std::size_t index, bool added) {
+        if (auto shared = parse_shared_subscription(topic_filter)) {
+            if (added) {
+                add_shared_route(shared.value().first, shared.value().second, index);
+            }
+            else {
+                remove_shared_route(shared.value().first, shared.value().second, index);
+            }
+            return;
+        }
+        if (added) {
+            add_route(topic_filter, index);
+        }
+        else {
+            remove_route(topic_filter, index);
+        }
+    }
+
+    /**
+     * @brief Count up the subscriptions of the topic filter on the shard.
+     *        routes_mtx_ must be locked.
+     */
+    void add_route(MQTT_NS::string_view topic_filter, std::size_t index) {
+        std::size_t count = 0;
+        if (auto shards = routes_.find(topic_filter)) {
+            auto it = shards->find(index);
+            if (it != shards->end()) count = it->second;
+        }
+        routes_.insert_or_assign(topic_filter, index, count + 1);
+    }
+
+    /**
+     * @brief Count down the subscriptions of the topic filter on the shard.
+     *        The route is removed when the count reaches 0.
+     *        routes_mtx_ must be locked.
+     */
+    void remove_route(MQTT_NS::string_view topic_filter, std::size_t index) {
+        auto shards = routes_.find(topic_filter);
+        if (!shards) return;
+        auto it = shards->find(index);
+        if (it == shards->end()) return;
+        if (it->second == 1) {
+            routes_.erase(topic_filter, index);
+        }
+        else {
+            routes_.insert_or_assign(topic_filter, index, it->second - 1);
+        }
+    }
+
+    /**
+     * @brief Returns the filter of test_broker that accepts the groups.
+     *        The accepted groups are erased, so the groups that remain have no member on the shard.
+     */
+    static test_broker::shared_group_filter make_shared_group_filter(
+        std::shared_ptr<std::set<std::pair<std::string, std::string>>> groups) {
+        return
+            [groups = MQTT_NS::force_move(groups)]
+            (MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter) {
+                return groups->erase(std::make_pair(std::string(share_name), std::string(topic_filter))) != 0;
+            };
+    }
+
+    /**
+     * @brief Returns the filter of test_broker that tells whether the message of the version
+     *        is routed after the move of each moving session.
+     */
+    test_broker::session_filter make_moved_filter(std::uint64_t version) {
+        return
+            [this, version]
+            (MQTT_NS::buffer const& client_id) {
+                std::shared_lock<std::shared_timed_mutex> g(routes_mtx_);
+                auto it = moves_.find(std::string(client_id));
+                return it != moves_.end() && version >= it->second;
+            };
+    }
+
+    /**
+     * @brief Post the message to the shards of the other members of the groups
+     *        whose selected member has left.
+     */
+    void redispatch_shared(
+        MQTT_NS::buffer const& topic,
+        MQTT_NS::buffer const& contents,
+        MQTT_NS::qos qos_value,
+        std::vector<MQTT_NS::v5::property_variant> const& props,
+        MQTT_NS::buffer const& publisher,
+        std::set<std::pair<std::string, std::string>> groups) {
+        if (groups.empty()) return;
+        auto shared = select_shared_if(
+            topic,
+            publisher,
+            [&](MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter) {
+                return groups.count(std::make_pair(std::string(share_name), std::string(topic_filter))) != 0;
+            }
+        );
+        for (std::size_t i = 0; i != shards_.size(); ++i) {
+            if (shared[i].empty()) continue;
+            auto& dst = *shards_[i];
+            as::post(
+                dst.ioc,
+                [this, &dst, topic, contents, qos_value, props, publisher,
+                 groups = std::make_shared<std::set<std::pair<std::string, std::string>>>(MQTT_NS::force_move(shared[i]))] {
+                    dst.broker.deliver_shared(topic, contents, qos_value, props, publisher, make_shared_group_filter(groups));
+                    redispatch_shared(topic, contents, qos_value, props, publisher, MQTT_NS::force_move(*groups));
+                }
+            );
+        }
+    }
+
+    /**
+     * @brief Add a member of the shared subscription group on the shard.
+     */
+    void add_shared_route(MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter, std::size_t index) {
+        std::lock_guard<std::mutex> g(shared_routes_mtx_);
+        auto& count = shared_counts_[std::make_tuple(std::string(share_name), std::string(topic_filter), index)];
+        shared_routes_.insert_or_assign(
+            share_name,
+            topic_filter,
+            std::make_pair(index, count),
+            std::make_pair(std::string(share_name), std::string(topic_filter))
+        );
+        ++count;
+    }
+
+    /**
+     * @brief Remove a member of the shared subscription group on the shard.
+     */
+    void remove_shared_route(MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter, std::size_t index) {
+        std::lock_guard<std::mutex> g(shared_routes_mtx_);
+        auto it = shared_counts_.find(std::make_tuple(std::string(share_name), std::string(topic_filter), index));
+        if (it == shared_counts_.end()) return;
+        --it->second;
+        shared_routes_.erase(share_name, topic_filter, std::make_pair(index, it->second));
+        if (it->second == 0) shared_counts_.erase(it);
+    }
+
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::mutex mtx_; ///< Guards owners_
+    std::unordered_map<std::string, std::size_t> owners_; ///< client id to the index of the shard that owns the session
+    std::shared_timed_mutex routes_mtx_; ///< Guards routes_, routes_version_, and moves_
+    multiple_subscription_map<std::size_t, std::size_t> routes_; ///< Topic filter to the index of the shard and the number of its subscriptions
+    std::uint64_t routes_version_ = 0; ///< Incremented when the routes of a session are moved
+    std::unordered_map<std::string, std::uint64_t> moves_; ///< client id of the moving session to the version of its move
+    std::mutex shared_routes_mtx_; ///< Guards shared_routes_ and shared_counts_
+    /// One entry per member of each group. The key is the index of the shard and the slot on the shard. The value is the share name and the topic filter.
+    shared_subscription_map<std::pair<std::size_t, std::size_t>, std::pair<std::string, std::string>> shared_routes_;
+    std::map<std::tuple<std::string, std::string, std::size_t>, std::size_t> shared_counts_; ///< Share name, topic filter, and index of the shard to the number of members
+};
+
+#endif // MQTT_TEST_SHARDED_BROKER_HPP
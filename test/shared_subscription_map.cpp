@@ -0,0 +1,124 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "shared_subscription_map.hpp"
+
+#include <map>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_shared_subscription_map)
+
+using map_t = shared_subscription_map<std::string, int>;
+
+// The number of the selected times of each member
+inline std::map<std::string, int> deliver(map_t& m, MQTT_NS::string_view topic, int times, MQTT_NS::string_view publisher = "pub") {
+    std::map<std::string, int> ret;
+    for (int i = 0; i != times; ++i) {
+        m.match(
+            topic,
+            publisher,
+            [&](std::string const& key, int /*value*/) {
+                ++ret[key];
+            }
+        );
+    }
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE( parse ) {
+    BOOST_TEST(!parse_shared_subscription("a/b"));
+    BOOST_TEST(!parse_shared_subscription("$share"));
+    BOOST_TEST(!parse_shared_subscription("$SYS/a"));
+
+    auto p = parse_shared_subscription("$share/g1/a/+/c");
+    BOOST_TEST(p.value().first == "g1");
+    BOOST_TEST(p.value().second == "a/+/c");
+
+    // invalid share names and filters
+    BOOST_TEST(parse_shared_subscription("$share/").value().first.empty());
+    BOOST_TEST(parse_shared_subscription("$share/g1").value().first.empty());
+    BOOST_TEST(parse_shared_subscription("$share/g1/").value().first.empty());
+    BOOST_TEST(parse_shared_subscription("$share//a").value().first.empty());
+    BOOST_TEST(parse_shared_subscription("$share/+/a").value().first.empty());
+    BOOST_TEST(parse_shared_subscription("$share/g#/a").value().first.empty());
+}
+
+BOOST_AUTO_TEST_CASE( round_robin ) {
+    map_t m;
+    BOOST_TEST(m.insert_or_assign("g1", "a/+", "k1", 1));
+    BOOST_TEST(m.insert_or_assign("g1", "a/+", "k2", 1));
+    BOOST_TEST(m.insert_or_assign("g1", "a/+", "k3", 1));
+    BOOST_TEST(!m.insert_or_assign("g1", "a/+", "k3", 2));
+    BOOST_TEST(m.size() == 3U);
+
+    BOOST_TEST((deliver(m, "a/b", 6) == std::map<std::string, int>{ { "k1", 2 }, { "k2", 2 }, { "k3", 2 } }));
+    BOOST_TEST(deliver(m, "b/b", 6).empty());
+
+    BOOST_TEST(m.erase("g1", "a/+", "k2") == 1U);
+    BOOST_TEST(m.erase("g1", "a/+", "k2") == 0U);
+    BOOST_TEST((deliver(m, "a/b", 4) == std::map<std::string, int>{ { "k1", 2 }, { "k3", 2 } }));
+}
+
+BOOST_AUTO_TEST_CASE( groups ) {
+    map_t m;
+    // Each group receives the message once.
+    m.insert_or_assign("g1", "a/#", "k1", 1);
+    m.insert_or_assign("g1", "a/#", "k2", 1);
+    m.insert_or_assign("g2", "a/#", "k3", 1);
+    m.insert_or_assign("g1", "a/b", "k4", 1);
+
+    BOOST_TEST((deliver(m, "a/b", 2) == std::map<std::string, int>{ { "k1", 1 }, { "k2", 1 }, { "k3", 2 }, { "k4", 2 } }));
+    BOOST_TEST((deliver(m, "a/c", 2) == std::map<std::string, int>{ { "k1", 1 }, { "k2", 1 }, { "k3", 2 } }));
+
+    BOOST_TEST(m.erase("g2", "a/#", "k3") == 1U);
+    BOOST_TEST(m.erase("g1", "a/b", "k4") == 1U);
+    BOOST_TEST(m.erase("g1", "a/#", "k1") == 1U);
+    BOOST_TEST(m.erase("g1", "a/#", "k2") == 1U);
+    BOOST_TEST(m.empty());
+    BOOST_TEST(deliver(m, "a/b", 2).empty());
+
+    // Removed groups can be created again.
+    m.insert_or_assign("g1", "a/#", "k1", 1);
+    BOOST_TEST((deliver(m, "a/b", 2) == std::map<std::string, int>{ { "k1", 2 } }));
+}
+
+BOOST_AUTO_TEST_CASE( least_inflight ) {
+    map_t m;
+    std::map<std::string, std::size_t> inflight { { "k1", 3 }, { "k2", 1 }, { "k3", 2 } };
+    m.set_policy(map_t::policy::least_inflight);
+    m.set_inflight_function(
+        [&](std::string const& key) {
+            return inflight[key];
+        }
+    );
+    m.insert_or_assign("g1", "a", "k1", 1);
+    m.insert_or_assign("g1", "a", "k2", 1);
+    m.insert_or_assign("g1", "a", "k3", 1);
+
+    BOOST_TEST((deliver(m, "a", 3) == std::map<std::string, int>{ { "k2", 3 } }));
+
+    // Tied members are selected in turn.
+    inflight["k2"] = 2;
+    inflight["k1"] = 2;
+    BOOST_TEST((deliver(m, "a", 3) == std::map<std::string, int>{ { "k1", 1 }, { "k2", 1 }, { "k3", 1 } }));
+}
+
+BOOST_AUTO_TEST_CASE( sticky ) {
+    map_t m;
+    m.set_policy(map_t::policy::sticky);
+    m.insert_or_assign("g1", "a", "k1", 1);
+    m.insert_or_assign("g1", "a", "k2", 1);
+    m.insert_or_assign("g1", "a", "k3", 1);
+
+    for (auto publisher : { "pub1", "pub2", "pub3", "pub4" }) {
+        auto ret = deliver(m, "a", 5, publisher);
+        BOOST_TEST(ret.size() == 1U);
+        BOOST_TEST(ret.begin()->second == 5);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,240 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_SHARED_SUBSCRIPTION_MAP_HPP)
+#define MQTT_TEST_SHARED_SUBSCRIPTION_MAP_HPP
+
+#include <functional>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <mqtt/buffer.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/string_view.hpp>
+
+#include "subscription_map.hpp"
+
+/**
+ * @brief Split a shared subscription topic filter "$share/{ShareName}/{filter}".
+ *        See https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901250
+ *        4.8.2 Shared Subscriptions
+ * @param topic_filter topic filter
+ * @return pair of the share name and the filter. nullopt if topic_filter is not a shared subscription.
+ *         If it starts with "$share/" but the share name or the filter is invalid,
+ *         the share name of the returned pair is empty.
+ */
+inline MQTT_NS::optional<std::pair<MQTT_NS::string_view, MQTT_NS::string_view>>
+parse_shared_subscription(MQTT_NS::string_view topic_filter) {
+    MQTT_NS::string_view const prefix = "$share/";
+    if (topic_filter.substr(0, prefix.size()) != prefix) return MQTT_NS::nullopt;
+    topic_filter.remove_prefix(prefix.size());
+    auto pos = topic_filter.find('/');
+    if (pos == MQTT_NS::string_view::npos || pos == 0 || pos + 1 == topic_filter.size()) {
+        return std::make_pair(MQTT_NS::string_view(), MQTT_NS::string_view());
+    }
+    auto share_name = topic_filter.substr(0, pos);
+    if (share_name.find_first_of("+#") != MQTT_NS::string_view::npos) {
+        return std::make_pair(MQTT_NS::string_view(), MQTT_NS::string_view());
+    }
+    return std::make_pair(share_name, topic_filter.substr(pos + 1));
+}
+
+/**
+ * @brief Shared subscriptions.
+ *
+ * The subscribers that subscribe the same topic filter with the same share name
+ * form a group, and each message that matches the filter is delivered to only
+ * one member of each group. The member is selected by the policy.
+ *
+ * Groups are found by multiple_subscription_map, so the cost of match() is the
+ * same as for non shared subscriptions.
+ */
+template <typename Key, typename Value>
+class shared_subscription_map {
+public:
+    enum class policy {
+        round_robin,    ///< Select the members in turn.
+        least_inflight, ///< Select the member that has the fewest in-flight messages. See set_inflight_function().
+        sticky          ///< Select the member by the hash of the publisher. The same publisher goes to the same member while the group doesn't change.
+    };
+
+    /**
+     * @brief Set the policy to select the member of a group.
+     *        The default is round_robin.
+     * @param p policy
+     */
+    void set_policy(policy p) {
+        policy_ = p;
+    }
+
+    /**
+     * @brief Set the function that returns the number of in-flight messages of a member.
+     *        It is used by policy::least_inflight. If it is not set, the policy works as round_robin.
+     * @param f function that is called as f(Key const&)
+     */
+    void set_inflight_function(std::function<std::size_t(Key const&)> f) {
+        inflight_ = std::move(f);
+    }
+
+    /**
+     * @brief Insert or update the member key of the group.
+     * @param share_name share name
+     * @param topic_filter topic filter without "$share/{ShareName}/"
+     * @param key key of the member (e.g. connection)
+     * @param value value of the subscription (e.g. QoS)
+     * @return true if inserted, false if updated
+     */
+    bool insert_or_assign(MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter, Key key, Value value) {
+        auto it = groups_.find(group_key(MQTT_NS::buffer(share_name), MQTT_NS::buffer(topic_filter)));
+        if (it == groups_.end()) {
+            // The key of the map must own the names.
+            it = groups_.emplace(
+                group_key(MQTT_NS::allocate_buffer(share_name), MQTT_NS::allocate_buffer(topic_filter)),
+                group()
+            ).first;
+            it->second.topic_filter = it->first.second;
+            filters_.insert_or_assign(topic_filter, it->first.first, &it->second);
+        }
+        auto& members = it->second.members;
+        for (auto& m : members) {
+            if (m.first == key) {
+                m.second = std::move(value);
+                return false;
+            }
+        }
+        members.emplace_back(std::move(key), std::move(value));
+        ++size_;
+        return true;
+    }
+
+    /**
+     * @brief Erase the member key of the group.
+     * @param share_name share name
+     * @param topic_filter topic filter without "$share/{ShareName}/"
+     * @param key key of the member
+     * @return number of erased members (0 or 1)
+     */
+    std::size_t erase(MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter, Key const& key) {
+        auto it = groups_.find(group_key(MQTT_NS::buffer(share_name), MQTT_NS::buffer(topic_filter)));
+        if (it == groups_.end()) return 0;
+        auto& g = it->second;
+        for (std::size_t i = 0; i != g.members.size(); ++i) {
+            if (g.members[i].first != key) continue;
+            g.members.erase(g.members.begin() + static_cast<std::ptrdiff_t>(i));
+            // Keep the turn of the next member.
+            if (g.next > i) --g.next;
+            --size_;
+            if (g.members.empty()) {
+                filters_.erase(topic_filter, it->first.first);
+                groups_.erase(it);
+            }
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Call f for the selected member of each group whose topic filter matches topic.
+     * @param topic topic name
+     * @param publisher the publisher of the message (e.g. client id). It is used by policy::sticky.
+     * @param f function that is called as f(Key const&, Value const&)
+     */
+    template <typename F>
+    void match(MQTT_NS::string_view topic, MQTT_NS::string_view publisher, F&& f) {
+        match_if(
+            topic,
+            publisher,
+            [](MQTT_NS::string_view /*share_name*/, MQTT_NS::string_view /*topic_filter*/) {
+                return true;
+            },
+            std::forward<F>(f)
+        );
+    }
+
+    /**
+     * @brief Call f for the selected member of each group whose topic filter matches topic,
+     *        if pred returns true for the group. No member of the other groups is selected.
+     * @param topic topic name
+     * @param publisher the publisher of the message (e.g. client id). It is used by policy::sticky.
+     * @param pred function that is called as pred(MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter)
+     * @param f function that is called as f(Key const&, Value const&)
+     */
+    template <typename Pred, typename F>
+    void match_if(MQTT_NS::string_view topic, MQTT_NS::string_view publisher, Pred&& pred, F&& f) {
+        filters_.match(
+            topic,
+            [&](MQTT_NS::buffer const& share_name, group* g) {
+                BOOST_ASSERT(!g->members.empty());
+                if (!pred(share_name, g->topic_filter)) return;
+                auto const& m = g->members[select(*g, publisher)];
+                f(m.first, m.second);
+            }
+        );
+    }
+
+    /**
+     * @brief Get the number of members of all the groups
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+private:
+    struct group {
+        MQTT_NS::buffer topic_filter; ///< Shares the memory of the key of groups_
+        std::vector<std::pair<Key, Value>> members;
+        std::size_t next = 0; ///< index of the next member for round_robin
+    };
+
+    using group_key = std::pair<MQTT_NS::buffer, MQTT_NS::buffer>; ///< share name and topic filter
+
+    std::size_t select(group& g, MQTT_NS::string_view publisher) {
+        auto size = g.members.size();
+        switch (policy_) {
+        case policy::least_inflight:
+            if (inflight_) {
+                // Start from the next member in order not to prefer the first one when tied.
+                std::size_t ret = g.next % size;
+                std::size_t min = std::numeric_limits<std::size_t>::max();
+                for (std::size_t i = 0; i != size; ++i) {
+                    auto idx = (g.next + i) % size;
+                    auto n = inflight_(g.members[idx].first);
+                    if (n < min) {
+                        min = n;
+                        ret = idx;
+                    }
+                }
+                g.next = ret + 1;
+                return ret;
+            }
+            break;
+        case policy::sticky:
+            return boost::hash_range(publisher.begin(), publisher.end()) % size;
+        default:
+            break;
+        }
+        auto ret = g.next % size;
+        g.next = ret + 1;
+        return ret;
+    }
+
+    policy policy_ = policy::round_robin;
+    std::function<std::size_t(Key const&)> inflight_;
+    std::map<group_key, group> groups_; ///< Addresses of the groups are stable
+    multiple_subscription_map<MQTT_NS::buffer, group*> filters_; ///< Topic filter trie of groups_. The key is the share name.
+    std::size_t size_ = 0;
+};
+
+#endif // MQTT_TEST_SHARED_SUBSCRIPTION_MAP_HPP
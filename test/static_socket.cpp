@@ -0,0 +1,114 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_server_endpoint.hpp"
+#include "checker.hpp"
+
+#include <mqtt_client_cpp.hpp>
+#include <mqtt/static_socket.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_static_socket)
+
+namespace as = boost::asio;
+
+using socket_t = MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+using endpoint_t = MQTT_NS::endpoint<std::mutex, std::lock_guard, 2, MQTT_NS::static_socket<socket_t>>;
+using server_t = test_server_endpoint<endpoint_t>;
+
+static_assert(
+    std::is_same<std::remove_reference_t<decltype(std::declval<endpoint_t&>().socket())>, MQTT_NS::static_socket<socket_t>>::value,
+    "endpoint should hold the static socket"
+);
+
+BOOST_AUTO_TEST_CASE( pubsub_qos1 ) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+
+    checker chk = {
+        cont("s_connect"),
+        cont("h_connack"),
+        cont("s_publish"),
+        cont("h_puback"),
+        cont("s_disconnect"),
+        cont("h_close"),
+    };
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_connect_handler(
+                [&]
+                (MQTT_NS::buffer client_id,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_session*/,
+                 std::uint16_t /*keep_alive*/) {
+                    MQTT_CHK("s_connect");
+                    BOOST_TEST(client_id == "cid1");
+                    ep.connack(false, MQTT_NS::connect_return_code::accepted);
+                    return true;
+                }
+            );
+            ep.set_publish_handler(
+                [&]
+                (std::uint8_t header,
+                 MQTT_NS::optional<std::uint16_t> packet_id,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents) {
+                    MQTT_CHK("s_publish");
+                    BOOST_TEST(MQTT_NS::publish::get_qos(header) == MQTT_NS::qos::at_least_once);
+                    BOOST_TEST(packet_id.has_value());
+                    BOOST_TEST(topic == "topic1");
+                    BOOST_TEST(contents == "topic1_contents");
+                    return true;
+                }
+            );
+            ep.set_disconnect_handler(
+                [&] {
+                    MQTT_CHK("s_disconnect");
+                    ep.force_disconnect();
+                }
+            );
+        }
+    );
+
+    c->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack");
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c->publish("topic1", "topic1_contents", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c->set_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/) {
+            MQTT_CHK("h_puback");
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close");
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
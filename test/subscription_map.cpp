@@ -0,0 +1,138 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "subscription_map.hpp"
+
+#include <set>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_subscription_map)
+
+using map_t = multiple_subscription_map<std::string, int>;
+
+inline std::multiset<std::string> match(map_t const& m, MQTT_NS::string_view topic) {
+    std::multiset<std::string> ret;
+    m.match(
+        topic,
+        [&](std::string const& key, int) {
+            ret.insert(key);
+        }
+    );
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE( exact ) {
+    map_t m;
+    BOOST_TEST(m.insert_or_assign("a/b/c", "k1", 0));
+    BOOST_TEST(m.insert_or_assign("a/b", "k2", 0));
+    BOOST_TEST(m.insert_or_assign("a/b/c", "k3", 0));
+    BOOST_TEST(!m.insert_or_assign("a/b/c", "k3", 1));
+    BOOST_TEST(m.size() == 3U);
+
+    BOOST_TEST((match(m, "a/b/c") == std::multiset<std::string>{ "k1", "k3" }));
+    BOOST_TEST((match(m, "a/b") == std::multiset<std::string>{ "k2" }));
+    BOOST_TEST(match(m, "a").empty());
+    BOOST_TEST(match(m, "a/b/c/d").empty());
+    BOOST_TEST(match(m, "a/b/").empty());
+
+    auto values = m.find("a/b/c");
+    BOOST_TEST(values != nullptr);
+    BOOST_TEST(values->size() == 2U);
+    BOOST_TEST(values->at("k3") == 1);
+    BOOST_TEST(m.find("a") == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( single_level_wildcard ) {
+    map_t m;
+    m.insert_or_assign("a/+/c", "k1", 0);
+    m.insert_or_assign("+/+/+", "k2", 0);
+    m.insert_or_assign("+", "k3", 0);
+    m.insert_or_assign("a/+", "k4", 0);
+
+    BOOST_TEST((match(m, "a/b/c") == std::multiset<std::string>{ "k1", "k2" }));
+    BOOST_TEST((match(m, "a//c") == std::multiset<std::string>{ "k1", "k2" }));
+    BOOST_TEST((match(m, "x/b/c") == std::multiset<std::string>{ "k2" }));
+    BOOST_TEST((match(m, "a") == std::multiset<std::string>{ "k3" }));
+    BOOST_TEST((match(m, "a/") == std::multiset<std::string>{ "k4" }));
+    BOOST_TEST(match(m, "a/b/c/d").empty());
+}
+
+BOOST_AUTO_TEST_CASE( multi_level_wildcard ) {
+    map_t m;
+    m.insert_or_assign("#", "k1", 0);
+    m.insert_or_assign("a/#", "k2", 0);
+    m.insert_or_assign("a/+/#", "k3", 0);
+    m.insert_or_assign("b/#", "k4", 0);
+
+    BOOST_TEST((match(m, "a") == std::multiset<std::string>{ "k1", "k2" }));
+    BOOST_TEST((match(m, "a/b") == std::multiset<std::string>{ "k1", "k2", "k3" }));
+    BOOST_TEST((match(m, "a/b/c/d") == std::multiset<std::string>{ "k1", "k2", "k3" }));
+    BOOST_TEST((match(m, "b") == std::multiset<std::string>{ "k1", "k4" }));
+    BOOST_TEST((match(m, "c") == std::multiset<std::string>{ "k1" }));
+}
+
+BOOST_AUTO_TEST_CASE( dollar ) {
+    map_t m;
+    m.insert_or_assign("#", "k1", 0);
+    m.insert_or_assign("+/monitor/Clients", "k2", 0);
+    m.insert_or_assign("$SYS/#", "k3", 0);
+    m.insert_or_assign("$SYS/monitor/+", "k4", 0);
+
+    BOOST_TEST((match(m, "$SYS/monitor/Clients") == std::multiset<std::string>{ "k3", "k4" }));
+    BOOST_TEST((match(m, "SYS/monitor/Clients") == std::multiset<std::string>{ "k1", "k2" }));
+    // '$' is a special character only at the beginning of the topic
+    BOOST_TEST((match(m, "a/$SYS") == std::multiset<std::string>{ "k1" }));
+}
+
+BOOST_AUTO_TEST_CASE( erase ) {
+    map_t m;
+    m.insert_or_assign("a/b/c", "k1", 0);
+    m.insert_or_assign("a/b", "k2", 0);
+    m.insert_or_assign("a/+/c", "k3", 0);
+
+    BOOST_TEST(m.erase("a/b/c", "k2") == 0U);
+    BOOST_TEST(m.erase("a/b/x", "k1") == 0U);
+    BOOST_TEST(m.erase("a/b/c", "k1") == 1U);
+    BOOST_TEST(m.erase("a/b/c", "k1") == 0U);
+    BOOST_TEST(m.size() == 2U);
+    BOOST_TEST((match(m, "a/b/c") == std::multiset<std::string>{ "k3" }));
+    BOOST_TEST((match(m, "a/b") == std::multiset<std::string>{ "k2" }));
+
+    BOOST_TEST(m.erase("a/b", "k2") == 1U);
+    BOOST_TEST(m.erase("a/+/c", "k3") == 1U);
+    BOOST_TEST(m.empty());
+    BOOST_TEST(match(m, "a/b/c").empty());
+    BOOST_TEST(m.find("a/b") == nullptr);
+
+    // Removed nodes can be created again.
+    m.insert_or_assign("a/b", "k1", 0);
+    BOOST_TEST((match(m, "a/b") == std::multiset<std::string>{ "k1" }));
+}
+
+BOOST_AUTO_TEST_CASE( many_filters ) {
+    map_t m;
+    for (int i = 0; i != 1000; ++i) {
+        for (int j = 0; j != 10; ++j) {
+            m.insert_or_assign(
+                "a/" + std::to_string(i) + "/" + std::to_string(j),
+                "k" + std::to_string(i) + "_" + std::to_string(j),
+                0
+            );
+        }
+        m.insert_or_assign("a/" + std::to_string(i) + "/+", "w" + std::to_string(i), 0);
+    }
+    BOOST_TEST(m.size() == 11000U);
+    BOOST_TEST((match(m, "a/123/4") == std::multiset<std::string>{ "k123_4", "w123" }));
+    BOOST_TEST((match(m, "a/123/x") == std::multiset<std::string>{ "w123" }));
+    for (int i = 0; i != 1000; ++i) {
+        m.erase("a/" + std::to_string(i) + "/+", "w" + std::to_string(i));
+    }
+    BOOST_TEST((match(m, "a/123/4") == std::multiset<std::string>{ "k123_4" }));
+    BOOST_TEST(m.size() == 10000U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
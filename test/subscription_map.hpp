@@ -0,0 +1,238 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_SUBSCRIPTION_MAP_HPP)
+#define MQTT_TEST_SUBSCRIPTION_MAP_HPP
+
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/assert.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <mqtt/buffer.hpp>
+#include <mqtt/string_view.hpp>
+
+/**
+ * @brief Topic filter trie.
+ *
+ * Each topic filter is split into levels, and every level is a node of the trie.
+ * Nodes are kept in one hash map keyed by (parent node id, level), so that the
+ * child of a node is found by one hash lookup.
+ * Each node holds the subscriptions (Key to Value map) of the topic filter that
+ * ends at the node, e.g. Key is a connection and Value is the subscribed QoS.
+ *
+ * match() follows the exact level, the '+' node, and the '#' node at each level
+ * of the topic. So the cost is proportional to the depth of the topic (and the
+ * number of wildcard filters that actually match), not to the number of filters.
+ * Topics that start with '$' are not matched by filters that start with
+ * a wildcard.
+ *
+ * Topic filters are not validated. The caller should validate them.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class multiple_subscription_map {
+public:
+    using values_type = std::map<Key, Value, Compare>;
+
+    /**
+     * @brief Insert or update the subscription of key on topic_filter.
+     * @param topic_filter topic filter
+     * @param key key of the subscription (e.g. connection)
+     * @param value value of the subscription (e.g. QoS)
+     * @return true if inserted, false if updated
+     */
+    bool insert_or_assign(MQTT_NS::string_view topic_filter, Key key, Value value) {
+        std::vector<node*> path;
+        auto n = &root_;
+        for_each_level(
+            topic_filter,
+            [&](MQTT_NS::string_view level) {
+                path.push_back(n);
+                auto it = map_.find(path_key(n->id, MQTT_NS::buffer(level)));
+                if (it == map_.end()) {
+                    // The key of the map must own the level.
+                    it = map_.emplace(
+                        path_key(n->id, MQTT_NS::allocate_buffer(level)),
+                        node(next_node_id_++)
+                    ).first;
+                }
+                n = &it->second;
+            }
+        );
+        path.push_back(n);
+
+        auto ret = n->values.emplace(std::move(key), value);
+        if (!ret.second) {
+            ret.first->second = std::move(value);
+            return false;
+        }
+        for (auto p : path) ++p->count;
+        ++size_;
+        return true;
+    }
+
+    /**
+     * @brief Erase the subscription of key on topic_filter.
+     * @param topic_filter topic filter
+     * @param key key of the subscription
+     * @return number of erased subscriptions (0 or 1)
+     */
+    std::size_t erase(MQTT_NS::string_view topic_filter, Key const& key) {
+        // Iterators are not invalidated by erasing other elements.
+        std::vector<typename map_type::iterator> path;
+        auto n = &root_;
+        bool found = true;
+        for_each_level(
+            topic_filter,
+            [&](MQTT_NS::string_view level) {
+                if (!found) return;
+                auto it = map_.find(path_key(n->id, MQTT_NS::buffer(level)));
+                if (it == map_.end()) {
+                    found = false;
+                    return;
+                }
+                path.push_back(it);
+                n = &it->second;
+            }
+        );
+        if (!found) return 0;
+        if (n->values.erase(key) == 0) return 0;
+
+        --root_.count;
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            if (--(*it)->second.count == 0) map_.erase(*it);
+        }
+        --size_;
+        return 1;
+    }
+
+    /**
+     * @brief Find the subscriptions of exactly topic_filter.
+     * @param topic_filter topic filter
+     * @return pointer to the subscriptions. nullptr if no subscription.
+     */
+    values_type const* find(MQTT_NS::string_view topic_filter) const {
+        auto n = &root_;
+        for_each_level(
+            topic_filter,
+            [&](MQTT_NS::string_view level) {
+                if (!n) return;
+                n = find_child(n, level);
+            }
+        );
+        if (!n || n->values.empty()) return nullptr;
+        return &n->values;
+    }
+
+    /**
+     * @brief Call f for each subscription whose topic filter matches topic.
+     *        If the same key subscribes overlapping topic filters, f is called for each of them.
+     * @param topic topic name
+     * @param f function that is called as f(Key const&, Value const&)
+     */
+    template <typename F>
+    void match(MQTT_NS::string_view topic, F&& f) const {
+        bool dollar = !topic.empty() && topic.front() == '$';
+        auto call = [&](node const* n) {
+            for (auto const& e : n->values) f(e.first, e.second);
+        };
+
+        std::vector<node const*> current { &root_ };
+        std::vector<node const*> next;
+        bool first = true;
+        for_each_level(
+            topic,
+            [&](MQTT_NS::string_view level) {
+                bool wildcard = !(first && dollar);
+                first = false;
+                for (auto n : current) {
+                    if (wildcard) {
+                        if (auto c = find_child(n, "#")) call(c);
+                        if (auto c = find_child(n, "+")) next.push_back(c);
+                    }
+                    if (auto c = find_child(n, level)) next.push_back(c);
+                }
+                current.swap(next);
+                next.clear();
+            }
+        );
+        for (auto n : current) {
+            call(n);
+            // "a/#" matches "a"
+            if (auto c = find_child(n, "#")) call(c);
+        }
+    }
+
+    /**
+     * @brief Get the number of subscriptions
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    void clear() {
+        map_.clear();
+        root_.values.clear();
+        root_.count = 0;
+        size_ = 0;
+    }
+
+private:
+    using node_id_t = std::size_t;
+
+    struct node {
+        explicit node(node_id_t id):id(id) {}
+        node_id_t id;
+        std::size_t count = 0; ///< number of subscriptions of this node and its descendants
+        values_type values;
+    };
+
+    using path_key = std::pair<node_id_t, MQTT_NS::buffer>;
+
+    struct path_key_hash {
+        std::size_t operator()(path_key const& k) const {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, k.first);
+            boost::hash_range(seed, k.second.begin(), k.second.end());
+            return seed;
+        }
+    };
+
+    using map_type = std::unordered_map<path_key, node, path_key_hash>;
+
+    template <typename F>
+    static void for_each_level(MQTT_NS::string_view topic, F&& f) {
+        while (true) {
+            auto pos = topic.find('/');
+            if (pos == MQTT_NS::string_view::npos) {
+                f(topic);
+                return;
+            }
+            f(topic.substr(0, pos));
+            topic.remove_prefix(pos + 1);
+        }
+    }
+
+    node const* find_child(node const* n, MQTT_NS::string_view level) const {
+        auto it = map_.find(path_key(n->id, MQTT_NS::buffer(level)));
+        if (it == map_.end()) return nullptr;
+        return &it->second;
+    }
+
+    map_type map_;
+    node root_ { 0 };
+    node_id_t next_node_id_ = 1;
+    std::size_t size_ = 0;
+};
+
+#endif // MQTT_TEST_SUBSCRIPTION_MAP_HPP
@@ -8,6 +8,7 @@
 #define MQTT_TEST_BROKER_HPP
 
 #include <iostream>
+#include <map>
 #include <set>
 
 #include <boost/lexical_cast.hpp>
@@ -22,6 +23,12 @@
 #include <mqtt/visitor_util.hpp>
 
 #include "test_settings.hpp"
+#include "subscription_map.hpp"
+#include "retained_topic_map.hpp"
+#include "shared_subscription_map.hpp"
+#include "offline_message_queue.hpp"
+#include "timer_wheel.hpp"
+#include "message_expiry.hpp"
 
 
 namespace mi = boost::multi_index;
@@ -35,10 +42,39 @@ using con_sp_t = std::shared_ptr<MQTT_NS::server<>::endpoint_t>;
 
 class test_broker {
 public:
+    using shared_subscription_policy = shared_subscription_map<con_sp_t, MQTT_NS::qos>::policy;
+    /**
+     * @brief Function that returns true if the message is dispatched to the shared subscription group.
+     *        It is called with the share name and the topic filter of the group.
+     *        The empty function means all the groups.
+     */
+    using shared_group_filter = std::function<bool(MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter)>;
+    /**
+     * @brief Function that returns true if the message is routed after the session of the client id
+     *        is moved to the new broker. See export_session().
+     *        The empty function means before the move.
+     */
+    using session_filter = std::function<bool(MQTT_NS::buffer const& client_id)>;
+    /**
+     * @brief Filters of deliver_publish() for the message that is published on this broker.
+     */
+    struct delivery_filter {
+        shared_group_filter shared;
+        session_filter moved;
+    };
+
     test_broker(as::io_context& ioc)
         :ioc_(ioc),
-         tim_disconnect_(ioc_)
-    {}
+         tim_disconnect_(ioc_),
+         timers_(std::chrono::milliseconds(100)),
+         tim_timers_tick_(ioc_)
+    {
+        shared_subs_.set_inflight_function(
+            [](con_sp_t const& con) {
+                return con->get_stored_message_count();
+            }
+        );
+    }
 
     // [begin] for test setting
     /**
@@ -335,6 +371,39 @@ public:
         pubcomp_props_ = std::move(props);
     }
 
+    /**
+     * @brief set_shared_subscription_policy sets how a message is dispatched to the members
+     *        of a shared subscription ($share/{ShareName}/{filter}).
+     *        least_inflight compares the number of stored messages of the connections.
+     *        sticky hashes the client id of the publisher.
+     *        The default is round_robin.
+     *
+     * @param policy - The policy to select the member.
+     */
+    void set_shared_subscription_policy(shared_subscription_policy policy) {
+        shared_subs_.set_policy(policy);
+    }
+
+    /**
+     * @brief set_offline_message_limits sets the limits of the messages that are kept
+     *        for each disconnected session. The default is unlimited.
+     *
+     * @param limits - The count and byte limits, and the policy to drop a message when exceeded.
+     */
+    void set_offline_message_limits(offline_message_queue::limits limits) {
+        offline_message_limits_ = limits;
+    }
+
+    /**
+     * @brief stop stops the timer that drives session expiry and will delay,
+     *        so that io_context::run() can return.
+     *        Sessions are not expired and delayed wills are not sent after this call.
+     */
+    void stop() {
+        stopped_ = true;
+        tim_timers_tick_.cancel();
+    }
+
     void set_connect_props_handler(std::function<void(std::vector<MQTT_NS::v5::property_variant> const&)> h) {
         h_connect_props_ = std::move(h);
     }
@@ -375,6 +444,179 @@ public:
         h_auth_props_ = std::move(h);
     }
 
+    // [begin] for sharding
+    /**
+     * @brief The session of a client id that is moved from a broker to another broker.
+     */
+    struct session_export;
+
+    /**
+     * @brief set_publish_forward_handler sets the handler that is called when a message
+     *        is published to this broker by a client, or by a will.
+     *
+     * It is used to pass the message to the other brokers. They should call deliver_publish().
+     * The handler returns the filters that are passed to deliver_publish() on this broker,
+     * so that each shared subscription group and each moving session receive the message
+     * on only one of the brokers.
+     */
+    void set_publish_forward_handler(
+        std::function<
+            delivery_filter(
+                MQTT_NS::buffer const& topic,
+                MQTT_NS::buffer const& contents,
+                MQTT_NS::qos qos_value,
+                bool is_retain,
+                std::vector<MQTT_NS::v5::property_variant> const& props,
+                MQTT_NS::buffer const& publisher
+            )
+        > h) {
+        h_publish_forward_ = std::move(h);
+    }
+
+    /**
+     * @brief set_session_fetch_handler sets the handler that is called when a client id connects.
+     *
+     * The handler should call the completion with the session of the client id that is
+     * taken from the broker that owns it, or with an empty session_export if this
+     * broker owns it. The completion must be called on the thread of this broker.
+     * CONNACK is sent after the completion is called.
+     * See export_session() for the steps to move the session.
+     */
+    void set_session_fetch_handler(
+        std::function<
+            void(
+                MQTT_NS::buffer const& client_id,
+                std::function<void(session_export)> completion
+            )
+        > h) {
+        h_session_fetch_ = std::move(h);
+    }
+
+    /**
+     * @brief set_session_end_handler sets the handler that is called when a session is discarded.
+     */
+    void set_session_end_handler(std::function<void(MQTT_NS::buffer const& client_id)> h) {
+        h_session_end_ = std::move(h);
+    }
+
+    /**
+     * @brief set_route_handler sets the handler that is called when a subscription that receives
+     *        messages is added to this broker, or removed from it.
+     *
+     * The subscriptions of non active sessions are included. Shared subscriptions are reported
+     * with the topic filter "$share/{ShareName}/{filter}" while the member is connected.
+     * A subscription that moves between an active session and a non active session is added
+     * before it is removed, so the topic filter is never reported as unsubscribed in between.
+     * It is used to forward messages only to the brokers that have a matching subscription.
+     */
+    void set_route_handler(std::function<void(MQTT_NS::string_view topic_filter, bool added)> h) {
+        h_route_ = std::move(h);
+    }
+
+    /**
+     * @brief export_session starts to move the session of the client id from this broker.
+     *
+     * A session is moved by the following steps.
+     * 1. export_session() on the old broker. The completion is called with the saved subscriptions.
+     * 2. The caller moves the routes of the subscriptions, and calls prepare_import() on the new broker.
+     * 3. take_session() on the old broker after the messages that are routed before the move arrive.
+     * 4. import_session() on the new broker with the session that is taken.
+     *
+     * If the client id is connected, the connection is closed without sending the will.
+     * If the session is being fetched from another broker, it is exported after it arrives.
+     * Until take_session() is called, the session stays on this broker and keeps the messages
+     * that are routed before the move, according to the moved_filter of deliver_publish().
+     * The new broker keeps the messages that are routed after the move, and import_session()
+     * puts them after the messages of the session, so no message is lost or duplicated.
+     * The routes of the moving subscriptions are not reported by these functions. The caller moves them.
+     *
+     * @param client_id - The client id of the session.
+     * @param completion - The function that is called with the saved subscriptions of the session.
+     *                     The state of the session is empty.
+     */
+    void export_session(MQTT_NS::buffer const& client_id, std::function<void(session_export)> completion) {
+        auto it = fetching_.find(client_id);
+        if (it != fetching_.end()) {
+            it->second.push_back(std::move(completion));
+            return;
+        }
+
+        auto& act_sess_idx = active_sessions_.get<tag_client_id>();
+        auto act_sess_it = act_sess_idx.find(client_id);
+        if (act_sess_it != act_sess_idx.end()) {
+            auto con = act_sess_it->con;
+            close_proc(*con, false);
+            con->force_disconnect();
+        }
+
+        auto& non_act_sess_idx = non_active_sessions_.get<tag_client_id>();
+        auto non_act_sess_it = non_act_sess_idx.find(client_id);
+        if (non_act_sess_it != non_act_sess_idx.end()) {
+            cancel_timers(*non_act_sess_it);
+        }
+        exporting_.insert(client_id);
+
+        session_export exported;
+        auto& idx = saved_subs_.get<tag_client_id>();
+        for (auto const& item : boost::make_iterator_range(idx.equal_range(client_id))) {
+            exported.subscriptions.push_back(item);
+        }
+        completion(MQTT_NS::force_move(exported));
+    }
+
+    /**
+     * @brief take_session removes the session that is exported by export_session() from this broker.
+     *
+     * @param client_id - The client id of the session.
+     * @return The state of the session including the kept messages. The subscriptions are empty.
+     */
+    session_export take_session(MQTT_NS::buffer const& client_id) {
+        exporting_.erase(client_id);
+
+        session_export exported;
+        auto& non_act_sess_idx = non_active_sessions_.get<tag_client_id>();
+        auto non_act_sess_it = non_act_sess_idx.find(client_id);
+        if (non_act_sess_it != non_act_sess_idx.end()) {
+            cancel_timers(*non_act_sess_it);
+            exported.state.emplace(*non_act_sess_it);
+            non_act_sess_idx.erase(non_act_sess_it);
+        }
+
+        auto& idx = saved_subs_.get<tag_client_id>();
+        auto const& range = boost::make_iterator_range(idx.equal_range(client_id));
+        for (auto const& item : range) {
+            // The route has been moved with the session.
+            saved_subs_map_.erase(item.topic, client_id);
+        }
+        idx.erase(range.begin(), range.end());
+        return exported;
+    }
+
+    /**
+     * @brief prepare_import adds the subscriptions of the session that is being exported by another broker.
+     *        The messages that match them are kept until import_session() is called.
+     *        If this broker already has a session of the client id, the subscriptions are discarded.
+     *
+     * @param client_id - The client id of the session.
+     * @param exported - The subscriptions that are passed to the completion of export_session().
+     */
+    void prepare_import(MQTT_NS::buffer const& client_id, session_export exported) {
+        if (active_sessions_.get<tag_client_id>().count(client_id) != 0 ||
+            non_active_sessions_.get<tag_client_id>().count(client_id) != 0) {
+            // Give back the routes that are moved with the subscriptions.
+            if (h_route_) {
+                for (auto const& item : exported.subscriptions) h_route_(item.topic, false);
+            }
+            return;
+        }
+        importing_.emplace(client_id, offline_message_queue());
+        for (auto& item : exported.subscriptions) {
+            saved_subs_map_.insert_or_assign(item.topic, client_id, item.topic);
+            saved_subs_.insert(MQTT_NS::force_move(item));
+        }
+    }
+    // [end] for sharding
+
 private:
     /**
      * @brief connect_proc Process an incoming CONNECT packet
@@ -407,6 +649,30 @@ private:
 
         if (ep.get_protocol_version() == MQTT_NS::protocol_version::v5 && h_connect_props_) h_connect_props_(props);
 
+        // The session of the connection expires after the interval since the connection is closed.
+        // In v5, the absent Session Expiry Interval means 0, so the session ends with the connection.
+        // In v3.1.1, the session of clean_session=0 doesn't expire.
+        MQTT_NS::optional<boost::posix_time::time_duration> session_expiry_interval;
+        if (ep.get_protocol_version() == MQTT_NS::protocol_version::v5) {
+            session_expiry_interval.emplace(boost::posix_time::seconds(0));
+        }
+        for (auto const& p : props) {
+            MQTT_NS::visit(
+                MQTT_NS::make_lambda_visitor<void>(
+                    [&](MQTT_NS::v5::property::session_expiry_interval const& v) {
+                        if (v.val() == session_never_expire) {
+                            session_expiry_interval = MQTT_NS::nullopt;
+                        }
+                        else {
+                            session_expiry_interval.emplace(boost::posix_time::seconds(static_cast<long>(v.val())));
+                        }
+                    },
+                    [](auto const&) {}
+                ),
+                p
+            );
+        }
+
         // If the Client supplies a zero-byte ClientId, the Client MUST also set CleanSession to 1 [MQTT-3.1.3-7].
         // If it's a not a clean session, but no client id is provided, we would have no way to map this
         // connection's session to a new connection later. So the connection must be rejected.
@@ -428,6 +694,58 @@ private:
             break;
         }
 
+        if (h_session_fetch_ && !client_id.empty()) {
+            // The session might be owned by another broker.
+            // Process the connection after the session arrives.
+            auto spep = ep.shared_from_this();
+            connecting_.insert(spep);
+            fetching_.emplace(client_id, std::vector<std::function<void(session_export)>>());
+            std::weak_ptr<std::remove_reference_t<decltype(ep)>> wp(spep);
+            h_session_fetch_(
+                client_id,
+                [this, wp, client_id, will = MQTT_NS::force_move(will), clean_session, session_expiry_interval]
+                (session_export exported) mutable {
+                    import_session(client_id, MQTT_NS::force_move(exported));
+                    if (auto sp = wp.lock()) {
+                        // The connection might be closed while fetching.
+                        if (connecting_.erase(sp)) {
+                            connect_proc(*sp, client_id, MQTT_NS::force_move(will), clean_session, session_expiry_interval);
+                        }
+                    }
+                    auto it = fetching_.find(client_id);
+                    if (it != fetching_.end()) {
+                        auto waiting = MQTT_NS::force_move(it->second);
+                        fetching_.erase(it);
+                        for (auto& completion : waiting) {
+                            export_session(client_id, MQTT_NS::force_move(completion));
+                        }
+                    }
+                }
+            );
+            return true;
+        }
+
+        connect_proc(ep, MQTT_NS::force_move(client_id), MQTT_NS::force_move(will), clean_session, session_expiry_interval);
+        return true;
+    }
+
+    /**
+     * @brief connect_proc Setup the session of the connection, and send CONNACK.
+     *
+     * @param ep - The connection.
+     * @param client_id - The client id of the connection.
+     * @param will - The will of the connection.
+     * @param clean_session - if the clean-session flag is set on the CONNECT message.
+     * @param session_expiry_interval - The Session Expiry Interval on the CONNECT message.
+     */
+    template <typename Endpoint>
+    void connect_proc(
+        Endpoint& ep,
+        MQTT_NS::buffer client_id,
+        MQTT_NS::optional<MQTT_NS::will> will,
+        bool clean_session,
+        MQTT_NS::optional<boost::posix_time::time_duration> session_expiry_interval
+    ) {
         auto spep = ep.shared_from_this();
 
         // Find any sessions that have the same client_id
@@ -469,6 +787,7 @@ private:
          *  the Session Present flag in CONNACK is always set to 0 if Clean Start is set to 1.
          */
         if(clean_session && (non_act_sess_it != non_act_sess_idx.end())) {
+            cancel_timers(*non_act_sess_it);
             non_act_sess_idx.erase(non_act_sess_it);
             BOOST_ASSERT(non_act_sess_idx.end() == non_act_sess_idx.find(client_id));
 
@@ -480,8 +799,20 @@ private:
             // to the active_session container.
             if(non_act_sess_it != non_act_sess_idx.end()) {
                 session_state state;
-                non_act_sess_idx.modify(non_act_sess_it, [&](session_state & val) { state = val; });
+                non_act_sess_idx.modify(
+                    non_act_sess_it,
+                    [&](session_state & val) {
+                        // The offline messages are moved, and the others are copied.
+                        auto offline_messages = MQTT_NS::force_move(val.offline_messages);
+                        state = val;
+                        state.offline_messages = MQTT_NS::force_move(offline_messages);
+                    }
+                );
                 state.con = spep;
+                // The session doesn't expire, and the delayed will is not sent while connected.
+                // The will of the new connection replaces it.
+                cancel_timers(state);
+                state.will = MQTT_NS::force_move(will);
                 non_act_sess_idx.erase(non_act_sess_it);
                 BOOST_ASSERT(non_act_sess_idx.end() == non_act_sess_idx.find(client_id));
 
@@ -534,6 +865,9 @@ private:
                 {
                     auto const& range = boost::make_iterator_range(subs_idx.equal_range(act_sess_it->con));
                     for(auto it = range.begin(); it != range.end(); std::advance(it, 1)) {
+                        // Insert before erase in order to keep the route.
+                        insert_subscription(it->topic, spep, it->qos_value);
+                        erase_subscription(it->topic, act_sess_it->con);
                         subs_idx.modify_key(it,
                                             [&](con_sp_t & val) { val = spep; },
                                             [&](con_sp_t&) { BOOST_ASSERT(false); });
@@ -546,9 +880,21 @@ private:
                                                        [&](con_sp_t&) { BOOST_ASSERT(false); });
         }
 
+        act_sess_idx.modify(
+            act_sess_it,
+            [&](session_state & val) {
+                val.session_expiry_interval = session_expiry_interval;
+            }
+        );
+
         if (clean_session) {
-            saved_subs_.get<tag_client_id>().erase(client_id);
-            BOOST_ASSERT(saved_subs_.get<tag_client_id>().count(client_id) == 0);
+            auto & idx = saved_subs_.get<tag_client_id>();
+            auto const& range = boost::make_iterator_range(idx.equal_range(client_id));
+            for(auto const& item : range) {
+                erase_saved_subscription(item.topic, client_id);
+            }
+            idx.erase(range.begin(), range.end());
+            BOOST_ASSERT(idx.count(client_id) == 0);
         }
         else {
             // If it's not a clean session, then all of the
@@ -557,25 +903,82 @@ private:
             auto & idx = saved_subs_.get<tag_client_id>();
             auto const& range = boost::make_iterator_range(idx.equal_range(client_id));
             for(auto const& item : range) {
-                // Send the saved messages out on the wire.
-                for (auto & d : item.messages) {
+                subs_.emplace(item.topic, spep, item.qos_value);
+                insert_subscription(item.topic, spep, item.qos_value);
+                erase_saved_subscription(item.topic, client_id);
+            }
+            idx.erase(range.begin(), range.end());
+            BOOST_ASSERT(idx.count(client_id) == 0);
+
+            // Send the saved messages out on the wire.
+            offline_message_queue messages;
+            act_sess_idx.modify(
+                act_sess_it,
+                [&](session_state & val) {
+                    messages = MQTT_NS::force_move(val.offline_messages);
+                }
+            );
+            auto now = expiry_clock::now();
+            messages.for_each(
+                [&](offline_message_queue::entry const& e) {
+                    // The message might expire after the last sweep.
+                    if (e.message->expired(now)) return;
                     // But *only* for this connection
                     // Not every connection in the broker.
                     ep.publish(
-                        as::buffer(item.topic),
-                        as::buffer(d.contents),
-                        std::make_pair(item.topic, d.contents),
-                        std::min(item.qos_value, d.qos_value),
+                        as::buffer(e.message->topic),
+                        as::buffer(e.message->contents),
+                        e.message,
+                        e.qos_value,
                         true, // TODO: why is this 'retain'?
-                        *(d.props)
+                        remaining_expiry_props(e.message->props, e.message->expiry, now)
                         );
                 }
-                subs_.emplace(item.topic, spep, item.qos_value);
+            );
+        }
+    }
+
+    /**
+     * @brief import_session Add the session that is taken from another broker.
+     *        The messages that are kept since prepare_import() follow the messages of the session.
+     *        If this broker already has a session of the client id, the taken one is discarded.
+     *
+     * @param client_id - The client id of the session.
+     * @param exported - The session that is returned by take_session().
+     */
+    void import_session(MQTT_NS::buffer const& client_id, session_export exported) {
+        auto kept = [&] {
+            offline_message_queue ret;
+            auto it = importing_.find(client_id);
+            if (it != importing_.end()) {
+                ret = MQTT_NS::force_move(it->second);
+                importing_.erase(it);
             }
-            idx.erase(range.begin(), range.end());
-            BOOST_ASSERT(idx.count(client_id) == 0);
+            return ret;
+        } ();
+        if (active_sessions_.get<tag_client_id>().count(client_id) != 0 ||
+            non_active_sessions_.get<tag_client_id>().count(client_id) != 0) return;
+
+        if (exported.state) {
+            auto& state = exported.state.value();
+            // The timers of the exporting broker have been cancelled.
+            // The session is connected soon, so the timers are not started again.
+            state.expiry_timer = 0;
+            state.will_timer = 0;
+            state.offline_message_timer = 0;
+            kept.for_each(
+                [&](offline_message_queue::entry const& e) {
+                    state.offline_messages.push(e.message, e.qos_value, offline_message_limits_);
+                }
+            );
+            auto const& ret = non_active_sessions_.insert(MQTT_NS::force_move(state));
+            BOOST_ASSERT(ret.second);
+            static_cast<void>(ret);
+        }
+        for (auto& item : exported.subscriptions) {
+            insert_saved_subscription(item.topic, item.client_id);
+            saved_subs_.insert(MQTT_NS::force_move(item));
         }
-        return true;
     }
 
     template <typename Endpoint>
@@ -611,12 +1014,19 @@ private:
 
         MQTT_NS::qos qos_value = MQTT_NS::publish::get_qos(header);
         bool is_retain = MQTT_NS::publish::is_retain(header);
+        MQTT_NS::buffer publisher;
+        {
+            auto& idx = active_sessions_.get<tag_con>();
+            auto it = idx.find(ep.shared_from_this());
+            if (it != idx.end()) publisher = it->client_id;
+        }
         do_publish(
             std::move(topic_name),
             std::move(contents),
             qos_value,
             is_retain,
-            std::move(props));
+            std::move(props),
+            publisher);
 
         switch (ep.get_protocol_version()) {
         case MQTT_NS::protocol_version::v3_1_1:
@@ -671,10 +1081,12 @@ private:
             for (auto const& e : entries) {
                 MQTT_NS::buffer topic = std::get<0>(e);
                 MQTT_NS::qos qos_value = std::get<1>(e).get_qos();
+                if (!is_valid_topic_filter(topic)) {
+                    res.emplace_back(MQTT_NS::suback_reason_code::unspecified_error);
+                    continue;
+                }
                 res.emplace_back(static_cast<MQTT_NS::suback_reason_code>(qos_value)); // converts to granted_qos_x
-                // TODO: This doesn't handle situations where we receive a new subscription for the same topic.
-                // MQTT 3.1.1 - 3.8.4 Response - paragraph 3.
-                subs_.emplace(std::move(topic), ep.shared_from_this(), qos_value);
+                subscribe(std::move(topic), ep.shared_from_this(), qos_value);
             }
             // Acknowledge the subscriptions, and the registered QOS settings
             ep.suback(packet_id, MQTT_NS::force_move(res));
@@ -687,10 +1099,12 @@ private:
             for (auto const& e : entries) {
                 MQTT_NS::buffer topic = std::get<0>(e);
                 MQTT_NS::qos qos_value = std::get<1>(e).get_qos();
+                if (!is_valid_topic_filter(topic)) {
+                    res.emplace_back(MQTT_NS::v5::suback_reason_code::topic_filter_invalid);
+                    continue;
+                }
                 res.emplace_back(static_cast<MQTT_NS::v5::suback_reason_code>(qos_value)); // converts to granted_qos_x
-                // TODO: This doesn't handle situations where we receive a new subscription for the same topic.
-                // MQTT 3.1.1 - 3.8.4 Response - paragraph 3.
-                subs_.emplace(std::move(topic), ep.shared_from_this(), qos_value);
+                subscribe(std::move(topic), ep.shared_from_this(), qos_value);
             }
             if (h_subscribe_props_) h_subscribe_props_(props);
             // Acknowledge the subscriptions, and the registered QOS settings
@@ -704,17 +1118,24 @@ private:
         for (auto const& e : entries) {
             MQTT_NS::buffer const& topic = std::get<0>(e);
             MQTT_NS::subscribe_options options = std::get<1>(e);
+            // Retained messages are not sent for shared subscriptions.
+            if (parse_shared_subscription(topic)) continue;
             // Publish any retained messages that match the newly subscribed topic.
-            auto it = retains_.find(topic);
-            if (it != retains_.end()) {
-                ep.publish(
-                    as::buffer(it->topic),
-                    as::buffer(it->contents),
-                    std::make_pair(it->topic, it->contents),
-                    std::min(it->qos_value, options.get_qos()),
-                    true,
-                    it->props);
-            }
+            auto now = expiry_clock::now();
+            retains_.match(
+                topic,
+                [&](retain const& r) {
+                    // The message might expire after the last sweep.
+                    if (r.expired(now)) return;
+                    ep.publish(
+                        as::buffer(r.topic),
+                        as::buffer(r.contents),
+                        std::make_pair(r.topic, r.contents),
+                        std::min(r.qos_value, options.get_qos()),
+                        true,
+                        remaining_expiry_props(r.props, r.expiry, now));
+                }
+            );
         }
         return true;
     }
@@ -749,6 +1170,7 @@ private:
                          * iterator because we might not have a match, and
                          * thus would infinitely loop on the current iterator.
                          */
+                        erase_subscription(it->topic, spep);
                         it = idx.erase(it);
                         match = true;
                         break;
@@ -788,53 +1210,118 @@ private:
      * @param qos - The QOS setting to use for the published message.
      * @param is_retain - Whether the message should be retained so it can
      *                    be sent to newly added subscriptions in the future.\
+     * @param publisher - The client id of the publisher. It is used to select the member of shared subscriptions.
      */
     void do_publish(
         MQTT_NS::buffer topic,
         MQTT_NS::buffer contents,
         MQTT_NS::qos qos_value,
         bool is_retain,
-        std::vector<MQTT_NS::v5::property_variant> props) {
-        // For each active subscription registered for this topic
-        for(auto const& sub : boost::make_iterator_range(subs_.get<tag_topic>().equal_range(topic))) {
-            // publish the message to subscribers.
-            // TODO: Probably this should be switched to async_publish?
-            //       Given the async_client / sync_client seperation
-            //       and the way they have different function names,
-            //       it wouldn't be possible for test_broker.hpp to be
-            //       used with some hypothetical "async_server" in the future.
-            sub.con->publish(
-                topic,
-                contents,
-                std::min(sub.qos_value, qos_value),
-                false,
-                props // TODO: Copying the properties vector for each subscription.
-            );
+        std::vector<MQTT_NS::v5::property_variant> props,
+        MQTT_NS::buffer const& publisher) {
+        delivery_filter filter;
+        if (h_publish_forward_) {
+            filter = h_publish_forward_(topic, contents, qos_value, is_retain, props, publisher);
         }
+        deliver_publish(
+            MQTT_NS::force_move(topic),
+            MQTT_NS::force_move(contents),
+            qos_value,
+            is_retain,
+            MQTT_NS::force_move(props),
+            publisher,
+            filter.shared,
+            filter.moved);
+    }
+
+public:
+    /**
+     * @brief deliver_publish Publish a message to the clients that are subscribed on this broker.
+     *        Unlike do_publish, the message is not forwarded to the other brokers.
+     *
+     * @param topic - The topic to publish the message on.
+     * @param contents - The contents of the message.
+     * @param qos - The QOS setting to use for the published message.
+     * @param is_retain - Whether the message should be retained so it can
+     *                    be sent to newly added subscriptions in the future.
+     * @param publisher - The client id of the publisher. It is used to select the member of shared subscriptions.
+     * @param shared_filter - The shared subscription groups that receive the message. The empty function means all the groups.
+     * @param moved_filter - Whether the message is routed after the move of each moving session. See export_session().
+     */
+    void deliver_publish(
+        MQTT_NS::buffer topic,
+        MQTT_NS::buffer contents,
+        MQTT_NS::qos qos_value,
+        bool is_retain,
+        std::vector<MQTT_NS::v5::property_variant> props,
+        MQTT_NS::buffer const& publisher,
+        shared_group_filter const& shared_filter = shared_group_filter(),
+        session_filter const& moved_filter = session_filter()) {
+        // The message is encoded once for each combination of protocol version,
+        // QoS, and retain flag, and shared by all the subscribers.
+        MQTT_NS::encoded_publish msg(topic, contents, props);
+
+        // For each active subscription that matches this topic
+        subs_map_.match(
+            topic,
+            [&](con_sp_t const& con, MQTT_NS::qos sub_qos_value) {
+                // publish the message to subscribers.
+                // TODO: Probably this should be switched to async_publish?
+                //       Given the async_client / sync_client seperation
+                //       and the way they have different function names,
+                //       it wouldn't be possible for test_broker.hpp to be
+                //       used with some hypothetical "async_server" in the future.
+                con->publish(
+                    msg,
+                    std::min(sub_qos_value, qos_value),
+                    false
+                );
+            }
+        );
+
+        publish_shared(topic, msg, qos_value, publisher, shared_filter);
 
         {
             // For each saved subscription, add this message to
-            // the list to be sent out when a connection resumes
-            // a lost session.
-            //
-            // TODO: This does not properly handle wildcards!
-            auto & idx = saved_subs_.get<tag_topic>();
-            auto range = boost::make_iterator_range(idx.equal_range(topic));
-            if( ! range.empty()) {
-                auto sp_props = std::make_shared<std::vector<MQTT_NS::v5::property_variant>>(props);
-                for(auto it = range.begin(); it != range.end(); std::advance(it, 1)) {
-                    idx.modify(it,
-                               [&](session_subscription & val)
-                               {
-                                   val.messages.emplace_back(
-                                       contents,
-                                       sp_props,
-                                       std::min(it->qos_value, qos_value));
-                               },
-                               [&](session_subscription&)
-                               {
-                                   BOOST_ASSERT(false);
-                               });
+            // the queue of the session to be sent out when a
+            // connection resumes the lost session.
+            // The message is queued once for each session with the
+            // maximum QoS of the matched subscriptions.
+            auto & idx = saved_subs_.get<tag_topic_client_id>();
+            std::map<MQTT_NS::buffer, MQTT_NS::qos> sessions;
+            saved_subs_map_.match(
+                topic,
+                [&](MQTT_NS::buffer const& client_id, MQTT_NS::buffer const& topic_filter) {
+                    auto it = idx.find(std::make_tuple(topic_filter, client_id));
+                    BOOST_ASSERT(it != idx.end());
+                    auto sub_qos_value = std::min(it->qos_value, qos_value);
+                    auto ret = sessions.emplace(client_id, sub_qos_value);
+                    if (!ret.second) ret.first->second = std::max(ret.first->second, sub_qos_value);
+                }
+            );
+            if (!sessions.empty()) {
+                // The body of the message is shared by all the sessions.
+                auto msg = std::make_shared<offline_message const>(topic, contents, props);
+                auto& non_act_sess_idx = non_active_sessions_.get<tag_client_id>();
+                for (auto const& e : sessions) {
+                    auto it = non_act_sess_idx.find(e.first);
+                    if (it == non_act_sess_idx.end()) {
+                        // Keep the message until the session arrives.
+                        auto imp_it = importing_.find(e.first);
+                        if (imp_it != importing_.end() && moved_filter && moved_filter(e.first)) {
+                            imp_it->second.push(msg, e.second, offline_message_limits_);
+                        }
+                        continue;
+                    }
+                    // The new broker keeps the message.
+                    if (exporting_.count(e.first) != 0 && moved_filter && moved_filter(e.first)) continue;
+                    non_act_sess_idx.modify(
+                        it,
+                        [&](session_state & val) {
+                            if (!val.offline_messages.push(msg, e.second, offline_message_limits_)) return;
+                            start_offline_message_timer(val);
+                        }
+                    );
                 }
             }
         }
@@ -863,33 +1350,66 @@ private:
         if (is_retain) {
             if (contents.empty()) {
                 retains_.erase(topic);
-                BOOST_ASSERT(retains_.count(topic) == 0);
+                BOOST_ASSERT(retains_.find(topic) == nullptr);
             }
             else {
-                auto const& it = retains_.find(topic);
-                if(it == retains_.end()) {
-                    auto const& ret = retains_.emplace(topic, contents, std::move(props), qos_value);
-                    BOOST_ASSERT(ret.second);
-                    BOOST_ASSERT(ret.first->topic == topic);
-                    BOOST_ASSERT(ret.first->contents == contents);
-                }
-                else {
-                    retains_.modify(it,
-                                    [&](retain& val)
-                                    {
-                                        val.qos_value = qos_value;
-                                        val.props = std::move(props);
-                                        val.contents = contents;
-                                    },
-                                    [&](retain&)
-                                    {
-                                        BOOST_ASSERT(false);
-                                    });
+                retain r(topic, contents, std::move(props), qos_value);
+                auto expiry = r.expiry;
+                retains_.insert_or_assign(topic, MQTT_NS::force_move(r));
+                if (expiry) {
+                    add_timer(expiry.value(), [this, topic] { sweep_retain(topic); });
                 }
             }
         }
     }
 
+    /**
+     * @brief deliver_shared Publish a message to the shared subscription groups on this broker.
+     *        It is used to deliver the message again when the selected member has left.
+     *
+     * @param topic - The topic to publish the message on.
+     * @param contents - The contents of the message.
+     * @param qos - The QOS setting to use for the published message.
+     * @param publisher - The client id of the publisher. It is used to select the member of shared subscriptions.
+     * @param shared_filter - The shared subscription groups that receive the message. The empty function means all the groups.
+     */
+    void deliver_shared(
+        MQTT_NS::buffer topic,
+        MQTT_NS::buffer contents,
+        MQTT_NS::qos qos_value,
+        std::vector<MQTT_NS::v5::property_variant> props,
+        MQTT_NS::buffer const& publisher,
+        shared_group_filter const& shared_filter) {
+        MQTT_NS::encoded_publish msg(topic, contents, props);
+        publish_shared(topic, msg, qos_value, publisher, shared_filter);
+    }
+
+private:
+    /**
+     * @brief publish_shared Publish a message to one member of each shared subscription group that matches the topic.
+     */
+    void publish_shared(
+        MQTT_NS::buffer const& topic,
+        MQTT_NS::encoded_publish& msg,
+        MQTT_NS::qos qos_value,
+        MQTT_NS::buffer const& publisher,
+        shared_group_filter const& shared_filter) {
+        shared_subs_.match_if(
+            topic,
+            publisher,
+            [&](MQTT_NS::string_view share_name, MQTT_NS::string_view topic_filter) {
+                return !shared_filter || shared_filter(share_name, topic_filter);
+            },
+            [&](con_sp_t const& con, MQTT_NS::qos sub_qos_value) {
+                con->publish(
+                    msg,
+                    std::min(sub_qos_value, qos_value),
+                    false
+                );
+            }
+        );
+    }
+
     /**
      * @brief close_proc - clean up a connection that has been closed.
      *
@@ -918,6 +1438,9 @@ private:
         ep.set_pingresp_handler();
         ep.set_v5_auth_handler();
 
+        // The connection is closed while its session is being fetched.
+        if (connecting_.erase(spep)) return;
+
         auto & act_sess_idx = active_sessions_.get<tag_con>();
         auto act_sess_it = act_sess_idx.find(spep);
 
@@ -926,9 +1449,16 @@ private:
         // this endpoint's connection with the broker above.
         BOOST_ASSERT(act_sess_it != act_sess_idx.end());
 
+        // The session ends with the connection if it is a clean session of v3.1.1,
+        // or if the Session Expiry Interval is 0.
+        bool const session_end =
+            (ep.clean_session() && (ep.get_protocol_version() == MQTT_NS::protocol_version::v3_1_1)) ||
+            (act_sess_it->session_expiry_interval &&
+             act_sess_it->session_expiry_interval.value().total_milliseconds() == 0);
+
         MQTT_NS::buffer client_id;
         MQTT_NS::optional<MQTT_NS::will> will;
-        if(ep.clean_session() && (ep.get_protocol_version() == MQTT_NS::protocol_version::v3_1_1)) {
+        if (session_end) {
             client_id = std::move(act_sess_it->client_id);
             will = std::move(act_sess_it->will);
             act_sess_idx.erase(act_sess_it);
@@ -941,15 +1471,38 @@ private:
 
             BOOST_ASSERT(non_active_sessions_.get<tag_client_id>().count(client_id) == 0);
             BOOST_ASSERT(non_active_sessions_.get<tag_client_id>().find(client_id) == non_active_sessions_.get<tag_client_id>().end());
+
+            if (h_session_end_) h_session_end_(client_id);
         }
         else
         {
             session_state state = std::move(*act_sess_it);
             client_id = state.client_id;
             will = std::move(state.will);
+            state.will = MQTT_NS::nullopt;
 
             // TODO: Should yank out the messages from this connection object and store it in the session_state object??
             state.con.reset(); // clear the shared pointer, so it doesn't stay alive after this funciton ends.
+
+            if (state.session_expiry_interval) {
+                auto const& expiry = state.session_expiry_interval.value();
+                if (send_will && will) {
+                    // The will is sent when the Will Delay Interval expires, or the session ends,
+                    // whichever happens first.
+                    auto delay = get_will_delay(will.value());
+                    if (delay.total_milliseconds() > 0 && expiry.total_milliseconds() > 0) {
+                        state.will = MQTT_NS::force_move(will);
+                        will = MQTT_NS::nullopt;
+                        if (delay < expiry) {
+                            state.will_timer = add_timer(delay, [this, client_id] { will_delay_expired(client_id); });
+                        }
+                    }
+                }
+                state.expiry_timer = add_timer(
+                    state.session_expiry_interval.value(),
+                    [this, client_id] { session_expired(client_id); }
+                );
+            }
             act_sess_idx.erase(act_sess_it);
             BOOST_ASSERT(active_sessions_.get<tag_client_id>().count(client_id) == 0);
             BOOST_ASSERT(active_sessions_.get<tag_client_id>().find(client_id) == active_sessions_.get<tag_client_id>().end());
@@ -972,42 +1525,324 @@ private:
         {
             auto& idx = subs_.get<tag_con>();
             auto const& range = boost::make_iterator_range(idx.equal_range(spep));
-            // In v3_1_1, we need to clear any subscriptions at the end of the session.
-            // In v5, we always save them, and clear them at the beginning of a session.
-            if (ep.clean_session() && (ep.get_protocol_version() == MQTT_NS::protocol_version::v3_1_1)) {
-                // Remove all subscriptions for this clientid
-                idx.erase(range.begin(), range.end());
-            }
-            else if( ! range.empty()) {
+            // The subscriptions are cleared at the end of the session.
+            // Otherwise they are saved, and cleared when a clean session starts.
+            if (!session_end) {
                 // Save all the subscriptions for this clientid for later.
+                // They are saved before they are erased in order to keep the routes.
                 for(auto const& item : range) {
                     auto const& ret = saved_subs_.emplace(client_id,
                                                           item.topic,
                                                           item.qos_value);
                     BOOST_ASSERT(ret.second);
                     BOOST_ASSERT(ret.first == saved_subs_.find(client_id));
+                    insert_saved_subscription(item.topic, client_id);
                 }
-                idx.erase(range.begin(), range.end());
             }
+            for(auto const& item : range) {
+                erase_subscription(item.topic, spep);
+            }
+            idx.erase(range.begin(), range.end());
             BOOST_ASSERT(idx.count(spep) == 0);
         }
 
         if(send_will && will) {
-            // TODO: This should be triggered by the will delay
-            // Not sent immediately.
             do_publish(
                 std::move(will.value().topic()),
                 std::move(will.value().message()),
                 will.value().get_qos(),
                 will.value().retain(),
-                std::move(will.value().props()));
+                std::move(will.value().props()),
+                client_id);
         }
     }
 
 private:
+    struct session_state;
+
+    /**
+     * @brief get_will_delay Get the Will Delay Interval of the will.
+     *
+     * @param w - The will.
+     * @return The Will Delay Interval. 0 if it is not set.
+     */
+    static boost::posix_time::time_duration get_will_delay(MQTT_NS::will const& w) {
+        boost::posix_time::time_duration delay;
+        for (auto const& p : w.props()) {
+            MQTT_NS::visit(
+                MQTT_NS::make_lambda_visitor<void>(
+                    [&](MQTT_NS::v5::property::will_delay_interval const& v) {
+                        delay = boost::posix_time::seconds(static_cast<long>(v.val()));
+                    },
+                    [](auto const&) {}
+                ),
+                p
+            );
+        }
+        return delay;
+    }
+
+    /**
+     * @brief add_timer Add the timer to timers_, and start the tick of timers_ if it is stopped.
+     *
+     * @param duration - The duration from now.
+     * @param f - The function that is called when the timer expires.
+     * @return The id of the timer.
+     */
+    timer_wheel::id_t add_timer(boost::posix_time::time_duration duration, std::function<void()> f) {
+        return add_timer(
+            timer_wheel::clock::now() + std::chrono::milliseconds(duration.total_milliseconds()),
+            MQTT_NS::force_move(f)
+        );
+    }
+
+    /**
+     * @brief add_timer Add the timer that expires at expiry to timers_.
+     *
+     * @param expiry - The time to call f.
+     * @param f - The function that is called when the timer expires.
+     * @return The id of the timer.
+     */
+    timer_wheel::id_t add_timer(timer_wheel::clock::time_point expiry, std::function<void()> f) {
+        auto id = timers_.add(expiry, MQTT_NS::force_move(f));
+        if (!ticking_ && !stopped_) {
+            ticking_ = true;
+            tick_timers();
+        }
+        return id;
+    }
+
+    /**
+     * @brief start_offline_message_timer Start the timer of the session that erases the expired
+     *        offline messages when the oldest one expires, unless it has been started.
+     *
+     * @param state - The non active session.
+     */
+    void start_offline_message_timer(session_state& state) {
+        if (state.offline_message_timer != 0) return;
+        auto expiry = state.offline_messages.front_expiry();
+        if (!expiry) return;
+        state.offline_message_timer = add_timer(
+            expiry.value(),
+            [this, client_id = state.client_id] { sweep_offline_messages(client_id); }
+        );
+    }
+
+    /**
+     * @brief sweep_offline_messages Erase the expired messages from the front of the offline
+     *        message queue, and restart the timer for the next oldest message.
+     *        The messages behind a message that doesn't expire yet are skipped at delivery.
+     *
+     * @param client_id - The client id of the non active session.
+     */
+    void sweep_offline_messages(MQTT_NS::buffer const& client_id) {
+        auto& idx = non_active_sessions_.get<tag_client_id>();
+        auto it = idx.find(client_id);
+        if (it == idx.end()) return;
+        idx.modify(
+            it,
+            [&](session_state & val) {
+                val.offline_message_timer = 0;
+                val.offline_messages.erase_expired_front(expiry_clock::now());
+                start_offline_message_timer(val);
+            }
+        );
+    }
+
+    /**
+     * @brief sweep_retain Erase the retained message of the topic if it has expired.
+     *        The message might have been replaced by a newer one that is not expired yet.
+     *
+     * @param topic - The topic of the retained message.
+     */
+    void sweep_retain(MQTT_NS::buffer const& topic) {
+        auto r = retains_.find(topic);
+        if (r && r->expired(expiry_clock::now())) retains_.erase(topic);
+    }
+
+    /**
+     * @brief tick_timers Advance timers_ periodically while it has timers.
+     *        One asio timer drives the timers of all the sessions.
+     */
+    void tick_timers() {
+        tim_timers_tick_.expires_after(timers_.tick());
+        tim_timers_tick_.async_wait(
+            [this](boost::system::error_code const& ec) {
+                if (ec) {
+                    ticking_ = false;
+                    return;
+                }
+                timers_.advance();
+                if (timers_.empty() || stopped_) {
+                    ticking_ = false;
+                    return;
+                }
+                tick_timers();
+            }
+        );
+    }
+
+    /**
+     * @brief cancel_timers Cancel the session expiry, the will delay, and the sweep of the offline
+     *        messages of the session. The will is kept in the session.
+     */
+    void cancel_timers(session_state const& state) {
+        if (state.expiry_timer != 0) timers_.cancel(state.expiry_timer);
+        if (state.will_timer != 0) timers_.cancel(state.will_timer);
+        if (state.offline_message_timer != 0) timers_.cancel(state.offline_message_timer);
+    }
+
+    void cancel_timers(session_state& state) {
+        cancel_timers(static_cast<session_state const&>(state));
+        state.expiry_timer = 0;
+        state.will_timer = 0;
+        state.offline_message_timer = 0;
+    }
+
+    /**
+     * @brief will_delay_expired Send the delayed will of the non active session.
+     *
+     * @param client_id - The client id of the session.
+     */
+    void will_delay_expired(MQTT_NS::buffer const& client_id) {
+        auto& idx = non_active_sessions_.get<tag_client_id>();
+        auto it = idx.find(client_id);
+        if (it == idx.end() || !it->will) return;
+        MQTT_NS::optional<MQTT_NS::will> will;
+        idx.modify(
+            it,
+            [&](session_state & val) {
+                will = MQTT_NS::force_move(val.will);
+                val.will = MQTT_NS::nullopt;
+                val.will_timer = 0;
+            }
+        );
+        do_publish(
+            std::move(will.value().topic()),
+            std::move(will.value().message()),
+            will.value().get_qos(),
+            will.value().retain(),
+            std::move(will.value().props()),
+            client_id);
+    }
+
+    /**
+     * @brief session_expired Discard the non active session and its saved subscriptions.
+     *        If the will of the session is waiting for the Will Delay Interval, it is sent.
+     *
+     * @param client_id - The client id of the session.
+     */
+    void session_expired(MQTT_NS::buffer const& client_id) {
+        auto& non_act_sess_idx = non_active_sessions_.get<tag_client_id>();
+        auto non_act_sess_it = non_act_sess_idx.find(client_id);
+        if (non_act_sess_it == non_act_sess_idx.end()) return;
+        if (non_act_sess_it->will_timer != 0) timers_.cancel(non_act_sess_it->will_timer);
+        if (non_act_sess_it->offline_message_timer != 0) timers_.cancel(non_act_sess_it->offline_message_timer);
+        auto will = non_act_sess_it->will;
+        non_act_sess_idx.erase(non_act_sess_it);
+
+        auto & idx = saved_subs_.get<tag_client_id>();
+        auto const& range = boost::make_iterator_range(idx.equal_range(client_id));
+        for(auto const& item : range) {
+            erase_saved_subscription(item.topic, client_id);
+        }
+        idx.erase(range.begin(), range.end());
+
+        if (h_session_end_) h_session_end_(client_id);
+
+        if (will) {
+            do_publish(
+                std::move(will.value().topic()),
+                std::move(will.value().message()),
+                will.value().get_qos(),
+                will.value().retain(),
+                std::move(will.value().props()),
+                client_id);
+        }
+    }
+
+    /**
+     * @brief is_valid_topic_filter checks the share name and the filter of shared subscriptions.
+     *        Other topic filters are not validated.
+     */
+    static bool is_valid_topic_filter(MQTT_NS::string_view topic_filter) {
+        auto shared = parse_shared_subscription(topic_filter);
+        return !shared || !shared.value().first.empty();
+    }
+
+    /**
+     * @brief subscribe adds the subscription of the connection to subs_ and the trie.
+     *        If the connection already subscribes the topic filter, the subscription is replaced.
+     *        MQTT 3.1.1 - 3.8.4 Response - paragraph 3.
+     */
+    void subscribe(MQTT_NS::buffer topic_filter, con_sp_t const& con, MQTT_NS::qos qos_value) {
+        insert_subscription(topic_filter, con, qos_value);
+        auto ret = subs_.emplace(std::move(topic_filter), con, qos_value);
+        if (!ret.second) {
+            // Keep subs_ in sync with the trie. The session is saved from subs_.
+            subs_.modify(
+                ret.first,
+                [&](sub_con& e) {
+                    e.qos_value = qos_value;
+                }
+            );
+        }
+    }
+
+    /**
+     * @brief insert_subscription adds the subscription to subs_map_, or to shared_subs_ if
+     *        topic_filter is a shared subscription.
+     */
+    void insert_subscription(MQTT_NS::string_view topic_filter, con_sp_t const& con, MQTT_NS::qos qos_value) {
+        bool inserted =
+            [&] {
+                if (auto shared = parse_shared_subscription(topic_filter)) {
+                    return shared_subs_.insert_or_assign(shared.value().first, shared.value().second, con, qos_value);
+                }
+                return subs_map_.insert_or_assign(topic_filter, con, qos_value);
+            } ();
+        if (inserted && h_route_) h_route_(topic_filter, true);
+    }
+
+    /**
+     * @brief erase_subscription removes the subscription that is added by insert_subscription.
+     */
+    void erase_subscription(MQTT_NS::string_view topic_filter, con_sp_t const& con) {
+        auto erased =
+            [&] {
+                if (auto shared = parse_shared_subscription(topic_filter)) {
+                    return shared_subs_.erase(shared.value().first, shared.value().second, con);
+                }
+                return subs_map_.erase(topic_filter, con);
+            } ();
+        if (erased != 0 && h_route_) h_route_(topic_filter, false);
+    }
+
+    /**
+     * @brief insert_saved_subscription adds the subscription of the non active session to saved_subs_map_.
+     *        Messages are not kept for the offline members of shared subscriptions.
+     */
+    void insert_saved_subscription(MQTT_NS::buffer const& topic_filter, MQTT_NS::buffer const& client_id) {
+        if (parse_shared_subscription(topic_filter)) return;
+        if (saved_subs_map_.insert_or_assign(topic_filter, client_id, topic_filter) && h_route_) {
+            h_route_(topic_filter, true);
+        }
+    }
+
+    /**
+     * @brief erase_saved_subscription removes the subscription that is added by insert_saved_subscription.
+     */
+    void erase_saved_subscription(MQTT_NS::buffer const& topic_filter, MQTT_NS::buffer const& client_id) {
+        if (saved_subs_map_.erase(topic_filter, client_id) != 0 && h_route_) {
+            h_route_(topic_filter, false);
+        }
+    }
+
+    static constexpr std::uint32_t session_never_expire = 0xFFFFFFFF; ///< Session Expiry Interval that means never expire
+
     struct tag_con {};
-    struct tag_topic {};
     struct tag_client_id {};
+    struct tag_topic_client_id {};
 
     /**
      * http://docs.oasis-open.org/mqtt/mqtt/v5.0/cs02/mqtt-v5.0-cs02.html#_Session_State
@@ -1042,11 +1877,14 @@ private:
 
         // TODO:
         // Messages sent to client, but not acknowledged.
-        // Messages pending transmission to client
         // messages received from client, but not acknowledged
-        MQTT_NS::optional<MQTT_NS::will> will;
+        offline_message_queue offline_messages; ///< Messages pending transmission to client
+        MQTT_NS::optional<MQTT_NS::will> will; ///< The will of the connection, or the will waiting for the delay if not active
         MQTT_NS::optional<boost::posix_time::time_duration> will_delay;
-        MQTT_NS::optional<boost::posix_time::time_duration> session_expiry_interval;
+        MQTT_NS::optional<boost::posix_time::time_duration> session_expiry_interval; ///< nullopt means never expire
+        timer_wheel::id_t will_timer = 0; ///< The timer of the Will Delay Interval. 0 if not waiting.
+        timer_wheel::id_t expiry_timer = 0; ///< The timer of the Session Expiry Interval. 0 if not waiting.
+        timer_wheel::id_t offline_message_timer = 0; ///< The timer to erase the expired offline messages. 0 if not waiting.
     };
 
     // The mi_active_sessions container holds the relevant data about an active connection with the broker.
@@ -1091,10 +1929,6 @@ private:
     using mi_sub_con = mi::multi_index_container<
         sub_con,
         mi::indexed_by<
-            mi::ordered_non_unique<
-                mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_MEMBER(sub_con, MQTT_NS::buffer, topic)
-            >,
             mi::ordered_non_unique<
                 mi::tag<tag_con>,
                 BOOST_MULTI_INDEX_MEMBER(sub_con, con_sp_t, con)
@@ -1121,39 +1955,20 @@ private:
             MQTT_NS::buffer contents,
             std::vector<MQTT_NS::v5::property_variant> props,
             MQTT_NS::qos qos_value)
-            :topic(std::move(topic)), contents(std::move(contents)), props(std::move(props)), qos_value(qos_value) {}
+            :topic(std::move(topic)), contents(std::move(contents)), props(std::move(props)), qos_value(qos_value),
+             expiry(message_expiry(this->props)) {}
+        bool expired(expiry_clock::time_point now) const {
+            return expiry && expiry.value() <= now;
+        }
         MQTT_NS::buffer topic;
         MQTT_NS::buffer contents;
         std::vector<MQTT_NS::v5::property_variant> props;
         MQTT_NS::qos qos_value;
-    };
-    using mi_retain = mi::multi_index_container<
-        retain,
-        mi::indexed_by<
-            mi::ordered_unique<
-                mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_MEMBER(retain, MQTT_NS::buffer, topic)
-            >
-        >
-    >;
-
-    // The saved_message structure holds messages that have been published on a
-    // topic that a not-currently-connected client is subscribed to.
-    // When a new connection is made with the client id for this saved data,
-    // these messages will be published to that client, and only that client.
-    struct saved_message {
-        saved_message(
-            MQTT_NS::buffer contents,
-            std::shared_ptr<std::vector<MQTT_NS::v5::property_variant>> props,
-            MQTT_NS::qos qos_value)
-            : contents(std::move(contents)), props(std::move(props)), qos_value(qos_value) {}
-        MQTT_NS::buffer contents;
-        std::shared_ptr<std::vector<MQTT_NS::v5::property_variant>> props;
-        MQTT_NS::qos qos_value;
+        MQTT_NS::optional<expiry_clock::time_point> expiry; ///< nullopt means never expire
     };
 
-    // Each instance of session_subscription describes a subscription that the associated client id has made
-    // and a collection of data associated with that subscription to be sent when the client reconnects.
+    // Each instance of session_subscription describes a subscription that the associated client id has made.
+    // The messages to be sent when the client reconnects are held by the offline_messages of the session_state.
     struct session_subscription {
         session_subscription(
             MQTT_NS::buffer client_id,
@@ -1162,7 +1977,6 @@ private:
             :client_id(std::move(client_id)), topic(std::move(topic)), qos_value(qos_value) {}
         MQTT_NS::buffer client_id;
         MQTT_NS::buffer topic;
-        std::vector<saved_message> messages;
         MQTT_NS::qos qos_value;
     };
 
@@ -1174,16 +1988,10 @@ private:
                 mi::tag<tag_client_id>,
                 BOOST_MULTI_INDEX_MEMBER(session_subscription, MQTT_NS::buffer, client_id)
             >,
-            // Allow multiple topics for the same client id
-            mi::ordered_non_unique<
-                mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_MEMBER(session_subscription, MQTT_NS::buffer, topic)
-            >,
             // Don't allow the same client id to have the same topic multiple times.
-            // Note that this index does not get used by any code in the broker
-            // other than to enforce the uniqueness constraints.
-            // Potentially this can be enabled only in debug builds.
+            // This index is used to find the subscription that is matched by saved_subs_map_.
             mi::ordered_unique<
+                mi::tag<tag_topic_client_id>,
                 mi::composite_key<
                     session_subscription,
                     BOOST_MULTI_INDEX_MEMBER(session_subscription, MQTT_NS::buffer, topic),
@@ -1193,15 +2001,49 @@ private:
         >
     >;
 
+public:
+    struct session_export {
+        MQTT_NS::optional<session_state> state; ///< The non active session and its saved messages
+        std::vector<session_subscription> subscriptions; ///< The saved subscriptions of the session
+    };
+
+private:
     as::io_context& ioc_; ///< The boost asio context to run this broker on.
     as::deadline_timer tim_disconnect_; ///< Used to delay disconnect handling for testing
     MQTT_NS::optional<boost::posix_time::time_duration> delay_disconnect_; ///< Used to delay disconnect handling for testing
+    timer_wheel timers_; ///< Session expiry, will delay, and message expiry of all the sessions.
+    as::steady_timer tim_timers_tick_; ///< Drives timers_ while it has timers.
+    bool ticking_ = false;
+    bool stopped_ = false;
 
     mi_active_sessions active_sessions_; ///< Map of active client id and connections
     mi_non_active_sessions non_active_sessions_; ///< Storage for sessions not currently active. Indexed by client id.
     mi_sub_con subs_; ///< Map of topic subscriptions to client ids
-    mi_session_subscription saved_subs_; ///< Topics and associated messages for clientids that are currently disconnected
-    mi_retain retains_; ///< A list of messages retained so they can be sent to newly subscribed clients.
+    mi_session_subscription saved_subs_; ///< Topics for clientids that are currently disconnected
+    multiple_subscription_map<con_sp_t, MQTT_NS::qos> subs_map_; ///< Topic filter trie of subs_. Used to find subscriptions that match a topic.
+    shared_subscription_map<con_sp_t, MQTT_NS::qos> shared_subs_; ///< Shared subscriptions of subs_. They are not in subs_map_.
+    multiple_subscription_map<MQTT_NS::buffer, MQTT_NS::buffer> saved_subs_map_; ///< Topic filter trie of saved_subs_. The value is the topic filter.
+    retained_topic_map<retain> retains_; ///< Topic name trie of messages retained so they can be sent to newly subscribed clients.
+    offline_message_queue::limits offline_message_limits_; ///< Limits of the offline_messages of each session_state.
+
+    // sharding members
+    std::function<
+        delivery_filter(
+            MQTT_NS::buffer const&,
+            MQTT_NS::buffer const&,
+            MQTT_NS::qos,
+            bool,
+            std::vector<MQTT_NS::v5::property_variant> const&,
+            MQTT_NS::buffer const&
+        )
+    > h_publish_forward_;
+    std::function<void(MQTT_NS::buffer const&, std::function<void(session_export)>)> h_session_fetch_;
+    std::function<void(MQTT_NS::buffer const&)> h_session_end_;
+    std::function<void(MQTT_NS::string_view, bool)> h_route_;
+    std::set<con_sp_t> connecting_; ///< Connections that are waiting for their sessions
+    std::map<MQTT_NS::buffer, std::vector<std::function<void(session_export)>>> fetching_; ///< Client ids whose sessions are being fetched, and the export requests for them
+    std::set<MQTT_NS::buffer> exporting_; ///< Client ids whose sessions are being exported
+    std::map<MQTT_NS::buffer, offline_message_queue> importing_; ///< Messages that are kept for the sessions being imported
 
     // MQTTv5 members
     std::vector<MQTT_NS::v5::property_variant> connack_props_;
@@ -0,0 +1,107 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_SERVER_ENDPOINT_HPP)
+#define MQTT_TEST_SERVER_ENDPOINT_HPP
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <mqtt/endpoint.hpp>
+#include <mqtt/tcp_endpoint.hpp>
+#include "test_settings.hpp"
+
+namespace as = boost::asio;
+
+/**
+ * @brief Server that accepts connections on broker_notls_port and passes a bare endpoint to the test.
+ *        Unlike test_server_no_tls, no broker is attached, so the test controls exactly what
+ *        the server sends by the handlers of the endpoint.
+ *        By default, the endpoint disconnects when DISCONNECT is received, and it is released when
+ *        the connection is closed. The accept handler can overwrite these handlers.
+ * @tparam Endpoint endpoint type that is constructed from the tcp socket
+ * @tparam Socket socket type that is constructed from the io_context. It should be tcp_endpoint or derived from it.
+ */
+template <
+    typename Endpoint = MQTT_NS::endpoint<std::mutex, std::lock_guard, 2>,
+    typename Socket = MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>
+>
+class test_server_endpoint {
+public:
+    using socket_t = Socket;
+    using endpoint_t = Endpoint;
+    // Called with each accepted endpoint before the session is started.
+    using accept_handler = std::function<void(endpoint_t& ep)>;
+
+    test_server_endpoint(as::io_context& ioc, accept_handler h)
+        : ioc_(ioc),
+          acceptor_(ioc, as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port)),
+          h_accept_(MQTT_NS::force_move(h)) {
+        do_accept();
+    }
+
+    /**
+     * @brief Get the endpoint of the last accepted connection
+     * @return endpoint. nullptr if it is closed.
+     */
+    std::shared_ptr<endpoint_t> const& endpoint() const {
+        return ep_;
+    }
+
+    /**
+     * @brief Stop accepting connections
+     */
+    void close() {
+        acceptor_.close();
+    }
+
+private:
+    void do_accept() {
+        auto socket = std::make_shared<socket_t>(ioc_);
+        acceptor_.async_accept(
+            socket->lowest_layer(),
+            [this, socket](boost::system::error_code const& ec) {
+                if (ec) return;
+                ep_ = std::make_shared<endpoint_t>(socket);
+                // The previous connection might be closed after the next one is accepted.
+                auto ep = ep_.get();
+                ep->set_disconnect_handler(
+                    [ep] {
+                        ep->force_disconnect();
+                    }
+                );
+                ep->set_v5_disconnect_handler(
+                    [ep]
+                    (MQTT_NS::v5::disconnect_reason_code /*reason_code*/,
+                     std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                        ep->force_disconnect();
+                    }
+                );
+                ep->set_close_handler(
+                    [this, ep] {
+                        if (ep_.get() == ep) ep_.reset();
+                    }
+                );
+                ep->set_error_handler(
+                    [this, ep](boost::system::error_code const&) {
+                        if (ep_.get() == ep) ep_.reset();
+                    }
+                );
+                h_accept_(*ep);
+                ep->start_session();
+                do_accept();
+            }
+        );
+    }
+
+    as::io_context& ioc_;
+    as::ip::tcp::acceptor acceptor_;
+    accept_handler h_accept_;
+    std::shared_ptr<endpoint_t> ep_;
+};
+
+#endif // MQTT_TEST_SERVER_ENDPOINT_HPP
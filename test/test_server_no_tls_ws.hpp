@@ -48,6 +48,7 @@ public:
 
     void close() {
         server_.close();
+        b_.stop();
     }
 
 private:
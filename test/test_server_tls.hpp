@@ -57,6 +57,7 @@ public:
 
     void close() {
         server_.close();
+        b_.stop();
     }
 
 private:
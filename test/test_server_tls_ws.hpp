@@ -58,6 +58,7 @@ public:
 
     void close() {
         server_.close();
+        b_.stop();
     }
 
 private:
@@ -0,0 +1,126 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "timer_wheel.hpp"
+
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(test_timer_wheel)
+
+using clock_t_ = timer_wheel::clock;
+using ms = std::chrono::milliseconds;
+
+BOOST_AUTO_TEST_CASE( fire ) {
+    auto origin = clock_t_::now();
+    timer_wheel w(ms(10), origin);
+    std::vector<int> fired;
+    w.add(origin + ms(25), [&] { fired.push_back(2); });
+    w.add(origin + ms(10), [&] { fired.push_back(1); });
+    w.add(origin - ms(10), [&] { fired.push_back(0); });
+    BOOST_TEST(w.size() == 3U);
+
+    BOOST_TEST(w.advance(origin + ms(9)) == 0U);
+    // The timers of the same tick fire in the added order.
+    BOOST_TEST(w.advance(origin + ms(10)) == 2U);
+    BOOST_TEST((fired == std::vector<int>{ 1, 0 }));
+    // 25ms is rounded up to 30ms
+    BOOST_TEST(w.advance(origin + ms(29)) == 0U);
+    BOOST_TEST(w.advance(origin + ms(30)) == 1U);
+    BOOST_TEST((fired == std::vector<int>{ 1, 0, 2 }));
+    BOOST_TEST(w.empty());
+}
+
+BOOST_AUTO_TEST_CASE( cancel ) {
+    auto origin = clock_t_::now();
+    timer_wheel w(ms(1), origin);
+    int fired = 0;
+    auto id1 = w.add(origin + ms(5), [&] { ++fired; });
+    auto id2 = w.add(origin + ms(1000), [&] { ++fired; });
+    w.add(origin + ms(5), [&] { ++fired; });
+    BOOST_TEST(id1 != 0U);
+    BOOST_TEST(w.cancel(id1));
+    BOOST_TEST(!w.cancel(id1));
+    BOOST_TEST(w.cancel(id2));
+    BOOST_TEST(w.size() == 1U);
+    BOOST_TEST(w.advance(origin + ms(2000)) == 1U);
+    BOOST_TEST(fired == 1);
+}
+
+BOOST_AUTO_TEST_CASE( upper_levels ) {
+    // Each timer fires exactly at its tick even if it is moved from the upper levels.
+    auto origin = clock_t_::now();
+    timer_wheel w(ms(1), origin);
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> dist(1, 200000);
+    std::vector<int> expiries { 1, 255, 256, 257, 511, 512, 65535, 65536, 65537, 131072 };
+    for (int i = 0; i != 1000; ++i) expiries.push_back(dist(gen));
+
+    std::size_t count = 0;
+    int now = 0;
+    for (auto e : expiries) {
+        w.add(
+            origin + ms(e),
+            [&, e] {
+                BOOST_TEST(now == e);
+                ++count;
+            }
+        );
+    }
+    for (now = 1; now <= 200000; ++now) {
+        w.advance(origin + ms(now));
+    }
+    BOOST_TEST(count == expiries.size());
+    BOOST_TEST(w.empty());
+}
+
+BOOST_AUTO_TEST_CASE( idle ) {
+    auto origin = clock_t_::now();
+    timer_wheel w(ms(1), origin);
+    // Idle ticks are skipped.
+    BOOST_TEST(w.advance(origin + std::chrono::hours(24 * 365)) == 0U);
+
+    int fired = 0;
+    auto now = origin + std::chrono::hours(24 * 365);
+    w.add(now + ms(300), [&] { ++fired; });
+    BOOST_TEST(w.advance(now + ms(299)) == 0U);
+    BOOST_TEST(w.advance(now + ms(300)) == 1U);
+    BOOST_TEST(fired == 1);
+}
+
+BOOST_AUTO_TEST_CASE( idle_add ) {
+    auto origin = clock_t_::now();
+    timer_wheel w(ms(1), origin);
+    int fired = 0;
+    // The idle ticks are skipped by add() without advance().
+    auto now = origin + std::chrono::hours(24 * 365);
+    w.add(now + ms(300), [&] { ++fired; }, now);
+    BOOST_TEST(w.advance(now + ms(299)) == 0U);
+    BOOST_TEST(w.advance(now + ms(300)) == 1U);
+    BOOST_TEST(fired == 1);
+}
+
+BOOST_AUTO_TEST_CASE( add_in_callback ) {
+    auto origin = clock_t_::now();
+    timer_wheel w(ms(1), origin);
+    std::vector<int> fired;
+    timer_wheel::id_t id3 = 0;
+    w.add(
+        origin + ms(1),
+        [&] {
+            fired.push_back(1);
+            // expired timer fires at the next tick
+            w.add(origin, [&] { fired.push_back(2); });
+            w.cancel(id3);
+        }
+    );
+    id3 = w.add(origin + ms(1), [&] { fired.push_back(3); });
+    BOOST_TEST(w.advance(origin + ms(1)) == 1U);
+    BOOST_TEST(w.advance(origin + ms(2)) == 1U);
+    BOOST_TEST((fired == std::vector<int>{ 1, 2 }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
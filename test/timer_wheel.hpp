@@ -0,0 +1,225 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_TIMER_WHEEL_HPP)
+#define MQTT_TEST_TIMER_WHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+#include <mqtt/move.hpp>
+
+/**
+ * @brief Hierarchical timer wheel.
+ *
+ * Timers are kept in levels of 256 slots. A slot of the level 0 is one tick,
+ * and a slot of the level n is 256^n ticks. When the level 0 goes around,
+ * the timers of the next slot of the upper level are moved to the lower levels.
+ * So add(), cancel(), and each tick of advance() are O(1) regardless of
+ * the number of timers, and one periodic timer can drive all of them.
+ *
+ * Timers never fire before their expiry. They fire at the first advance()
+ * after the expiry rounded up to the tick.
+ * cancel() only forgets the timer. The id left in the slot is skipped when
+ * the slot is processed.
+ */
+class timer_wheel {
+public:
+    using clock = std::chrono::steady_clock;
+    using id_t = std::uint64_t;
+
+    /**
+     * @brief Constructor
+     * @param tick resolution of the timers
+     * @param now current time
+     */
+    explicit timer_wheel(clock::duration tick, clock::time_point now = clock::now())
+        :tick_(tick), origin_(now) {
+        BOOST_ASSERT(tick_.count() > 0);
+    }
+
+    /**
+     * @brief Add a timer.
+     * @param expiry time to call f
+     * @param f function that is called by advance()
+     * @param now current time
+     * @return id of the timer. It is never 0, so 0 can be used as no timer.
+     */
+    id_t add(clock::time_point expiry, std::function<void()> f, clock::time_point now = clock::now()) {
+        if (timers_.empty()) {
+            // Skip the idle ticks here. Otherwise the next advance() walks all of them.
+            skip_idle(now);
+        }
+        auto id = ++last_id_;
+        std::uint64_t expiry_tick = 0;
+        if (expiry > origin_) {
+            // round up in order not to fire early
+            expiry_tick = static_cast<std::uint64_t>((expiry - origin_ + tick_ - clock::duration(1)) / tick_);
+        }
+        timers_.emplace(id, timer { expiry_tick, MQTT_NS::force_move(f) });
+        // The slot of the current tick has been processed.
+        place(id, expiry_tick, current_tick_ + 1);
+        return id;
+    }
+
+    /**
+     * @brief Add a timer that expires after duration.
+     * @param duration duration from now
+     * @param f function that is called by advance()
+     * @return id of the timer
+     */
+    id_t add_after(clock::duration duration, std::function<void()> f) {
+        auto now = clock::now();
+        return add(now + duration, MQTT_NS::force_move(f), now);
+    }
+
+    /**
+     * @brief Cancel the timer.
+     * @param id id of the timer
+     * @return true if cancelled, false if the timer has already fired or been cancelled
+     */
+    bool cancel(id_t id) {
+        return timers_.erase(id) != 0;
+    }
+
+    /**
+     * @brief Call the functions of the timers that expire until now.
+     *        The functions can add and cancel timers.
+     * @param now current time
+     * @return number of the called functions
+     */
+    std::size_t advance(clock::time_point now = clock::now()) {
+        if (now < origin_) return 0;
+        if (timers_.empty()) {
+            // Nothing to cascade. Skip the idle ticks.
+            skip_idle(now);
+            return 0;
+        }
+        auto now_tick = static_cast<std::uint64_t>((now - origin_) / tick_);
+        std::size_t fired = 0;
+        while (current_tick_ < now_tick) {
+            ++current_tick_;
+            // Move the timers of the upper levels down when the lower level goes around.
+            for (std::size_t level = 1; level != levels; ++level) {
+                if ((current_tick_ & ((std::uint64_t(1) << (bits * level)) - 1)) != 0) break;
+                auto ids = MQTT_NS::force_move(slot(level, current_tick_));
+                slot(level, current_tick_).clear();
+                for (auto id : ids) {
+                    auto it = timers_.find(id);
+                    if (it == timers_.end()) continue;
+                    // The level 0 slot of the current tick is processed below.
+                    place(id, it->second.expiry_tick, current_tick_);
+                }
+            }
+            auto ids = MQTT_NS::force_move(slot(0, current_tick_));
+            slot(0, current_tick_).clear();
+            for (auto id : ids) {
+                auto it = timers_.find(id);
+                if (it == timers_.end()) continue;
+                if (it->second.expiry_tick > current_tick_) {
+                    // It was beyond the top level.
+                    place(id, it->second.expiry_tick, current_tick_ + 1);
+                    continue;
+                }
+                auto f = MQTT_NS::force_move(it->second.f);
+                timers_.erase(it);
+                f();
+                ++fired;
+            }
+            if (timers_.empty()) {
+                skip_idle(now);
+                break;
+            }
+        }
+        return fired;
+    }
+
+    /**
+     * @brief Get the resolution of the timers
+     */
+    clock::duration tick() const {
+        return tick_;
+    }
+
+    /**
+     * @brief Get the number of the timers that are not fired or cancelled
+     */
+    std::size_t size() const {
+        return timers_.size();
+    }
+
+    bool empty() const {
+        return timers_.empty();
+    }
+
+private:
+    static constexpr std::size_t bits = 8;
+    static constexpr std::size_t slots = std::size_t(1) << bits;
+    static constexpr std::size_t levels = 4;
+
+    struct timer {
+        std::uint64_t expiry_tick;
+        std::function<void()> f;
+    };
+
+    std::vector<id_t>& slot(std::size_t level, std::uint64_t tick) {
+        return wheel_[level][(tick >> (bits * level)) & (slots - 1)];
+    }
+
+    /**
+     * @brief Put the id into the slot of the level that the expiry falls in.
+     *        The timer that expires beyond the top level is put into the farthest slot.
+     * @param min_tick the earliest tick whose slot is not processed yet
+     */
+    void place(id_t id, std::uint64_t expiry_tick, std::uint64_t min_tick) {
+        if (expiry_tick < min_tick) expiry_tick = min_tick;
+        auto delta = expiry_tick - current_tick_;
+        auto max_delta = (std::uint64_t(1) << (bits * levels)) - 1;
+        if (delta > max_delta) expiry_tick = current_tick_ + max_delta;
+        for (std::size_t level = 0; level != levels; ++level) {
+            if (delta < (std::uint64_t(1) << (bits * (level + 1))) || level + 1 == levels) {
+                slot(level, expiry_tick).push_back(id);
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Move the current tick to now while no timer is active.
+     *        The slots only have the ids of the cancelled timers, so they are cleared.
+     */
+    void skip_idle(clock::time_point now) {
+        BOOST_ASSERT(timers_.empty());
+        if (now > origin_) {
+            auto now_tick = static_cast<std::uint64_t>((now - origin_) / tick_);
+            if (now_tick > current_tick_) current_tick_ = now_tick;
+        }
+        clear_slots();
+    }
+
+    void clear_slots() {
+        for (auto& level : wheel_) {
+            for (auto& s : level) {
+                if (!s.empty()) std::vector<id_t>().swap(s);
+            }
+        }
+    }
+
+    clock::duration tick_;
+    clock::time_point origin_;
+    std::uint64_t current_tick_ = 0;
+    id_t last_id_ = 0;
+    std::unordered_map<id_t, timer> timers_;
+    std::array<std::array<std::vector<id_t>, slots>, levels> wheel_;
+};
+
+#endif // MQTT_TEST_TIMER_WHEEL_HPP
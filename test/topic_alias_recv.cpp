@@ -0,0 +1,412 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_server_endpoint.hpp"
+#include "checker.hpp"
+
+#include <mqtt_client_cpp.hpp>
+#include <mqtt/topic_alias_recv.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_topic_alias_recv)
+
+namespace as = boost::asio;
+
+using server_t = test_server_endpoint<>;
+using endpoint_t = server_t::endpoint_t;
+
+BOOST_AUTO_TEST_CASE( insert_find ) {
+    MQTT_NS::topic_alias_recv tar(2);
+    BOOST_TEST(tar.max() == 2U);
+    BOOST_TEST(!tar.find(1));
+
+    BOOST_TEST(tar.insert_or_update(1, MQTT_NS::allocate_buffer("topic1")));
+    BOOST_TEST(tar.insert_or_update(2, MQTT_NS::allocate_buffer("topic2")));
+    BOOST_TEST(tar.find(1).value() == "topic1");
+    BOOST_TEST(tar.find(2).value() == "topic2");
+
+    BOOST_TEST(tar.insert_or_update(1, MQTT_NS::allocate_buffer("topic3")));
+    BOOST_TEST(tar.find(1).value() == "topic3");
+
+    // out of range
+    BOOST_TEST(!tar.insert_or_update(0, MQTT_NS::allocate_buffer("topic4")));
+    BOOST_TEST(!tar.insert_or_update(3, MQTT_NS::allocate_buffer("topic4")));
+    BOOST_TEST(!tar.find(0));
+    BOOST_TEST(!tar.find(3));
+}
+
+BOOST_AUTO_TEST_CASE( shared_topic ) {
+    MQTT_NS::topic_alias_recv tar(1);
+    auto topic = MQTT_NS::allocate_buffer("topic1");
+    tar.insert_or_update(1, topic);
+    // The topic name is not copied.
+    BOOST_TEST(tar.find(1).value().data() == topic.data());
+}
+
+BOOST_AUTO_TEST_CASE( reset ) {
+    MQTT_NS::topic_alias_recv tar(1);
+    tar.insert_or_update(1, MQTT_NS::allocate_buffer("topic1"));
+    tar.reset(2);
+    BOOST_TEST(tar.max() == 2U);
+    BOOST_TEST(!tar.find(1));
+    tar.reset(0);
+    BOOST_TEST(!tar.insert_or_update(1, MQTT_NS::allocate_buffer("topic1")));
+}
+
+// Both the client and the server send topic_alias_maximum and publish with auto topic alias.
+// Each receiver gets the resolved topic names.
+BOOST_AUTO_TEST_CASE( endpoint_pubsub ) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_auto_topic_alias_send();
+
+    checker chk = {
+        cont("s_connect"),
+        cont("h_connack"),
+        cont("s_publish_1"),
+        cont("s_publish_2"),
+        cont("s_publish_3"),
+        cont("h_puback"),
+        cont("h_publish_1"),
+        cont("h_publish_2"),
+        cont("s_disconnect"),
+        cont("h_close"),
+    };
+
+    auto get_alias =
+        [](std::vector<MQTT_NS::v5::property_variant> const& props) {
+            std::uint16_t alias = 0;
+            for (auto const& p : props) {
+                MQTT_NS::visit(
+                    MQTT_NS::make_lambda_visitor<void>(
+                        [&](MQTT_NS::v5::property::topic_alias const& t) {
+                            alias = t.val();
+                        },
+                        [](auto const&) {}
+                    ),
+                    p
+                );
+            }
+            return alias;
+        };
+
+    std::size_t s_published = 0;
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_auto_topic_alias_send();
+            ep.set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    MQTT_CHK("s_connect");
+                    ep.connack(
+                        false,
+                        MQTT_NS::v5::connect_reason_code::success,
+                        std::vector<MQTT_NS::v5::property_variant> {
+                            MQTT_NS::v5::property::topic_alias_maximum(1)
+                        }
+                    );
+                    return true;
+                }
+            );
+            ep.set_v5_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer /*contents*/,
+                 std::vector<MQTT_NS::v5::property_variant> props) {
+                    ++s_published;
+                    MQTT_CHK("s_publish_" + std::to_string(s_published));
+                    BOOST_TEST(topic == "topic1");
+                    BOOST_TEST(get_alias(props) == 1U);
+                    return true;
+                }
+            );
+            ep.set_v5_disconnect_handler(
+                [&]
+                (MQTT_NS::v5::disconnect_reason_code /*reason_code*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    MQTT_CHK("s_disconnect");
+                    ep.force_disconnect();
+                }
+            );
+        }
+    );
+
+    std::size_t c_published = 0;
+    c->set_v5_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_connack");
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            c->publish("topic1", "contents", MQTT_NS::qos::at_most_once);
+            c->publish("topic1", "contents", MQTT_NS::qos::at_most_once);
+            c->publish("topic1", "contents", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c->set_v5_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::puback_reason_code /*reason_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_puback");
+            s.endpoint()->publish("topic2", "contents", MQTT_NS::qos::at_most_once);
+            s.endpoint()->publish("topic2", "contents", MQTT_NS::qos::at_most_once);
+            return true;
+        });
+    c->set_v5_publish_handler(
+        [&]
+        (std::uint8_t /*header*/,
+         MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+         MQTT_NS::buffer topic,
+         MQTT_NS::buffer /*contents*/,
+         std::vector<MQTT_NS::v5::property_variant> props) {
+            ++c_published;
+            MQTT_CHK("h_publish_" + std::to_string(c_published));
+            BOOST_TEST(topic == "topic2");
+            BOOST_TEST(get_alias(props) == 1U);
+            if (c_published == 2) c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close");
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c->connect(
+        std::vector<MQTT_NS::v5::property_variant> {
+            MQTT_NS::v5::property::topic_alias_maximum(1)
+        }
+    );
+    ioc.run();
+    BOOST_TEST(chk.all());
+}
+
+// The client maps the topic aliases explicitly.
+// The publish message with the topic name and the mapped alias remaps it.
+// The server gets the resolved topic names for the empty ones.
+BOOST_AUTO_TEST_CASE( endpoint_remap ) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+
+    checker chk = {
+        cont("s_connect"),
+        cont("h_connack"),
+        cont("s_publish_1"),
+        cont("s_publish_2"),
+        cont("s_publish_3"),
+        cont("s_publish_4"),
+        cont("s_publish_5"),
+        cont("h_puback"),
+        cont("s_disconnect"),
+        cont("h_close"),
+    };
+
+    // topic name on the wire, alias, and the resolved topic name
+    struct publish_entry {
+        std::string wire_topic;
+        std::uint16_t alias;
+        std::string topic;
+    };
+    std::vector<publish_entry> const entries {
+        { "topic1", 1, "topic1" },
+        { "",       1, "topic1" },
+        { "topic2", 2, "topic2" },
+        // remap
+        { "topic3", 1, "topic3" },
+        { "",       1, "topic3" },
+    };
+
+    std::size_t s_published = 0;
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    MQTT_CHK("s_connect");
+                    ep.connack(
+                        false,
+                        MQTT_NS::v5::connect_reason_code::success,
+                        std::vector<MQTT_NS::v5::property_variant> {
+                            MQTT_NS::v5::property::topic_alias_maximum(2)
+                        }
+                    );
+                    return true;
+                }
+            );
+            ep.set_v5_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    BOOST_TEST(s_published < entries.size());
+                    ++s_published;
+                    MQTT_CHK("s_publish_" + std::to_string(s_published));
+                    BOOST_TEST(topic == entries[s_published - 1].topic);
+                    BOOST_TEST(contents == std::to_string(s_published));
+                    return true;
+                }
+            );
+            ep.set_v5_disconnect_handler(
+                [&]
+                (MQTT_NS::v5::disconnect_reason_code /*reason_code*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    MQTT_CHK("s_disconnect");
+                    ep.force_disconnect();
+                }
+            );
+        }
+    );
+
+    c->set_v5_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_connack");
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            for (std::size_t i = 0; i != entries.size(); ++i) {
+                c->publish(
+                    entries[i].wire_topic,
+                    std::to_string(i + 1),
+                    i + 1 == entries.size() ? MQTT_NS::qos::at_least_once : MQTT_NS::qos::at_most_once,
+                    false,
+                    std::vector<MQTT_NS::v5::property_variant> {
+                        MQTT_NS::v5::property::topic_alias(entries[i].alias)
+                    }
+                );
+            }
+            return true;
+        });
+    c->set_v5_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::puback_reason_code /*reason_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_puback");
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close");
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+}
+
+// The empty topic name with the topic alias that is not mapped is a protocol error.
+BOOST_AUTO_TEST_CASE( endpoint_unknown_alias ) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+
+    checker chk = {
+        cont("s_connect"),
+        cont("h_connack"),
+        cont("s_error"),
+    };
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    MQTT_CHK("s_connect");
+                    ep.connack(
+                        false,
+                        MQTT_NS::v5::connect_reason_code::success,
+                        std::vector<MQTT_NS::v5::property_variant> {
+                            MQTT_NS::v5::property::topic_alias_maximum(1)
+                        }
+                    );
+                    return true;
+                }
+            );
+            ep.set_v5_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer /*topic*/,
+                 MQTT_NS::buffer /*contents*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    BOOST_CHECK(false);
+                    return true;
+                }
+            );
+            ep.set_error_handler(
+                [&](boost::system::error_code const& ec) {
+                    MQTT_CHK("s_error");
+                    BOOST_TEST(ec == boost::system::errc::protocol_error);
+                    ep.force_disconnect();
+                    s.close();
+                }
+            );
+        }
+    );
+
+    c->set_v5_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::v5::connect_reason_code /*connack_return_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_connack");
+            c->publish(
+                "",
+                "contents",
+                MQTT_NS::qos::at_most_once,
+                false,
+                std::vector<MQTT_NS::v5::property_variant> {
+                    MQTT_NS::v5::property::topic_alias(1)
+                }
+            );
+            return true;
+        });
+    c->set_close_handler([] {});
+    c->set_error_handler([](boost::system::error_code const&) {});
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,345 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "checker.hpp"
+
+#include <mqtt_client_cpp.hpp>
+#include <mqtt/topic_alias_send.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_topic_alias_send)
+
+namespace as = boost::asio;
+
+BOOST_AUTO_TEST_CASE( assign ) {
+    MQTT_NS::topic_alias_send tas(2);
+    BOOST_TEST(tas.max() == 2U);
+
+    auto a1 = tas.find_or_assign("topic1");
+    BOOST_TEST(a1.has_value());
+    BOOST_TEST(a1.value().first == 1U);
+    BOOST_TEST(a1.value().second);
+
+    auto a2 = tas.find_or_assign("topic2");
+    BOOST_TEST(a2.has_value());
+    BOOST_TEST(a2.value().first == 2U);
+    BOOST_TEST(a2.value().second);
+
+    auto a3 = tas.find_or_assign("topic1");
+    BOOST_TEST(a3.has_value());
+    BOOST_TEST(a3.value().first == 1U);
+    BOOST_TEST(!a3.value().second);
+    BOOST_TEST(tas.size() == 2U);
+}
+
+BOOST_AUTO_TEST_CASE( lru ) {
+    MQTT_NS::topic_alias_send tas(2);
+    tas.find_or_assign("topic1");
+    tas.find_or_assign("topic2");
+    // topic2 becomes the least recently used one
+    tas.find_or_assign("topic1");
+
+    auto a3 = tas.find_or_assign("topic3");
+    BOOST_TEST(a3.has_value());
+    BOOST_TEST(a3.value().first == 2U);
+    BOOST_TEST(a3.value().second);
+    BOOST_TEST(tas.size() == 2U);
+
+    auto a1 = tas.find_or_assign("topic1");
+    BOOST_TEST(a1.value().first == 1U);
+    BOOST_TEST(!a1.value().second);
+
+    // topic2 has been evicted, so the alias of topic3 is reassigned to it
+    auto a2 = tas.find_or_assign("topic2");
+    BOOST_TEST(a2.value().first == 2U);
+    BOOST_TEST(a2.value().second);
+}
+
+BOOST_AUTO_TEST_CASE( no_alias ) {
+    MQTT_NS::topic_alias_send tas;
+    BOOST_TEST(!tas.find_or_assign("topic1"));
+
+    tas.reset(1);
+    BOOST_TEST(!tas.find_or_assign(""));
+    BOOST_TEST(tas.find_or_assign("topic1").has_value());
+    BOOST_TEST(tas.size() == 1U);
+
+    tas.reset(0);
+    BOOST_TEST(tas.size() == 0U);
+    BOOST_TEST(!tas.find_or_assign("topic1"));
+}
+
+BOOST_AUTO_TEST_CASE( endpoint_publish ) {
+    as::io_context ioc;
+    as::ip::tcp::acceptor acceptor(ioc, as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port));
+    acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+    auto socket = std::make_shared<MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>>(ioc);
+    std::shared_ptr<MQTT_NS::endpoint<std::mutex, std::lock_guard, 2>> s;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_auto_topic_alias_send();
+
+    checker chk = {
+        cont("s_connect"),
+        cont("h_connack"),
+        cont("s_publish_1"),
+        cont("s_publish_2"),
+        cont("s_publish_3"),
+        cont("s_publish_4"),
+        cont("s_publish_5"),
+        cont("s_publish_6"),
+        cont("h_puback"),
+        cont("s_disconnect"),
+        cont("h_close"),
+    };
+
+    struct expected_publish {
+        std::string chk;
+        std::string topic;
+        std::string wire_topic;
+        std::uint16_t alias;
+    };
+    // The server resolves the topic aliases, so the topic names passed to the handler are always set.
+    // The topic names on the wire are empty if the aliases are already mapped.
+    std::vector<expected_publish> const expected {
+        { "s_publish_1", "topic1", "topic1", 1 },
+        { "s_publish_2", "topic2", "topic2", 2 },
+        { "s_publish_3", "topic1", "",       1 },
+        // topic2 is the least recently used one
+        { "s_publish_4", "topic3", "topic3", 2 },
+        { "s_publish_5", "topic1", "",       1 },
+        { "s_publish_6", "topic3", "",       2 },
+    };
+    std::size_t published = 0;
+    // Remaining Lengths of the received publish packets
+    std::vector<std::size_t> wire_lengths;
+
+    acceptor.async_accept(
+        socket->lowest_layer(),
+        [&](boost::system::error_code const& ec) {
+            BOOST_TEST(!ec);
+            s = std::make_shared<MQTT_NS::endpoint<std::mutex, std::lock_guard, 2>>(socket);
+            s->set_is_valid_length_handler(
+                [&](MQTT_NS::control_packet_type cpt, std::size_t remaining_length) {
+                    if (cpt == MQTT_NS::control_packet_type::publish) {
+                        wire_lengths.push_back(remaining_length);
+                    }
+                    return true;
+                }
+            );
+            s->set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    MQTT_CHK("s_connect");
+                    s->connack(
+                        false,
+                        MQTT_NS::v5::connect_reason_code::success,
+                        std::vector<MQTT_NS::v5::property_variant> {
+                            MQTT_NS::v5::property::topic_alias_maximum(2)
+                        }
+                    );
+                    return true;
+                }
+            );
+            s->set_v5_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> packet_id,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents,
+                 std::vector<MQTT_NS::v5::property_variant> props) {
+                    std::uint16_t alias = 0;
+                    for (auto const& p : props) {
+                        MQTT_NS::visit(
+                            MQTT_NS::make_lambda_visitor<void>(
+                                [&](MQTT_NS::v5::property::topic_alias const& t) {
+                                    alias = t.val();
+                                },
+                                [](auto const&) {}
+                            ),
+                            p
+                        );
+                    }
+                    BOOST_TEST(published < expected.size());
+                    MQTT_CHK(std::string(expected[published].chk));
+                    BOOST_TEST(topic == expected[published].topic);
+                    BOOST_TEST(alias == expected[published].alias);
+                    // topic name length, topic name, packet id, property length, topic alias, and payload
+                    std::size_t const wire_length =
+                        2 + expected[published].wire_topic.size() +
+                        (packet_id ? 2 : 0) +
+                        1 + 3 +
+                        contents.size();
+                    BOOST_TEST(wire_lengths.size() == published + 1);
+                    BOOST_TEST(wire_lengths.back() == wire_length);
+                    ++published;
+                    return true;
+                }
+            );
+            s->set_v5_disconnect_handler(
+                [&]
+                (MQTT_NS::v5::disconnect_reason_code /*reason_code*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    MQTT_CHK("s_disconnect");
+                    s->force_disconnect();
+                }
+            );
+            s->set_close_handler([&] { s.reset(); });
+            s->set_error_handler([&](boost::system::error_code const&) { s.reset(); });
+            s->start_session();
+        }
+    );
+
+    c->set_v5_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_connack");
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            c->publish("topic1", "contents", MQTT_NS::qos::at_most_once);
+            c->publish("topic2", "contents", MQTT_NS::qos::at_most_once);
+            c->publish("topic1", "contents", MQTT_NS::qos::at_most_once);
+            c->publish("topic3", "contents", MQTT_NS::qos::at_most_once);
+            c->publish("topic1", "contents", MQTT_NS::qos::at_most_once);
+            c->publish("topic3", "contents", MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c->set_v5_puback_handler(
+        [&]
+        (std::uint16_t /*packet_id*/, MQTT_NS::v5::puback_reason_code /*reason_code*/, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            MQTT_CHK("h_puback");
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close");
+            acceptor.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+}
+
+// The handler that is called while writing a publish message publishes another one.
+// The messages are written in the order that the aliases are assigned.
+BOOST_AUTO_TEST_CASE( publish_in_handler ) {
+    as::io_context ioc;
+    as::ip::tcp::acceptor acceptor(ioc, as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port));
+    acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+    auto socket = std::make_shared<MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>>(ioc);
+    std::shared_ptr<MQTT_NS::endpoint<std::mutex, std::lock_guard, 2>> s;
+
+    auto c = MQTT_NS::make_client(ioc, broker_url, broker_notls_port, MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_auto_topic_alias_send();
+
+    std::vector<std::pair<std::string, std::string>> received;
+    bool nested = false;
+
+    acceptor.async_accept(
+        socket->lowest_layer(),
+        [&](boost::system::error_code const& ec) {
+            BOOST_TEST(!ec);
+            s = std::make_shared<MQTT_NS::endpoint<std::mutex, std::lock_guard, 2>>(socket);
+            s->set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_start*/,
+                 std::uint16_t /*keep_alive*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    s->connack(
+                        false,
+                        MQTT_NS::v5::connect_reason_code::success,
+                        std::vector<MQTT_NS::v5::property_variant> {
+                            MQTT_NS::v5::property::topic_alias_maximum(1)
+                        }
+                    );
+                    return true;
+                }
+            );
+            s->set_v5_publish_handler(
+                [&]
+                (std::uint8_t /*header*/,
+                 MQTT_NS::optional<std::uint16_t> /*packet_id*/,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    received.emplace_back(std::string(topic), std::string(contents));
+                    return true;
+                }
+            );
+            s->set_v5_disconnect_handler(
+                [&]
+                (MQTT_NS::v5::disconnect_reason_code /*reason_code*/,
+                 std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+                    s->force_disconnect();
+                }
+            );
+            s->set_close_handler([&] { s.reset(); });
+            s->set_error_handler([&](boost::system::error_code const&) { s.reset(); });
+            s->start_session();
+        }
+    );
+
+    c->set_v5_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::v5::connect_reason_code connack_return_code, std::vector<MQTT_NS::v5::property_variant> /*props*/) {
+            BOOST_TEST(connack_return_code == MQTT_NS::v5::connect_reason_code::success);
+            // The client sets its own handler when it connects.
+            nested = true;
+            c->set_pre_send_handler(
+                [&] {
+                    if (!nested) return;
+                    nested = false;
+                    // The alias 1 is reassigned to topic2 after it is assigned to topic1.
+                    c->publish("topic2", "nested", MQTT_NS::qos::at_most_once);
+                });
+            c->publish("topic1", "outer", MQTT_NS::qos::at_most_once);
+            // Sent with the alias 1 only.
+            c->publish("topic2", "after", MQTT_NS::qos::at_most_once);
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            acceptor.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c->connect();
+    ioc.run();
+    BOOST_TEST(
+        (received ==
+         std::vector<std::pair<std::string, std::string>> {
+             { "topic1", "outer" },
+             { "topic2", "nested" },
+             { "topic2", "after" },
+         })
+    );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
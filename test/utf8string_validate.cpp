@@ -436,6 +436,59 @@ BOOST_AUTO_TEST_CASE( combination ) {
 #endif // MQTT_USE_STR_CHECK
 }
 
+// Strings longer than one SIMD block with a special character at every position.
+BOOST_AUTO_TEST_CASE( long_string ) {
+#if defined(MQTT_USE_STR_CHECK)
+    using namespace MQTT_NS::utf8string;
+    std::string const ascii(100, 'a');
+    BOOST_TEST(validate_contents(ascii) == validation::well_formed);
+
+    struct {
+        std::string chars;
+        validation expected;
+    } const cases[] = {
+        { std::string(1, '\x00'), validation::ill_formed },
+        { "\x01", validation::well_formed_with_non_charactor },
+        { "\x1f", validation::well_formed_with_non_charactor },
+        { "\x7f", validation::well_formed_with_non_charactor },
+        { " ", validation::well_formed },
+        { "~", validation::well_formed },
+        { "\xc2\x80", validation::well_formed_with_non_charactor },
+        { "\xc2\xa0", validation::well_formed },
+        { "\xc0\xaf", validation::ill_formed },
+        { "\xe3\x81\x82", validation::well_formed },
+        { "\xef\xbf\xbf", validation::well_formed_with_non_charactor },
+        { "\xed\xa0\x80", validation::ill_formed },
+        { "\xf0\x9f\x98\x80", validation::well_formed },
+        { "\xf4\x8f\xbf\xbe", validation::well_formed_with_non_charactor },
+        { "\xf4\x90\x80\x80", validation::ill_formed },
+        { "\x80", validation::ill_formed },
+        { "\xe3\x81", validation::ill_formed },
+    };
+    for (auto const& c : cases) {
+        for (std::size_t pos = 0; pos <= ascii.size(); ++pos) {
+            auto l = ascii;
+            l.insert(pos, c.chars);
+            BOOST_TEST(validate_contents(l) == c.expected);
+            BOOST_TEST(detail::validate_contents_scalar(l) == c.expected);
+        }
+    }
+
+    // Non ASCII characters across the blocks.
+    std::string mixed;
+    for (std::size_t i = 0; i != 40; ++i) {
+        mixed += "\xe3\x81\x82";
+        mixed += std::string(i, 'a');
+    }
+    BOOST_TEST(validate_contents(mixed) == validation::well_formed);
+    for (std::size_t i = 0; i != mixed.size(); ++i) {
+        auto l = mixed;
+        l.resize(i);
+        BOOST_TEST(validate_contents(l) == detail::validate_contents_scalar(l));
+    }
+#endif // MQTT_USE_STR_CHECK
+}
+
 BOOST_AUTO_TEST_CASE( connect_overlength_client_id ) {
 #if defined(MQTT_USE_STR_CHECK)
     auto test = [](boost::asio::io_context& ioc, auto& c, auto& /*s*/, auto& /*b*/) {
@@ -0,0 +1,111 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_server_endpoint.hpp"
+
+#include <chrono>
+
+#include <mqtt_client_cpp.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_write_coalescing)
+
+namespace as = boost::asio;
+
+using server_t = test_server_endpoint<>;
+using endpoint_t = server_t::endpoint_t;
+
+// The client holds a publish message, and the connection is closed while it is held.
+// The held message is finished with the error, and the hold timer doesn't keep
+// the io_context running.
+BOOST_AUTO_TEST_CASE( close_while_holding ) {
+    as::io_context ioc;
+
+    auto c = MQTT_NS::make_async_client(ioc, broker_url, broker_notls_port);
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    auto const hold = std::chrono::seconds(10);
+    c->set_write_coalescing(1024, hold);
+
+    std::size_t const burst = 3;
+    std::size_t written = 0;
+    bool held_finished = false;
+    as::steady_timer tim(ioc);
+
+    server_t s(
+        ioc,
+        [&](endpoint_t& ep) {
+            ep.set_connect_handler(
+                [&]
+                (MQTT_NS::buffer /*client_id*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*username*/,
+                 MQTT_NS::optional<MQTT_NS::buffer> /*password*/,
+                 MQTT_NS::optional<MQTT_NS::will> /*will*/,
+                 bool /*clean_session*/,
+                 std::uint16_t /*keep_alive*/) {
+                    ep.connack(false, MQTT_NS::connect_return_code::accepted);
+                    return true;
+                }
+            );
+        }
+    );
+
+    c->set_connack_handler(
+        [&]
+        (bool /*sp*/, MQTT_NS::connect_return_code /*connack_return_code*/) {
+            // The first message is written alone, and the others are written together.
+            // Holding starts after the write that carries more than one message.
+            for (std::size_t i = 0; i != burst; ++i) {
+                c->async_publish(
+                    "topic1",
+                    "topic1_contents",
+                    MQTT_NS::qos::at_most_once,
+                    false,
+                    [&](boost::system::error_code const& ec) {
+                        BOOST_TEST(!ec);
+                        if (++written != burst) return;
+                        c->async_publish(
+                            "topic1",
+                            "topic1_contents",
+                            MQTT_NS::qos::at_most_once,
+                            false,
+                            [&](boost::system::error_code const& ec) {
+                                BOOST_TEST(ec);
+                                held_finished = true;
+                            }
+                        );
+                        // After the message is queued and held.
+                        tim.expires_after(std::chrono::milliseconds(100));
+                        tim.async_wait(
+                            [&](boost::system::error_code const& ec) {
+                                BOOST_TEST(!ec);
+                                c->force_disconnect();
+                            }
+                        );
+                    }
+                );
+            }
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->set_error_handler(
+        [&](boost::system::error_code const&) {
+            s.close();
+        });
+
+    c->connect();
+    auto start = std::chrono::steady_clock::now();
+    ioc.run();
+    BOOST_TEST(written == burst);
+    BOOST_TEST(held_finished);
+    BOOST_TEST((std::chrono::steady_clock::now() - start < hold));
+}
+
+BOOST_AUTO_TEST_SUITE_END()